@@ -0,0 +1,165 @@
+/* syntax tree layout benchmark: memory and full-traversal time of the
+   pointer TreeNode tree against its flattened, index-based copy. Given an
+   image path, also compares loading a saved AST image with re-parsing.
+   build: cc -O2 -Isrc -o astbench bench/astbench.c src/scan.c src/skip.c
+          src/parse.c src/util.c src/intern.c src/arena.c src/flat.c
+          src/compile.c src/astfile.c src/tokens.c src/pool.c src/symtab.c
+          src/analyze.c src/fold.c -lpthread
+   usage: astbench file.c [repeat] [image] */
+#include <time.h>
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "compile.h"
+#include "intern.h"
+#include "flat.h"
+#include "astfile.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// typical pass shape: visit every node, look at its kind and payload
+static long walkPointer(TreeNode *t) {
+    long sum = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        sum += t->nodeKind + t->val + t->sym;
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            sum += walkPointer(t->child[i]);
+        }
+    }
+    return sum;
+}
+
+static long walkFlat(const FlatTree *f, NodeId n) {
+    long sum = 0;
+    unsigned int i;
+
+    for(; n != NULLNODE; n = f->sibling[n]) {
+        sum += FLAT_NODEKIND(f->info[n]) + f->val[n] + f->sym[n];
+        for(i = 0; i < FLAT_SLOTS(f->info[n]); ++i) {
+            sum += walkFlat(f, f->kids[f->kidStart[n] + i]);
+        }
+    }
+    return sum;
+}
+
+// passes that don't care about structure just sweep the arrays
+static long sweepFlat(const FlatTree *f) {
+    long sum = 0;
+    unsigned int n;
+
+    for(n = 1; n < f->count; ++n) {
+        sum += FLAT_NODEKIND(f->info[n]) + f->val[n] + f->sym[n];
+    }
+    return sum;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 20;
+    CompileContext ctx;
+    FILE *inputfile;
+    double best[3] = {0, 0, 0};
+    long sums[3] = {0, 0, 0};
+    TreeNode *tree;
+    FlatTree *flat;
+    size_t nodes;
+    int r;
+    int k;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat] [image]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    initContext(&ctx, stdout);
+    inputfile = fopen(argv[1], "r");
+    if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    flat = flattenTree(&ctx, tree);
+    nodes = flat->count - 1;
+
+    for(r = 0; r < repeat; ++r) {
+        for(k = 0; k < 3; ++k) {
+            double t0 = now();
+            double t;
+
+            if(k == 0) {
+                sums[k] = walkPointer(tree);
+            }
+            else if(k == 1) {
+                sums[k] = walkFlat(flat, 1);
+            }
+            else {
+                sums[k] = sweepFlat(flat);
+            }
+            t = now() - t0;
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+        }
+    }
+
+    printf("%lu nodes\n", (unsigned long)nodes);
+    printf("pointer tree: %8.1f KB (%4.1f B/node), walk  %7.3f ms (%5.2f ns/node)\n",
+        ctx.tree.used / 1024.0, (double)ctx.tree.used / nodes, best[0] * 1e3, best[0] * 1e9 / nodes);
+    printf("flat tree:    %8.1f KB (%4.1f B/node), walk  %7.3f ms (%5.2f ns/node), sweep %7.3f ms (%5.2f ns/node)\n",
+        flatTreeBytes(flat) / 1024.0, (double)flatTreeBytes(flat) / nodes, best[1] * 1e3, best[1] * 1e9 / nodes,
+        best[2] * 1e3, best[2] * 1e9 / nodes);
+    if((sums[0] != sums[1]) || (sums[1] != sums[2])) {
+        printf("traversals disagree: %ld %ld %ld\n", sums[0], sums[1], sums[2]);
+        return EXIT_FAILURE;
+    }
+
+    if(argc > 3) {
+        FILE *fp = fopen(argv[3], "wb");
+        double parse = 0, load = 0;
+        long sum = 0;
+
+        if((fp == NULL) || !saveFlatTree(flat, fp) || (fclose(fp) != 0)) {
+            fprintf(stderr, "cannot write %s\n", argv[3]);
+            return EXIT_FAILURE;
+        }
+        for(r = 0; r < repeat; ++r) {
+            double t0 = now();
+            double t1, t2;
+            FlatTree *img;
+
+            compileFile(&ctx, inputfile, &tree);
+            t1 = now();
+            // load and touch every node, so lazily mapped pages count too
+            img = loadFlatTree(argv[3]);
+            if(img == NULL) {
+                fprintf(stderr, "cannot load %s\n", argv[3]);
+                return EXIT_FAILURE;
+            }
+            sum = sweepFlat(img);
+            t2 = now();
+            if((r == 0) || (t1 - t0 < parse)) {
+                parse = t1 - t0;
+            }
+            if((r == 0) || (t2 - t1 < load)) {
+                load = t2 - t1;
+            }
+            freeFlatTree(img);
+        }
+        printf("image:        %8.1f KB, parse %7.3f ms, load+sweep %7.3f ms\n",
+            flatTreeBytes(flat) / 1024.0, parse * 1e3, load * 1e3);
+        if(sum != sums[2]) {
+            printf("image disagrees: %ld %ld\n", sum, sums[2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    freeFlatTree(flat);
+    freeContext(&ctx);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
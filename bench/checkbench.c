@@ -0,0 +1,72 @@
+/* semantic check benchmark: parsing alone, parsing with the checks fused
+   in, and parsing followed by the checks as a separate pass over the tree
+   build: cc -O2 -Isrc -o checkbench bench/checkbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/compile.c
+          -lpthread
+   usage: checkbench file.c [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, const char *argv[]) {
+    static const CheckMode modes[3] = { CHECK_NONE, CHECK_FUSED, CHECK_PASS };
+    static const char *names[3] = { "parse only", "fused", "separate pass" };
+    int repeat = (argc > 2) ? atoi(argv[2]) : 10;
+    CompileContext ctx;
+    FILE *inputfile;
+    FILE *sink;
+    double best[3] = {0, 0, 0};
+    int r;
+    int k;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    inputfile = fopen(argv[1], "r");
+    // diagnostics are written on every round; keep them out of the way
+    sink = tmpfile();
+    initContext(&ctx, sink);
+    if((inputfile == NULL) || (sink == NULL) || !openSource(&ctx, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for(r = 0; r < repeat; ++r) {
+        for(k = 0; k < 3; ++k) {
+            double t0, t;
+
+            rewind(sink);
+            ctx.checks = modes[k];
+            t0 = now();
+            compileSource(&ctx);
+            t = now() - t0;
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+        }
+    }
+
+    printf("%lu nodes, %d semantic errors, best of %d\n", ctx.tree.allocs, ctx.checker.errors, repeat);
+    for(k = 0; k < 3; ++k) {
+        printf("%s: %.3f ms", names[k], best[k] * 1e3);
+        if(k > 0) {
+            printf(", checks %.3f ms", (best[k] - best[0]) * 1e3);
+        }
+        printf("\n");
+    }
+
+    freeContext(&ctx);
+    fclose(sink);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
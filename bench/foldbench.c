@@ -0,0 +1,97 @@
+/* constant folding benchmark: how many nodes folding removes, what it
+   costs, and the time of a later full walk (the tree dump) before and after
+   build: cc -O2 -Isrc -o foldbench bench/foldbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/compile.c
+          -lpthread
+   usage: foldbench file.c [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "fold.h"
+#include "compile.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long countNodes(TreeNode *t) {
+    unsigned long n = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        n++;
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            n += countNodes(t->child[i]);
+        }
+    }
+    return n;
+}
+
+static double timeDump(CompileContext *ctx, TreeNode *tree) {
+    double t0;
+
+    rewind(ctx->out);
+    t0 = now();
+    printTree(ctx, tree);
+    return now() - t0;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 10;
+    CompileContext ctx;
+    FILE *inputfile;
+    FILE *sink;
+    TreeNode *tree;
+    unsigned long before = 0, after = 0;
+    double best[3] = {0, 0, 0};
+    double t[3];
+    int r;
+    int k;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    inputfile = fopen(argv[1], "r");
+    sink = tmpfile();
+    initContext(&ctx, sink);
+    if((inputfile == NULL) || (sink == NULL) || !openSource(&ctx, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for(r = 0; r < repeat; ++r) {
+        double t0;
+
+        tree = compileSource(&ctx);
+        before = countNodes(tree);
+        t[0] = timeDump(&ctx, tree);
+
+        t0 = now();
+        tree = foldTree(&ctx, tree);
+        t[1] = now() - t0;
+        after = countNodes(tree);
+        t[2] = timeDump(&ctx, tree);
+
+        for(k = 0; k < 3; ++k) {
+            if((r == 0) || (t[k] < best[k])) {
+                best[k] = t[k];
+            }
+        }
+    }
+
+    printf("%lu nodes, %lu after folding (%.1f%% fewer), best of %d\n", before, after,
+        before ? 100.0 * (before - after) / before : 0.0, repeat);
+    printf("fold: %.3f ms\n", best[1] * 1e3);
+    printf("tree dump: %.3f ms before, %.3f ms after\n", best[0] * 1e3, best[2] * 1e3);
+
+    freeContext(&ctx);
+    fclose(sink);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
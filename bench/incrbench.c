@@ -0,0 +1,112 @@
+/* incremental reparse benchmark: latency of one-character edits in the
+   middle of a file against parsing the whole file again
+   build: cc -O2 -Isrc -o incrbench bench/incrbench.c src/scan.c src/skip.c
+          src/parse.c src/util.c src/intern.c src/arena.c src/compile.c
+          src/incr.c src/tokens.c src/pool.c src/symtab.c src/analyze.c
+          src/fold.c -lpthread
+   usage: incrbench file.c [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "incr.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// somewhere inside the middle declaration, next to a blank
+static size_t editPoint(IncrParse *ip) {
+    size_t pos = ip->decls[ip->numDecls / 2].end;
+
+    while((pos > 0) && (ip->text[pos] != ' ')) {
+        pos--;
+    }
+    return pos;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 20;
+    CompileContext ctx, full;
+    IncrParse ip;
+    FILE *inputfile;
+    double best[4] = {0, 0, 0, 0};
+    int reparsed = 0;
+    size_t pos;
+    int r;
+    int k;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    initContext(&ctx, stdout);
+    initContext(&full, stdout);
+    inputfile = fopen(argv[1], "r");
+    if((inputfile == NULL) || !openSource(&full, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    incrInit(&ip, &ctx);
+    incrParse(&ip, full.srcBase, (size_t)(full.srcEnd - full.srcBase));
+    if(ip.Error) {
+        fprintf(stderr, "%s has syntax errors\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    pos = editPoint(&ip);
+
+    for(r = 0; r < repeat; ++r) {
+        for(k = 0; k < 4; ++k) {
+            double t0 = now();
+            double t;
+
+            if(k == 0) {
+                compileSource(&full);
+                t = now() - t0;
+            }
+            else if(k == 1) {
+                // type a blank, then delete it
+                incrEdit(&ip, pos, 0, " ", 1);
+                reparsed = ip.reparsed;
+                incrEdit(&ip, pos, 1, "", 0);
+                t = (now() - t0) / 2;
+            }
+            else if(k == 2) {
+                // a newline moves every later line, but only in the spans
+                incrEdit(&ip, pos, 0, "\n", 1);
+                incrEdit(&ip, pos, 1, "", 0);
+                t = (now() - t0) / 2;
+            }
+            else {
+                // until the nodes are renumbered
+                incrEdit(&ip, pos, 0, "\n", 1);
+                t0 = now();
+                incrSyncLines(&ip);
+                t = now() - t0;
+                incrEdit(&ip, pos, 1, "", 0);
+                incrSyncLines(&ip);
+            }
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+        }
+    }
+
+    printf("%d declarations, %lu bytes\n", ip.numDecls, (unsigned long)ip.len);
+    printf("full parse:        %8.3f ms\n", best[0] * 1e3);
+    printf("edit in line:      %8.3f ms (%d declaration reparsed)\n", best[1] * 1e3, reparsed);
+    printf("newline inserted:  %8.3f ms, then %.3f ms to renumber lines\n", best[2] * 1e3, best[3] * 1e3);
+    if(ip.full) {
+        printf("edits fell back to full parses\n");
+        return EXIT_FAILURE;
+    }
+
+    incrFree(&ip);
+    freeContext(&ctx);
+    freeContext(&full);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
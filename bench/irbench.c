@@ -0,0 +1,147 @@
+/* three-address code benchmark: what lowering costs, and one pass over the
+   program as the tree and as the code. The pass counts the values every
+   operator reads, the kind of question an optimization asks of each node.
+   Then the code is optimized, and what that removes is counted.
+   build: cc -O2 -Isrc -o irbench bench/irbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/ir.c src/opt.c
+          src/regalloc.c src/select.c src/jit.c src/vm.c src/backend.c
+          src/compile.c -lpthread
+   usage: irbench file.c [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// operands of expression nodes: children that are expressions or calls
+static unsigned long treeReads(const TreeNode *t) {
+    unsigned long n = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            if(t->child[i] != NULL) {
+                n += (t->nodeKind == ExpK);
+                n += treeReads(t->child[i]);
+            }
+        }
+    }
+    return n;
+}
+
+static unsigned long irReads(const IrModule *m) {
+    unsigned long n = 0;
+    const IrInst *in;
+    const IrInst *end = m->insts + m->numInsts;
+
+    for(in = m->insts; in < end; ++in) {
+        if(in->op < IR_ADDR) {
+            n += (in->a != IR_NONE) + ((in->op != IR_MOV) && (in->b != IR_NONE));
+        }
+    }
+    return n;
+}
+
+static unsigned long countNodes(const TreeNode *t) {
+    unsigned long n = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        n++;
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            n += countNodes(t->child[i]);
+        }
+    }
+    return n;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 10;
+    CompileContext ctx;
+    BackEnd be;
+    FILE *inputfile;
+    TreeNode *tree = NULL;
+    IrModule *m = NULL;
+    unsigned long reads[2] = {0, 0};
+    int before[2] = {0, 0};
+    double best[4] = {0, 0, 0, 0};
+    double t[4];
+    int r;
+    int k;
+
+    if((argc < 2) || (repeat < 1)) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    inputfile = fopen(argv[1], "r");
+    initContext(&ctx, stderr);
+    initBackEnd(&be, &ctx.names);
+    ctx.checks = CHECK_PASS;
+    if((inputfile == NULL) || !openSource(&ctx, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for(r = 0; r < repeat; ++r) {
+        double t0;
+
+        tree = compileSource(&ctx);
+        if((tree == NULL) || !checkCompiled(&ctx, tree)) {
+            fprintf(stderr, "%s has errors\n", argv[1]);
+            freeBackEnd(&be);
+            freeContext(&ctx);
+            fclose(inputfile);
+            return EXIT_FAILURE;
+        }
+        m = &be.ir;
+        t0 = now();
+        lowerTree(m, tree);
+        t[0] = now() - t0;
+
+        t0 = now();
+        reads[0] = treeReads(tree);
+        t[1] = now() - t0;
+        t0 = now();
+        reads[1] = irReads(m);
+        t[2] = now() - t0;
+
+        before[0] = m->numInsts;
+        before[1] = m->numBlocks;
+        t0 = now();
+        optimizeIr(m);
+        t[3] = now() - t0;
+
+        for(k = 0; k < 4; ++k) {
+            if((r == 0) || (t[k] < best[k])) {
+                best[k] = t[k];
+            }
+        }
+    }
+
+    printf("%lu nodes, %d instructions in %d blocks, best of %d\n", countNodes(tree),
+        before[0], before[1], repeat);
+    printf("lower: %.3f ms\n", best[0] * 1e3);
+    printf("tree pass: %.3f ms, %lu reads\n", best[1] * 1e3, reads[0]);
+    printf("code pass: %.3f ms, %lu reads, %.2fx\n", best[2] * 1e3, reads[1],
+        best[2] > 0 ? best[1] / best[2] : 0.0);
+    printf("optimize: %.3f ms, %d instructions in %d blocks left\n", best[3] * 1e3,
+        m->numInsts, m->numBlocks);
+
+    freeBackEnd(&be);
+    freeContext(&ctx);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+/* JIT latency benchmark: from source already in memory to the program's
+   last output, as it comes and optimized, split into parsing and checks,
+   lowering and optimizing, register allocation, encoding and the run.
+   input() gives the numbers after the repeat count, then zeros; outputs
+   are counted and summed rather than printed.
+   build: cc -O2 -Isrc -o jitbench bench/jitbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/ir.c src/opt.c
+          src/regalloc.c src/select.c src/jit.c src/vm.c src/backend.c
+          src/compile.c -lpthread
+   usage: jitbench file.c [repeat [input ...]] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+
+typedef struct _Io {
+    const int *input;
+    int numInput;
+    int next;
+    int outputs;
+    long sum;
+} Io;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int readInput(void *arg) {
+    Io *io = (Io *)arg;
+
+    return (io->next < io->numInput) ? io->input[io->next++] : 0;
+}
+
+static void writeOutput(void *arg, int value) {
+    Io *io = (Io *)arg;
+
+    io->outputs++;
+    io->sum += value;
+}
+
+int main(int argc, const char *argv[]) {
+    static const char *stages[5] = {"parse", "lower", "allocate", "encode", "run"};
+    static const char *ends[4] = {"", ", then division by zero", ", then an address out of range",
+        ", then calls nested too deep"};
+    int repeat = (argc > 2) ? atoi(argv[2]) : 1000;
+    CompileContext ctx;
+    BackEnd be;
+    TreeNode *tree;
+    FILE *inputfile;
+    Io io;
+    int *input;
+    double t[6], best[2][6];
+    JitStatus ran = JIT_DONE;
+    int k, r, s;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat [input ...]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    input = (int *)malloc(sizeof(int) * (argc + 1));
+    if(input == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(k = 3; k < argc; ++k) {
+        input[k - 3] = atoi(argv[k]);
+    }
+
+    initContext(&ctx, stderr);
+    initBackEnd(&be, &ctx.names);
+    inputfile = fopen(argv[1], "r");
+    if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for(k = 0; k < 2; ++k) {
+        for(r = 0; r < repeat; ++r) {
+            t[0] = now();
+            tree = compileSource(&ctx);
+            t[1] = now();
+            if((tree == NULL) || !checkCompiled(&ctx, tree)) {
+                fprintf(stderr, "%s has errors\n", argv[1]);
+                return EXIT_FAILURE;
+            }
+            lowerTree(&be.ir, tree);
+            if(k) {
+                optimizeIr(&be.ir);
+            }
+            t[2] = now();
+            allocateRegisters(&be.ir, &be.alloc);
+            t[3] = now();
+            if(!jitCompile(&be.jit, &be.ir, &be.alloc, be.names)) {
+                fprintf(stderr, "%s can't run\n", argv[1]);
+                return EXIT_FAILURE;
+            }
+            t[4] = now();
+            memset(&io, 0, sizeof(Io));
+            io.input = input;
+            io.numInput = (argc > 3) ? argc - 3 : 0;
+            ran = jitRun(&be.jit, readInput, writeOutput, &io);
+            t[5] = now();
+            for(s = 0; s < 5; ++s) {
+                if((r == 0) || (t[s + 1] - t[s] < best[k][s])) {
+                    best[k][s] = t[s + 1] - t[s];
+                }
+            }
+            if((r == 0) || (t[5] - t[0] < best[k][5])) {
+                best[k][5] = t[5] - t[0];
+            }
+        }
+    }
+
+    printf("%d outputs summing to %ld%s, best of %d in microseconds\n", io.outputs, io.sum,
+        ends[ran], repeat);
+    for(k = 0; k < 2; ++k) {
+        printf("%-9s", k ? "optimized" : "plain");
+        for(s = 0; s < 5; ++s) {
+            printf("  %s %.1f", stages[s], best[k][s] * 1e6);
+        }
+        printf("  total %.1f\n", best[k][5] * 1e6);
+    }
+    printf("%lu bytes of code\n", (unsigned long)(be.jit.pos - be.jit.dataSize));
+
+    freeBackEnd(&be);
+    freeContext(&ctx);
+    fclose(inputfile);
+    free(input);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+/* native code benchmark: a file is compiled to assembly as it comes and
+   optimized, each is built with cc, and the programs are timed. Input
+   for input() comes from a file. With -g it runs a generated selection
+   sort of n numbers, the one of test/2.c, and a loop summing over them.
+   build: cc -O2 -Isrc -o nativebench bench/nativebench.c src/scan.c
+          src/skip.c src/tokens.c src/pool.c src/parse.c src/util.c
+          src/intern.c src/arena.c src/symtab.c src/analyze.c src/fold.c
+          src/ir.c src/opt.c src/regalloc.c src/select.c src/jit.c src/vm.c
+          src/codegen.c src/backend.c src/compile.c -lpthread
+   usage: nativebench file.c [repeat] [input]
+          nativebench -g n [repeat] */
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+#include "codegen.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char *generate(int n, size_t *len) {
+    static const char *fmt =
+        "int v[%d];\n"
+        "void fill(int n)\n"
+        "{ int i; int x; i = 0; x = 12345;\n"
+        "  while (i < n) { x = x * 1103515245 + 12345; v[i] = x / 65536; i = i + 1; } }\n"
+        "int minloc(int a[], int low, int high)\n"
+        "{ int i; int x; int k; k = low; x = a[low]; i = low + 1;\n"
+        "  while (i < high) { if (a[i] < x) { x = a[i]; k = i; } i = i + 1; }\n"
+        "  return k; }\n"
+        "void sort(int a[], int low, int high)\n"
+        "{ int i; int k; i = low;\n"
+        "  while (i < high - 1) { int t; k = minloc(a, i, high);\n"
+        "    t = a[k]; a[k] = a[i]; a[i] = t; i = i + 1; } }\n"
+        "int sum(int a[], int n)\n"
+        "{ int i; int j; int s; s = 0; j = 0;\n"
+        "  while (j < 100) { i = 0; while (i < n) { s = s + a[i] * (i - j); i = i + 1; } j = j + 1; }\n"
+        "  return s; }\n"
+        "void main(void)\n"
+        "{ fill(%d); sort(v, 0, %d); output(v[0]); output(v[%d]); output(sum(v, %d)); }\n";
+    char *src = (char *)malloc(strlen(fmt) + 64);
+
+    if(src == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    *len = (size_t)sprintf(src, fmt, n, n, n, n - 1, n);
+    return src;
+}
+
+// lower, maybe optimize, allocate and write the assembly; seconds, 0 on errors
+static double emit(CompileContext *ctx, BackEnd *be, TreeNode *tree, int optimize, const char *path, long *bytes) {
+    FILE *out = fopen(path, "w");
+    double t0 = now();
+
+    if((out == NULL) || (tree == NULL) || !checkCompiled(ctx, tree)) {
+        return 0;
+    }
+    lowerTree(&be->ir, tree);
+    if(optimize) {
+        optimizeIr(&be->ir);
+    }
+    allocateRegisters(&be->ir, &be->alloc);
+    emitAssembly(&be->ir, &be->alloc, be->names, out);
+    fflush(out);
+    t0 = now() - t0;
+    *bytes = ftell(out);
+    fclose(out);
+    return t0;
+}
+
+int main(int argc, const char *argv[]) {
+    int gen = (argc > 1) && !strcmp(argv[1], "-g");
+    const char *input = (!gen && (argc > 3)) ? argv[3] : "/dev/null";
+    int repeat;
+    CompileContext ctx;
+    BackEnd be;
+    TreeNode *tree;
+    FILE *inputfile = NULL;
+    char *src = NULL;
+    size_t len = 0;
+    char asmPath[2][64], exePath[2][64], cmd[256];
+    double emitTime[2], buildTime[2], best[2] = {0, 0};
+    long bytes[2];
+    int k, r;
+
+    if(gen ? (argc < 3) : (argc < 2)) {
+        fprintf(stderr, "usage: %s file.c [repeat] [input]\n       %s -g n [repeat]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    repeat = (argc > 2 + gen) ? atoi(argv[2 + gen]) : 5;
+
+    initContext(&ctx, stderr);
+    initBackEnd(&be, &ctx.names);
+    if(gen) {
+        src = generate(atoi(argv[2]) > 1 ? atoi(argv[2]) : 2, &len);
+        tree = compile(&ctx, src, len);
+    }
+    else {
+        inputfile = fopen(argv[1], "r");
+        if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(k = 0; k < 2; ++k) {
+        sprintf(asmPath[k], "/tmp/nativebench%d-%d.s", (int)getpid(), k);
+        sprintf(exePath[k], "/tmp/nativebench%d-%d", (int)getpid(), k);
+        emitTime[k] = emit(&ctx, &be, tree, k, asmPath[k], &bytes[k]);
+        if(emitTime[k] == 0) {
+            fprintf(stderr, "%s has errors\n", gen ? "generated program" : argv[1]);
+            return EXIT_FAILURE;
+        }
+        sprintf(cmd, "cc -o %s %s", exePath[k], asmPath[k]);
+        buildTime[k] = now();
+        if(system(cmd) != 0) {
+            fprintf(stderr, "cc failed on %s\n", asmPath[k]);
+            return EXIT_FAILURE;
+        }
+        buildTime[k] = now() - buildTime[k];
+    }
+
+    for(r = 0; r < repeat; ++r) {
+        for(k = 0; k < 2; ++k) {
+            double t0, t;
+
+            sprintf(cmd, "%s < %s > /dev/null", exePath[k], input);
+            t0 = now();
+            if(system(cmd) != 0) {
+                fprintf(stderr, "%s failed\n", exePath[k]);
+                return EXIT_FAILURE;
+            }
+            t = now() - t0;
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+        }
+    }
+
+    printf("best of %d, run times include starting the process\n", repeat);
+    for(k = 0; k < 2; ++k) {
+        printf("%s: compile %.3f ms, %ld bytes of assembly, cc %.1f ms, run %.3f ms\n",
+            k ? "optimized" : "plain", emitTime[k] * 1e3, bytes[k], buildTime[k] * 1e3, best[k] * 1e3);
+        remove(asmPath[k]);
+        remove(exePath[k]);
+    }
+    printf("optimized code runs %.2fx as fast\n", best[1] > 0 ? best[0] / best[1] : 0.0);
+
+    freeBackEnd(&be);
+    freeContext(&ctx);
+    free(src);
+    if(inputfile != NULL) {
+        fclose(inputfile);
+    }
+    return 0;
+}
\ No newline at end of file
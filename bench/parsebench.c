@@ -0,0 +1,68 @@
+/* parser benchmark: lexing and parsing a whole file on one thread against
+   parsing its function bodies on several
+   build: cc -O2 -Isrc -o parsebench bench/parsebench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/compile.c
+          -lpthread
+   usage: parsebench file.c [repeat] [threads] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "pool.h"
+#include "compile.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 10;
+    int threads = (argc > 3) ? atoi(argv[3]) : poolThreads();
+    CompileContext ctx;
+    FILE *inputfile;
+    double best[2] = {0, 0};
+    unsigned long nodes = 0;
+    int r;
+    int k;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat] [threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    inputfile = fopen(argv[1], "r");
+    initContext(&ctx, stdout);
+    if((inputfile == NULL) || !openSource(&ctx, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    ctx.lexAhead = TRUE;
+
+    for(r = 0; r < repeat; ++r) {
+        for(k = 0; k < 2; ++k) {
+            double t0, t;
+
+            ctx.threads = k ? threads : 1;
+            t0 = now();
+            compileSource(&ctx);
+            t = now() - t0;
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+            // bodies parsed on other threads have their nodes elsewhere
+            if(k == 0) {
+                nodes = ctx.tree.allocs;
+            }
+        }
+    }
+
+    printf("%d tokens, %lu nodes, best of %d\n", ctx.tokens.count, nodes, repeat);
+    printf("1 thread: %.3f ms\n", best[0] * 1e3);
+    printf("%d threads: %.3f ms, %.2fx\n", threads, best[1] * 1e3, best[0] / best[1]);
+
+    freeContext(&ctx);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
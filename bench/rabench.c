@@ -0,0 +1,157 @@
+/* register allocation benchmark: time to allocate the optimized code of a
+   file, per instruction, and how much of it ends up on the stack. With no
+   file it allocates one generated function of the given number of
+   statements over more locals than there are registers, to see that the
+   time per instruction stays flat as the function grows.
+   build: cc -O2 -Isrc -o rabench bench/rabench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/ir.c
+          src/opt.c src/regalloc.c src/select.c src/jit.c src/vm.c
+          src/backend.c src/compile.c -lpthread
+   usage: rabench file.c [repeat]
+          rabench -g statements [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+
+#define GENLOCALS 24
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// identifiers are letters only: x, then the number in base 26
+static char *varName(int i, char *buf) {
+    int n = 1;
+
+    buf[0] = 'x';
+    do {
+        buf[n++] = (char)('a' + i % 26);
+        i /= 26;
+    } while(i > 0);
+    buf[n] = '\0';
+    return buf;
+}
+
+/* one function: statements mixing locals that all stay live, in loops of
+   sixteen with a call at the end of each */
+static char *generate(int statements, size_t *len) {
+    size_t max = (size_t)statements * 48 + GENLOCALS * 32 + 256;
+    char *src = (char *)malloc(max);
+    size_t n = 0;
+    char a[16], b[16], c[16];
+    int i;
+
+    if(src == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    n += sprintf(src + n, "int g;\nint f(int a)\n{\nint i;\n");
+    for(i = 0; i < GENLOCALS; ++i) {
+        n += sprintf(src + n, "int %s;\n", varName(i, a));
+    }
+    for(i = 0; i < GENLOCALS; ++i) {
+        n += sprintf(src + n, "%s = a + %d;\n", varName(i, a), i);
+    }
+    for(i = 0; i < statements; ++i) {
+        if(i % 16 == 0) {
+            n += sprintf(src + n, "i = 0;\nwhile(i < a) {\n");
+        }
+        n += sprintf(src + n, "%s = %s + %s * i;\n", varName(i % GENLOCALS, a),
+            varName((i * 7 + 3) % GENLOCALS, b), varName((i * 13 + 5) % GENLOCALS, c));
+        if((i % 16 == 15) || (i == statements - 1)) {
+            n += sprintf(src + n, "g = g + f(%s);\ni = i + 1;\n}\n", varName(i % GENLOCALS, a));
+        }
+    }
+    n += sprintf(src + n, "return");
+    for(i = 0; i < GENLOCALS; ++i) {
+        n += sprintf(src + n, "%s%s", i ? " + " : " ", varName(i, a));
+    }
+    n += sprintf(src + n, ";\n}\n");
+    *len = n;
+    return src;
+}
+
+int main(int argc, const char *argv[]) {
+    int gen = (argc > 1) && !strcmp(argv[1], "-g");
+    int repeat;
+    CompileContext ctx;
+    BackEnd be;
+    TreeNode *tree;
+    IrModule *m;
+    char *src = NULL;
+    size_t len = 0;
+    FILE *inputfile = NULL;
+    double best = 0;
+    int regs = 0, spilled = 0, spillMoves = 0;
+    int r;
+    int f;
+
+    if(gen ? (argc < 3) : (argc < 2)) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n       %s -g statements [repeat]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    repeat = (argc > (gen ? 3 : 2)) ? atoi(argv[gen ? 3 : 2]) : 10;
+
+    initContext(&ctx, stderr);
+    if(gen) {
+        src = generate(atoi(argv[2]), &len);
+        tree = compile(&ctx, src, len);
+    }
+    else {
+        inputfile = fopen(argv[1], "r");
+        if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    if((tree == NULL) || !checkCompiled(&ctx, tree)) {
+        fprintf(stderr, "%s has errors\n", gen ? "generated function" : argv[1]);
+        return EXIT_FAILURE;
+    }
+    initBackEnd(&be, &ctx.names);
+    m = &be.ir;
+    lowerTree(m, tree);
+    optimizeIr(m);
+
+    for(r = 0; r < repeat; ++r) {
+        double t0, t;
+
+        t0 = now();
+        allocateRegisters(m, &be.alloc);
+        t = now() - t0;
+        if((r == 0) || (t < best)) {
+            best = t;
+        }
+    }
+
+    for(f = 0; f < m->numFuncs; ++f) {
+        regs += m->funcs[f].numRegs;
+        spilled += be.alloc.funcs[f].spilled;
+        spillMoves += be.alloc.funcs[f].spillMoves;
+    }
+    printf("%d instructions, %d registers in %d functions, best of %d\n", m->numInsts, regs,
+        m->numFuncs, repeat);
+    printf("allocate: %.3f ms, %.1f ns per instruction\n", best * 1e3,
+        m->numInsts ? best * 1e9 / m->numInsts : 0.0);
+    printf("%d spilled, %d spill moves, %d moves in all\n", spilled, spillMoves,
+        be.alloc.numMoves);
+
+    freeBackEnd(&be);
+    freeContext(&ctx);
+    free(src);
+    if(inputfile != NULL) {
+        fclose(inputfile);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/* scanner microbenchmark: tokens/sec of getToken() over a source file,
+   and of lexing it into the parser's token array on some threads
+   build: cc -O2 -Isrc -o scanbench bench/scanbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/util.c src/compile.c src/parse.c
+          src/intern.c src/arena.c src/symtab.c src/analyze.c src/fold.c
+          -lpthread
+   usage: scanbench file.c [repeat] [scalar|sse2|avx2] [threads] */
+#include <time.h>
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "tokens.h"
+#include "compile.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, const char *argv[]) {
+    int repeat = (argc > 2) ? atoi(argv[2]) : 10;
+    CompileContext ctx;
+    FILE *inputfile;
+    long tokens = 0;
+    long bytes = 0;
+    double best = 0;
+    double bestArray = 0;
+    int r;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.c [repeat] [scalar|sse2|avx2] [threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    initContext(&ctx, stdout);
+    if((argc > 3) && !useSkipper(&ctx, argv[3])) {
+        fprintf(stderr, "skip kernels '%s' not available\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+    ctx.threads = (argc > 4) ? atoi(argv[4]) : 1;
+
+    inputfile = fopen(argv[1], "r");
+    if((inputfile == NULL) || !openSource(&ctx, inputfile)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    bytes = (long)(ctx.srcEnd - ctx.srcBase);
+
+    for(r = 0; r < repeat; ++r) {
+        double t0, t;
+        long n = 0;
+
+        rewindSource(&ctx);
+        t0 = now();
+        while(getToken(&ctx) != ENDFILE) {
+            n++;
+        }
+        t = now() - t0;
+
+        if((r == 0) || (t < best)) {
+            best = t;
+        }
+        tokens = n;
+
+        t0 = now();
+        lexTokens(&ctx);
+        t = now() - t0;
+        if((r == 0) || (t < bestArray)) {
+            bestArray = t;
+        }
+    }
+
+    printf("%ld tokens, %ld bytes, best of %d: %.3f ms, %.1f Mtokens/s, %.1f MB/s\n",
+        tokens, bytes, repeat, best * 1e3, tokens / best * 1e-6, bytes / best * 1e-6);
+    printf("into token array on %d threads: %.3f ms, %.1f Mtokens/s, %d KB\n",
+        ctx.threads, bestArray * 1e3, tokens / bestArray * 1e-6, (int)(ctx.tokens.max * sizeof(Token) >> 10));
+
+    freeContext(&ctx);
+    fclose(inputfile);
+    return 0;
+}
\ No newline at end of file
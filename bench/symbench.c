@@ -0,0 +1,295 @@
+/* name resolution benchmark: the scoped symbol table against a scope chain
+   kept as one linked list searched from the innermost binding out. With no
+   file it resolves a generated function with many locals in deeply nested
+   blocks, where the list walk gets long.
+   build: cc -O2 -Isrc -o symbench bench/symbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/compile.c
+          -lpthread
+   usage: symbench file.c [repeat]
+          symbench -g locals depth [repeat] */
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+
+typedef struct _ChainEntry {
+    TreeNode *decl;
+    struct _ChainEntry *next;
+} ChainEntry;
+
+typedef struct _Chain {
+    ChainEntry *head;
+    ChainEntry *entries;
+    int count;
+    int max;
+    unsigned long probes;
+    unsigned long uses;
+    unsigned long mismatches;
+} Chain;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void chainDeclare(Chain *c, TreeNode *decl) {
+    ChainEntry *e;
+
+    if(c->count == c->max) {
+        // entries point at each other, so the array can't move
+        fprintf(stderr, "scope chain full\n");
+        exit(EXIT_FAILURE);
+    }
+    e = &c->entries[c->count++];
+    e->decl = decl;
+    e->next = c->head;
+    c->head = e;
+}
+
+static void chainUse(Chain *c, TreeNode *t) {
+    ChainEntry *e;
+
+    for(e = c->head; e != NULL; e = e->next) {
+        c->probes++;
+        if(e->decl->sym == t->sym) {
+            break;
+        }
+    }
+    c->uses++;
+    // builtins aren't on the chain
+    if((e != NULL) && (e->decl != t->decl)) {
+        c->mismatches++;
+    }
+}
+
+/* the same walk over the symbol table. A function's parameters and its
+   outermost block share a scope, every nested block opens its own. */
+static void tableList(SymTable *st, TreeNode *t, int shareScope) {
+    Binding *b;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        if(t->nodeKind == DecK) {
+            if(t->sym != NOSYM) {
+                declareName(st, t);
+            }
+            if(t->kind.dec == FunctionDeclaration) {
+                enterScope(st);
+                tableList(st, t->child[0], FALSE);
+                tableList(st, t->child[1], TRUE);
+                leaveScope(st);
+            }
+            continue;
+        }
+        if(((t->nodeKind == ExpK) && (t->kind.exp == Id)) ||
+            ((t->nodeKind == StmtK) && (t->kind.stmt == Call))) {
+            b = lookupName(st, t->sym);
+            t->decl = (b != NULL) ? b->decl : NULL;
+        }
+        if((t->nodeKind == StmtK) && (t->kind.stmt == Compound) && !shareScope) {
+            enterScope(st);
+        }
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            tableList(st, t->child[i], FALSE);
+        }
+        if((t->nodeKind == StmtK) && (t->kind.stmt == Compound) && !shareScope) {
+            leaveScope(st);
+        }
+    }
+}
+
+static void tableResolve(SymTable *st, TreeNode *tree, TreeNode *builtins[2]) {
+    arenaReset(&st->bindings);
+    st->numLog = 0;
+    st->depth = 0;
+    enterScope(st);
+    if(builtins[0] != NULL) {
+        declareName(st, builtins[0]);
+    }
+    if(builtins[1] != NULL) {
+        declareName(st, builtins[1]);
+    }
+    tableList(st, tree, FALSE);
+    // the global scope, so current[] is all NULL again for the next tree
+    leaveScope(st);
+}
+
+/* same walk with the scopes kept as a chain, a scope is left by putting
+   the head back where it was */
+static void chainList(Chain *c, TreeNode *t, int shareScope) {
+    ChainEntry *head;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        head = c->head;
+        if(t->nodeKind == DecK) {
+            if(t->sym != NOSYM) {
+                chainDeclare(c, t);
+            }
+            if(t->kind.dec == FunctionDeclaration) {
+                head = c->head;
+                chainList(c, t->child[0], FALSE);
+                chainList(c, t->child[1], TRUE);
+                c->head = head;
+            }
+            continue;
+        }
+        if(((t->nodeKind == ExpK) && (t->kind.exp == Id)) ||
+            ((t->nodeKind == StmtK) && (t->kind.stmt == Call))) {
+            chainUse(c, t);
+        }
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            chainList(c, t->child[i], FALSE);
+        }
+        if((t->nodeKind == StmtK) && (t->kind.stmt == Compound) && !shareScope) {
+            c->head = head;
+        }
+    }
+}
+
+static unsigned long countNodes(TreeNode *t) {
+    unsigned long n = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        n++;
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            n += countNodes(t->child[i]);
+        }
+    }
+    return n;
+}
+
+// identifiers are letters only: x, then the number in base 26
+static char *varName(int i, char *buf) {
+    int n = 1;
+
+    buf[0] = 'x';
+    do {
+        buf[n++] = (char)('a' + i % 26);
+        i /= 26;
+    } while(i > 0);
+    buf[n] = '\0';
+    return buf;
+}
+
+// one function, locals spread over depth nested blocks, every local used at the bottom
+static char *generate(int locals, int depth, size_t *len) {
+    size_t max = (size_t)locals * 64 + (size_t)depth * 16 + 256;
+    char *src = (char *)malloc(max);
+    size_t n = 0;
+    int perBlock = (locals + depth - 1) / depth;
+    char a[16], b[16];
+    int v = 0;
+    int d;
+    int i;
+
+    if(src == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    n += sprintf(src + n, "int g;\nint f(int a)\n");
+    for(d = 0; d < depth; ++d) {
+        n += sprintf(src + n, "{\n");
+        for(i = 0; (i < perBlock) && (v < locals); ++i, ++v) {
+            n += sprintf(src + n, "int %s;\n", varName(v, a));
+        }
+    }
+    for(i = 0; i < locals; ++i) {
+        n += sprintf(src + n, "%s = %s + g + a;\n", varName(i, a), varName((i * 7) % locals, b));
+    }
+    n += sprintf(src + n, "output(f(a));\n");
+    for(d = 0; d < depth; ++d) {
+        n += sprintf(src + n, "}\n");
+    }
+    *len = n;
+    return src;
+}
+
+int main(int argc, const char *argv[]) {
+    int gen = (argc > 1) && !strcmp(argv[1], "-g");
+    int repeat;
+    CompileContext ctx;
+    TreeNode *tree;
+    Chain chain;
+    SymTable st;
+    TreeNode *builtins[2];
+    char *src = NULL;
+    size_t len = 0;
+    FILE *inputfile = NULL;
+    double best[2] = {0, 0};
+    unsigned long nodes;
+    int r;
+
+    if(gen ? (argc < 4) : (argc < 2)) {
+        fprintf(stderr, "usage: %s file.c [repeat]\n       %s -g locals depth [repeat]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    repeat = (argc > (gen ? 4 : 2)) ? atoi(argv[gen ? 4 : 2]) : 10;
+
+    initContext(&ctx, stdout);
+    if(gen) {
+        src = generate(atoi(argv[2]), atoi(argv[3]) > 0 ? atoi(argv[3]) : 1, &len);
+        tree = compile(&ctx, src, len);
+    }
+    else {
+        inputfile = fopen(argv[1], "r");
+        if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    nodes = countNodes(tree);
+    memset(&st, 0, sizeof(SymTable));
+    builtins[0] = builtinDecl(&ctx, "input");
+    builtins[1] = builtinDecl(&ctx, "output");
+
+    memset(&chain, 0, sizeof(Chain));
+    chain.max = (int)nodes;
+    chain.entries = (ChainEntry *)malloc(sizeof(ChainEntry) * chain.max);
+    if(chain.entries == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(r = 0; r < repeat; ++r) {
+        double t0, t;
+
+        t0 = now();
+        tableResolve(&st, tree, builtins);
+        t = now() - t0;
+        if((r == 0) || (t < best[0])) {
+            best[0] = t;
+        }
+
+        chain.head = NULL;
+        chain.count = 0;
+        chain.probes = chain.uses = chain.mismatches = 0;
+        t0 = now();
+        chainList(&chain, tree, FALSE);
+        t = now() - t0;
+        if((r == 0) || (t < best[1])) {
+            best[1] = t;
+        }
+    }
+
+    printf("%lu nodes, %lu uses, best of %d\n", nodes, chain.uses, repeat);
+    printf("symbol table: %.3f ms\n", best[0] * 1e3);
+    printf("scope chain: %.3f ms, %.1f probes per use, %.2fx\n", best[1] * 1e3,
+        chain.uses ? (double)chain.probes / chain.uses : 0.0, best[1] / best[0]);
+    if(chain.mismatches) {
+        printf("%lu uses resolved differently\n", chain.mismatches);
+    }
+
+    free(chain.entries);
+    freeSymTable(&st);
+    freeContext(&ctx);
+    free(src);
+    if(inputfile != NULL) {
+        fclose(inputfile);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,460 @@
+/* bytecode benchmark: a program run by a plain tree-walking interpreter
+   and by the bytecode VM, as it comes and optimized. The walker finds
+   each variable through a hash of declarations and evaluates nodes
+   recursively, as a first interpreter would. input() gives the numbers
+   after the repeat count, then zeros; outputs are counted and summed,
+   and must agree. With -g it runs a generated selection sort of n
+   numbers, the one of test/2.c, and a loop summing over them.
+   build: cc -O2 -Isrc -o vmbench bench/vmbench.c src/scan.c src/skip.c
+          src/tokens.c src/pool.c src/parse.c src/util.c src/intern.c
+          src/arena.c src/symtab.c src/analyze.c src/fold.c src/ir.c src/opt.c
+          src/regalloc.c src/select.c src/jit.c src/vm.c src/backend.c
+          src/compile.c -lpthread
+   usage: vmbench file.c [repeat [input ...]]
+          vmbench -g n [repeat] */
+#include <setjmp.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "compile.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+
+#define WALKWORDS (1 << 22)
+
+typedef struct _Io {
+    const int *input;
+    int numInput;
+    int next;
+    int outputs;
+    long sum;
+} Io;
+
+// where a declaration lives: a global address or an offset in the frame
+typedef struct _Place {
+    const TreeNode *decl;
+    int offset;             // for a function, its frame size
+    int global;
+} Place;
+
+typedef struct _Walker {
+    Place *places;
+    unsigned int mask;
+    int *mem;               // globals, then frames
+    int globalWords;
+    int sp;
+    int fp;
+    int returned;
+    int result;
+    Io *io;
+    jmp_buf fail;
+} Walker;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int readInput(void *arg) {
+    Io *io = (Io *)arg;
+
+    return (io->next < io->numInput) ? io->input[io->next++] : 0;
+}
+
+static void writeOutput(void *arg, int value) {
+    Io *io = (Io *)arg;
+
+    io->outputs++;
+    io->sum += value;
+}
+
+static Place *findPlace(Walker *w, const TreeNode *decl) {
+    unsigned int i = (unsigned int)(((unsigned long long)(uintptr_t)decl * 0x9e3779b97f4a7c15ull) >> 32);
+
+    for(i &= w->mask; (w->places[i].decl != NULL) && (w->places[i].decl != decl); i = (i + 1) & w->mask);
+    w->places[i].decl = decl;
+    return &w->places[i];
+}
+
+static int countDecls(const TreeNode *t) {
+    int n = 0;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        n += (t->nodeKind == DecK);
+        for(i = 0; i < MAXCHILDREN; ++i) {
+            n += countDecls(t->child[i]);
+        }
+    }
+    return n;
+}
+
+// locals of the compounds in t from offset *size of the frame on
+static void placeLocals(Walker *w, const TreeNode *t, int *size) {
+    const TreeNode *p;
+    Place *place;
+    int i;
+
+    for(; t != NULL; t = t->sibling) {
+        if((t->nodeKind == StmtK) && (t->kind.stmt == Compound)) {
+            for(p = t->child[0]; p != NULL; p = p->sibling) {
+                place = findPlace(w, p);
+                place->offset = *size;
+                *size += p->arrayType ? p->val : 1;
+            }
+        }
+        if(t->nodeKind == StmtK) {
+            for(i = 0; i < MAXCHILDREN; ++i) {
+                placeLocals(w, t->child[i], size);
+            }
+        }
+    }
+}
+
+static void placeAll(Walker *w, const TreeNode *tree) {
+    const TreeNode *t, *p;
+    Place *place;
+    int size;
+
+    w->mask = 64;
+    while(w->mask < (unsigned int)countDecls(tree) * 2) {
+        w->mask *= 2;
+    }
+    w->places = (Place *)calloc(w->mask, sizeof(Place));
+    w->mem = (int *)malloc(sizeof(int) * WALKWORDS);
+    if((w->places == NULL) || (w->mem == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    w->mask--;
+    w->globalWords = 0;
+    for(t = tree; t != NULL; t = t->sibling) {
+        place = findPlace(w, t);
+        if(t->kind.dec != FunctionDeclaration) {
+            place->global = TRUE;
+            place->offset = w->globalWords;
+            w->globalWords += t->arrayType ? t->val : 1;
+            continue;
+        }
+        // parameters first, an array one holding the address it was passed
+        size = 0;
+        for(p = t->child[0]; p != NULL; p = p->sibling) {
+            findPlace(w, p)->offset = size++;
+        }
+        placeLocals(w, t->child[1], &size);
+        findPlace(w, t)->offset = size;
+    }
+}
+
+static int eval(Walker *w, const TreeNode *t);
+
+// address of what Id node t names, indexed if it is
+static int address(Walker *w, const TreeNode *t) {
+    const TreeNode *d = t->decl;
+    Place *place = findPlace(w, d);
+    int addr = place->global ? place->offset : w->fp + place->offset;
+
+    if(d->arrayType && (d->kind.dec == ParamDeclaration)) {
+        addr = w->mem[addr];
+    }
+    if(t->arrayType) {
+        addr = (int)((unsigned int)addr + (unsigned int)eval(w, t->child[0]));
+        if((addr < 0) || (addr >= WALKWORDS)) {
+            longjmp(w->fail, 1);
+        }
+    }
+    return addr;
+}
+
+static void execList(Walker *w, const TreeNode *t);
+
+static int call(Walker *w, const TreeNode *t) {
+    const TreeNode *f = t->decl;
+    const TreeNode *a;
+    int base = w->sp;
+    int fp = w->fp;
+    int size;
+
+    if(f->child[1] == NULL) {
+        if(f->type == Void) {
+            writeOutput(w->io, eval(w, t->child[0]));
+            return 0;
+        }
+        return readInput(w->io);
+    }
+    size = findPlace(w, f)->offset;
+    if(base + size + 64 > WALKWORDS) {
+        longjmp(w->fail, 1);
+    }
+    for(a = t->child[0]; a != NULL; a = a->sibling) {
+        int v = eval(w, a);
+
+        w->mem[w->sp++] = v;
+    }
+    memset(w->mem + w->sp, 0, sizeof(int) * (base + size - w->sp));
+    w->sp = base + size;
+    w->fp = base;
+    w->result = 0;
+    execList(w, f->child[1]);
+    w->returned = FALSE;
+    w->fp = fp;
+    w->sp = base;
+    return w->result;
+}
+
+static int eval(Walker *w, const TreeNode *t) {
+    unsigned int a, b;
+    int addr;
+
+    if(t->nodeKind == StmtK) {
+        return call(w, t);
+    }
+    switch(t->kind.exp) {
+        case Constant:
+            return t->val;
+        case Id:
+            addr = address(w, t);
+            return (t->decl->arrayType && !t->arrayType) ? addr : w->mem[addr];
+        case Assign:
+            addr = address(w, t->child[0]);
+            a = (unsigned int)eval(w, t->child[1]);
+            w->mem[addr] = (int)a;
+            return (int)a;
+        default:
+            a = (unsigned int)eval(w, t->child[0]);
+            b = (unsigned int)eval(w, t->child[1]);
+            switch(t->op) {
+                case PLUS: return (int)(a + b);
+                case MINUS: return (int)(a - b);
+                case TIMES: return (int)(a * b);
+                case OVER:
+                    if(b == 0) {
+                        longjmp(w->fail, 1);
+                    }
+                    return ((int)b == -1) ? (int)(0u - a) : (int)a / (int)b;
+                case LESSTHAN: return (int)a < (int)b;
+                case LESSEQTHAN: return (int)a <= (int)b;
+                case GREATERTHAN: return (int)a > (int)b;
+                case GREATEREQTHAN: return (int)a >= (int)b;
+                case EQ: return a == b;
+                default: return a != b;
+            }
+    }
+}
+
+static void exec(Walker *w, const TreeNode *t) {
+    const TreeNode *p;
+
+    if(t->nodeKind != StmtK) {
+        if(t->nodeKind == ExpK) {
+            eval(w, t);
+        }
+        return;
+    }
+    switch(t->kind.stmt) {
+        case Compound:
+            // scalars start out zero each time, as lowering has them
+            for(p = t->child[0]; p != NULL; p = p->sibling) {
+                if(!p->arrayType) {
+                    w->mem[w->fp + findPlace(w, p)->offset] = 0;
+                }
+            }
+            execList(w, t->child[1]);
+            break;
+        case Selection:
+            if(eval(w, t->child[0])) {
+                execList(w, t->child[1]);
+            }
+            else {
+                execList(w, t->child[2]);
+            }
+            break;
+        case Iteration:
+            while(!w->returned && eval(w, t->child[0])) {
+                execList(w, t->child[1]);
+            }
+            break;
+        case Return:
+            w->result = (t->child[0] != NULL) ? eval(w, t->child[0]) : 0;
+            w->returned = TRUE;
+            break;
+        case Call:
+            call(w, t);
+            break;
+    }
+}
+
+static void execList(Walker *w, const TreeNode *t) {
+    for(; (t != NULL) && !w->returned; t = t->sibling) {
+        exec(w, t);
+    }
+}
+
+// FALSE if it failed at run time
+static int walk(Walker *w, const TreeNode *tree) {
+    const TreeNode *t;
+
+    memset(w->mem, 0, sizeof(int) * w->globalWords);
+    w->sp = w->fp = w->globalWords;
+    w->returned = FALSE;
+    if(setjmp(w->fail)) {
+        return FALSE;
+    }
+    for(t = tree; t != NULL; t = t->sibling) {
+        if((t->kind.dec == FunctionDeclaration) && !strcmp(t->name, "main")) {
+            w->sp += findPlace(w, t)->offset;
+            memset(w->mem + w->fp, 0, sizeof(int) * (w->sp - w->fp));
+            execList(w, t->child[1]);
+        }
+    }
+    return TRUE;
+}
+
+static char *generate(int n, size_t *len) {
+    static const char *fmt =
+        "int v[%d];\n"
+        "void fill(int n)\n"
+        "{ int i; int x; i = 0; x = 12345;\n"
+        "  while (i < n) { x = x * 1103515245 + 12345; v[i] = x / 65536; i = i + 1; } }\n"
+        "int minloc(int a[], int low, int high)\n"
+        "{ int i; int x; int k; k = low; x = a[low]; i = low + 1;\n"
+        "  while (i < high) { if (a[i] < x) { x = a[i]; k = i; } i = i + 1; }\n"
+        "  return k; }\n"
+        "void sort(int a[], int low, int high)\n"
+        "{ int i; int k; i = low;\n"
+        "  while (i < high - 1) { int t; k = minloc(a, i, high);\n"
+        "    t = a[k]; a[k] = a[i]; a[i] = t; i = i + 1; } }\n"
+        "int sum(int a[], int n)\n"
+        "{ int i; int j; int s; s = 0; j = 0;\n"
+        "  while (j < 100) { i = 0; while (i < n) { s = s + a[i] * (i - j); i = i + 1; } j = j + 1; }\n"
+        "  return s; }\n"
+        "void main(void)\n"
+        "{ fill(%d); sort(v, 0, %d); output(v[0]); output(v[%d]); output(sum(v, %d)); }\n";
+    char *src = (char *)malloc(strlen(fmt) + 64);
+
+    if(src == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    *len = (size_t)sprintf(src, fmt, n, n, n, n - 1, n);
+    return src;
+}
+
+int main(int argc, const char *argv[]) {
+    static const char *names[3] = {"tree walk", "bytecode", "optimized"};
+    int gen = (argc > 1) && !strcmp(argv[1], "-g");
+    int repeat;
+    CompileContext ctx;
+    BackEnd be;
+    TreeNode *tree;
+    FILE *inputfile = NULL;
+    char *src = NULL;
+    size_t len = 0;
+    Walker w;
+    Io io[3];
+    int *input;
+    int numInput = 0;
+    int ok[3];
+    double t, best[3], compileTime[3] = {0, 0, 0};
+    int k, r;
+
+    if(gen ? (argc < 3) : (argc < 2)) {
+        fprintf(stderr, "usage: %s file.c [repeat [input ...]]\n       %s -g n [repeat]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    repeat = (argc > 2 + gen) ? atoi(argv[2 + gen]) : 5;
+    input = (int *)malloc(sizeof(int) * (argc + 1));
+    if(input == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(k = 3; !gen && (k < argc); ++k) {
+        input[numInput++] = atoi(argv[k]);
+    }
+
+    initContext(&ctx, stderr);
+    if(gen) {
+        src = generate(atoi(argv[2]) > 1 ? atoi(argv[2]) : 2, &len);
+        tree = compile(&ctx, src, len);
+    }
+    else {
+        inputfile = fopen(argv[1], "r");
+        if((inputfile == NULL) || !compileFile(&ctx, inputfile, &tree)) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    // the checks resolve names, which the walker needs too
+    if((tree == NULL) || !checkCompiled(&ctx, tree)) {
+        fprintf(stderr, "%s has errors\n", gen ? "generated program" : argv[1]);
+        return EXIT_FAILURE;
+    }
+    initBackEnd(&be, &ctx.names);
+    memset(&w, 0, sizeof(Walker));
+    placeAll(&w, tree);
+
+    for(k = 0; k < 3; ++k) {
+        if(k > 0) {
+            t = now();
+            lowerTree(&be.ir, tree);
+            if(k == 2) {
+                optimizeIr(&be.ir);
+            }
+            if(!vmCompile(&be.vm, &be.ir, be.names)) {
+                fprintf(stderr, "%s has no main\n", gen ? "generated program" : argv[1]);
+                return EXIT_FAILURE;
+            }
+            compileTime[k] = now() - t;
+        }
+        for(r = 0; r < repeat; ++r) {
+            memset(&io[k], 0, sizeof(Io));
+            io[k].input = input;
+            io[k].numInput = numInput;
+            t = now();
+            if(k == 0) {
+                w.io = &io[k];
+                ok[k] = walk(&w, tree);
+            }
+            else {
+                ok[k] = (vmRun(&be.vm, readInput, writeOutput, &io[k]) == VM_DONE);
+            }
+            t = now() - t;
+            if((r == 0) || (t < best[k])) {
+                best[k] = t;
+            }
+        }
+    }
+
+    printf("%d outputs summing to %ld%s, best of %d\n", io[0].outputs, io[0].sum,
+        ok[0] ? "" : ", then a runtime error", repeat);
+    for(k = 0; k < 3; ++k) {
+        printf("%-9s  run %.3f ms", names[k], best[k] * 1e3);
+        if(k > 0) {
+            printf(", %.2fx the tree walk, compiled in %.1f us", best[k] > 0 ? best[0] / best[k] : 0.0,
+                compileTime[k] * 1e6);
+        }
+        if((io[k].outputs != io[0].outputs) || (io[k].sum != io[0].sum) || (ok[k] != ok[0])) {
+            printf(", OUTPUT DIFFERS");
+        }
+        printf("\n");
+    }
+    printf("%d words of bytecode\n", be.vm.numCode);
+
+    freeBackEnd(&be);
+    freeContext(&ctx);
+    free(w.places);
+    free(w.mem);
+    free(src);
+    free(input);
+    if(inputfile != NULL) {
+        fclose(inputfile);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include <stdarg.h>
+
+#include "globals.h"
+#include "symtab.h"
+#include "analyze.h"
+
+// a node on the pass's work list, before or after its children
+typedef struct _CheckFrame {
+    TreeNode *t;
+    int after;
+} CheckFrame;
+
+static void report(CompileContext *ctx, TreeNode *t, const char *fmt, ...) {
+    Checker *c = &ctx->checker;
+    va_list ap;
+    int n;
+    size_t need;
+
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    // "\n>>> Semantic error at line N: " is at most 64 bytes
+    need = c->diagLen + (size_t)n + 66;
+    if(need > c->diagMax) {
+        c->diagMax = (need > c->diagMax * 2) ? need : c->diagMax * 2;
+        c->diag = (char *)realloc(c->diag, c->diagMax);
+        if(c->diag == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    c->diagLen += sprintf(c->diag + c->diagLen, "\n>>> Semantic error at line %d: ", t->lineno);
+    va_start(ap, fmt);
+    c->diagLen += vsprintf(c->diag + c->diagLen, fmt, ap);
+    va_end(ap);
+    c->diag[c->diagLen++] = '\n';
+    c->errors++;
+}
+
+static int isFunction(const TreeNode *d) {
+    return (d->nodeKind == DecK) && (d->kind.dec == FunctionDeclaration);
+}
+
+static void declare(CompileContext *ctx, TreeNode *t) {
+    SymTable *st = &ctx->scopes;
+    Binding *b;
+
+    if(t->sym == NOSYM) {
+        return;
+    }
+    b = lookupName(st, t->sym);
+    if((b != NULL) && (b->depth == st->depth - 1)) {
+        report(ctx, t, "'%s' is already declared at line %d", t->name, b->decl->lineno);
+    }
+    declareName(st, t);
+}
+
+// the declaration t's name refers to, also kept in t->decl
+static TreeNode *resolve(CompileContext *ctx, TreeNode *t) {
+    Checker *c = &ctx->checker;
+    Binding *b = lookupName(&ctx->scopes, t->sym);
+    int i;
+
+    if(b != NULL) {
+        t->decl = b->decl;
+    }
+    // input and output are there unless the program declares its own
+    else if((t->name != NULL) && (!strcmp(t->name, "input") || !strcmp(t->name, "output"))) {
+        i = (t->name[0] == 'o');
+        if(c->builtins[i] == NULL) {
+            c->builtins[i] = builtinDecl(ctx, t->name);
+        }
+        t->decl = c->builtins[i];
+    }
+    else {
+        t->decl = NULL;
+        if(t->name != NULL) {
+            report(ctx, t, "'%s' is not declared", t->name);
+        }
+    }
+    return t->decl;
+}
+
+// e is used as an int
+static void checkValue(CompileContext *ctx, TreeNode *e) {
+    TreeNode *d;
+
+    if((e == NULL) || ((d = e->decl) == NULL)) {
+        return;
+    }
+    if((e->nodeKind == StmtK) && (e->kind.stmt == Call)) {
+        if(isFunction(d) && (d->type == Void)) {
+            report(ctx, e, "'%s' returns no value", e->name);
+        }
+    }
+    else if((e->nodeKind == ExpK) && (e->kind.exp == Id)) {
+        if(!isFunction(d) && d->arrayType && !e->arrayType) {
+            report(ctx, e, "array '%s' used as a value", e->name);
+        }
+    }
+}
+
+static void checkId(CompileContext *ctx, TreeNode *t) {
+    TreeNode *d = resolve(ctx, t);
+
+    if(d == NULL) {
+        return;
+    }
+    if(isFunction(d)) {
+        report(ctx, t, "function '%s' used as a variable", t->name);
+    }
+    else if(t->arrayType) {
+        if(!d->arrayType) {
+            report(ctx, t, "'%s' is not an array", t->name);
+        }
+        checkValue(ctx, t->child[0]);
+    }
+}
+
+static void checkCall(CompileContext *ctx, TreeNode *t) {
+    TreeNode *d = resolve(ctx, t);
+    TreeNode *p, *a;
+    int params = 0;
+    int args = 0;
+
+    if(d == NULL) {
+        return;
+    }
+    if(!isFunction(d)) {
+        report(ctx, t, "'%s' is not a function", t->name);
+        return;
+    }
+    for(p = d->child[0]; p != NULL; p = p->sibling) {
+        params++;
+    }
+    for(a = t->child[0]; a != NULL; a = a->sibling) {
+        args++;
+    }
+    if(args != params) {
+        report(ctx, t, "'%s' takes %d argument%s, %d given", t->name, params, (params == 1) ? "" : "s", args);
+    }
+
+    for(p = d->child[0], a = t->child[0], args = 1; (p != NULL) && (a != NULL); p = p->sibling, a = a->sibling, ++args) {
+        if(!p->arrayType) {
+            checkValue(ctx, a);
+        }
+        else if((a->nodeKind != ExpK) || (a->kind.exp != Id) || a->arrayType ||
+            (a->decl == NULL) || isFunction(a->decl) || !a->decl->arrayType) {
+            report(ctx, a, "argument %d of '%s' must be an array", args, t->name);
+        }
+    }
+}
+
+static void checkReturn(CompileContext *ctx, TreeNode *t) {
+    TreeNode *f = ctx->checker.function;
+
+    if(f == NULL) {
+        return;
+    }
+    if((t->child[0] != NULL) && (f->type == Void)) {
+        report(ctx, t, "void function '%s' returns a value", f->name);
+    }
+    else if((t->child[0] == NULL) && (f->type == Int)) {
+        report(ctx, t, "'%s' must return a value", f->name);
+    }
+    checkValue(ctx, t->child[0]);
+}
+
+void checkStart(CompileContext *ctx) {
+    Checker *c = &ctx->checker;
+    SymTable *st = &ctx->scopes;
+
+    arenaReset(&st->bindings);
+    st->numLog = 0;
+    st->depth = 0;
+    enterScope(st);
+    c->function = NULL;
+    c->body = NULL;
+    c->builtins[0] = c->builtins[1] = NULL;
+    c->diagLen = 0;
+    c->errors = 0;
+}
+
+void checkEnter(CompileContext *ctx, TreeNode *t) {
+    Checker *c = &ctx->checker;
+
+    if(t->nodeKind == DecK) {
+        declare(ctx, t);
+        c->function = t;
+        c->body = NULL;
+        enterScope(&ctx->scopes);
+    }
+    // the first block in a function is its body
+    else if((c->function != NULL) && (c->body == NULL)) {
+        c->body = t;
+    }
+    else {
+        enterScope(&ctx->scopes);
+    }
+}
+
+void checkNode(CompileContext *ctx, TreeNode *t) {
+    Checker *c = &ctx->checker;
+
+    if(t->nodeKind == DecK) {
+        if(t->kind.dec == FunctionDeclaration) {
+            leaveScope(&ctx->scopes);
+            c->function = NULL;
+            c->body = NULL;
+            return;
+        }
+        if(t->type == Void) {
+            report(ctx, t, "%s '%s' declared void",
+                (t->kind.dec == ParamDeclaration) ? "parameter" : "variable", t->name);
+        }
+        declare(ctx, t);
+    }
+    else if(t->nodeKind == StmtK) {
+        switch(t->kind.stmt) {
+            case Compound:
+                if(t != c->body) {
+                    leaveScope(&ctx->scopes);
+                }
+                break;
+            case Selection: case Iteration:
+                checkValue(ctx, t->child[0]);
+                break;
+            case Return:
+                checkReturn(ctx, t);
+                break;
+            case Call:
+                checkCall(ctx, t);
+                break;
+        }
+    }
+    else {
+        switch(t->kind.exp) {
+            case Id:
+                checkId(ctx, t);
+                break;
+            case Assign:
+                if((t->child[0]->decl != NULL) && !isFunction(t->child[0]->decl) &&
+                    t->child[0]->decl->arrayType && !t->child[0]->arrayType) {
+                    report(ctx, t, "can't assign to array '%s'", t->child[0]->name);
+                }
+                checkValue(ctx, t->child[1]);
+                break;
+            case Op:
+                checkValue(ctx, t->child[0]);
+                checkValue(ctx, t->child[1]);
+                break;
+            case Constant:
+                break;
+        }
+    }
+}
+
+void checkFinish(CompileContext *ctx) {
+    Checker *c = &ctx->checker;
+
+    while(ctx->scopes.depth > 0) {
+        leaveScope(&ctx->scopes);
+    }
+    if(!ctx->Error && (c->errors > 0)) {
+        fwrite(c->diag, 1, c->diagLen, ctx->out);
+        ctx->Error = TRUE;
+    }
+}
+
+static void growStack(Checker *c, int need) {
+    if(need > c->maxStack) {
+        c->maxStack = (need > c->maxStack * 2) ? need : c->maxStack * 2;
+        if(c->maxStack < 64) {
+            c->maxStack = 64;
+        }
+        c->stack = (CheckFrame *)realloc(c->stack, sizeof(CheckFrame) * c->maxStack);
+        if(c->stack == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* the order of the fused checks: functions and blocks are entered before
+   their children and every node is checked after them */
+void checkTree(CompileContext *ctx, TreeNode *tree) {
+    Checker *c = &ctx->checker;
+    CheckFrame f;
+    int top = 0;
+    int i;
+
+    checkStart(ctx);
+    growStack(c, 1);
+    if(tree != NULL) {
+        c->stack[top].t = tree;
+        c->stack[top++].after = FALSE;
+    }
+    while(top > 0) {
+        f = c->stack[--top];
+        if(f.after) {
+            checkNode(ctx, f.t);
+            continue;
+        }
+
+        growStack(c, top + MAXCHILDREN + 2);
+        // sibling goes under the node so it's done after it
+        if(f.t->sibling != NULL) {
+            c->stack[top].t = f.t->sibling;
+            c->stack[top++].after = FALSE;
+        }
+        c->stack[top].t = f.t;
+        c->stack[top++].after = TRUE;
+        if(((f.t->nodeKind == DecK) && (f.t->kind.dec == FunctionDeclaration)) ||
+            ((f.t->nodeKind == StmtK) && (f.t->kind.stmt == Compound))) {
+            checkEnter(ctx, f.t);
+        }
+        for(i = MAXCHILDREN - 1; i >= 0; --i) {
+            if(f.t->child[i] != NULL) {
+                c->stack[top].t = f.t->child[i];
+                c->stack[top++].after = FALSE;
+            }
+        }
+    }
+    checkFinish(ctx);
+}
+
+void freeChecker(Checker *c) {
+    free(c->diag);
+    free(c->stack);
+    memset(c, 0, sizeof(Checker));
+}
\ No newline at end of file
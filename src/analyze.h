@@ -0,0 +1,37 @@
+#ifndef _ANALYZE_H_
+#define _ANALYZE_H_
+
+/* semantic checks: names declared before use and not twice in a scope, no
+   void variables, arrays and scalars used as declared, calls with as many
+   arguments as parameters, and returns that match the function. They run
+   either fused into the parse, which calls checkEnter and checkNode as it
+   builds the tree, or as a pass over the finished tree; the diagnostics
+   are the same. They are only reported for a tree without syntax errors. */
+typedef enum { CHECK_NONE, CHECK_FUSED, CHECK_PASS } CheckMode;
+
+typedef struct _Checker {
+    TreeNode *function;     // declaration being checked, NULL between them
+    TreeNode *body;         // its outermost block, in the parameters' scope
+    TreeNode *builtins[2];  // input and output, made when first used
+    char *diag;             // errors held until the parse is known to be clean
+    size_t diagLen;
+    size_t diagMax;
+    int errors;
+    struct _CheckFrame *stack;  // work list of the pass
+    int maxStack;
+} Checker;
+
+struct compileContext;
+
+void checkStart(struct compileContext *ctx);
+// a function once its name is known, or a block after its '{'
+void checkEnter(struct compileContext *ctx, TreeNode *t);
+// any node once it and everything under it is complete
+void checkNode(struct compileContext *ctx, TreeNode *t);
+// report what was found, if the parse had no syntax errors
+void checkFinish(struct compileContext *ctx);
+// all of the above as one walk over a finished tree
+void checkTree(struct compileContext *ctx, TreeNode *tree);
+void freeChecker(Checker *c);
+
+#endif
\ No newline at end of file
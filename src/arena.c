@@ -0,0 +1,89 @@
+#include "globals.h"
+#include "arena.h"
+
+#define CHUNKSIZE 65536
+#define ALIGNMENT 8
+
+// first aligned byte of a chunk
+static char *chunkStart(ArenaChunk *c) {
+    char *p = (char *)(c + 1);
+    return p + ((ALIGNMENT - ((size_t)p & (ALIGNMENT - 1))) & (ALIGNMENT - 1));
+}
+
+static ArenaChunk *newChunk(Arena *a, size_t size) {
+    size_t n = (size > CHUNKSIZE) ? size : CHUNKSIZE;
+    ArenaChunk *c = (ArenaChunk *)malloc(sizeof(ArenaChunk) + ALIGNMENT + n);
+
+    if(c == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    c->next = NULL;
+    c->size = n;
+    a->reserved += n;
+    return c;
+}
+
+// move on to a chunk with room for size bytes, reusing ones kept by a reset
+static void nextChunk(Arena *a, size_t size) {
+    ArenaChunk *c;
+
+    if(a->current == NULL) {
+        c = (a->first != NULL) ? a->first : newChunk(a, size);
+        a->first = c;
+    }
+    else {
+        c = a->current->next;
+        if((c == NULL) || (c->size < size)) {
+            c = newChunk(a, size);
+            c->next = a->current->next;
+            a->current->next = c;
+        }
+    }
+
+    // a kept first chunk can be too small for an oversized request
+    if(c->size < size) {
+        ArenaChunk *big = newChunk(a, size);
+        big->next = c->next;
+        c->next = big;
+        c = big;
+    }
+
+    a->current = c;
+    a->pos = chunkStart(c);
+    a->end = a->pos + c->size;
+}
+
+void *arenaAlloc(Arena *a, size_t size) {
+    void *p;
+
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if((a->pos == NULL) || ((size_t)(a->end - a->pos) < size)) {
+        nextChunk(a, size);
+    }
+    p = a->pos;
+    a->pos += size;
+    a->allocs++;
+    a->used += size;
+    return p;
+}
+
+void arenaReset(Arena *a) {
+    a->current = NULL;
+    a->pos = a->end = NULL;
+    a->allocs = 0;
+    a->used = 0;
+}
+
+void arenaFree(Arena *a) {
+    ArenaChunk *c = a->first;
+
+    while(c != NULL) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->first = NULL;
+    a->reserved = 0;
+    arenaReset(a);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+/* bump allocator over a list of chunks. Everything is released at once:
+   arenaReset() rewinds in O(1) and keeps the chunks for the next use,
+   arenaFree() gives them back. A zeroed Arena is ready to use. */
+typedef struct _ArenaChunk {
+    struct _ArenaChunk *next;
+    size_t size;
+} ArenaChunk;
+
+typedef struct _Arena {
+    ArenaChunk *first;
+    ArenaChunk *current;
+    char *pos;
+    char *end;
+    unsigned long allocs;   // arenaAlloc calls since the last reset
+    size_t used;            // bytes handed out since the last reset
+    size_t reserved;        // bytes held in chunks
+} Arena;
+
+void *arenaAlloc(Arena *a, size_t size);
+void arenaReset(Arena *a);
+void arenaFree(Arena *a);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "globals.h"
+#include "intern.h"
+#include "flat.h"
+#include "astfile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define BYTEORDER 0x01020304u
+
+// place a section of bytes at *off and move past it, 4-byte aligned
+static unsigned int placeSection(size_t *off, size_t bytes) {
+    unsigned int at = (unsigned int)*off;
+
+    *off += (bytes + 3) & ~(size_t)3;
+    return at;
+}
+
+static int writeSection(FILE *fp, const void *p, size_t bytes) {
+    static const char pad[4] = {0, 0, 0, 0};
+
+    if((bytes > 0) && (fwrite(p, 1, bytes, fp) != bytes)) {
+        return FALSE;
+    }
+    return (bytes % 4 == 0) || (fwrite(pad, 1, 4 - bytes % 4, fp) == 4 - bytes % 4);
+}
+
+int saveFlatTree(const FlatTree *f, FILE *fp) {
+    AstHeader h;
+    size_t nodeBytes = sizeof(unsigned int) * (size_t)f->count;
+    size_t off = sizeof(AstHeader);
+
+    memset(&h, 0, sizeof(AstHeader));
+    memcpy(h.magic, AST_MAGIC, sizeof(h.magic));
+    h.version = AST_VERSION;
+    h.byteOrder = BYTEORDER;
+    h.count = f->count;
+    h.numKids = f->numKids;
+    h.numSyms = f->numSyms;
+    h.strBytes = f->strBytes;
+    h.diagBytes = f->diagBytes;
+    h.info = placeSection(&off, nodeBytes);
+    h.val = placeSection(&off, nodeBytes);
+    h.sym = placeSection(&off, nodeBytes);
+    h.lineno = placeSection(&off, nodeBytes);
+    h.sibling = placeSection(&off, nodeBytes);
+    h.kidStart = placeSection(&off, nodeBytes);
+    h.kids = placeSection(&off, sizeof(NodeId) * (size_t)f->numKids);
+    h.strStart = placeSection(&off, sizeof(unsigned int) * ((size_t)f->numSyms + 1));
+    h.strings = placeSection(&off, f->strBytes);
+    h.diag = placeSection(&off, f->diagBytes);
+    // offsets are 32-bit
+    if(off > 0xffffffffu) {
+        return FALSE;
+    }
+    h.fileBytes = (unsigned int)off;
+
+    return (fwrite(&h, sizeof(AstHeader), 1, fp) == 1)
+        && writeSection(fp, f->info, nodeBytes)
+        && writeSection(fp, f->val, nodeBytes)
+        && writeSection(fp, f->sym, nodeBytes)
+        && writeSection(fp, f->lineno, nodeBytes)
+        && writeSection(fp, f->sibling, nodeBytes)
+        && writeSection(fp, f->kidStart, nodeBytes)
+        && writeSection(fp, f->kids, sizeof(NodeId) * (size_t)f->numKids)
+        && writeSection(fp, f->strStart, sizeof(unsigned int) * ((size_t)f->numSyms + 1))
+        && writeSection(fp, f->strings, f->strBytes)
+        && writeSection(fp, f->diag, f->diagBytes);
+}
+
+// whole file into memory, for when it can't be mapped
+static void *readImage(FILE *fp, size_t *size) {
+    long len;
+    void *p;
+
+    if((fseek(fp, 0, SEEK_END) != 0) || ((len = ftell(fp)) < 0) || (fseek(fp, 0, SEEK_SET) != 0)) {
+        return NULL;
+    }
+    p = malloc(len ? (size_t)len : 1);
+    if(p == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    if(fread(p, 1, (size_t)len, fp) != (size_t)len) {
+        free(p);
+        return NULL;
+    }
+    *size = (size_t)len;
+    return p;
+}
+
+// section [off, off + bytes) lies in the file and is aligned
+static int inFile(size_t size, unsigned int off, size_t bytes) {
+    return (off % 4 == 0) && (off <= size) && (bytes <= size - off);
+}
+
+static int checkHeader(const AstHeader *h, size_t size) {
+    size_t nodeBytes = sizeof(unsigned int) * (size_t)h->count;
+
+    return (memcmp(h->magic, AST_MAGIC, sizeof(h->magic)) == 0)
+        && (h->version == AST_VERSION)
+        && (h->byteOrder == BYTEORDER)
+        && (h->fileBytes == size)
+        && (h->count >= 1)
+        && inFile(size, h->info, nodeBytes)
+        && inFile(size, h->val, nodeBytes)
+        && inFile(size, h->sym, nodeBytes)
+        && inFile(size, h->lineno, nodeBytes)
+        && inFile(size, h->sibling, nodeBytes)
+        && inFile(size, h->kidStart, nodeBytes)
+        && inFile(size, h->kids, sizeof(NodeId) * (size_t)h->numKids)
+        && inFile(size, h->strStart, sizeof(unsigned int) * ((size_t)h->numSyms + 1))
+        && inFile(size, h->strings, h->strBytes)
+        && inFile(size, h->diag, h->diagBytes);
+}
+
+FlatTree *loadFlatTree(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    FlatTree *f;
+    const AstHeader *h;
+    char *base = NULL;
+    size_t size = 0;
+    size_t mapped = 0;
+
+    if(fp == NULL) {
+        return NULL;
+    }
+#ifndef _WIN32
+    {
+        struct stat st;
+        void *p;
+
+        if((fstat(fileno(fp), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+            p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+            if(p != MAP_FAILED) {
+                base = (char *)p;
+                size = mapped = (size_t)st.st_size;
+            }
+        }
+    }
+#endif
+    if(base == NULL) {
+        base = (char *)readImage(fp, &size);
+    }
+    fclose(fp);
+    if(base == NULL) {
+        return NULL;
+    }
+
+    f = (FlatTree *)malloc(sizeof(FlatTree));
+    if(f == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    f->mem = base;
+    f->mapped = mapped;
+
+    h = (const AstHeader *)base;
+    if((size < sizeof(AstHeader)) || !checkHeader(h, size)) {
+        freeFlatTree(f);
+        return NULL;
+    }
+
+    // point straight into the image
+    f->count = h->count;
+    f->numKids = h->numKids;
+    f->numSyms = h->numSyms;
+    f->strBytes = h->strBytes;
+    f->info = (unsigned int *)(base + h->info);
+    f->val = (int *)(base + h->val);
+    f->sym = (int *)(base + h->sym);
+    f->lineno = (int *)(base + h->lineno);
+    f->sibling = (NodeId *)(base + h->sibling);
+    f->kidStart = (unsigned int *)(base + h->kidStart);
+    f->kids = (NodeId *)(base + h->kids);
+    f->strStart = (unsigned int *)(base + h->strStart);
+    f->strings = base + h->strings;
+    f->diag = base + h->diag;
+    f->diagBytes = h->diagBytes;
+    return f;
+}
+
+/* handles only point forward and every node has exactly one parent slot
+   or predecessor, so walks terminate and see a tree */
+int checkFlatTree(const FlatTree *f) {
+    unsigned char *seen;
+    unsigned int n, i;
+    NodeId m;
+    int ok = TRUE;
+
+    for(i = 0; i < f->numSyms; ++i) {
+        if((f->strStart[i] >= f->strStart[i+1]) || (f->strStart[i+1] > f->strBytes)
+            || (f->strings[f->strStart[i+1] - 1] != '\0')) {
+            return FALSE;
+        }
+    }
+
+    seen = (unsigned char *)calloc(f->count, 1);
+    if(seen == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(n = 1; ok && (n < f->count); ++n) {
+        unsigned int slots = FLAT_SLOTS(f->info[n]);
+
+        if(((f->sym[n] != NOSYM) && ((unsigned int)f->sym[n] >= f->numSyms))
+            || (f->kidStart[n] > f->numKids) || (slots > f->numKids - f->kidStart[n])) {
+            ok = FALSE;
+            break;
+        }
+        for(i = 0; ok && (i <= slots); ++i) {
+            m = (i < slots) ? f->kids[f->kidStart[n] + i] : f->sibling[n];
+            if(m == NULLNODE) {
+                continue;
+            }
+            if((m <= n) || (m >= f->count) || seen[m]) {
+                ok = FALSE;
+            }
+            else {
+                seen[m] = 1;
+            }
+        }
+    }
+    free(seen);
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _ASTFILE_H_
+#define _ASTFILE_H_
+
+/* binary image of a FlatTree. A fixed header is followed by the node
+   arrays, child slots, name offsets and names, each placed at a 4-byte
+   aligned offset recorded in the header, and optionally by the
+   diagnostics the parse produced. Everything is addressed by
+   handles and offsets, so a mapped file is used in place without fix-ups.
+   Integers are in the writer's byte order; a reader with the other order
+   rejects the file. */
+#define AST_MAGIC "CMAST\r\n\032"
+#define AST_VERSION 2
+
+typedef struct _AstHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int byteOrder;     // 0x01020304 as the writer stored it
+    unsigned int fileBytes;
+    unsigned int count;         // nodes, including the null node
+    unsigned int numKids;
+    unsigned int numSyms;
+    unsigned int strBytes;
+    unsigned int diagBytes;
+    // byte offsets from the start of the file
+    unsigned int info;
+    unsigned int val;
+    unsigned int sym;
+    unsigned int lineno;
+    unsigned int sibling;
+    unsigned int kidStart;
+    unsigned int kids;
+    unsigned int strStart;
+    unsigned int strings;
+    unsigned int diag;
+} AstHeader;
+
+// stores f->diag along with the tree; FALSE on a write error
+int saveFlatTree(const FlatTree *f, FILE *fp);
+/* map the image at path read-only and point a FlatTree into it. Only the
+   header and section bounds are checked; NULL if they are bad. */
+FlatTree *loadFlatTree(const char *path);
+/* full O(n) check of handles, child slots and names, for images from
+   untrusted sources */
+int checkFlatTree(const FlatTree *f);
+
+#endif
\ No newline at end of file
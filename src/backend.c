@@ -0,0 +1,19 @@
+#include "globals.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+
+void initBackEnd(BackEnd *be, const InternTable *names) {
+    memset(be, 0, sizeof(BackEnd));
+    be->names = names;
+}
+
+void freeBackEnd(BackEnd *be) {
+    freeIr(&be->ir);
+    freeAlloc(&be->alloc);
+    freeJit(&be->jit);
+    freeVm(&be->vm);
+    memset(be, 0, sizeof(BackEnd));
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+/* what the back ends keep for the program they work on, apart from the
+   CompileContext its tree was parsed in: the three-address code, where
+   its registers went, its machine code and its bytecode. The tree and
+   names stay with the front end and are only read here. Each part keeps
+   its memory for the next program, so a driver makes one per thread next
+   to the thread's CompileContext. */
+typedef struct _BackEnd {
+    const InternTable *names;   // of the context the tree comes from
+    // three-address code of the last tree, see lowerTree
+    IrModule ir;
+    // where its registers went, see allocateRegisters
+    RegAlloc alloc;
+    // its machine code, see jitCompile
+    Jit jit;
+    // its bytecode, see vmCompile
+    Vm vm;
+} BackEnd;
+
+void initBackEnd(BackEnd *be, const InternTable *names);
+void freeBackEnd(BackEnd *be);
+
+#endif
\ No newline at end of file
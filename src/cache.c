@@ -0,0 +1,263 @@
+#include "globals.h"
+#include "intern.h"
+#include "flat.h"
+#include "astfile.h"
+#include "cache.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+#define P5 0x27D4EB2F165667C5ull
+
+#define ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+typedef unsigned long long u64;
+
+static u64 read64(const char *p) {
+    u64 v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static u64 read32(const char *p) {
+    unsigned int v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static u64 mixRound(u64 acc, u64 v) {
+    acc += v * P2;
+    acc = ROTL(acc, 31);
+    return acc * P1;
+}
+
+static u64 mergeRound(u64 h, u64 v) {
+    h ^= mixRound(0, v);
+    return h * P1 + P4;
+}
+
+// XXH64: four lanes of 8 bytes per step, then the tail
+static u64 hashBytes64(const char *p, size_t len, u64 seed) {
+    const char *end = p + len;
+    u64 h;
+
+    if(len >= 32) {
+        u64 v1 = seed + P1 + P2;
+        u64 v2 = seed + P2;
+        u64 v3 = seed;
+        u64 v4 = seed - P1;
+
+        do {
+            v1 = mixRound(v1, read64(p));
+            v2 = mixRound(v2, read64(p + 8));
+            v3 = mixRound(v3, read64(p + 16));
+            v4 = mixRound(v4, read64(p + 24));
+            p += 32;
+        } while(end - p >= 32);
+
+        h = ROTL(v1, 1) + ROTL(v2, 7) + ROTL(v3, 12) + ROTL(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else {
+        h = seed + P5;
+    }
+    h += (u64)len;
+
+    for(; end - p >= 8; p += 8) {
+        h ^= mixRound(0, read64(p));
+        h = ROTL(h, 27) * P1 + P4;
+    }
+    if(end - p >= 4) {
+        h ^= read32(p) * P1;
+        h = ROTL(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for(; p < end; ++p) {
+        h ^= (u64)(unsigned char)*p * P5;
+        h = ROTL(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+CacheKey cacheKey(const char *src, size_t len, unsigned int options) {
+    CacheKey key;
+
+    // a new compiler or image version, or other options, start a fresh key space
+    key.hash = hashBytes64(src, len, ((u64)CACHE_VERSION << 32) ^ ((u64)options << 16) ^ AST_VERSION);
+    key.len = (unsigned long)len;
+    return key;
+}
+
+int cacheOpen(const char *dir) {
+#ifndef _WIN32
+    struct stat st;
+
+    mkdir(dir, 0777);
+    return (stat(dir, &st) == 0) && S_ISDIR(st.st_mode);
+#else
+    return TRUE;
+#endif
+}
+
+static void entryPath(char *path, const char *dir, CacheKey key) {
+    snprintf(path, FILENAME_MAX, "%s/%016llx-%lu.ast", dir, key.hash, key.len);
+}
+
+FlatTree *cacheLoad(const char *dir, CacheKey key) {
+    char path[FILENAME_MAX];
+    FlatTree *f;
+
+    entryPath(path, dir, key);
+    f = loadFlatTree(path);
+    if(f == NULL) {
+        return NULL;
+    }
+    // the directory may be shared, so don't trust the contents
+    if(!checkFlatTree(f)) {
+        freeFlatTree(f);
+        return NULL;
+    }
+#ifndef _WIN32
+    utime(path, NULL);
+#endif
+    return f;
+}
+
+int cacheStore(const char *dir, CacheKey key, const FlatTree *f, int worker) {
+    char path[FILENAME_MAX];
+    char tmp[FILENAME_MAX + 32];
+    FILE *fp;
+    int ok;
+
+    entryPath(path, dir, key);
+#ifndef _WIN32
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%d.tmp", path, (long)getpid(), worker);
+#else
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, worker);
+#endif
+
+    fp = fopen(tmp, "wb");
+    if(fp == NULL) {
+        return FALSE;
+    }
+    ok = saveFlatTree(f, fp);
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || (rename(tmp, path) != 0)) {
+        remove(tmp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#ifndef _WIN32
+typedef struct _Entry {
+    char *name;
+    time_t used;
+    unsigned long long bytes;
+} Entry;
+
+// oldest first; names break ties so runs are repeatable
+static int olderFirst(const void *a, const void *b) {
+    const Entry *x = (const Entry *)a;
+    const Entry *y = (const Entry *)b;
+
+    if(x->used != y->used) {
+        return (x->used < y->used) ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+// "<hash>-<len>.ast"; temporaries being written end in ".tmp"
+static int isEntry(const char *name) {
+    size_t len = strlen(name);
+
+    return (len > 4) && (strchr(name, '.') == name + len - 4) && !strcmp(name + len - 4, ".ast");
+}
+#endif
+
+long cacheTrim(const char *dir, unsigned long long maxBytes, unsigned long long *kept) {
+    long evicted = 0;
+
+    *kept = 0;
+#ifndef _WIN32
+    {
+        DIR *d = opendir(dir);
+        struct dirent *de;
+        struct stat st;
+        char path[FILENAME_MAX];
+        Entry *entries = NULL;
+        int num = 0;
+        int max = 0;
+        unsigned long long total = 0;
+        int i;
+
+        if(d == NULL) {
+            return 0;
+        }
+        while((de = readdir(d)) != NULL) {
+            if(!isEntry(de->d_name)) {
+                continue;
+            }
+            snprintf(path, FILENAME_MAX, "%s/%s", dir, de->d_name);
+            if((stat(path, &st) != 0) || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            if(num == max) {
+                max = max ? max * 2 : 64;
+                entries = (Entry *)realloc(entries, sizeof(Entry) * max);
+                if(entries == NULL) {
+                    fprintf(stderr, "memory allocation error. exiting...\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            entries[num].name = (char *)malloc(strlen(de->d_name) + 1);
+            if(entries[num].name == NULL) {
+                fprintf(stderr, "memory allocation error. exiting...\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(entries[num].name, de->d_name);
+            entries[num].used = st.st_mtime;
+            entries[num].bytes = (unsigned long long)st.st_size;
+            total += entries[num].bytes;
+            num++;
+        }
+        closedir(d);
+
+        qsort(entries, num, sizeof(Entry), olderFirst);
+        for(i = 0; i < num; ++i) {
+            if(total > maxBytes) {
+                snprintf(path, FILENAME_MAX, "%s/%s", dir, entries[i].name);
+                // someone else may have removed it already
+                if((remove(path) == 0) || (access(path, F_OK) != 0)) {
+                    total -= entries[i].bytes;
+                    evicted++;
+                }
+            }
+            free(entries[i].name);
+        }
+        free(entries);
+        *kept = total;
+    }
+#endif
+    return evicted;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/* on-disk parse cache. An entry is the AST image (with diagnostics) of
+   one source text, named after a hash of the bytes and their length, so
+   unchanged files skip scanning and parsing. Entries are written under a
+   temporary name and renamed into place, which makes concurrent
+   compilers and processes sharing a directory safe. */
+
+// bump whenever the parser's trees or diagnostics change
+#define CACHE_VERSION 1
+
+typedef struct _CacheKey {
+    unsigned long long hash;
+    unsigned long len;
+} CacheKey;
+
+// create dir if needed; FALSE if it isn't a usable directory
+int cacheOpen(const char *dir);
+// options: anything besides the source that changes the result, 0 if none
+CacheKey cacheKey(const char *src, size_t len, unsigned int options);
+// the entry for key, or NULL on a miss; a hit counts as a use for eviction
+FlatTree *cacheLoad(const char *dir, CacheKey key);
+// worker keeps temporary names apart within a process; FALSE on failure
+int cacheStore(const char *dir, CacheKey key, const FlatTree *f, int worker);
+/* evict least recently used entries until the rest fit in maxBytes.
+   Returns how many were removed; *kept gets the bytes left. */
+long cacheTrim(const char *dir, unsigned long long maxBytes, unsigned long long *kept);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,529 @@
+#include <stdarg.h>
+
+#include "globals.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "select.h"
+#include "codegen.h"
+
+static const char *regs64[RA_NUMREGS + 1] = {
+    "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "rbx", "r12", "r13", "r14", "r15", "r11"
+};
+static const char *regs32[RA_NUMREGS + 1] = {
+    "eax", "ecx", "edx", "esi", "edi", "r8d", "r9d", "r10d", "ebx", "r12d", "r13d", "r14d", "r15d", "r11d"
+};
+static const char *regs8[RA_NUMREGS + 1] = {
+    "al", "cl", "dl", "sil", "dil", "r8b", "r9b", "r10b", "bl", "r12b", "r13b", "r14b", "r15b", "r11b"
+};
+
+// condition codes of LT..NE, and of their opposites
+static const char *conds[] = {"l", "le", "g", "ge", "e", "ne"};
+static const char *negated[] = {"ge", "g", "le", "l", "ne", "e"};
+
+static const char runtime[] =
+    "\t.text\n"
+    "\t.globl\tmain\n"
+    "\t.type\tmain, @function\n"
+    "main:\n"
+    "\tsubq\t$8, %rsp\n"
+    "\tcall\tcm_main\n"
+    "\txorl\t%eax, %eax\n"
+    "\taddq\t$8, %rsp\n"
+    "\tret\n"
+    "cm_input:\n"
+    "\tsubq\t$24, %rsp\n"
+    "\tmovl\t$0, 12(%rsp)\n"
+    "\tleaq\t.Lin(%rip), %rdi\n"
+    "\tleaq\t12(%rsp), %rsi\n"
+    "\txorl\t%eax, %eax\n"
+    "\tcall\tscanf@PLT\n"
+    "\tmovl\t12(%rsp), %eax\n"
+    "\taddq\t$24, %rsp\n"
+    "\tret\n"
+    "cm_output:\n"
+    "\tsubq\t$8, %rsp\n"
+    "\tmovl\t%edi, %esi\n"
+    "\tleaq\t.Lout(%rip), %rdi\n"
+    "\txorl\t%eax, %eax\n"
+    "\tcall\tprintf@PLT\n"
+    "\taddq\t$8, %rsp\n"
+    "\tret\n"
+    "\t.section\t.rodata\n"
+    ".Lin:\n"
+    "\t.string\t\"%d\"\n"
+    ".Lout:\n"
+    "\t.string\t\"%d\\n\"\n"
+    "\t.section\t.note.GNU-stack,\"\",@progbits\n";
+
+typedef struct _Emitter {
+    Select s;
+    const InternTable *names;
+    FILE *out;
+    char text[3][32];       // operands of the instruction being written
+} Emitter;
+
+static void ins(Emitter *e, const char *fmt, ...) {
+    va_list args;
+
+    fputc('\t', e->out);
+    va_start(args, fmt);
+    vfprintf(e->out, fmt, args);
+    va_end(args);
+    fputc('\n', e->out);
+}
+
+// operand as the assembler writes it, into text k
+static const char *where(Emitter *e, int k, int operand, int loc, int size) {
+    char *s = e->text[k];
+
+    if(IR_ISCONST(operand)) {
+        sprintf(s, "$%d", e->s.m->consts[IR_CONSTINDEX(operand)]);
+    }
+    else if(RA_ISINCOMING(loc) || RA_ISSLOT(loc)) {
+        sprintf(s, "%d(%%rbp)", frameOffset(&e->s, loc));
+    }
+    else {
+        sprintf(s, "%%%s", (size == 8) ? regs64[loc] : regs32[loc]);
+    }
+    return s;
+}
+
+static void moveLoc(Emitter *e, int from, int to) {
+    if(isMem(IR_NONE, from) && isMem(IR_NONE, to)) {
+        ins(e, "movq\t%s, %%r11", where(e, 0, IR_NONE, from, 8));
+        ins(e, "movq\t%%r11, %s", where(e, 0, IR_NONE, to, 8));
+    }
+    else {
+        ins(e, "movq\t%s, %s", where(e, 0, IR_NONE, from, 8), where(e, 1, IR_NONE, to, 8));
+    }
+}
+
+static void emitMoves(Emitter *e, int place) {
+    const RaMove *mv;
+    int k;
+
+    for(k = e->s.ra->moveStart[place]; k < e->s.ra->moveStart[place + 1]; ++k) {
+        mv = &e->s.ra->moves[k];
+        if(mv->swap) {
+            ins(e, "xchgq\t%%%s, %%%s", regs64[mv->from], regs64[mv->to]);
+        }
+        else {
+            moveLoc(e, mv->from, mv->to);
+        }
+    }
+}
+
+// an int operand into register r, unless it is there already
+static void loadInt(Emitter *e, int operand, int loc, int r) {
+    if(regOf(operand, loc) != r) {
+        ins(e, "movl\t%s, %%%s", where(e, 0, operand, loc, 4), regs32[r]);
+    }
+}
+
+// the result, computed in r, to where dst lives
+static void storeResult(Emitter *e, int r, int loc) {
+    if(r != loc) {
+        ins(e, "movq\t%%%s, %s", regs64[r], where(e, 0, IR_NONE, loc, 8));
+    }
+}
+
+// an address operand into its base register
+static int loadBase(Emitter *e, int operand, int loc) {
+    int r = baseReg(operand, loc);
+
+    if(r == SCRATCH) {
+        ins(e, "movq\t%s, %%r11", where(e, 0, operand, loc, 8));
+    }
+    return r;
+}
+
+// the memory LOAD or STORE i reaches
+static const char *memOperand(Emitter *e, int b, int i) {
+    const IrInst *ix = &e->s.m->insts[i - 1];
+    const int *lx = &e->s.ra->locs[3 * (i - 1)];
+    char *s = e->text[2];
+
+    if((i > e->s.m->blocks[b].start) && fusedIndex(&e->s, b, i - 1)) {
+        if(IR_ISCONST(ix->b)) {
+            sprintf(s, "%d(%%%s)", 4 * e->s.m->consts[IR_CONSTINDEX(ix->b)], regs64[lx[1]]);
+        }
+        else {
+            ins(e, "movslq\t%s, %%r11", where(e, 0, ix->b, lx[2], 4));
+            sprintf(s, "(%%%s,%%r11,4)", regs64[lx[1]]);
+        }
+    }
+    else {
+        sprintf(s, "(%%%s)", regs64[loadBase(e, e->s.m->insts[i].a, e->s.ra->locs[3 * i + 1])]);
+    }
+    return s;
+}
+
+static void epilogue(Emitter *e) {
+    int k;
+
+    if(e->s.numSaved > 0) {
+        ins(e, "leaq\t%d(%%rbp), %%rsp", -8 * e->s.numSaved);
+        for(k = e->s.numSaved - 1; k >= 0; --k) {
+            ins(e, "popq\t%%%s", regs64[e->s.saved[k]]);
+        }
+        ins(e, "popq\t%%rbp");
+    }
+    else {
+        ins(e, "leave");
+    }
+    ins(e, "ret");
+}
+
+static void arithmetic(Emitter *e, const IrInst *in, const int *loc) {
+    static const char *names[] = {"addl", "subl", "imull"};
+    int a = in->a, la = loc[1];
+    int b = in->b, lb = loc[2];
+    int w, t;
+
+    if(swapsOperands(in, loc)) {
+        t = a, a = b, b = t;
+        t = la, la = lb, lb = t;
+    }
+    w = ((regOf(b, lb) >= 0) && (regOf(b, lb) == loc[0])) ? SCRATCH : workReg(loc[0]);
+    loadInt(e, a, la, w);
+    if((in->op == IR_MUL) && IR_ISCONST(b)) {
+        ins(e, "imull\t%s, %%%s, %%%s", where(e, 0, b, lb, 4), regs32[w], regs32[w]);
+    }
+    else {
+        ins(e, "%s\t%s, %%%s", names[in->op - IR_ADD], where(e, 0, b, lb, 4), regs32[w]);
+    }
+    storeResult(e, w, loc[0]);
+}
+
+// a divisor of -1 negates and skips the idiv, which would trap on the smallest int
+static void divide(Emitter *e, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    const char *divisor;
+    int rb = regOf(in->b, loc[2]);
+
+    if(IR_ISCONST(in->b) && (e->s.m->consts[IR_CONSTINDEX(in->b)] == -1)) {
+        loadInt(e, in->a, loc[1], RA_RAX);
+        ins(e, "negl\t%%eax");
+        if(loc[0] != IR_NONE) {
+            storeResult(e, RA_RAX, loc[0]);
+        }
+        return;
+    }
+
+    // cltd and the dividend take rax and rdx
+    if(IR_ISCONST(in->b) || (rb == RA_RAX) || (rb == RA_RDX)) {
+        loadInt(e, in->b, loc[2], SCRATCH);
+        divisor = "%r11d";
+    }
+    else {
+        divisor = where(e, 1, in->b, loc[2], 4);
+    }
+    if(!IR_ISCONST(in->b)) {
+        ins(e, "cmpl\t$-1, %s", divisor);
+        ins(e, "jne\t.LD%d", i);
+        loadInt(e, in->a, loc[1], RA_RAX);
+        ins(e, "negl\t%%eax");
+        ins(e, "jmp\t.LQ%d", i);
+        fprintf(e->out, ".LD%d:\n", i);
+    }
+    loadInt(e, in->a, loc[1], RA_RAX);
+    ins(e, "cltd");
+    ins(e, "idivl\t%s", divisor);
+    if(!IR_ISCONST(in->b)) {
+        fprintf(e->out, ".LQ%d:\n", i);
+    }
+    if(loc[0] != IR_NONE) {
+        storeResult(e, RA_RAX, loc[0]);
+    }
+}
+
+// flags for a against b, and the result as 0 or 1 if anything reads it
+static void compare(Emitter *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    const char *left;
+    int w;
+
+    if(IR_ISCONST(in->a) || (isMem(in->a, loc[1]) && isMem(in->b, loc[2]))) {
+        loadInt(e, in->a, loc[1], SCRATCH);
+        left = "%r11d";
+    }
+    else {
+        left = where(e, 1, in->a, loc[1], 4);
+    }
+    ins(e, "cmpl\t%s, %s", where(e, 0, in->b, loc[2], 4), left);
+    if((loc[0] == IR_NONE) || keepsFlags(&e->s, b, i)) {
+        return;
+    }
+    w = workReg(loc[0]);
+    ins(e, "set%s\t%%%s", conds[in->op - IR_LT], regs8[w]);
+    ins(e, "movzbl\t%%%s, %%%s", regs8[w], regs32[w]);
+    storeResult(e, w, loc[0]);
+}
+
+static void address(Emitter *e, const IrInst *in, const int *loc) {
+    const IrSlot *s = &e->s.m->slots[in->a];
+    int w = workReg(loc[0]);
+
+    if(s->func < 0) {
+        ins(e, "leaq\tcm_%s(%%rip), %%%s", symName(e->names, s->sym), regs64[w]);
+    }
+    else {
+        ins(e, "leaq\t%d(%%rbp), %%%s", e->s.offsets[in->a], regs64[w]);
+    }
+    storeResult(e, w, loc[0]);
+}
+
+// a + 4 * b, with b sign-extended
+static void indexed(Emitter *e, const IrInst *in, const int *loc) {
+    int w = workReg(loc[0]);
+    int base;
+
+    if(IR_ISCONST(in->b)) {
+        base = loadBase(e, in->a, loc[1]);
+        ins(e, "leaq\t%d(%%%s), %%%s", 4 * e->s.m->consts[IR_CONSTINDEX(in->b)], regs64[base], regs64[w]);
+    }
+    else if(regOf(in->a, loc[1]) >= 0) {
+        ins(e, "movslq\t%s, %%r11", where(e, 0, in->b, loc[2], 4));
+        ins(e, "leaq\t(%%%s,%%r11,4), %%%s", regs64[loc[1]], regs64[w]);
+    }
+    else {
+        ins(e, "movslq\t%s, %%r11", where(e, 0, in->b, loc[2], 4));
+        ins(e, "salq\t$2, %%r11");
+        ins(e, "addq\t%s, %%r11", where(e, 0, in->a, loc[1], 8));
+        w = SCRATCH;
+    }
+    storeResult(e, w, loc[0]);
+}
+
+static void load(Emitter *e, int b, int i) {
+    const int *loc = &e->s.ra->locs[3 * i];
+    const char *mem = memOperand(e, b, i);
+    int w = workReg(loc[0]);
+
+    ins(e, "movl\t%s, %%%s", mem, regs32[w]);
+    storeResult(e, w, loc[0]);
+}
+
+static void store(Emitter *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    const char *mem;
+
+    if(!isMem(in->b, loc[2])) {
+        mem = memOperand(e, b, i);
+        ins(e, "movl\t%s, %s", where(e, 1, in->b, loc[2], 4), mem);
+    }
+    else if((regOf(in->a, loc[1]) >= 0) || ((i > e->s.m->blocks[b].start) && fusedIndex(&e->s, b, i - 1))) {
+        loadInt(e, in->b, loc[2], SCRATCH);
+        mem = memOperand(e, b, i);
+        ins(e, "movl\t%%r11d, %s", mem);
+    }
+    else {
+        // both in memory: rax lends a hand, the slots are off rbp
+        ins(e, "pushq\t%%rax");
+        ins(e, "movq\t%s, %%rax", where(e, 0, in->a, loc[1], 8));
+        loadInt(e, in->b, loc[2], SCRATCH);
+        ins(e, "movl\t%%r11d, (%%rax)");
+        ins(e, "popq\t%%rax");
+    }
+}
+
+static void call(Emitter *e, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    int n = in->b;
+    int onStack = (n > 6) ? n - 6 : 0;
+    int pad = onStack & 1;
+    int direct = directArgs(&e->s, i);
+    int j, op, l;
+
+    if(pad) {
+        ins(e, "subq\t$8, %%rsp");
+    }
+    for(j = n - 1; j >= (direct ? 6 : 0); --j) {
+        op = e->s.m->insts[i - n + j].a;
+        l = e->s.ra->locs[3 * (i - n + j) + 1];
+        ins(e, "pushq\t%s", where(e, 0, op, l, 8));
+    }
+    for(j = 0; (j < n) && (j < 6); ++j) {
+        if(direct) {
+            op = e->s.m->insts[i - n + j].a;
+            l = e->s.ra->locs[3 * (i - n + j) + 1];
+            if(regOf(op, l) != argReg(j)) {
+                ins(e, "movq\t%s, %%%s", where(e, 0, op, l, 8), regs64[argReg(j)]);
+            }
+        }
+        else {
+            ins(e, "popq\t%%%s", regs64[argReg(j)]);
+        }
+    }
+    ins(e, "call\tcm_%s", symName(e->names, in->a));
+    if(onStack + pad > 0) {
+        ins(e, "addq\t$%d, %%rsp", 8 * (onStack + pad));
+    }
+    if((in->dst != IR_NONE) && (loc[0] != IR_NONE)) {
+        storeResult(e, RA_RAX, loc[0]);
+    }
+}
+
+static void branch(Emitter *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    char target[32];
+
+    if(branchEdge(&e->s, b)) {
+        sprintf(target, ".LE%d", b);
+    }
+    else {
+        sprintf(target, ".LB%d", jumpTarget(&e->s, in->b));
+    }
+    if(IR_ISCONST(in->a)) {
+        if(e->s.m->consts[IR_CONSTINDEX(in->a)] == 0) {
+            ins(e, "jmp\t%s", target);
+        }
+        return;
+    }
+    if(branchesOnFlags(&e->s, b, i)) {
+        ins(e, "j%s\t%s", negated[e->s.m->insts[i - 1].op - IR_LT], target);
+        return;
+    }
+    if(isMem(in->a, loc[1])) {
+        ins(e, "cmpl\t$0, %s", where(e, 0, in->a, loc[1], 4));
+    }
+    else {
+        ins(e, "testl\t%%%s, %%%s", regs32[loc[1]], regs32[loc[1]]);
+    }
+    ins(e, "je\t%s", target);
+}
+
+static void emitInst(Emitter *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+
+    if(!emitsCode(&e->s, b, i)) {
+        return;
+    }
+    switch(in->op) {
+        case IR_MOV:
+            if(IR_ISCONST(in->a)) {
+                ins(e, "movq\t%s, %s", where(e, 0, in->a, loc[1], 8), where(e, 1, in->dst, loc[0], 8));
+            }
+            else {
+                moveLoc(e, loc[1], loc[0]);
+            }
+            break;
+        case IR_ADD: case IR_SUB: case IR_MUL:
+            arithmetic(e, in, loc);
+            break;
+        case IR_DIV:
+            divide(e, i);
+            break;
+        case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+            compare(e, b, i);
+            break;
+        case IR_ADDR:
+            address(e, in, loc);
+            break;
+        case IR_INDEX:
+            indexed(e, in, loc);
+            break;
+        case IR_LOAD:
+            load(e, b, i);
+            break;
+        case IR_STORE:
+            store(e, b, i);
+            break;
+        case IR_ARG:
+            break;
+        case IR_CALL:
+            call(e, i);
+            break;
+        case IR_RET:
+            if(in->a != IR_NONE) {
+                loadInt(e, in->a, loc[1], RA_RAX);
+            }
+            epilogue(e);
+            break;
+        case IR_JMP:
+            emitMoves(e, RA_EDGE(e->s.m, b, 0));
+            if(jumpTarget(&e->s, in->a) != b + 1) {
+                ins(e, "jmp\t.LB%d", jumpTarget(&e->s, in->a));
+            }
+            break;
+        case IR_BRZ:
+            branch(e, b, i);
+            emitMoves(e, RA_EDGE(e->s.m, b, 0));
+            break;
+    }
+}
+
+static void prologue(Emitter *e) {
+    int k;
+
+    ins(e, "pushq\t%%rbp");
+    ins(e, "movq\t%%rsp, %%rbp");
+    for(k = 0; k < e->s.numSaved; ++k) {
+        ins(e, "pushq\t%%%s", regs64[e->s.saved[k]]);
+    }
+    if(e->s.frameBytes > 0) {
+        ins(e, "subq\t$%d, %%rsp", e->s.frameBytes);
+    }
+}
+
+static void emitFunction(Emitter *e, int fi) {
+    const IrModule *m = e->s.m;
+    const IrFunc *f = &m->funcs[fi];
+    const char *name = symName(e->names, f->sym);
+    int b, i;
+
+    selectFunction(&e->s, fi);
+    fprintf(e->out, "\t.p2align 4\n\t.type\tcm_%s, @function\ncm_%s:\n", name, name);
+    prologue(e);
+    emitMoves(e, RA_ENTRY(m, fi));
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        fprintf(e->out, ".LB%d:\n", b);
+        for(i = m->blocks[b].start; i < m->blocks[b].end; ++i) {
+            emitMoves(e, RA_BEFORE(i));
+            emitInst(e, b, i);
+        }
+        if(fallsThrough(&e->s, b)) {
+            emitMoves(e, RA_EDGE(m, b, 0));
+        }
+    }
+    if(runsOff(&e->s)) {
+        epilogue(e);
+    }
+
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        if(branchEdge(&e->s, b)) {
+            fprintf(e->out, ".LE%d:\n", b);
+            emitMoves(e, RA_EDGE(m, b, 1));
+            ins(e, "jmp\t.LB%d", jumpTarget(&e->s, m->insts[m->blocks[b].end - 1].b));
+        }
+    }
+}
+
+void emitAssembly(const IrModule *m, const RegAlloc *ra, const InternTable *names, FILE *out) {
+    Emitter e;
+    int i;
+
+    memset(&e, 0, sizeof(Emitter));
+    initSelect(&e.s, m, ra);
+    e.names = names;
+    e.out = out;
+
+    fprintf(out, "\t.bss\n");
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func < 0) {
+            fprintf(out, "\t.p2align 3\ncm_%s:\n\t.zero\t%d\n", symName(names, m->slots[i].sym), 4 * m->slots[i].size);
+        }
+    }
+    fprintf(out, "\t.text\n");
+    for(i = 0; i < m->numFuncs; ++i) {
+        emitFunction(&e, i);
+    }
+    fputs(runtime, out);
+    freeSelect(&e.s);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef _CODEGEN_H_
+#define _CODEGEN_H_
+
+/* x86-64 assembly for the GNU assembler from code with registers
+   allocated, in AT&T syntax. Functions and globals are named after their
+   declarations with a cm_ prefix, so they can't collide with the C
+   library. Ints are computed in 32 bits and kept in 64-bit registers and
+   slots with addresses. Functions follow the SysV ABI, with frames laid
+   out by select.h. Division by zero traps, dividing the smallest int by
+   -1 gives the smallest int, and locals start out with whatever was
+   there.
+
+   The output ends with a runtime: main calls cm_main, and input() and
+   output() read and print one int with scanf and printf. It builds with
+   cc -o prog prog.s. */
+void emitAssembly(const IrModule *m, const RegAlloc *ra, const InternTable *names, FILE *out);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "globals.h"
+#include "scan.h"
+#include "parse.h"
+#include "skip.h"
+#include "tokens.h"
+#include "fold.h"
+#include "compile.h"
+
+void initContext(CompileContext *ctx, FILE *out) {
+    memset(ctx, 0, sizeof(CompileContext));
+    ctx->out = out;
+    ctx->skipper = bestSkipper();
+}
+
+void freeContext(CompileContext *ctx) {
+    closeSource(ctx);
+    freeTokens(ctx);
+    freeParser(ctx);
+    arenaFree(&ctx->tree);
+    internFree(&ctx->names);
+    freeSymTable(&ctx->scopes);
+    freeChecker(&ctx->checker);
+}
+
+// fresh per-compilation state, then parse whatever source is set
+static TreeNode *run(CompileContext *ctx) {
+    TreeNode *t;
+
+    ctx->Error = FALSE;
+    t = parse(ctx);
+    if(ctx->checks == CHECK_PASS) {
+        checkTree(ctx, t);
+    }
+    if(ctx->fold) {
+        t = foldTree(ctx, t);
+    }
+    return t;
+}
+
+TreeNode *compile(CompileContext *ctx, const char *src, size_t len) {
+    releaseTree(ctx);
+    setSource(ctx, src, len);
+    return run(ctx);
+}
+
+int compileFile(CompileContext *ctx, FILE *fp, TreeNode **tree) {
+    releaseTree(ctx);
+    if(!openSource(ctx, fp)) {
+        *tree = NULL;
+        return FALSE;
+    }
+    *tree = run(ctx);
+    return TRUE;
+}
+
+TreeNode *compileSource(CompileContext *ctx) {
+    releaseTree(ctx);
+    rewindSource(ctx);
+    return run(ctx);
+}
+
+int checkCompiled(CompileContext *ctx, TreeNode *tree) {
+    if(ctx->checks == CHECK_NONE) {
+        checkTree(ctx, tree);
+    }
+    return !ctx->Error;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef _COMPILE_H_
+#define _COMPILE_H_
+
+// dump and diagnostics go to out
+void initContext(CompileContext *ctx, FILE *out);
+void freeContext(CompileContext *ctx);
+
+/* parse src[0, len) into a tree owned by ctx until its next compile. The
+   buffer must stay alive as long as the tree is used. */
+TreeNode *compile(CompileContext *ctx, const char *src, size_t len);
+// same for a whole file; FALSE if it can't be read
+int compileFile(CompileContext *ctx, FILE *fp, TreeNode **tree);
+// parse the source already set in ctx again, from its start
+TreeNode *compileSource(CompileContext *ctx);
+/* run the semantic checks on the last tree if the compile didn't, as the
+   back ends need them; FALSE if it has errors of any kind */
+int checkCompiled(CompileContext *ctx, TreeNode *tree);
+
+#endif
\ No newline at end of file
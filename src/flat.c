@@ -0,0 +1,283 @@
+#include "globals.h"
+#include "util.h"
+#include "intern.h"
+#include "flat.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// child slots actually used by t
+static int numSlots(TreeNode *t) {
+    int n = MAXCHILDREN;
+
+    while((n > 0) && (t->child[n-1] == NULL)) {
+        n--;
+    }
+    return n;
+}
+
+/* nodes still to visit, and where each one's handle goes once it has one.
+   Handles are given in preorder, so a node's sibling goes under its
+   children. */
+typedef struct _Pending {
+    TreeNode *t;
+    NodeId *link;
+} Pending;
+
+// room for a node's sibling and children on top of the stack
+static Pending *reserve(Pending *stack, int *size, int top) {
+    if((stack == NULL) || (top + MAXCHILDREN + 1 > *size)) {
+        *size = (stack == NULL) ? 64 : *size * 2;
+        stack = (Pending *)realloc(stack, sizeof(Pending) * *size);
+        if(stack == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return stack;
+}
+
+static void countList(TreeNode *t, unsigned int *nodes, unsigned int *kids) {
+    Pending *stack = NULL;
+    int size = 0;
+    int top = 0;
+    int i;
+
+    stack = reserve(stack, &size, top);
+    stack[top++].t = t;
+    while(top > 0) {
+        t = stack[--top].t;
+        if(t == NULL) {
+            continue;
+        }
+        (*nodes)++;
+        *kids += numSlots(t);
+
+        stack = reserve(stack, &size, top);
+        stack[top++].t = t->sibling;
+        for(i = MAXCHILDREN - 1; i >= 0; --i) {
+            stack[top++].t = t->child[i];
+        }
+    }
+    free(stack);
+}
+
+static unsigned int packInfo(TreeNode *t, int slots) {
+    unsigned int w = (unsigned int)t->nodeKind & 0x3;
+
+    w |= ((unsigned int)t->kind.exp & 0x7) << 2;
+    if((t->nodeKind == ExpK) && (t->kind.exp == Op)) {
+        w |= ((unsigned int)t->op & 0x1f) << 5;
+    }
+    w |= (unsigned int)(t->type == Int) << 10;
+    w |= (unsigned int)(t->arrayType != FALSE) << 11;
+    w |= (unsigned int)slots << 12;
+    return w;
+}
+
+// val only means something for array sizes and constants
+static int nodeVal(TreeNode *t) {
+    if((t->nodeKind == DecK) && (t->kind.dec == VarDeclaration) && t->arrayType) {
+        return t->val;
+    }
+    if((t->nodeKind == ExpK) && (t->kind.exp == Constant)) {
+        return t->val;
+    }
+    return 0;
+}
+
+// lay out the sibling list starting at t in preorder
+static void flattenList(FlatTree *f, TreeNode *t, unsigned int *nextKid) {
+    Pending *stack = NULL;
+    NodeId root = NULLNODE;
+    NodeId *link;
+    NodeId n;
+    int size = 0;
+    int top = 0;
+    int slots;
+    int i;
+
+    stack = reserve(stack, &size, top);
+    stack[top].t = t;
+    stack[top++].link = &root;
+    while(top > 0) {
+        t = stack[--top].t;
+        link = stack[top].link;
+        if(t == NULL) {
+            continue;
+        }
+        n = f->count++;
+        *link = n;
+        slots = numSlots(t);
+
+        f->info[n] = packInfo(t, slots);
+        f->val[n] = nodeVal(t);
+        f->sym[n] = t->sym;
+        f->lineno[n] = t->lineno;
+        f->sibling[n] = NULLNODE;
+        f->kidStart[n] = *nextKid;
+        *nextKid += slots;
+
+        stack = reserve(stack, &size, top);
+        stack[top].t = t->sibling;
+        stack[top++].link = &f->sibling[n];
+        for(i = slots - 1; i >= 0; --i) {
+            f->kids[f->kidStart[n] + i] = NULLNODE;
+            stack[top].t = t->child[i];
+            stack[top++].link = &f->kids[f->kidStart[n] + i];
+        }
+    }
+    free(stack);
+}
+
+// u32 words for the arrays of a tree this size, strings rounded up
+static size_t blockWords(unsigned int nodes, unsigned int kids, unsigned int syms, unsigned int strBytes) {
+    return 6 * (size_t)nodes + kids + (syms + 1) + (strBytes + 3) / 4;
+}
+
+FlatTree *flattenTree(CompileContext *ctx, TreeNode *t) {
+    FlatTree *f = (FlatTree *)malloc(sizeof(FlatTree));
+    unsigned int nodes = 1;
+    unsigned int kids = 0;
+    unsigned int syms = (unsigned int)symCount(&ctx->names);
+    unsigned int strBytes = 0;
+    unsigned int *p;
+    unsigned int nextKid = 0;
+    unsigned int i;
+
+    countList(t, &nodes, &kids);
+    for(i = 0; i < syms; ++i) {
+        strBytes += (unsigned int)symLength(&ctx->names, (int)i) + 1;
+    }
+
+    // one block: six per-node arrays, the child slots, then the names
+    p = (unsigned int *)malloc(sizeof(unsigned int) * blockWords(nodes, kids, syms, strBytes));
+    if((f == NULL) || (p == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    f->mem = p;
+    f->mapped = 0;
+    f->info = p;
+    f->val = (int *)(p + nodes);
+    f->sym = (int *)(p + 2 * (size_t)nodes);
+    f->lineno = (int *)(p + 3 * (size_t)nodes);
+    f->sibling = p + 4 * (size_t)nodes;
+    f->kidStart = p + 5 * (size_t)nodes;
+    f->kids = p + 6 * (size_t)nodes;
+    f->numKids = kids;
+    f->strStart = f->kids + kids;
+    f->strings = (char *)(f->strStart + syms + 1);
+    f->numSyms = syms;
+    f->strBytes = strBytes;
+    f->diag = NULL;
+    f->diagBytes = 0;
+
+    // sym ids stay the same, only the storage moves
+    strBytes = 0;
+    for(i = 0; i < syms; ++i) {
+        unsigned int len = (unsigned int)symLength(&ctx->names, (int)i) + 1;
+
+        f->strStart[i] = strBytes;
+        memcpy(f->strings + strBytes, symName(&ctx->names, (int)i), len);
+        strBytes += len;
+    }
+    f->strStart[syms] = strBytes;
+    memset(f->strings + strBytes, 0, (size_t)((4 - strBytes % 4) % 4));
+
+    // handle 0 is the null node
+    f->info[0] = 0;
+    f->val[0] = 0;
+    f->sym[0] = NOSYM;
+    f->lineno[0] = 0;
+    f->sibling[0] = NULLNODE;
+    f->kidStart[0] = 0;
+    f->count = 1;
+
+    flattenList(f, t, &nextKid);
+    return f;
+}
+
+void freeFlatTree(FlatTree *f) {
+    if(f != NULL) {
+#ifndef _WIN32
+        if(f->mapped) {
+            munmap(f->mem, f->mapped);
+        }
+        else
+#endif
+        free(f->mem);
+        free(f);
+    }
+}
+
+size_t flatTreeBytes(const FlatTree *f) {
+    return sizeof(unsigned int) * blockWords(f->count, f->numKids, f->numSyms, f->strBytes);
+}
+
+// same traversal as printTree, over handles
+void printFlatTree(CompileContext *ctx, const FlatTree *f, NodeId n) {
+    OutBuf *b;
+    NodeId *stack;
+    int *depths;
+    TreeNode t;
+    unsigned int w;
+    int top = 0;
+    int size = 64;
+    int depth;
+    int i;
+
+    b = (OutBuf *)malloc(sizeof(OutBuf));
+    stack = (NodeId *)malloc(sizeof(NodeId) * size);
+    depths = (int *)malloc(sizeof(int) * size);
+    if((b == NULL) || (stack == NULL) || (depths == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    outInit(b, ctx->out);
+
+    stack[top] = n;
+    depths[top++] = 1;
+    while(top > 0) {
+        n = stack[--top];
+        depth = depths[top];
+        if(n == NULLNODE) {
+            continue;
+        }
+
+        // unpack into a scratch node so the dump matches printTree exactly
+        w = f->info[n];
+        t.nodeKind = FLAT_NODEKIND(w);
+        t.kind.exp = (ExpKind)FLAT_KIND(w);
+        t.op = FLAT_OP(w);
+        t.type = FLAT_TYPE(w);
+        t.arrayType = FLAT_ARRAY(w);
+        t.val = f->val[n];
+        t.name = FLAT_NAME(f, n);
+
+        outIndent(b, 2 * depth);
+        outNode(b, &t);
+
+        if(top + (int)FLAT_SLOTS(w) + 1 > size) {
+            size = 2 * size + (int)FLAT_SLOTS(w);
+            stack = (NodeId *)realloc(stack, sizeof(NodeId) * size);
+            depths = (int *)realloc(depths, sizeof(int) * size);
+            if((stack == NULL) || (depths == NULL)) {
+                fprintf(stderr, "memory allocation error. exiting...\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        stack[top] = f->sibling[n];
+        depths[top++] = depth;
+        for(i = (int)FLAT_SLOTS(w) - 1; i >= 0; --i) {
+            stack[top] = f->kids[f->kidStart[n] + i];
+            depths[top++] = depth + 1;
+        }
+    }
+
+    outFlush(b);
+    free(depths);
+    free(stack);
+    free(b);
+}
\ No newline at end of file
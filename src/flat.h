@@ -0,0 +1,56 @@
+#ifndef _FLAT_H_
+#define _FLAT_H_
+
+/* compact, index-based copy of a syntax tree. Nodes live in parallel
+   arrays addressed by 32-bit handles in preorder; handle 0 is the null
+   node. A node's children are a range of slots in kids (one per
+   TreeNode.child up to the last non-empty one), each slot holding the
+   first node of that child's sibling list. Names are copied into a
+   string table indexed by sym, so the tree doesn't depend on the
+   context's intern table. */
+typedef unsigned int NodeId;
+
+#define NULLNODE 0
+
+/* info packs nodeKind, kind, op, type, arrayType and the slot count:
+   bits 0-1 nodeKind, 2-4 kind, 5-9 op, 10 type, 11 arrayType, 12-14 slots */
+#define FLAT_NODEKIND(w) ((NodeKind)((w) & 0x3))
+#define FLAT_KIND(w) (((w) >> 2) & 0x7)
+#define FLAT_OP(w) ((TokenType)(((w) >> 5) & 0x1f))
+#define FLAT_TYPE(w) ((ExpType)(((w) >> 10) & 0x1))
+#define FLAT_ARRAY(w) (((w) >> 11) & 0x1)
+#define FLAT_SLOTS(w) (((w) >> 12) & 0x7)
+
+typedef struct _FlatTree {
+    unsigned int count;      // nodes, including the null node
+    unsigned int numKids;    // entries in kids
+    unsigned int *info;
+    int *val;
+    int *sym;                // interned name, NOSYM if none
+    int *lineno;
+    NodeId *sibling;
+    unsigned int *kidStart;  // first slot of each node in kids
+    NodeId *kids;
+    unsigned int numSyms;    // names in the string table
+    unsigned int strBytes;
+    unsigned int *strStart;  // offset of each name in strings
+    char *strings;           // names, each NUL-terminated
+    const char *diag;        // diagnostics kept with an image, not owned
+    unsigned int diagBytes;
+    void *mem;               // single block behind all arrays
+    size_t mapped;           // mem is a read-only file mapping this long
+} FlatTree;
+
+#define FLAT_CHILD(f, n, i) \
+    (((unsigned int)(i) < FLAT_SLOTS((f)->info[n])) ? (f)->kids[(f)->kidStart[n] + (i)] : NULLNODE)
+#define FLAT_NAME(f, n) \
+    (((f)->sym[n] == NOSYM) ? (const char *)NULL : (f)->strings + (f)->strStart[(f)->sym[n]])
+
+// root of the flattened tree is handle 1, or NULLNODE for an empty tree
+FlatTree *flattenTree(CompileContext *ctx, TreeNode *t);
+void freeFlatTree(FlatTree *f);
+// size of the block behind the arrays
+size_t flatTreeBytes(const FlatTree *f);
+void printFlatTree(CompileContext *ctx, const FlatTree *f, NodeId n);
+
+#endif
\ No newline at end of file
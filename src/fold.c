@@ -0,0 +1,242 @@
+#include <limits.h>
+
+#include "globals.h"
+#include "fold.h"
+
+static TreeNode *foldList(CompileContext *ctx, TreeNode *t);
+
+static int isConstant(const TreeNode *t) {
+    return (t->nodeKind == ExpK) && (t->kind.exp == Constant);
+}
+
+static int isValue(const TreeNode *t, int val) {
+    return isConstant(t) && (t->val == val);
+}
+
+// t and everything under it, but not its siblings, onto the free list
+static void releaseNodes(CompileContext *ctx, TreeNode *t) {
+    TreeNode *c, *next;
+    int i;
+
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        for(c = t->child[i]; c != NULL; c = next) {
+            next = c->sibling;
+            releaseNodes(ctx, c);
+        }
+    }
+    t->sibling = ctx->freeNodes;
+    ctx->freeNodes = t;
+}
+
+// evaluating t can't call anything or assign to anything
+static int isPure(const TreeNode *t) {
+    const TreeNode *c;
+    int i;
+
+    if((t->nodeKind == StmtK) || ((t->nodeKind == ExpK) && (t->kind.exp == Assign))) {
+        return FALSE;
+    }
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        for(c = t->child[i]; c != NULL; c = c->sibling) {
+            if(!isPure(c)) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+// a and b are the same expression; names in one expression mean one variable
+static int sameExpr(const TreeNode *a, const TreeNode *b) {
+    int i;
+
+    if((a == NULL) || (b == NULL)) {
+        return a == b;
+    }
+    if((a->nodeKind != ExpK) || (b->nodeKind != ExpK) || (a->kind.exp != b->kind.exp)) {
+        return FALSE;
+    }
+    switch(a->kind.exp) {
+        case Constant:
+            return a->val == b->val;
+        case Id:
+            if((a->sym == NOSYM) || (a->sym != b->sym) || (a->arrayType != b->arrayType)) {
+                return FALSE;
+            }
+            break;
+        case Op:
+            if(a->op != b->op) {
+                return FALSE;
+            }
+            break;
+        default:
+            return FALSE;
+    }
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        if(!sameExpr(a->child[i], b->child[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// a op b as the program would compute it, FALSE if that must wait for run time
+static int evaluate(TokenType op, int a, int b, int *val) {
+    switch(op) {
+        case PLUS:
+            *val = (int)((unsigned int)a + (unsigned int)b);
+            return TRUE;
+        case MINUS:
+            *val = (int)((unsigned int)a - (unsigned int)b);
+            return TRUE;
+        case TIMES:
+            *val = (int)((unsigned int)a * (unsigned int)b);
+            return TRUE;
+        case OVER:
+            if((b == 0) || ((a == INT_MIN) && (b == -1))) {
+                return FALSE;
+            }
+            *val = a / b;
+            return TRUE;
+        case LESSTHAN:
+            *val = a < b;
+            return TRUE;
+        case LESSEQTHAN:
+            *val = a <= b;
+            return TRUE;
+        case GREATERTHAN:
+            *val = a > b;
+            return TRUE;
+        case GREATEREQTHAN:
+            *val = a >= b;
+            return TRUE;
+        case EQ:
+            *val = a == b;
+            return TRUE;
+        case NEQ:
+            *val = a != b;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// x op x for a pure x, FALSE if it depends on x
+static int sameOperands(TokenType op, int *val) {
+    switch(op) {
+        case MINUS: case LESSTHAN: case GREATERTHAN: case NEQ:
+            *val = 0;
+            return TRUE;
+        case LESSEQTHAN: case GREATEREQTHAN: case EQ:
+            *val = 1;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// t becomes the constant val; its operands go
+static TreeNode *toConstant(CompileContext *ctx, TreeNode *t, int val) {
+    releaseNodes(ctx, t->child[0]);
+    releaseNodes(ctx, t->child[1]);
+    t->child[0] = t->child[1] = NULL;
+    t->kind.exp = Constant;
+    t->op = ERROR;
+    t->val = val;
+    t->type = Int;
+    return t;
+}
+
+// t is replaced by its operand keep; the other operand and t go
+static TreeNode *toOperand(CompileContext *ctx, TreeNode *t, TreeNode *keep) {
+    TreeNode *drop = (keep == t->child[0]) ? t->child[1] : t->child[0];
+
+    keep->sibling = t->sibling;
+    releaseNodes(ctx, drop);
+    t->child[0] = t->child[1] = NULL;
+    releaseNodes(ctx, t);
+    return keep;
+}
+
+// t with folded operands, or what replaces it
+static TreeNode *foldOp(CompileContext *ctx, TreeNode *t) {
+    TreeNode *l = t->child[0];
+    TreeNode *r = t->child[1];
+    int val;
+
+    if((l == NULL) || (r == NULL)) {
+        return t;
+    }
+    if(isConstant(l) && isConstant(r)) {
+        return evaluate(t->op, l->val, r->val, &val) ? toConstant(ctx, t, val) : t;
+    }
+
+    switch(t->op) {
+        case PLUS:
+            if(isValue(r, 0)) {
+                return toOperand(ctx, t, l);
+            }
+            if(isValue(l, 0)) {
+                return toOperand(ctx, t, r);
+            }
+            break;
+        case MINUS:
+            if(isValue(r, 0)) {
+                return toOperand(ctx, t, l);
+            }
+            break;
+        case TIMES:
+            if(isValue(r, 1)) {
+                return toOperand(ctx, t, l);
+            }
+            if(isValue(l, 1)) {
+                return toOperand(ctx, t, r);
+            }
+            if(isValue(r, 0) && isPure(l)) {
+                return toOperand(ctx, t, r);
+            }
+            if(isValue(l, 0) && isPure(r)) {
+                return toOperand(ctx, t, l);
+            }
+            break;
+        case OVER:
+            if(isValue(r, 1)) {
+                return toOperand(ctx, t, l);
+            }
+            break;
+        default:
+            break;
+    }
+    if(sameOperands(t->op, &val) && isPure(l) && sameExpr(l, r)) {
+        return toConstant(ctx, t, val);
+    }
+    return t;
+}
+
+/* children first, so constants come up from the leaves. Recursion only
+   goes as deep as the parser's did. */
+static TreeNode *foldNode(CompileContext *ctx, TreeNode *t) {
+    int i;
+
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        t->child[i] = foldList(ctx, t->child[i]);
+    }
+    if((t->nodeKind == ExpK) && (t->kind.exp == Op)) {
+        return foldOp(ctx, t);
+    }
+    return t;
+}
+
+static TreeNode *foldList(CompileContext *ctx, TreeNode *t) {
+    TreeNode **link = &t;
+
+    while(*link != NULL) {
+        *link = foldNode(ctx, *link);
+        link = &(*link)->sibling;
+    }
+    return t;
+}
+
+TreeNode *foldTree(CompileContext *ctx, TreeNode *tree) {
+    return foldList(ctx, tree);
+}
\ No newline at end of file
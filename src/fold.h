@@ -0,0 +1,13 @@
+#ifndef _FOLD_H_
+#define _FOLD_H_
+
+/* constant folding over a parsed tree. An Op with two constant operands
+   becomes a constant, in int arithmetic that wraps on overflow; division
+   by zero and INT_MIN / -1 are left for run time. x+0, 0+x, x-0, x*1, 1*x
+   and x/1 become x. x*0, x-x and comparisons of x with itself become a
+   constant when x has no calls or assignments in it. A folded Op node is
+   reused for the constant, and nodes that drop out go on the context's
+   free list, which createNewNode takes from before the arena. */
+TreeNode *foldTree(CompileContext *ctx, TreeNode *tree);
+
+#endif
\ No newline at end of file
@@ -17,7 +17,6 @@
 #endif
 
 #define MAXTOKENLEN 45
-#define MAXRESERVED 6
 
 typedef enum {
     ENDFILE, ERROR,
@@ -29,12 +28,6 @@ typedef enum {
     LRNDBRKT, RRNDBRKT, LCURLBRKT, RCURLBRKT, LSQRBRKT, RSQRBRKT,
 }TokenType;
 
-extern FILE* inputfile;
-extern FILE* outputfile;
-
-extern int lineno;
-extern int PrintScan;
-
 typedef enum {DecK, StmtK, ExpK} NodeKind;
 typedef enum {VarDeclaration, FunctionDeclaration, ParamDeclaration} DecKind;
 typedef enum {Compound, Selection, Iteration, Return, Call} StmtKind;
@@ -52,10 +45,84 @@ typedef struct treeNode {
     union { DecKind dec; StmtKind stmt; ExpKind exp; } kind;
     TokenType op; 
     int val; 
-    char *name;
+    const char *name;
+    int sym;
     ExpType type;
     int arrayType;
+    struct treeNode *decl;      // Id and Call: what the name refers to, see analyze.c
 } TreeNode;
 
-extern int Error;
+#include "arena.h"
+#include "intern.h"
+#include "symtab.h"
+#include "analyze.h"
+
+/* one lexed token: where it is, what it is and its line. Kind is in the
+   low 8 bits of info, the length in bytes above it. */
+typedef struct _Token {
+    unsigned int offset;
+    unsigned int info;
+    int line;
+} Token;
+
+#define TOKEN_KIND(t) ((TokenType)((t).info & 0xff))
+#define TOKEN_LEN(t) ((t).info >> 8)
+
+typedef struct _TokenArray {
+    Token *toks;
+    int count;
+    int max;
+    int next;               // index of the token after the current one
+    const char *start;      // where lexing began, and the line there
+    int startLine;
+} TokenArray;
+
+/* everything one compilation touches. Contexts share nothing, so separate
+   threads can compile with one context each. */
+typedef struct compileContext {
+    // source being scanned: mapped, read in whole, or borrowed from the caller
+    const char *srcBase;
+    const char *srcPos;
+    const char *srcEnd;
+    size_t srcMapped;
+    int srcOwned;
+    const struct _Skipper *skipper;
+
+    // scanner and parser state
+    char tokenString[MAXTOKENLEN+1];
+    TokenType token;
+    int lineno;
+    const char *tokenStart;     // of the token getToken returned last
+    int inComment;              // scan starts, or stopped at srcEnd, inside a comment
+    // where the token before the current one ended, and on which line
+    const char *prevEnd;
+    int prevLine;
+    int Error;
+    int PrintScan;
+
+    // tokens the parser reads; lexAhead fills in the whole source at once
+    TokenArray tokens;
+    int lexAhead;
+    int threads;                // lexAhead may split one large source across threads,
+                                // for lexing and for parsing function bodies
+    // function bodies parsed ahead on other threads (parse.c), NULL if none
+    struct _Bodies *bodies;
+    struct _BodyWorker *worker; // set on the context a body is parsed in
+
+    // semantic checks during the parse or after it, see analyze.h
+    CheckMode checks;
+    int fold;                   // constant folding after parse and checks (fold.c)
+
+    // tree dump and diagnostics
+    FILE *out;
+
+    // nodes of the last tree and the names they use
+    Arena tree;
+    TreeNode *freeNodes;        // dropped from the tree, reused before the arena
+    InternTable names;
+    // scopes for name resolution over the last tree, and semantic checks
+    SymTable scopes;
+    Checker checker;
+} CompileContext;
+
 #endif
\ No newline at end of file
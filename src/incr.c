@@ -0,0 +1,274 @@
+#include <stddef.h>
+
+#include "globals.h"
+#include "scan.h"
+#include "parse.h"
+#include "tokens.h"
+#include "intern.h"
+#include "incr.h"
+
+/* reparse everything once the subtrees replaced by edits outweigh the
+   live tree this many times over, so the arena doesn't grow forever */
+#define GARBAGE_FACTOR 4
+#define MINGARBAGE (1 << 20)
+
+static DeclSpan *addSpan(DeclSpan **spans, int *num, int *max) {
+    if(*num == *max) {
+        *max = *max ? *max * 2 : 64;
+        *spans = (DeclSpan *)realloc(*spans, sizeof(DeclSpan) * *max);
+        if(*spans == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return &(*spans)[(*num)++];
+}
+
+// fill in the span of the declaration t just parsed
+static void setSpan(IncrParse *ip, DeclSpan *d, TreeNode *t) {
+    CompileContext *ctx = ip->ctx;
+
+    d->end = (size_t)(ctx->prevEnd - ctx->srcBase);
+    d->line = ctx->prevLine;
+    d->shift = 0;
+    d->tree = t;
+}
+
+// t and everything under it, but not its siblings
+static void shiftLines(TreeNode *t, int delta) {
+    TreeNode *c;
+    int i;
+
+    t->lineno += delta;
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        for(c = t->child[i]; c != NULL; c = c->sibling) {
+            shiftLines(c, delta);
+        }
+    }
+}
+
+static void fullParse(IncrParse *ip) {
+    CompileContext *ctx = ip->ctx;
+    TreeNode *t;
+    TreeNode *last = NULL;
+
+    releaseTree(ctx);
+    setSource(ctx, ip->text, ip->len);
+    ctx->Error = FALSE;
+    ip->numDecls = 0;
+    ip->tree = NULL;
+
+    // same steps as parse(): one declaration, then more until ENDFILE
+    resetTokens(ctx);
+    nextToken(ctx);
+    do {
+        t = parseDeclaration(ctx);
+        setSpan(ip, addSpan(&ip->decls, &ip->numDecls, &ip->maxDecls), t);
+        if(last != NULL) {
+            last->sibling = t;
+        }
+        else {
+            ip->tree = t;
+        }
+        last = t;
+    } while(ctx->token != ENDFILE);
+
+    ip->Error = ctx->Error;
+    ip->fullUsed = ctx->tree.used;
+    ip->reparsed = ip->numDecls;
+    ip->full = TRUE;
+}
+
+/* the old text had [from, to) replaced, moving everything after it by
+   delta. FALSE if only a full parse can tell what the new text means. */
+static int reparseRegion(IncrParse *ip, size_t from, size_t to, ptrdiff_t delta) {
+    CompileContext *ctx = ip->ctx;
+    FILE *out = ctx->out;
+    DeclSpan *d = NULL;
+    TreeNode *t;
+    size_t start;
+    int numFresh = 0;
+    int resync = -1;
+    int numAfter;
+    int lineDelta = 0;
+    int lo, hi, a, k, i;
+
+    // errors can cascade across declarations
+    if(ip->Error || (ip->numDecls == 0) || (ip->scratch == NULL)
+        || (ctx->tree.used > GARBAGE_FACTOR * ip->fullUsed + MINGARBAGE)) {
+        return FALSE;
+    }
+
+    /* first declaration ending at or after the edit; a token ending right
+       at from could have been extended by it */
+    lo = 0;
+    hi = ip->numDecls;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if(ip->decls[mid].end < from) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    a = lo;
+    start = a ? ip->decls[a-1].end : 0;
+
+    // diagnostics of a partial parse would be out of order; a full one redoes them
+    setSource(ctx, ip->text, ip->len);
+    seekSource(ctx, start, a ? ip->decls[a-1].line : 1);
+    rewind(ip->scratch);
+    ctx->out = ip->scratch;
+    ctx->Error = FALSE;
+
+    resetTokens(ctx);
+    nextToken(ctx);
+    k = a;
+    while(ctx->token != ENDFILE) {
+        t = parseDeclaration(ctx);
+        if(ctx->Error) {
+            break;
+        }
+        d = addSpan(&ip->fresh, &numFresh, &ip->maxFresh);
+        setSpan(ip, d, t);
+
+        // past the edit, a boundary that lines up with an old one means the rest is unchanged
+        while((k < ip->numDecls) && ((ptrdiff_t)ip->decls[k].end + delta < (ptrdiff_t)d->end)) {
+            k++;
+        }
+        if((k < ip->numDecls) && ((ptrdiff_t)ip->decls[k].end + delta == (ptrdiff_t)d->end)
+            && (ip->decls[k].end >= to)) {
+            resync = k;
+            break;
+        }
+    }
+    ctx->out = out;
+    if(ctx->Error) {
+        return FALSE;
+    }
+
+    numAfter = (resync >= 0) ? ip->numDecls - resync - 1 : 0;
+    if(a + numFresh + numAfter == 0) {
+        // no declarations at all is a syntax error
+        return FALSE;
+    }
+    if(resync >= 0) {
+        lineDelta = d->line - ip->decls[resync].line;
+    }
+
+    // declarations after the resync point only move; their nodes catch up later
+    for(i = ip->numDecls - numAfter; i < ip->numDecls; ++i) {
+        ip->decls[i].end = (size_t)((ptrdiff_t)ip->decls[i].end + delta);
+        ip->decls[i].line += lineDelta;
+        ip->decls[i].shift += lineDelta;
+    }
+
+    // splice the fresh ones in place of [a, numDecls - numAfter)
+    while(ip->maxDecls < a + numFresh + numAfter) {
+        ip->maxDecls *= 2;
+        ip->decls = (DeclSpan *)realloc(ip->decls, sizeof(DeclSpan) * ip->maxDecls);
+        if(ip->decls == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memmove(ip->decls + a + numFresh, ip->decls + ip->numDecls - numAfter, sizeof(DeclSpan) * numAfter);
+    memcpy(ip->decls + a, ip->fresh, sizeof(DeclSpan) * numFresh);
+    ip->numDecls = a + numFresh + numAfter;
+
+    for(i = (a > 0) ? a - 1 : 0; i < a + numFresh; ++i) {
+        ip->decls[i].tree->sibling = (i + 1 < ip->numDecls) ? ip->decls[i+1].tree : NULL;
+    }
+    ip->tree = ip->decls[0].tree;
+    ip->reparsed = numFresh;
+    ip->full = FALSE;
+    return TRUE;
+}
+
+void incrInit(IncrParse *ip, CompileContext *ctx) {
+    memset(ip, 0, sizeof(IncrParse));
+    ip->ctx = ctx;
+    // lexing to the end of the file would defeat the point
+    ctx->lexAhead = FALSE;
+    /* fused checks would see only the reparsed declarations, in scopes
+       the ones spliced back in never entered */
+    ctx->checks = CHECK_NONE;
+    // without it every update is a full parse
+    ip->scratch = tmpfile();
+}
+
+void incrFree(IncrParse *ip) {
+    if(ip->scratch != NULL) {
+        fclose(ip->scratch);
+    }
+    free(ip->text);
+    free(ip->decls);
+    free(ip->fresh);
+    memset(ip, 0, sizeof(IncrParse));
+}
+
+static void reserveText(IncrParse *ip, size_t len) {
+    if(len > ip->cap) {
+        ip->cap = (len > 2 * ip->cap) ? len : 2 * ip->cap;
+        ip->text = (char *)realloc(ip->text, ip->cap);
+        if(ip->text == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+TreeNode *incrParse(IncrParse *ip, const char *src, size_t len) {
+    reserveText(ip, len);
+    memcpy(ip->text, src, len);
+    ip->len = len;
+    fullParse(ip);
+    return ip->tree;
+}
+
+TreeNode *incrEdit(IncrParse *ip, size_t start, size_t removed, const char *text, size_t inserted) {
+    if(start > ip->len) {
+        start = ip->len;
+    }
+    if(removed > ip->len - start) {
+        removed = ip->len - start;
+    }
+
+    reserveText(ip, ip->len - removed + inserted);
+    memmove(ip->text + start + inserted, ip->text + start + removed, ip->len - start - removed);
+    memcpy(ip->text + start, text, inserted);
+    ip->len = ip->len - removed + inserted;
+
+    if(!reparseRegion(ip, start, start + removed, (ptrdiff_t)inserted - (ptrdiff_t)removed)) {
+        fullParse(ip);
+    }
+    return ip->tree;
+}
+
+TreeNode *incrUpdate(IncrParse *ip, const char *src, size_t len) {
+    size_t n = (len < ip->len) ? len : ip->len;
+    size_t p = 0;
+    size_t q = 0;
+
+    // the common prefix and suffix bound the edit
+    while((p < n) && (ip->text[p] == src[p])) {
+        p++;
+    }
+    while((q < n - p) && (ip->text[ip->len - 1 - q] == src[len - 1 - q])) {
+        q++;
+    }
+    return incrEdit(ip, p, ip->len - p - q, src + p, len - p - q);
+}
+
+void incrSyncLines(IncrParse *ip) {
+    int i;
+
+    for(i = 0; i < ip->numDecls; ++i) {
+        if(ip->decls[i].shift != 0) {
+            shiftLines(ip->decls[i].tree, ip->decls[i].shift);
+            ip->decls[i].shift = 0;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef _INCR_H_
+#define _INCR_H_
+
+/* incremental parsing for editors. The text is kept here together with
+   the span and end line of every top-level declaration. After an edit,
+   scanning restarts at the end of the last declaration before it and
+   stops at the first old declaration boundary past it; the declarations
+   on either side are spliced back in untouched. Every update gives the
+   same tree and diagnostics a full parse would, except that when an edit
+   adds or removes lines, the line numbers in the declarations after it
+   are only brought up to date by incrSyncLines(). Until then, shift says
+   how far behind they are. Semantic checks are left to a pass over the
+   finished tree. */
+typedef struct _DeclSpan {
+    size_t end;                 // one past the declaration's last token
+    int line;                   // line at end
+    int shift;                  // lines still to add to the nodes under tree
+    TreeNode *tree;
+} DeclSpan;
+
+typedef struct _IncrParse {
+    CompileContext *ctx;
+    char *text;
+    size_t len;
+    size_t cap;
+    DeclSpan *decls;
+    int numDecls;
+    int maxDecls;
+    DeclSpan *fresh;            // scratch for reparsed declarations
+    int maxFresh;
+    TreeNode *tree;
+    int Error;                  // the current text has syntax errors
+    FILE *scratch;              // swallows diagnostics of partial reparses
+    size_t fullUsed;            // tree arena in use after the last full parse
+    // what the last update did
+    int reparsed;
+    int full;
+} IncrParse;
+
+// the tree and names live in ctx, which must not be used for anything else
+void incrInit(IncrParse *ip, CompileContext *ctx);
+void incrFree(IncrParse *ip);
+// replace the whole text and parse it from scratch
+TreeNode *incrParse(IncrParse *ip, const char *src, size_t len);
+// replace text[start, start + removed) by inserted bytes of text
+TreeNode *incrEdit(IncrParse *ip, size_t start, size_t removed, const char *text, size_t inserted);
+// new version of the whole text; only the part that differs is reparsed
+TreeNode *incrUpdate(IncrParse *ip, const char *src, size_t len);
+// apply pending line shifts to the nodes, for passes that report lines
+void incrSyncLines(IncrParse *ip);
+
+#endif
\ No newline at end of file
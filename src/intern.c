@@ -0,0 +1,148 @@
+#include "globals.h"
+#include "arena.h"
+#include "intern.h"
+
+#define INITSLOTS 256
+
+/* the slots are an open-addressing table of ids into syms, linear probing,
+   at most half full. A slot is live only if it carries the current
+   generation, so a reset empties the table without touching it. */
+
+static unsigned int hashBytes(const char *s, int len) {
+    unsigned int h = 2166136261u;
+    int i;
+
+    // FNV-1a
+    for(i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void clearSlots(InternTable *tab) {
+    unsigned int i;
+
+    for(i = 0; tab->slots && (i <= tab->slotMask); ++i) {
+        tab->slots[i].gen = 0;
+    }
+}
+
+static void growSlots(InternTable *tab) {
+    unsigned int n = tab->slots ? (tab->slotMask + 1) * 2 : INITSLOTS;
+    unsigned int i;
+    int id;
+
+    free(tab->slots);
+    tab->slots = (Slot *)malloc(sizeof(Slot) * n);
+    if(tab->slots == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    tab->slotMask = n - 1;
+    clearSlots(tab);
+    // generation 0 marks never-used slots
+    if(tab->generation == 0) {
+        tab->generation = 1;
+    }
+
+    // ids are dense, so rehashing walks syms instead of the old slots
+    for(id = 0; id < tab->numSyms; ++id) {
+        i = tab->syms[id].hash & tab->slotMask;
+        while(tab->slots[i].gen == tab->generation) {
+            i = (i + 1) & tab->slotMask;
+        }
+        tab->slots[i].id = id;
+        tab->slots[i].gen = tab->generation;
+    }
+}
+
+int internString(InternTable *tab, const char *s, int len) {
+    unsigned int h = hashBytes(s, len);
+    unsigned int i;
+    Symbol *sym;
+    char *copy;
+    int id;
+
+    if((unsigned int)tab->numSyms * 2 >= tab->slotMask) {
+        growSlots(tab);
+    }
+
+    for(i = h & tab->slotMask; tab->slots[i].gen == tab->generation; i = (i + 1) & tab->slotMask) {
+        sym = &tab->syms[tab->slots[i].id];
+        if((sym->hash == h) && (sym->len == len) && !memcmp(sym->str, s, len)) {
+            return tab->slots[i].id;
+        }
+    }
+
+    if(tab->numSyms == tab->maxSyms) {
+        Symbol *p;
+        tab->maxSyms = tab->maxSyms ? tab->maxSyms * 2 : INITSLOTS;
+        p = (Symbol *)realloc(tab->syms, sizeof(Symbol) * tab->maxSyms);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        tab->syms = p;
+    }
+
+    copy = (char *)arenaAlloc(&tab->strings, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+
+    id = tab->numSyms++;
+    tab->syms[id].str = copy;
+    tab->syms[id].len = len;
+    tab->syms[id].hash = h;
+    tab->slots[i].id = id;
+    tab->slots[i].gen = tab->generation;
+    return id;
+}
+
+int findString(const InternTable *tab, const char *s, int len) {
+    unsigned int h = hashBytes(s, len);
+    unsigned int i;
+    const Symbol *sym;
+
+    if(tab->slots == NULL) {
+        return NOSYM;
+    }
+    for(i = h & tab->slotMask; tab->slots[i].gen == tab->generation; i = (i + 1) & tab->slotMask) {
+        sym = &tab->syms[tab->slots[i].id];
+        if((sym->hash == h) && (sym->len == len) && !memcmp(sym->str, s, len)) {
+            return tab->slots[i].id;
+        }
+    }
+    return NOSYM;
+}
+
+const char *symName(const InternTable *tab, int sym) {
+    return (sym == NOSYM) ? NULL : tab->syms[sym].str;
+}
+
+int symLength(const InternTable *tab, int sym) {
+    return (sym == NOSYM) ? 0 : tab->syms[sym].len;
+}
+
+int symCount(const InternTable *tab) {
+    return tab->numSyms;
+}
+
+void internReset(InternTable *tab) {
+    tab->numSyms = 0;
+    arenaReset(&tab->strings);
+    // skip generation 0 on wraparound
+    if(++tab->generation == 0) {
+        clearSlots(tab);
+        tab->generation = 1;
+    }
+}
+
+void internFree(InternTable *tab) {
+    free(tab->slots);
+    free(tab->syms);
+    arenaFree(&tab->strings);
+    tab->slots = NULL;
+    tab->slotMask = 0;
+    tab->syms = NULL;
+    tab->numSyms = tab->maxSyms = 0;
+}
\ No newline at end of file
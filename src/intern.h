@@ -0,0 +1,39 @@
+#ifndef _INTERN_H_
+#define _INTERN_H_
+
+#define NOSYM (-1)
+
+typedef struct _Symbol {
+    const char *str;
+    int len;
+    unsigned int hash;
+} Symbol;
+
+typedef struct _Slot {
+    int id;
+    unsigned int gen;
+} Slot;
+
+/* identifier interning: equal names get the same id and share one
+   NUL-terminated copy, so later passes can compare names as integers.
+   A zeroed table is ready to use. */
+typedef struct _InternTable {
+    Slot *slots;
+    unsigned int slotMask;
+    unsigned int generation;
+    Symbol *syms;
+    int numSyms;
+    int maxSyms;
+    Arena strings;
+} InternTable;
+
+int internString(InternTable *tab, const char *s, int len);
+// id of a name already interned, NOSYM if it isn't
+int findString(const InternTable *tab, const char *s, int len);
+const char *symName(const InternTable *tab, int sym);
+int symLength(const InternTable *tab, int sym);
+int symCount(const InternTable *tab);
+void internReset(InternTable *tab);
+void internFree(InternTable *tab);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,552 @@
+#include <stdint.h>
+
+#include "globals.h"
+#include "ir.h"
+
+#define INITIR 64
+
+// where a declaration's value lives: a register, or a slot if reg is IR_NONE
+typedef struct _IrLoc {
+    const TreeNode *decl;
+    int reg;
+    int slot;
+} IrLoc;
+
+// lowering state for one tree
+typedef struct _Lower {
+    IrModule *m;
+    int func;
+    int regs;               // registers the current function uses so far
+    int ended;              // the last instruction jumps or returns
+    char *isVar;            // per register: it holds a variable, not a temporary
+    int maxVar;
+    int *args;              // operands of calls being lowered, innermost on top
+    int numArgs;
+    int maxArgs;
+} Lower;
+
+static int value(Lower *L, TreeNode *t);
+static void lowerList(Lower *L, TreeNode *t);
+
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        if(*max < INITIR) {
+            *max = INITIR;
+        }
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+// nodes are arena neighbours, so the low bits alone would cluster
+static unsigned int hashDecl(const TreeNode *decl) {
+    return (unsigned int)(((unsigned long long)(uintptr_t)decl * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static IrLoc *findLoc(IrModule *m, const TreeNode *decl) {
+    unsigned int i;
+
+    if(m->locs == NULL) {
+        return NULL;
+    }
+    for(i = hashDecl(decl) & m->locMask; m->locs[i].decl != NULL; i = (i + 1) & m->locMask) {
+        if(m->locs[i].decl == decl) {
+            return &m->locs[i];
+        }
+    }
+    return NULL;
+}
+
+// a new entry for decl, which isn't in the map yet
+static IrLoc *addLoc(IrModule *m, const TreeNode *decl) {
+    IrLoc *old = m->locs;
+    unsigned int oldSize = old ? m->locMask + 1 : 0;
+    unsigned int j;
+    unsigned int i;
+
+    // at most half full
+    if(2 * (unsigned int)(m->numLocs + 1) > oldSize) {
+        unsigned int size = oldSize ? oldSize * 2 : INITIR;
+
+        m->locs = (IrLoc *)calloc(size, sizeof(IrLoc));
+        if(m->locs == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        m->locMask = size - 1;
+        for(j = 0; j < oldSize; ++j) {
+            if(old[j].decl != NULL) {
+                for(i = hashDecl(old[j].decl) & m->locMask; m->locs[i].decl != NULL; i = (i + 1) & m->locMask);
+                m->locs[i] = old[j];
+            }
+        }
+        free(old);
+    }
+    for(i = hashDecl(decl) & m->locMask; m->locs[i].decl != NULL; i = (i + 1) & m->locMask);
+    m->locs[i].decl = decl;
+    m->locs[i].reg = IR_NONE;
+    m->locs[i].slot = IR_NONE;
+    m->numLocs++;
+    return &m->locs[i];
+}
+
+static int newReg(Lower *L, int isVar) {
+    L->isVar = (char *)growArray(L->isVar, &L->maxVar, L->regs + 1, sizeof(char));
+    L->isVar[L->regs] = (char)isVar;
+    return L->regs++;
+}
+
+int irConst(IrModule *m, int val) {
+    m->consts = (int *)growArray(m->consts, &m->maxConsts, m->numConsts + 1, sizeof(int));
+    m->consts[m->numConsts] = val;
+    return IR_CONST(m->numConsts++);
+}
+
+static int newSlot(IrModule *m, const TreeNode *decl, int func) {
+    m->slots = (IrSlot *)growArray(m->slots, &m->maxSlots, m->numSlots + 1, sizeof(IrSlot));
+    m->slots[m->numSlots].sym = decl->sym;
+    m->slots[m->numSlots].size = decl->arrayType ? decl->val : 1;
+    m->slots[m->numSlots].func = func;
+    return m->numSlots++;
+}
+
+static void openBlock(IrModule *m) {
+    m->blocks = (IrBlock *)growArray(m->blocks, &m->maxBlocks, m->numBlocks + 1, sizeof(IrBlock));
+    m->blocks[m->numBlocks].start = m->blocks[m->numBlocks].end = m->numInsts;
+    m->numBlocks++;
+}
+
+/* the block the next instruction goes in, as a jump target. An empty block
+   is used as it is, except for a function's entry, which nothing jumps to. */
+static int label(Lower *L) {
+    IrModule *m = L->m;
+    IrBlock *b = &m->blocks[m->numBlocks - 1];
+
+    L->ended = FALSE;
+    if((b->start == m->numInsts) && (m->numBlocks - 1 > m->funcs[L->func].firstBlock)) {
+        return m->numBlocks - 1;
+    }
+    b->end = m->numInsts;
+    openBlock(m);
+    return m->numBlocks - 1;
+}
+
+static int emit(Lower *L, IrOp op, int dst, int a, int b) {
+    IrModule *m = L->m;
+    IrInst *in;
+
+    // whatever follows a jump starts a block
+    if(L->ended) {
+        label(L);
+    }
+    m->insts = (IrInst *)growArray(m->insts, &m->maxInsts, m->numInsts + 1, sizeof(IrInst));
+    in = &m->insts[m->numInsts];
+    in->op = op;
+    in->dst = dst;
+    in->a = a;
+    in->b = b;
+    L->ended = (op == IR_JMP) || (op == IR_BRZ) || (op == IR_RET);
+    return m->numInsts++;
+}
+
+// t, or anything under it, assigns to a variable
+static int hasAssign(const TreeNode *t) {
+    const TreeNode *c;
+    int i;
+
+    if((t->nodeKind == ExpK) && (t->kind.exp == Assign)) {
+        return TRUE;
+    }
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        for(c = t->child[i]; c != NULL; c = c->sibling) {
+            if(hasAssign(c)) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/* an operand read before later evaluates and used after them; a variable
+   the later ones assign to is copied first */
+static int keep(Lower *L, int o, const TreeNode *later) {
+    int r;
+
+    if((o < 0) || !L->isVar[o]) {
+        return o;
+    }
+    for(; later != NULL; later = later->sibling) {
+        if(hasAssign(later)) {
+            r = newReg(L, FALSE);
+            emit(L, IR_MOV, r, o, IR_NONE);
+            return r;
+        }
+    }
+    return o;
+}
+
+// first word of the array decl
+static int arrayBase(Lower *L, const TreeNode *decl) {
+    IrLoc *loc = findLoc(L->m, decl);
+    int r;
+
+    // array parameters hold the address they were passed
+    if(loc->reg != IR_NONE) {
+        return loc->reg;
+    }
+    r = newReg(L, FALSE);
+    emit(L, IR_ADDR, r, loc->slot, IR_NONE);
+    return r;
+}
+
+// address of the variable t names, when it is in memory
+static int address(Lower *L, TreeNode *t) {
+    IrLoc *loc = findLoc(L->m, t->decl);
+    int base, index, r;
+
+    if(!t->arrayType) {
+        r = newReg(L, FALSE);
+        emit(L, IR_ADDR, r, loc->slot, IR_NONE);
+        return r;
+    }
+    base = arrayBase(L, t->decl);
+    index = value(L, t->child[0]);
+    r = newReg(L, FALSE);
+    emit(L, IR_INDEX, r, base, index);
+    return r;
+}
+
+static IrOp binaryOp(TokenType op) {
+    switch(op) {
+        case PLUS: return IR_ADD;
+        case MINUS: return IR_SUB;
+        case TIMES: return IR_MUL;
+        case OVER: return IR_DIV;
+        case LESSTHAN: return IR_LT;
+        case LESSEQTHAN: return IR_LE;
+        case GREATERTHAN: return IR_GT;
+        case GREATEREQTHAN: return IR_GE;
+        case EQ: return IR_EQ;
+        default: return IR_NE;
+    }
+}
+
+// arguments are all evaluated before the first ARG, so nested calls don't interleave
+static int call(Lower *L, TreeNode *t) {
+    TreeNode *a;
+    int base = L->numArgs;
+    int n = 0;
+    int o, r;
+
+    for(a = t->child[0]; a != NULL; a = a->sibling, ++n) {
+        o = keep(L, value(L, a), a->sibling);
+        L->args = (int *)growArray(L->args, &L->maxArgs, L->numArgs + 1, sizeof(int));
+        L->args[L->numArgs++] = o;
+    }
+    for(o = base; o < L->numArgs; ++o) {
+        emit(L, IR_ARG, IR_NONE, L->args[o], IR_NONE);
+    }
+    L->numArgs = base;
+    r = (t->decl->type == Int) ? newReg(L, FALSE) : IR_NONE;
+    emit(L, IR_CALL, r, t->sym, n);
+    return r;
+}
+
+static int assign(Lower *L, TreeNode *t) {
+    TreeNode *target = t->child[0];
+    IrLoc *loc = findLoc(L->m, target->decl);
+    int addr, v;
+
+    if(!target->arrayType && (loc->reg != IR_NONE)) {
+        v = value(L, t->child[1]);
+        emit(L, IR_MOV, loc->reg, v, IR_NONE);
+        return loc->reg;
+    }
+    addr = address(L, target);
+    v = value(L, t->child[1]);
+    emit(L, IR_STORE, IR_NONE, addr, v);
+    return v;
+}
+
+// operand holding the value of expression t; IR_NONE for a void call
+static int value(Lower *L, TreeNode *t) {
+    IrLoc *loc;
+    int a, b, r;
+
+    if(t->nodeKind == StmtK) {
+        return call(L, t);
+    }
+    switch(t->kind.exp) {
+        case Constant:
+            return irConst(L->m, t->val);
+        case Id:
+            // a whole array is passed as its address
+            if(t->decl->arrayType && !t->arrayType) {
+                return arrayBase(L, t->decl);
+            }
+            loc = findLoc(L->m, t->decl);
+            if(!t->arrayType && (loc->reg != IR_NONE)) {
+                return loc->reg;
+            }
+            a = address(L, t);
+            r = newReg(L, FALSE);
+            emit(L, IR_LOAD, r, a, IR_NONE);
+            return r;
+        case Assign:
+            return assign(L, t);
+        default:
+            a = keep(L, value(L, t->child[0]), t->child[1]);
+            b = value(L, t->child[1]);
+            r = newReg(L, FALSE);
+            emit(L, binaryOp(t->op), r, a, b);
+            return r;
+    }
+}
+
+static void local(Lower *L, TreeNode *t) {
+    IrLoc *loc = addLoc(L->m, t);
+
+    if(t->arrayType) {
+        loc->slot = newSlot(L->m, t, L->func);
+    }
+    // so every use has a definition before it
+    else {
+        loc->reg = newReg(L, TRUE);
+        emit(L, IR_MOV, loc->reg, irConst(L->m, 0), IR_NONE);
+    }
+}
+
+static void lowerStmt(Lower *L, TreeNode *t) {
+    IrModule *m = L->m;
+    TreeNode *p;
+    int branch, jump, top;
+
+    if(t->nodeKind != StmtK) {
+        if(t->nodeKind == ExpK) {
+            value(L, t);
+        }
+        return;
+    }
+    switch(t->kind.stmt) {
+        case Compound:
+            for(p = t->child[0]; p != NULL; p = p->sibling) {
+                local(L, p);
+            }
+            lowerList(L, t->child[1]);
+            break;
+        case Selection:
+            branch = emit(L, IR_BRZ, IR_NONE, value(L, t->child[0]), IR_NONE);
+            lowerList(L, t->child[1]);
+            if(t->child[2] != NULL) {
+                jump = emit(L, IR_JMP, IR_NONE, IR_NONE, IR_NONE);
+                m->insts[branch].b = label(L);
+                lowerList(L, t->child[2]);
+                m->insts[jump].a = label(L);
+            }
+            else {
+                m->insts[branch].b = label(L);
+            }
+            break;
+        case Iteration:
+            top = label(L);
+            branch = emit(L, IR_BRZ, IR_NONE, value(L, t->child[0]), IR_NONE);
+            lowerList(L, t->child[1]);
+            emit(L, IR_JMP, IR_NONE, top, IR_NONE);
+            m->insts[branch].b = label(L);
+            break;
+        case Return:
+            emit(L, IR_RET, IR_NONE, (t->child[0] != NULL) ? value(L, t->child[0]) : IR_NONE, IR_NONE);
+            break;
+        case Call:
+            call(L, t);
+            break;
+    }
+}
+
+static void lowerList(Lower *L, TreeNode *t) {
+    for(; t != NULL; t = t->sibling) {
+        lowerStmt(L, t);
+    }
+}
+
+static void lowerFunction(Lower *L, TreeNode *t) {
+    IrModule *m = L->m;
+    IrFunc *f;
+    TreeNode *p;
+    IrLoc *loc;
+
+    m->funcs = (IrFunc *)growArray(m->funcs, &m->maxFuncs, m->numFuncs + 1, sizeof(IrFunc));
+    L->func = m->numFuncs++;
+    f = &m->funcs[L->func];
+    f->sym = t->sym;
+    f->type = t->type;
+    f->numParams = 0;
+    f->firstBlock = m->numBlocks;
+    openBlock(m);
+    L->regs = 0;
+    L->ended = FALSE;
+
+    for(p = t->child[0]; p != NULL; p = p->sibling) {
+        loc = addLoc(m, p);
+        loc->reg = newReg(L, TRUE);
+        m->funcs[L->func].numParams++;
+    }
+    lowerList(L, t->child[1]);
+    if(!L->ended) {
+        emit(L, IR_RET, IR_NONE, (t->type == Int) ? irConst(m, 0) : IR_NONE, IR_NONE);
+    }
+
+    f = &m->funcs[L->func];
+    m->blocks[m->numBlocks - 1].end = m->numInsts;
+    f->numBlocks = m->numBlocks - f->firstBlock;
+    f->numRegs = L->regs;
+}
+
+void lowerTree(IrModule *m, TreeNode *tree) {
+    Lower L;
+    TreeNode *t;
+
+    m->numInsts = m->numBlocks = m->numFuncs = m->numSlots = m->numConsts = 0;
+    if(m->locs != NULL) {
+        memset(m->locs, 0, sizeof(IrLoc) * (m->locMask + 1));
+    }
+    m->numLocs = 0;
+
+    memset(&L, 0, sizeof(Lower));
+    L.m = m;
+    for(t = tree; t != NULL; t = t->sibling) {
+        if(t->kind.dec == FunctionDeclaration) {
+            lowerFunction(&L, t);
+        }
+        else {
+            addLoc(m, t)->slot = newSlot(m, t, -1);
+        }
+    }
+    free(L.isVar);
+    free(L.args);
+}
+
+static const char *opName(IrOp op) {
+    switch(op) {
+        case IR_ADD: return "+";
+        case IR_SUB: return "-";
+        case IR_MUL: return "*";
+        case IR_DIV: return "/";
+        case IR_LT: return "<";
+        case IR_LE: return "<=";
+        case IR_GT: return ">";
+        case IR_GE: return ">=";
+        case IR_EQ: return "==";
+        case IR_NE: return "!=";
+        default: return "?";
+    }
+}
+
+static void printOperand(const IrModule *m, int o, FILE *out) {
+    if(IR_ISCONST(o)) {
+        fprintf(out, "%d", m->consts[IR_CONSTINDEX(o)]);
+    }
+    else {
+        fprintf(out, "r%d", o);
+    }
+}
+
+static void printInst(const IrModule *m, const InternTable *names, const IrInst *in, FILE *out) {
+    fprintf(out, "    ");
+    if(in->dst != IR_NONE) {
+        fprintf(out, "r%d = ", in->dst);
+    }
+    switch(in->op) {
+        case IR_MOV:
+            printOperand(m, in->a, out);
+            break;
+        case IR_ADDR:
+            fprintf(out, "addr %s", symName(names, m->slots[in->a].sym));
+            break;
+        case IR_INDEX:
+            fprintf(out, "index ");
+            printOperand(m, in->a, out);
+            fprintf(out, ", ");
+            printOperand(m, in->b, out);
+            break;
+        case IR_LOAD:
+            fprintf(out, "load ");
+            printOperand(m, in->a, out);
+            break;
+        case IR_STORE:
+            fprintf(out, "store ");
+            printOperand(m, in->a, out);
+            fprintf(out, ", ");
+            printOperand(m, in->b, out);
+            break;
+        case IR_ARG:
+            fprintf(out, "arg ");
+            printOperand(m, in->a, out);
+            break;
+        case IR_CALL:
+            fprintf(out, "call %s, %d", symName(names, in->a), in->b);
+            break;
+        case IR_RET:
+            fprintf(out, "ret");
+            if(in->a != IR_NONE) {
+                fprintf(out, " ");
+                printOperand(m, in->a, out);
+            }
+            break;
+        case IR_JMP:
+            fprintf(out, "jmp B%d", in->a);
+            break;
+        case IR_BRZ:
+            fprintf(out, "brz ");
+            printOperand(m, in->a, out);
+            fprintf(out, ", B%d", in->b);
+            break;
+        default:
+            printOperand(m, in->a, out);
+            fprintf(out, " %s ", opName(in->op));
+            printOperand(m, in->b, out);
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+void printIr(const IrModule *m, const InternTable *names, FILE *out) {
+    const IrFunc *f;
+    int i, b, j;
+
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func < 0) {
+            fprintf(out, "global %s[%d]\n", symName(names, m->slots[i].sym), m->slots[i].size);
+        }
+    }
+    for(i = 0; i < m->numFuncs; ++i) {
+        f = &m->funcs[i];
+        fprintf(out, "function %s: %d params, %d registers\n", symName(names, f->sym), f->numParams, f->numRegs);
+        for(j = 0; j < m->numSlots; ++j) {
+            if(m->slots[j].func == i) {
+                fprintf(out, "  local %s[%d]\n", symName(names, m->slots[j].sym), m->slots[j].size);
+            }
+        }
+        for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+            fprintf(out, "  B%d:\n", b);
+            for(j = m->blocks[b].start; j < m->blocks[b].end; ++j) {
+                printInst(m, names, &m->insts[j], out);
+            }
+        }
+    }
+}
+
+void freeIr(IrModule *m) {
+    free(m->insts);
+    free(m->blocks);
+    free(m->funcs);
+    free(m->slots);
+    free(m->consts);
+    free(m->locs);
+    memset(m, 0, sizeof(IrModule));
+}
\ No newline at end of file
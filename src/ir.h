@@ -0,0 +1,102 @@
+#ifndef _IR_H_
+#define _IR_H_
+
+/* three-address code. A module is a few flat arrays: instructions of all
+   functions back to back, basic blocks as ranges of them, and the storage
+   slots and constants they refer to. Every instruction has the same
+   size and writes at most dst from at most a and b.
+
+   Operands are virtual registers (>= 0), constants (IR_CONST(k) is
+   entry k of consts) or IR_NONE. Registers are numbered per function; a
+   function's parameters come in r0, r1, ... and its scalar locals get
+   registers of their own. Arrays and global scalars live in slots and
+   are reached through addresses, counted in ints.
+
+   op         dst     a               b
+   MOV        r       value
+   ADD..NE    r       value           value       (LT..NE give 0 or 1)
+   ADDR       r       slot
+   INDEX      r       address         value       r = a + b ints
+   LOAD       r       address
+   STORE              address         value
+   ARG                value                       next argument of the CALL after it
+   CALL       r/NONE  callee sym      argument count
+   RET                value/NONE
+   JMP                block
+   BRZ                value           block       to b if a is 0, else the next block
+
+   A block ends at a JMP, BRZ or RET, or falls through to the block after
+   it. Blocks start at function entry, after every jump or return, and at
+   the targets Selection and Iteration statements branch to. */
+typedef enum {
+    IR_MOV,
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV,
+    IR_LT, IR_LE, IR_GT, IR_GE, IR_EQ, IR_NE,
+    IR_ADDR, IR_INDEX, IR_LOAD, IR_STORE,
+    IR_ARG, IR_CALL, IR_RET, IR_JMP, IR_BRZ
+} IrOp;
+
+#define IR_NONE (-1)
+#define IR_CONST(k) (-2 - (k))
+#define IR_ISCONST(o) ((o) <= -2)
+#define IR_CONSTINDEX(o) (-2 - (o))
+
+typedef struct _IrInst {
+    IrOp op;
+    int dst;
+    int a;
+    int b;
+} IrInst;
+
+typedef struct _IrBlock {
+    int start;              // first instruction, and one past the last
+    int end;
+} IrBlock;
+
+typedef struct _IrFunc {
+    int sym;
+    ExpType type;
+    int numParams;
+    int numRegs;
+    int firstBlock;         // its blocks are consecutive
+    int numBlocks;
+} IrFunc;
+
+typedef struct _IrSlot {
+    int sym;
+    int size;               // in ints
+    int func;               // owning function, -1 for a global
+} IrSlot;
+
+/* a zeroed module is ready to use; lowering refills it and keeps the
+   memory for the next tree */
+typedef struct _IrModule {
+    IrInst *insts;
+    int numInsts;
+    int maxInsts;
+    IrBlock *blocks;
+    int numBlocks;
+    int maxBlocks;
+    IrFunc *funcs;
+    int numFuncs;
+    int maxFuncs;
+    IrSlot *slots;
+    int numSlots;
+    int maxSlots;
+    int *consts;
+    int numConsts;
+    int maxConsts;
+    struct _IrLoc *locs;    // where each declaration lives, while lowering
+    unsigned int locMask;
+    int numLocs;
+} IrModule;
+
+/* lower a tree that passed the semantic checks (see checkCompiled) into
+   m, replacing what was there */
+void lowerTree(IrModule *m, TreeNode *tree);
+// operand for the constant val, a new entry in consts
+int irConst(IrModule *m, int val);
+void printIr(const IrModule *m, const InternTable *names, FILE *out);
+void freeIr(IrModule *m);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1037 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "select.h"
+#include "jit.h"
+
+// hardware numbers of the allocator's registers, then r11
+static const int hw[RA_NUMREGS + 1] = {0, 1, 2, 6, 7, 8, 9, 10, 3, 12, 13, 14, 15, 11};
+#define HW_RAX 0
+#define HW_RSP 4
+#define HW_RBP 5
+#define HW_RSI 6
+#define HW_RDI 7
+#define HW_R11 11
+#define RIP (-1)                // base of a memory operand relative to the next instruction
+
+#define REXW 8
+#define NOLABEL (-1)
+#define CC_B 0x2
+#define CC_NE 0x5
+
+/* the program's own stack, as deep as the bytecode's memory can grow,
+   with a guard page under it and the signal stack under that. Calls stop
+   short of the guard by enough for the host's input() and output(). */
+#define STACKBYTES ((size_t)1 << 28)
+#define SIGNALBYTES ((size_t)1 << 16)
+#define HOSTBYTES ((size_t)1 << 18)
+
+#ifdef __GNUC__
+#define THREADLOCAL __thread
+#else
+#define THREADLOCAL _Thread_local
+#endif
+
+// rbx, rbp and r12 to r15, which the entry keeps for its caller
+static const int entrySaved[6] = {3, 5, 12, 13, 14, 15};
+
+// condition codes of LT..NE, and of their opposites
+static const int conds[] = {0xc, 0xe, 0xf, 0xd, 0x4, 0x5};
+static const int negated[] = {0xd, 0xf, 0xe, 0xc, 0x5, 0x4};
+#define CC_E 0x4
+
+/* pages at the start of the mapping: the host's pointers, read-only
+   while the program runs; the rsp the entry notes, to leave from
+   anywhere; a guard page, so an index just below the first global
+   faults; then the globals */
+#define SAVEDRSP 1
+#define GLOBALS 3
+
+// the first page
+typedef struct _JitData {
+    JitInput input;
+    JitOutput output;
+    void *arg;
+    void *limit;            // lowest rsp a function may start with
+} JitData;
+
+typedef enum { OPND_REG, OPND_MEM, OPND_IMM } OpndKind;
+
+// a register, memory at reg + (index << scale) + disp, or an immediate
+typedef struct _Opnd {
+    OpndKind kind;
+    int reg;                // hardware number; RIP for memory relative to the code
+    int index;              // -1 if none
+    int scale;
+    int disp;               // from RIP: where in the mapping
+    int imm;
+} Opnd;
+
+// a 32-bit displacement at pos to fill in with where target ends up
+typedef struct _Fixup {
+    size_t pos;
+    int target;
+} Fixup;
+
+typedef struct _Encoder {
+    Select s;               // with the mapping offset of each global in its offsets
+    Jit *jit;
+    long *labels;           // per block where it starts, then where its branch's moves are
+    long *funcAt;           // per symbol where its function starts, -1 if none
+    Fixup *jumps;           // of the function being encoded, to labels
+    int numJumps;
+    int maxJumps;
+    Fixup *calls;           // to symbols
+    int numCalls;
+    int maxCalls;
+    long abort;             // where a division by zero goes
+    long tooDeep;           // where a call past the stack limit goes
+} Encoder;
+
+// a run on this thread, for a fault to leave by
+typedef struct _JitRun {
+    sigjmp_buf env;
+    const Jit *jit;
+} JitRun;
+
+static THREADLOCAL JitRun *running;
+static pthread_once_t handlersOnce = PTHREAD_ONCE_INIT;
+static const int faults[] = {SIGSEGV, SIGBUS, SIGILL};
+static struct sigaction oldActions[3];
+
+static size_t pageRound(size_t n) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    return (n + page - 1) & ~(page - 1);
+}
+
+// where page k of the mapping starts
+static size_t pages(int k) {
+    return (size_t)k * pageRound(1);
+}
+
+static void protect(unsigned char *p, size_t size, int prot) {
+    if(mprotect(p, size, prot) != 0) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static unsigned char *mapMemory(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(p == MAP_FAILED) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    return (unsigned char *)p;
+}
+
+// everything writable again, and at least size bytes of it
+static void reserve(Jit *jit, size_t size) {
+    if(jit->size < size) {
+        if(jit->mem != NULL) {
+            munmap(jit->mem, jit->size);
+        }
+        jit->mem = mapMemory(size);
+        jit->size = size;
+    }
+    else {
+        protect(jit->mem, jit->size, PROT_READ | PROT_WRITE);
+    }
+}
+
+// twice the room; everything in the mapping is addressed relative to it
+static void grow(Jit *jit) {
+    unsigned char *mem = mapMemory(2 * jit->size);
+
+    memcpy(mem, jit->mem, jit->pos);
+    munmap(jit->mem, jit->size);
+    jit->mem = mem;
+    jit->size *= 2;
+}
+
+static void put(Encoder *e, int byte) {
+    Jit *jit = e->jit;
+
+    if(jit->pos == jit->size) {
+        grow(jit);
+    }
+    jit->mem[jit->pos++] = (unsigned char)byte;
+}
+
+static void put32(Encoder *e, int v) {
+    put(e, v & 0xff);
+    put(e, (v >> 8) & 0xff);
+    put(e, (v >> 16) & 0xff);
+    put(e, (v >> 24) & 0xff);
+}
+
+static void patch32(Jit *jit, size_t pos, long v) {
+    int k;
+
+    for(k = 0; k < 4; ++k) {
+        jit->mem[pos + k] = (unsigned char)((unsigned long)v >> (8 * k));
+    }
+}
+
+static Opnd reg(int r) {
+    Opnd o = {OPND_REG, r, -1, 0, 0, 0};
+    return o;
+}
+
+static Opnd mem(int base, int disp) {
+    Opnd o = {OPND_MEM, base, -1, 0, disp, 0};
+    return o;
+}
+
+static Opnd memIndex(int base, int index, int scale, int disp) {
+    Opnd o = {OPND_MEM, base, index, scale, disp, 0};
+    return o;
+}
+
+static Opnd imm(int k) {
+    Opnd o = {OPND_IMM, -1, -1, 0, 0, k};
+    return o;
+}
+
+// a REX prefix byte registers need: sil and dil have none without one
+static int byteRex(int r) {
+    return ((r >= 4) && (r < 8)) ? 0x40 : 0;
+}
+
+static int isByte(int v) {
+    return (v >= -128) && (v <= 127);
+}
+
+/* an instruction with a ModRM byte: a REX prefix if anything asks for
+   one, an opcode of one byte or two, reg in the reg field and rm a
+   register or memory. immBytes follow it, which an address relative to
+   the next instruction has to reach past. */
+static void modrm(Encoder *e, int rex, int opcode, int reg, Opnd rm, int immBytes) {
+    int base = rm.reg, disp = rm.disp;
+    int mod;
+
+    rex |= ((reg & 8) ? 4 : 0) | ((rm.index >= 0) && (rm.index & 8) ? 2 : 0) | ((base >= 0) && (base & 8) ? 1 : 0);
+    if(rex != 0) {
+        put(e, 0x40 | rex);
+    }
+    if(opcode > 0xff) {
+        put(e, opcode >> 8);
+    }
+    put(e, opcode & 0xff);
+
+    if(rm.kind == OPND_REG) {
+        put(e, 0xc0 | ((reg & 7) << 3) | (base & 7));
+        return;
+    }
+    if(base == RIP) {
+        put(e, ((reg & 7) << 3) | 5);
+        put32(e, (int)(disp - (long)(e->jit->pos + 4 + immBytes)));
+        return;
+    }
+    // rbp and r13 have no form without a displacement
+    mod = ((disp == 0) && ((base & 7) != 5)) ? 0 : isByte(disp) ? 1 : 2;
+    if((rm.index >= 0) || ((base & 7) == 4)) {
+        put(e, (mod << 6) | ((reg & 7) << 3) | 4);
+        put(e, (rm.scale << 6) | ((((rm.index >= 0) ? rm.index : 4) & 7) << 3) | (base & 7));
+    }
+    else {
+        put(e, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+    }
+    if(mod == 1) {
+        put(e, disp & 0xff);
+    }
+    else if(mod == 2) {
+        put32(e, disp);
+    }
+}
+
+// a register's number in the low bits of the opcode, as push and pop have it
+static void opReg(Encoder *e, int opcode, int r) {
+    if(r & 8) {
+        put(e, 0x41);
+    }
+    put(e, opcode + (r & 7));
+}
+
+/* movl or movq; ints in registers are only ever read as 32 bits, so a
+   constant into one is a movl either way */
+static void mov(Encoder *e, int w, Opnd from, Opnd to) {
+    if((from.kind == OPND_IMM) && (to.kind == OPND_REG)) {
+        opReg(e, 0xb8, to.reg);
+        put32(e, from.imm);
+    }
+    else if(from.kind == OPND_IMM) {
+        modrm(e, w, 0xc7, 0, to, 4);
+        put32(e, from.imm);
+    }
+    else if(to.kind == OPND_REG) {
+        modrm(e, w, 0x8b, to.reg, from, 0);
+    }
+    else {
+        modrm(e, w, 0x89, from.reg, to, 0);
+    }
+}
+
+// add, sub or cmp by the digit of their group: 0, 5 or 7
+static void alu(Encoder *e, int w, int digit, Opnd src, Opnd dst) {
+    if((src.kind == OPND_IMM) && isByte(src.imm)) {
+        modrm(e, w, 0x83, digit, dst, 1);
+        put(e, src.imm & 0xff);
+    }
+    else if(src.kind == OPND_IMM) {
+        modrm(e, w, 0x81, digit, dst, 4);
+        put32(e, src.imm);
+    }
+    else if(dst.kind == OPND_REG) {
+        modrm(e, w, 8 * digit + 3, dst.reg, src, 0);
+    }
+    else {
+        modrm(e, w, 8 * digit + 1, src.reg, dst, 0);
+    }
+}
+
+static void imul(Encoder *e, Opnd src, int r) {
+    if((src.kind == OPND_IMM) && isByte(src.imm)) {
+        modrm(e, 0, 0x6b, r, reg(r), 1);
+        put(e, src.imm & 0xff);
+    }
+    else if(src.kind == OPND_IMM) {
+        modrm(e, 0, 0x69, r, reg(r), 4);
+        put32(e, src.imm);
+    }
+    else {
+        modrm(e, 0, 0x0faf, r, src, 0);
+    }
+}
+
+static void push(Encoder *e, Opnd o) {
+    if(o.kind == OPND_REG) {
+        opReg(e, 0x50, o.reg);
+    }
+    else if(o.kind == OPND_IMM) {
+        put(e, 0x68);
+        put32(e, o.imm);
+    }
+    else {
+        modrm(e, 0, 0xff, 6, o, 0);
+    }
+}
+
+static void pop(Encoder *e, int r) {
+    opReg(e, 0x58, r);
+}
+
+static void addFixup(Fixup **list, int *num, int *max, size_t pos, int target) {
+    if(*num == *max) {
+        *max = *max ? 2 * *max : 64;
+        *list = (Fixup *)realloc(*list, sizeof(Fixup) * *max);
+        if(*list == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    (*list)[*num].pos = pos;
+    (*list)[*num].target = target;
+    (*num)++;
+}
+
+/* jmp, or a jcc with condition code cc (-1 for none), to a known place:
+   two bytes when it reaches */
+static void jumpAt(Encoder *e, int cc, long target) {
+    long rel = target - (long)(e->jit->pos + 2);
+
+    if(isByte((int)rel) && (rel == (int)rel)) {
+        put(e, (cc < 0) ? 0xeb : 0x70 + cc);
+        put(e, (int)rel & 0xff);
+        return;
+    }
+    if(cc < 0) {
+        put(e, 0xe9);
+    }
+    else {
+        put(e, 0x0f);
+        put(e, 0x80 + cc);
+    }
+    put32(e, (int)(target - (long)(e->jit->pos + 4)));
+}
+
+// the same to a label, filled in later if it isn't placed yet
+static void jump(Encoder *e, int cc, int label) {
+    if(e->labels[label] >= 0) {
+        jumpAt(e, cc, e->labels[label]);
+        return;
+    }
+    if(cc < 0) {
+        put(e, 0xe9);
+    }
+    else {
+        put(e, 0x0f);
+        put(e, 0x80 + cc);
+    }
+    addFixup(&e->jumps, &e->numJumps, &e->maxJumps, e->jit->pos, label);
+    put32(e, 0);
+}
+
+static void callSym(Encoder *e, int sym) {
+    put(e, 0xe8);
+    addFixup(&e->calls, &e->numCalls, &e->maxCalls, e->jit->pos, sym);
+    put32(e, 0);
+}
+
+static Opnd at(Encoder *e, int operand, int loc) {
+    if(IR_ISCONST(operand)) {
+        return imm(e->s.m->consts[IR_CONSTINDEX(operand)]);
+    }
+    if(RA_ISINCOMING(loc) || RA_ISSLOT(loc)) {
+        return mem(HW_RBP, frameOffset(&e->s, loc));
+    }
+    return reg(hw[loc]);
+}
+
+static void moveLoc(Encoder *e, int from, int to) {
+    if(isMem(IR_NONE, from) && isMem(IR_NONE, to)) {
+        mov(e, REXW, at(e, IR_NONE, from), reg(HW_R11));
+        mov(e, REXW, reg(HW_R11), at(e, IR_NONE, to));
+    }
+    else {
+        mov(e, REXW, at(e, IR_NONE, from), at(e, IR_NONE, to));
+    }
+}
+
+static void emitMoves(Encoder *e, int place) {
+    const RaMove *mv;
+    int k;
+
+    for(k = e->s.ra->moveStart[place]; k < e->s.ra->moveStart[place + 1]; ++k) {
+        mv = &e->s.ra->moves[k];
+        if(mv->swap) {
+            modrm(e, REXW, 0x87, hw[mv->from], reg(hw[mv->to]), 0);
+        }
+        else {
+            moveLoc(e, mv->from, mv->to);
+        }
+    }
+}
+
+// an int operand into register r, unless it is there already
+static void loadInt(Encoder *e, int operand, int loc, int r) {
+    if(regOf(operand, loc) != r) {
+        mov(e, 0, at(e, operand, loc), reg(hw[r]));
+    }
+}
+
+// the result, computed in r, to where dst lives
+static void storeResult(Encoder *e, int r, int loc) {
+    if(r != loc) {
+        mov(e, REXW, reg(hw[r]), at(e, IR_NONE, loc));
+    }
+}
+
+// an address operand into its base register
+static int loadBase(Encoder *e, int operand, int loc) {
+    int r = baseReg(operand, loc);
+
+    if(r == SCRATCH) {
+        mov(e, REXW, at(e, operand, loc), reg(HW_R11));
+    }
+    return r;
+}
+
+// the memory LOAD or STORE i reaches
+static Opnd memOperand(Encoder *e, int b, int i) {
+    const IrInst *ix = &e->s.m->insts[i - 1];
+    const int *lx = &e->s.ra->locs[3 * (i - 1)];
+
+    if((i > e->s.m->blocks[b].start) && fusedIndex(&e->s, b, i - 1)) {
+        if(IR_ISCONST(ix->b)) {
+            return mem(hw[lx[1]], 4 * e->s.m->consts[IR_CONSTINDEX(ix->b)]);
+        }
+        modrm(e, REXW, 0x63, HW_R11, at(e, ix->b, lx[2]), 0);
+        return memIndex(hw[lx[1]], HW_R11, 2, 0);
+    }
+    return mem(hw[loadBase(e, e->s.m->insts[i].a, e->s.ra->locs[3 * i + 1])], 0);
+}
+
+static void epilogue(Encoder *e) {
+    int k;
+
+    if(e->s.numSaved > 0) {
+        modrm(e, REXW, 0x8d, HW_RSP, mem(HW_RBP, -8 * e->s.numSaved), 0);
+        for(k = e->s.numSaved - 1; k >= 0; --k) {
+            pop(e, hw[e->s.saved[k]]);
+        }
+        pop(e, HW_RBP);
+    }
+    else {
+        put(e, 0xc9);
+    }
+    put(e, 0xc3);
+}
+
+static void arithmetic(Encoder *e, const IrInst *in, const int *loc) {
+    int a = in->a, la = loc[1];
+    int b = in->b, lb = loc[2];
+    int w, t;
+
+    if(swapsOperands(in, loc)) {
+        t = a, a = b, b = t;
+        t = la, la = lb, lb = t;
+    }
+    w = ((regOf(b, lb) >= 0) && (regOf(b, lb) == loc[0])) ? SCRATCH : workReg(loc[0]);
+    loadInt(e, a, la, w);
+    if(in->op == IR_MUL) {
+        imul(e, at(e, b, lb), hw[w]);
+    }
+    else {
+        alu(e, 0, (in->op == IR_ADD) ? 0 : 5, at(e, b, lb), reg(hw[w]));
+    }
+    storeResult(e, w, loc[0]);
+}
+
+// a divisor of 0 leaves the program; -1 negates and skips the idiv
+static void divide(Encoder *e, const IrInst *in, const int *loc) {
+    Opnd divisor;
+    int rb = regOf(in->b, loc[2]);
+    size_t skip = 0;
+    size_t over = 0;
+
+    if(IR_ISCONST(in->b) && (e->s.m->consts[IR_CONSTINDEX(in->b)] == -1)) {
+        loadInt(e, in->a, loc[1], RA_RAX);
+        modrm(e, 0, 0xf7, 3, reg(HW_RAX), 0);
+        if(loc[0] != IR_NONE) {
+            storeResult(e, RA_RAX, loc[0]);
+        }
+        return;
+    }
+
+    // cltd and the dividend take rax and rdx
+    if(IR_ISCONST(in->b) || (rb == RA_RAX) || (rb == RA_RDX)) {
+        loadInt(e, in->b, loc[2], SCRATCH);
+        divisor = reg(HW_R11);
+    }
+    else {
+        divisor = at(e, in->b, loc[2]);
+    }
+    if(!IR_ISCONST(in->b) || (e->s.m->consts[IR_CONSTINDEX(in->b)] == 0)) {
+        if(divisor.kind == OPND_REG) {
+            modrm(e, 0, 0x85, divisor.reg, divisor, 0);
+        }
+        else {
+            alu(e, 0, 7, imm(0), divisor);
+        }
+        jumpAt(e, CC_E, e->abort);
+    }
+    if(!IR_ISCONST(in->b)) {
+        alu(e, 0, 7, imm(-1), divisor);
+        put(e, 0x70 + CC_NE);
+        skip = e->jit->pos;
+        put(e, 0);
+        loadInt(e, in->a, loc[1], RA_RAX);
+        modrm(e, 0, 0xf7, 3, reg(HW_RAX), 0);
+        put(e, 0xeb);
+        over = e->jit->pos;
+        put(e, 0);
+        e->jit->mem[skip] = (unsigned char)(e->jit->pos - (skip + 1));
+    }
+    loadInt(e, in->a, loc[1], RA_RAX);
+    put(e, 0x99);
+    modrm(e, 0, 0xf7, 7, divisor, 0);
+    if(over > 0) {
+        e->jit->mem[over] = (unsigned char)(e->jit->pos - (over + 1));
+    }
+    if(loc[0] != IR_NONE) {
+        storeResult(e, RA_RAX, loc[0]);
+    }
+}
+
+// flags for a against b, and the result as 0 or 1 if anything reads it
+static void compare(Encoder *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    Opnd left;
+    int w;
+
+    if(IR_ISCONST(in->a) || (isMem(in->a, loc[1]) && isMem(in->b, loc[2]))) {
+        loadInt(e, in->a, loc[1], SCRATCH);
+        left = reg(HW_R11);
+    }
+    else {
+        left = at(e, in->a, loc[1]);
+    }
+    alu(e, 0, 7, at(e, in->b, loc[2]), left);
+    if((loc[0] == IR_NONE) || keepsFlags(&e->s, b, i)) {
+        return;
+    }
+    w = hw[workReg(loc[0])];
+    modrm(e, byteRex(w), 0x0f90 + conds[in->op - IR_LT], 0, reg(w), 0);
+    modrm(e, byteRex(w), 0x0fb6, w, reg(w), 0);
+    storeResult(e, workReg(loc[0]), loc[0]);
+}
+
+static void address(Encoder *e, const IrInst *in, const int *loc) {
+    const IrSlot *s = &e->s.m->slots[in->a];
+    int w = workReg(loc[0]);
+
+    modrm(e, REXW, 0x8d, hw[w], mem((s->func < 0) ? RIP : HW_RBP, e->s.offsets[in->a]), 0);
+    storeResult(e, w, loc[0]);
+}
+
+// a + 4 * b, with b sign-extended
+static void indexed(Encoder *e, const IrInst *in, const int *loc) {
+    int w = workReg(loc[0]);
+
+    if(IR_ISCONST(in->b)) {
+        int base = loadBase(e, in->a, loc[1]);
+
+        modrm(e, REXW, 0x8d, hw[w], mem(hw[base], 4 * e->s.m->consts[IR_CONSTINDEX(in->b)]), 0);
+    }
+    else if(regOf(in->a, loc[1]) >= 0) {
+        modrm(e, REXW, 0x63, HW_R11, at(e, in->b, loc[2]), 0);
+        modrm(e, REXW, 0x8d, hw[w], memIndex(hw[loc[1]], HW_R11, 2, 0), 0);
+    }
+    else {
+        modrm(e, REXW, 0x63, HW_R11, at(e, in->b, loc[2]), 0);
+        modrm(e, REXW, 0xc1, 4, reg(HW_R11), 1);
+        put(e, 2);
+        modrm(e, REXW, 0x03, HW_R11, at(e, in->a, loc[1]), 0);
+        w = SCRATCH;
+    }
+    storeResult(e, w, loc[0]);
+}
+
+static void load(Encoder *e, int b, int i) {
+    const int *loc = &e->s.ra->locs[3 * i];
+    Opnd src = memOperand(e, b, i);
+    int w = workReg(loc[0]);
+
+    mov(e, 0, src, reg(hw[w]));
+    storeResult(e, w, loc[0]);
+}
+
+static void store(Encoder *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    Opnd dst;
+
+    if(!isMem(in->b, loc[2])) {
+        dst = memOperand(e, b, i);
+        mov(e, 0, at(e, in->b, loc[2]), dst);
+    }
+    else if((regOf(in->a, loc[1]) >= 0) || ((i > e->s.m->blocks[b].start) && fusedIndex(&e->s, b, i - 1))) {
+        loadInt(e, in->b, loc[2], SCRATCH);
+        dst = memOperand(e, b, i);
+        mov(e, 0, reg(HW_R11), dst);
+    }
+    else {
+        // both in memory: rax lends a hand, the slots are off rbp
+        push(e, reg(HW_RAX));
+        mov(e, REXW, at(e, in->a, loc[1]), reg(HW_RAX));
+        loadInt(e, in->b, loc[2], SCRATCH);
+        mov(e, 0, reg(HW_R11), mem(HW_RAX, 0));
+        pop(e, HW_RAX);
+    }
+}
+
+static void call(Encoder *e, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    int n = in->b;
+    int onStack = (n > 6) ? n - 6 : 0;
+    int pad = onStack & 1;
+    int direct = directArgs(&e->s, i);
+    int j, op, l;
+
+    if(pad) {
+        alu(e, REXW, 5, imm(8), reg(HW_RSP));
+    }
+    for(j = n - 1; j >= (direct ? 6 : 0); --j) {
+        op = e->s.m->insts[i - n + j].a;
+        l = e->s.ra->locs[3 * (i - n + j) + 1];
+        push(e, at(e, op, l));
+    }
+    for(j = 0; (j < n) && (j < 6); ++j) {
+        if(direct) {
+            op = e->s.m->insts[i - n + j].a;
+            l = e->s.ra->locs[3 * (i - n + j) + 1];
+            if(regOf(op, l) != argReg(j)) {
+                mov(e, REXW, at(e, op, l), reg(hw[argReg(j)]));
+            }
+        }
+        else {
+            pop(e, hw[argReg(j)]);
+        }
+    }
+    callSym(e, in->a);
+    if(onStack + pad > 0) {
+        alu(e, REXW, 0, imm(8 * (onStack + pad)), reg(HW_RSP));
+    }
+    if((in->dst != IR_NONE) && (loc[0] != IR_NONE)) {
+        storeResult(e, RA_RAX, loc[0]);
+    }
+}
+
+static void branch(Encoder *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+    int target = branchEdge(&e->s, b) ? e->s.m->numBlocks + b : jumpTarget(&e->s, in->b);
+
+    if(IR_ISCONST(in->a)) {
+        if(e->s.m->consts[IR_CONSTINDEX(in->a)] == 0) {
+            jump(e, -1, target);
+        }
+        return;
+    }
+    if(branchesOnFlags(&e->s, b, i)) {
+        jump(e, negated[e->s.m->insts[i - 1].op - IR_LT], target);
+        return;
+    }
+    if(isMem(in->a, loc[1])) {
+        alu(e, 0, 7, imm(0), at(e, in->a, loc[1]));
+    }
+    else {
+        modrm(e, 0, 0x85, hw[loc[1]], reg(hw[loc[1]]), 0);
+    }
+    jump(e, CC_E, target);
+}
+
+static void emitInst(Encoder *e, int b, int i) {
+    const IrInst *in = &e->s.m->insts[i];
+    const int *loc = &e->s.ra->locs[3 * i];
+
+    if(!emitsCode(&e->s, b, i)) {
+        return;
+    }
+    switch(in->op) {
+        case IR_MOV:
+            if(IR_ISCONST(in->a)) {
+                mov(e, REXW, at(e, in->a, loc[1]), at(e, in->dst, loc[0]));
+            }
+            else {
+                moveLoc(e, loc[1], loc[0]);
+            }
+            break;
+        case IR_ADD: case IR_SUB: case IR_MUL:
+            arithmetic(e, in, loc);
+            break;
+        case IR_DIV:
+            divide(e, in, loc);
+            break;
+        case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+            compare(e, b, i);
+            break;
+        case IR_ADDR:
+            address(e, in, loc);
+            break;
+        case IR_INDEX:
+            indexed(e, in, loc);
+            break;
+        case IR_LOAD:
+            load(e, b, i);
+            break;
+        case IR_STORE:
+            store(e, b, i);
+            break;
+        case IR_ARG:
+            break;
+        case IR_CALL:
+            call(e, i);
+            break;
+        case IR_RET:
+            if(in->a != IR_NONE) {
+                loadInt(e, in->a, loc[1], RA_RAX);
+            }
+            epilogue(e);
+            break;
+        case IR_JMP:
+            emitMoves(e, RA_EDGE(e->s.m, b, 0));
+            if(jumpTarget(&e->s, in->a) != b + 1) {
+                jump(e, -1, jumpTarget(&e->s, in->a));
+            }
+            break;
+        case IR_BRZ:
+            branch(e, b, i);
+            emitMoves(e, RA_EDGE(e->s.m, b, 0));
+            break;
+    }
+}
+
+// and a call too deep leaves the program before it takes its frame
+static void prologue(Encoder *e) {
+    int k;
+
+    push(e, reg(HW_RBP));
+    mov(e, REXW, reg(HW_RSP), reg(HW_RBP));
+    for(k = 0; k < e->s.numSaved; ++k) {
+        push(e, reg(hw[e->s.saved[k]]));
+    }
+    if(e->s.frameBytes > 0) {
+        alu(e, REXW, 5, imm(e->s.frameBytes), reg(HW_RSP));
+    }
+    alu(e, REXW, 7, mem(RIP, offsetof(JitData, limit)), reg(HW_RSP));
+    jumpAt(e, CC_B, e->tooDeep);
+}
+
+// functions start 16-byte aligned; the padding is never run
+static void align(Encoder *e) {
+    while(e->jit->pos & 15) {
+        put(e, 0xcc);
+    }
+}
+
+static void emitFunction(Encoder *e, int fi) {
+    const IrModule *m = e->s.m;
+    const IrFunc *f = &m->funcs[fi];
+    int b, i, k;
+
+    selectFunction(&e->s, fi);
+    align(e);
+    e->funcAt[f->sym] = (long)e->jit->pos;
+    e->numJumps = 0;
+    prologue(e);
+    emitMoves(e, RA_ENTRY(m, fi));
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        e->labels[b] = (long)e->jit->pos;
+        for(i = m->blocks[b].start; i < m->blocks[b].end; ++i) {
+            emitMoves(e, RA_BEFORE(i));
+            emitInst(e, b, i);
+        }
+        if(fallsThrough(&e->s, b)) {
+            emitMoves(e, RA_EDGE(m, b, 0));
+        }
+    }
+    if(runsOff(&e->s)) {
+        epilogue(e);
+    }
+
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        if(branchEdge(&e->s, b)) {
+            e->labels[m->numBlocks + b] = (long)e->jit->pos;
+            emitMoves(e, RA_EDGE(m, b, 1));
+            jump(e, -1, jumpTarget(&e->s, m->insts[m->blocks[b].end - 1].b));
+        }
+    }
+
+    // every block of the function is placed now
+    for(k = 0; k < e->numJumps; ++k) {
+        patch32(e->jit, e->jumps[k].pos, e->labels[e->jumps[k].target] - (long)(e->jumps[k].pos + 4));
+    }
+}
+
+// the entry's pushes undone, with the result in eax
+static void leaveEntry(Encoder *e) {
+    int k;
+
+    alu(e, REXW, 0, imm(8), reg(HW_RSP));
+    for(k = 5; k >= 0; --k) {
+        pop(e, entrySaved[k]);
+    }
+    put(e, 0xc3);
+}
+
+// back out of the entry from anywhere, returning status
+static long emitAbort(Encoder *e, JitStatus status) {
+    long at;
+
+    align(e);
+    at = (long)e->jit->pos;
+    mov(e, REXW, mem(RIP, (int)pages(SAVEDRSP)), reg(HW_RSP));
+    mov(e, 0, imm(status), reg(HW_RAX));
+    leaveEntry(e);
+    return at;
+}
+
+/* input and output pass arg along to the host and return to the
+   caller from there; a division by zero or a call too deep comes back
+   out of the entry */
+static void emitRuntime(Encoder *e, const InternTable *names) {
+    int input = findString(names, "input", 5);
+    int output = findString(names, "output", 6);
+
+    if(input != NOSYM) {
+        e->funcAt[input] = (long)e->jit->pos;
+        mov(e, REXW, mem(RIP, offsetof(JitData, arg)), reg(HW_RDI));
+        modrm(e, 0, 0xff, 4, mem(RIP, offsetof(JitData, input)), 0);
+    }
+    if(output != NOSYM) {
+        align(e);
+        e->funcAt[output] = (long)e->jit->pos;
+        mov(e, 0, reg(HW_RDI), reg(HW_RSI));
+        mov(e, REXW, mem(RIP, offsetof(JitData, arg)), reg(HW_RDI));
+        modrm(e, 0, 0xff, 4, mem(RIP, offsetof(JitData, output)), 0);
+    }
+    e->abort = emitAbort(e, JIT_DIVZERO);
+    e->tooDeep = emitAbort(e, JIT_DEPTH);
+}
+
+// called from C with the top of the stack: keeps what it has to, notes rsp and calls main there
+static void emitEntry(Encoder *e, int mainSym) {
+    int k;
+
+    align(e);
+    e->jit->entry = (long)e->jit->pos;
+    for(k = 0; k < 6; ++k) {
+        push(e, reg(entrySaved[k]));
+    }
+    alu(e, REXW, 5, imm(8), reg(HW_RSP));
+    mov(e, REXW, reg(HW_RSP), mem(RIP, (int)pages(SAVEDRSP)));
+    mov(e, REXW, reg(HW_RDI), reg(HW_RSP));
+    callSym(e, mainSym);
+    mov(e, REXW, mem(RIP, (int)pages(SAVEDRSP)), reg(HW_RSP));
+    modrm(e, 0, 0x31, HW_RAX, reg(HW_RAX), 0);
+    leaveEntry(e);
+}
+
+int jitCompile(Jit *jit, const IrModule *m, const RegAlloc *ra, const InternTable *names) {
+    Encoder e;
+    int mainSym = findString(names, "main", 4);
+    size_t data = pages(GLOBALS);
+    int i;
+
+    jit->entry = -1;
+    memset(&e, 0, sizeof(Encoder));
+    initSelect(&e.s, m, ra);
+    e.jit = jit;
+    e.labels = (long *)malloc(sizeof(long) * (2 * m->numBlocks + 1));
+    e.funcAt = (long *)malloc(sizeof(long) * (symCount(names) + 1));
+    if((e.labels == NULL) || (e.funcAt == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < 2 * m->numBlocks; ++i) {
+        e.labels[i] = NOLABEL;
+    }
+    for(i = 0; i < symCount(names); ++i) {
+        e.funcAt[i] = -1;
+    }
+
+    // code from the page after the globals
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func < 0) {
+            e.s.offsets[i] = (int)data;
+            data += (size_t)slotBytes(&m->slots[i]);
+        }
+    }
+    jit->globalBytes = data - pages(GLOBALS);
+    jit->dataSize = pageRound(data);
+    reserve(jit, jit->dataSize + pageRound(16 * (size_t)m->numInsts + 256));
+    jit->pos = jit->dataSize;
+
+    emitRuntime(&e, names);
+    for(i = 0; i < m->numFuncs; ++i) {
+        emitFunction(&e, i);
+    }
+    if((mainSym != NOSYM) && (e.funcAt[mainSym] >= 0)) {
+        emitEntry(&e, mainSym);
+    }
+    for(i = 0; i < e.numCalls; ++i) {
+        long target = (e.funcAt[e.calls[i].target] >= 0) ? e.funcAt[e.calls[i].target] : e.abort;
+
+        patch32(jit, e.calls[i].pos, target - (long)(e.calls[i].pos + 4));
+    }
+
+    freeSelect(&e.s);
+    free(e.labels);
+    free(e.funcAt);
+    free(e.jumps);
+    free(e.calls);
+
+    if((mprotect(jit->mem + pages(GLOBALS - 1), pages(1), PROT_NONE) != 0) ||
+        (mprotect(jit->mem + jit->dataSize, jit->size - jit->dataSize, PROT_READ | PROT_EXEC) != 0)) {
+        jit->entry = -1;
+    }
+    return jit->entry >= 0;
+}
+
+/* a fault in the program leaves the run it happened in; anywhere else it
+   goes to whoever handled it before */
+static void onFault(int sig, siginfo_t *info, void *context) {
+    JitRun *r = running;
+    const unsigned char *guard;
+    int i;
+
+    (void)context;
+    if(r == NULL) {
+        for(i = 0; faults[i] != sig; ++i);
+        sigaction(sig, &oldActions[i], NULL);
+        return;
+    }
+    running = NULL;
+    guard = r->jit->stack + SIGNALBYTES;
+    if(((const unsigned char *)info->si_addr >= guard) &&
+        ((const unsigned char *)info->si_addr < guard + pageRound(1))) {
+        siglongjmp(r->env, JIT_DEPTH);
+    }
+    siglongjmp(r->env, JIT_BOUNDS);
+}
+
+static void installHandlers(void) {
+    struct sigaction sa;
+    int i;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = onFault;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    for(i = 0; i < 3; ++i) {
+        sigaction(faults[i], &sa, &oldActions[i]);
+    }
+}
+
+JitStatus jitRun(Jit *jit, JitInput input, JitOutput output, void *arg) {
+    JitData *d = (JitData *)jit->mem;
+    int (*entry)(void *);
+    JitRun r;
+    stack_t alt, old;
+    volatile int status;
+
+    if(jit->entry < 0) {
+        return JIT_DONE;
+    }
+    if(jit->stack == NULL) {
+        jit->stack = mapMemory(SIGNALBYTES + pageRound(1) + STACKBYTES);
+        protect(jit->stack + SIGNALBYTES, pageRound(1), PROT_NONE);
+    }
+    pthread_once(&handlersOnce, installHandlers);
+
+    protect(jit->mem, pages(1), PROT_READ | PROT_WRITE);
+    d->input = input;
+    d->output = output;
+    d->arg = arg;
+    d->limit = jit->stack + SIGNALBYTES + pageRound(1) + HOSTBYTES;
+    protect(jit->mem, pages(1), PROT_READ);
+    memset(jit->mem + pages(GLOBALS), 0, jit->globalBytes);
+    entry = (int (*)(void *))(void *)(jit->mem + jit->entry);
+
+    alt.ss_sp = jit->stack;
+    alt.ss_size = SIGNALBYTES;
+    alt.ss_flags = 0;
+    sigaltstack(&alt, &old);
+    r.jit = jit;
+    status = sigsetjmp(r.env, 1);
+    if(status == JIT_DONE) {
+        running = &r;
+        status = entry(jit->stack + SIGNALBYTES + pageRound(1) + STACKBYTES);
+    }
+    running = NULL;
+    sigaltstack(&old, NULL);
+    return (JitStatus)status;
+}
+
+void freeJit(Jit *jit) {
+    if(jit->mem != NULL) {
+        munmap(jit->mem, jit->size);
+    }
+    if(jit->stack != NULL) {
+        munmap(jit->stack, SIGNALBYTES + pageRound(1) + STACKBYTES);
+    }
+    memset(jit, 0, sizeof(Jit));
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+/* x86-64 machine code in memory from code with registers allocated, run
+   in the calling process. The instructions are the ones codegen.h writes
+   as assembly, both chosen by select.h, encoded straight into an mmap'd
+   region. Its first page holds the host's pointers and the stack limit,
+   and is only readable while the program runs. The next holds the rsp
+   the entry notes, then comes a guard page, the globals and the code.
+   The code pages are writable while they are filled in and only
+   readable and executable once they run; never both.
+
+   Functions are laid out in one pass. Jumps back to a block already
+   placed are encoded directly, jumps forward and calls get a 32-bit
+   displacement that is filled in once the target is known. input() and
+   output() become calls to the host through the pointers jitRun is
+   given.
+
+   The program runs on a stack of its own with a guard page below it.
+   Every function checks on entry that its frame stays clear of the
+   guard, and a divisor is checked for zero; either way the program is
+   left through the entry. Dividing by -1 negates, as select.h has it. A
+   fault anywhere else in the program, such as an index far outside its
+   array, is caught by a signal handler on its own stack that jumps back
+   out of the run. So is an access just below the globals, and a store
+   to the pointers or the code. One that lands in other globals, or on
+   the page with the saved rsp further below, is not caught, as in C. */
+typedef enum { JIT_DONE, JIT_DIVZERO, JIT_BOUNDS, JIT_DEPTH } JitStatus;
+
+typedef int (*JitInput)(void *arg);
+typedef void (*JitOutput)(void *arg, int value);
+
+// a zeroed one is ready to use, and keeps its memory for the next module
+typedef struct _Jit {
+    unsigned char *mem;     // data, then code from dataSize on
+    size_t size;            // mapped
+    size_t dataSize;
+    size_t pos;             // end of the code so far
+    size_t globalBytes;
+    long entry;             // where a run starts, -1 if there is nothing to run
+    unsigned char *stack;   // signal stack, guard page and the program's stack
+} Jit;
+
+// FALSE if the module has no main or the code can't be made executable
+int jitCompile(Jit *jit, const IrModule *m, const RegAlloc *ra, const InternTable *names);
+/* main with fresh globals, input() and output() calling back with arg;
+   JIT_DONE without running anything if jitCompile failed */
+JitStatus jitRun(Jit *jit, JitInput input, JitOutput output, void *arg);
+void freeJit(Jit *jit);
+
+#endif
\ No newline at end of file
@@ -1,28 +1,505 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
-#include "parse.h"
+#include "compile.h"
+#include "pool.h"
+#include "intern.h"
+#include "flat.h"
+#include "astfile.h"
+#include "cache.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "jit.h"
+#include "vm.h"
+#include "backend.h"
+#include "opt.h"
+#include "codegen.h"
 
-FILE *inputfile, *outputfile;
-int lineno = 0;
-int Error = FALSE;
-int PrintScan = FALSE;
+#define DEFAULT_CACHE_BYTES (256ull << 20)
 
-int main(int argc, const char * argv[]) {
-    TreeNode *tree;
+// what happened to one input/output pair
+typedef enum { DONE_OK, NO_INPUT, NO_OUTPUT } JobStatus;
+typedef enum { UNCACHED, CACHE_HIT, CACHE_MISS } CacheUse;
+
+typedef struct _Job {
+    const char *input;
+    const char *output;
+    JobStatus status;
+    CacheUse cache;
+} Job;
+
+// state a worker reuses across its jobs
+typedef struct _Worker {
+    CompileContext ctx;
+    BackEnd be;             // code for -i and the options after it, on ctx's names
+    FILE *diag;             // scratch file diagnostics are captured in
+    char *diagBuf;
+    size_t diagCap;
+} Worker;
+
+typedef struct _Driver {
+    Job *jobs;
+    int numJobs;
+    int maxJobs;
+    Worker *workers;
+    int binary;             // write AST images instead of the text dump
+    int stats;
+    int lexAhead;           // lex each file whole before parsing it
+    CheckMode checks;
+    int fold;
+    int ir;                 // print three-address code instead of the tree
+    int regs;               // with registers allocated
+    int native;             // as x86-64 assembly
+    int run;                // compiled to memory and run, printing what it outputs
+    int bytecode;           // run as bytecode instead
+    const char *cacheDir;   // NULL if caching is off
+    unsigned long long cacheBytes;
+} Driver;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-j N] [-b] [-l] [-a|-A] [-O] [-i|-r|-S|-x|-v] [-s] [-c dir [-C size]] input output [input output ...]\n", prog);
+    fprintf(stderr, "       %s [-j N] [-b] [-l] [-a|-A] [-O] [-i|-r|-S|-x|-v] [-s] [-c dir [-C size]] -m manifest\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// bytes, with an optional K, M or G suffix
+static int parseSize(const char *s, unsigned long long *bytes) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    if(end == s) {
+        return FALSE;
+    }
+    switch(*end) {
+        case 'G': case 'g':
+            n <<= 10;
+            // fall through
+        case 'M': case 'm':
+            n <<= 10;
+            // fall through
+        case 'K': case 'k':
+            n <<= 10;
+            end++;
+        break;
+        default:
+        break;
+    }
+    *bytes = n;
+    return *end == '\0';
+}
+
+static char *copyString(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *t = (char *)malloc(len);
+
+    if(t == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(t, s, len);
+    return t;
+}
+
+static void addJob(Driver *d, const char *input, const char *output) {
+    if(d->numJobs == d->maxJobs) {
+        d->maxJobs = d->maxJobs ? d->maxJobs * 2 : 16;
+        d->jobs = (Job *)realloc(d->jobs, sizeof(Job) * d->maxJobs);
+        if(d->jobs == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    d->jobs[d->numJobs].input = input;
+    d->jobs[d->numJobs].output = output;
+    d->jobs[d->numJobs].status = DONE_OK;
+    d->jobs[d->numJobs].cache = UNCACHED;
+    d->numJobs++;
+}
+
+/* one "input output" pair per line; blank lines and lines starting with
+   '#' are skipped. Paths can't contain whitespace. */
+static void readManifest(Driver *d, const char *path) {
+    char line[2 * FILENAME_MAX + 16];
+    char input[FILENAME_MAX], output[FILENAME_MAX];
+    char fmt[32];
+    int n = 0;
+    FILE *fp = fopen(path, "r");
+
+    if(fp == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    sprintf(fmt, "%%%ds %%%ds", FILENAME_MAX - 1, FILENAME_MAX - 1);
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        int fields = sscanf(line, fmt, input, output);
 
-    // open inputfile & outputfile
-    inputfile = fopen(argv[1], "r");
-    outputfile = fopen(argv[2], "w");
+        n++;
+        if((fields <= 0) || (input[0] == '#')) {
+            continue;
+        }
+        if(fields != 2) {
+            fprintf(stderr, "%s:%d: expected \"input output\"\n", path, n);
+            exit(EXIT_FAILURE);
+        }
+        addJob(d, copyString(input), copyString(output));
+    }
+    fclose(fp);
+}
+
+// diagnostics written to the worker's scratch file since the rewind
+static const char *takeDiagnostics(Worker *w, unsigned int *len) {
+    long n = ftell(w->diag);
+
+    *len = 0;
+    if(n <= 0) {
+        return "";
+    }
+    if((size_t)n > w->diagCap) {
+        w->diagCap = (size_t)n;
+        w->diagBuf = (char *)realloc(w->diagBuf, w->diagCap);
+        if(w->diagBuf == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    rewind(w->diag);
+    *len = (unsigned int)fread(w->diagBuf, 1, (size_t)n, w->diag);
+    return w->diagBuf;
+}
 
-    // get syntax tree
-    tree = parse();
-    if(tree != NULL) {
+/* text dump or image of a stored parse. Diagnostics come first, as they
+   would from the parser. */
+static int emitImage(Driver *d, CompileContext *ctx, FlatTree *flat, FILE *outputfile) {
+    if(d->binary) {
+        fwrite(flat->diag, 1, flat->diagBytes, stderr);
+        return saveFlatTree(flat, outputfile);
+    }
+    fwrite(flat->diag, 1, flat->diagBytes, outputfile);
+    if(flat->count > 1) {
         fprintf(outputfile, "<<Syntax Tree>>\n");
-        printTree(tree);
+        ctx->out = outputfile;
+        printFlatTree(ctx, flat, 1);
+    }
+    return TRUE;
+}
+
+// input() of a program run with -x or -v reads stdin, 0 if there is nothing there
+static int readInput(void *arg) {
+    int value = 0;
+
+    (void)arg;
+    if(scanf("%d", &value) != 1) {
+        value = 0;
+    }
+    return value;
+}
+
+static void writeOutput(void *arg, int value) {
+    fprintf((FILE *)arg, "%d\n", value);
+}
+
+static void runProgram(BackEnd *be, FILE *outputfile) {
+    if(!jitCompile(&be->jit, &be->ir, &be->alloc, be->names)) {
+        fprintf(outputfile, "\n>>> Runtime error: cannot run without main or executable memory\n");
+    }
+    else {
+        switch(jitRun(&be->jit, readInput, writeOutput, outputfile)) {
+            case JIT_DIVZERO:
+                fprintf(outputfile, "\n>>> Runtime error: division by zero\n");
+            break;
+            case JIT_BOUNDS:
+                fprintf(outputfile, "\n>>> Runtime error: address out of range\n");
+            break;
+            case JIT_DEPTH:
+                fprintf(outputfile, "\n>>> Runtime error: calls nested too deep\n");
+            break;
+            default:
+            break;
+        }
+    }
+}
+
+static void runBytecode(BackEnd *be, FILE *outputfile) {
+    if(!vmCompile(&be->vm, &be->ir, be->names)) {
+        fprintf(outputfile, "\n>>> Runtime error: cannot run without main\n");
+        return;
+    }
+    switch(vmRun(&be->vm, readInput, writeOutput, outputfile)) {
+        case VM_DIVZERO:
+            fprintf(outputfile, "\n>>> Runtime error: division by zero\n");
+        break;
+        case VM_BOUNDS:
+            fprintf(outputfile, "\n>>> Runtime error: address out of range\n");
+        break;
+        case VM_DEPTH:
+            fprintf(outputfile, "\n>>> Runtime error: calls nested too deep\n");
+        break;
+        default:
+        break;
+    }
+}
+
+// parse the open source and write the result; with a cache, store it too
+static int emitParse(Driver *d, Worker *w, int worker, Job *j, CacheKey key, FILE *outputfile) {
+    CompileContext *ctx = &w->ctx;
+    FlatTree *flat;
+    TreeNode *tree;
+    int ok = TRUE;
+
+    // plain dump: diagnostics go straight to the output
+    if(!d->binary && (j->cache == UNCACHED)) {
+        ctx->out = outputfile;
+        tree = compileSource(ctx);
+        if(d->ir) {
+            if((tree != NULL) && checkCompiled(ctx, tree)) {
+                BackEnd *be = &w->be;
+
+                lowerTree(&be->ir, tree);
+                if(d->fold) {
+                    optimizeIr(&be->ir);
+                }
+                if(d->regs) {
+                    allocateRegisters(&be->ir, &be->alloc);
+                }
+                if(d->bytecode) {
+                    runBytecode(be, outputfile);
+                }
+                else if(d->run) {
+                    runProgram(be, outputfile);
+                }
+                else if(d->native) {
+                    emitAssembly(&be->ir, &be->alloc, be->names, outputfile);
+                }
+                else if(d->regs) {
+                    fprintf(outputfile, "<<Register Allocation>>\n");
+                    printAlloc(&be->ir, &be->alloc, be->names, outputfile);
+                }
+                else {
+                    fprintf(outputfile, "<<Three-Address Code>>\n");
+                    printIr(&be->ir, be->names, outputfile);
+                }
+            }
+        }
+        else if(tree != NULL) {
+            fprintf(outputfile, "<<Syntax Tree>>\n");
+            printTree(ctx, tree);
+        }
+        return TRUE;
+    }
+
+    // otherwise they are kept with the tree
+    rewind(w->diag);
+    ctx->out = w->diag;
+    tree = compileSource(ctx);
+    flat = flattenTree(ctx, tree);
+    flat->diag = takeDiagnostics(w, &flat->diagBytes);
+
+    ok = emitImage(d, ctx, flat, outputfile);
+    // the cache is best effort; a failed store just means another miss
+    if(j->cache == CACHE_MISS) {
+        cacheStore(d->cacheDir, key, flat, worker);
+    }
+    freeFlatTree(flat);
+    return ok;
+}
+
+// runs on a worker; workers' state is reused across their jobs
+static void compileJob(void *arg, int job, int worker) {
+    Driver *d = (Driver *)arg;
+    Job *j = &d->jobs[job];
+    Worker *w = &d->workers[worker];
+    CompileContext *ctx = &w->ctx;
+    FILE *inputfile, *outputfile;
+    FlatTree *flat = NULL;
+    CacheKey key = {0, 0};
+
+    inputfile = fopen(j->input, "r");
+    if(inputfile == NULL) {
+        j->status = NO_INPUT;
+        return;
+    }
+    outputfile = fopen(j->output, d->binary ? "wb" : "w");
+    if(outputfile == NULL) {
+        j->status = NO_OUTPUT;
+        fclose(inputfile);
+        return;
     }
 
-    // close inputfile & outputfile
+    if(!openSource(ctx, inputfile)) {
+        j->status = NO_INPUT;
+    }
+    else {
+        // a hit skips scanning and parsing altogether; the cache holds trees, not code
+        if((d->cacheDir != NULL) && !d->ir) {
+            // both ways of checking give the same result
+            key = cacheKey(ctx->srcBase, (size_t)(ctx->srcEnd - ctx->srcBase),
+                (d->checks != CHECK_NONE) | (d->fold << 1));
+            flat = cacheLoad(d->cacheDir, key);
+            j->cache = (flat != NULL) ? CACHE_HIT : CACHE_MISS;
+        }
+        if(flat != NULL) {
+            if(!emitImage(d, ctx, flat, outputfile)) {
+                j->status = NO_OUTPUT;
+            }
+            freeFlatTree(flat);
+        }
+        else if(!emitParse(d, w, worker, j, key, outputfile)) {
+            j->status = NO_OUTPUT;
+        }
+    }
+    closeSource(ctx);
+    ctx->out = NULL;
+
     fclose(inputfile);
-    fclose(outputfile);
+    if(fclose(outputfile) != 0) {
+        j->status = NO_OUTPUT;
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    Driver d;
+    int threads = 0;
+    int fileThreads;
+    int failed = 0;
+    int hits = 0;
+    int misses = 0;
+    int i;
+
+    memset(&d, 0, sizeof(Driver));
+    d.cacheBytes = DEFAULT_CACHE_BYTES;
+
+    // options, then the input/output pairs
+    for(i = 1; (i < argc) && (argv[i][0] == '-') && argv[i][1]; ++i) {
+        if(!strcmp(argv[i], "-j") && (i + 1 < argc)) {
+            threads = atoi(argv[++i]);
+            if(threads <= 0) {
+                usage(argv[0]);
+            }
+        }
+        else if(!strcmp(argv[i], "-b")) {
+            d.binary = TRUE;
+        }
+        else if(!strcmp(argv[i], "-l")) {
+            d.lexAhead = TRUE;
+        }
+        else if(!strcmp(argv[i], "-a")) {
+            d.checks = CHECK_FUSED;
+        }
+        else if(!strcmp(argv[i], "-A")) {
+            d.checks = CHECK_PASS;
+        }
+        else if(!strcmp(argv[i], "-O")) {
+            d.fold = TRUE;
+        }
+        else if(!strcmp(argv[i], "-i")) {
+            d.ir = TRUE;
+        }
+        else if(!strcmp(argv[i], "-r")) {
+            d.ir = d.regs = TRUE;
+        }
+        else if(!strcmp(argv[i], "-S")) {
+            d.ir = d.regs = d.native = TRUE;
+        }
+        else if(!strcmp(argv[i], "-x")) {
+            d.ir = d.regs = d.run = TRUE;
+        }
+        else if(!strcmp(argv[i], "-v")) {
+            d.ir = d.run = d.bytecode = TRUE;
+        }
+        else if(!strcmp(argv[i], "-s")) {
+            d.stats = TRUE;
+        }
+        else if(!strcmp(argv[i], "-c") && (i + 1 < argc)) {
+            d.cacheDir = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-C") && (i + 1 < argc)) {
+            if(!parseSize(argv[++i], &d.cacheBytes)) {
+                usage(argv[0]);
+            }
+        }
+        else if(!strcmp(argv[i], "-m") && (i + 1 < argc)) {
+            readManifest(&d, argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+    if(((argc - i) % 2 != 0) || ((d.numJobs == 0) && (i == argc)) || (d.ir && d.binary)) {
+        usage(argv[0]);
+    }
+    for(; i < argc; i += 2) {
+        addJob(&d, argv[i], argv[i+1]);
+    }
+
+    if((d.cacheDir != NULL) && !cacheOpen(d.cacheDir)) {
+        fprintf(stderr, "cannot use cache directory %s\n", d.cacheDir);
+        exit(EXIT_FAILURE);
+    }
+
+    if(threads == 0) {
+        threads = poolThreads();
+    }
+    // threads left over from too few files go to lexing and parsing each one
+    fileThreads = threads / d.numJobs;
+    if(threads > d.numJobs) {
+        threads = d.numJobs;
+    }
+    d.workers = (Worker *)calloc(threads, sizeof(Worker));
+    if(d.workers == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < threads; ++i) {
+        initContext(&d.workers[i].ctx, NULL);
+        initBackEnd(&d.workers[i].be, &d.workers[i].ctx.names);
+        d.workers[i].ctx.lexAhead = d.lexAhead;
+        d.workers[i].ctx.checks = d.checks;
+        d.workers[i].ctx.fold = d.fold;
+        d.workers[i].ctx.threads = fileThreads;
+        if(d.binary || (d.cacheDir != NULL)) {
+            d.workers[i].diag = tmpfile();
+            if(d.workers[i].diag == NULL) {
+                fprintf(stderr, "cannot create a temporary file\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    runPool(threads, d.numJobs, compileJob, &d);
+
+    // report in input order, whatever order the workers finished in
+    for(i = 0; i < d.numJobs; ++i) {
+        if(d.jobs[i].status == NO_INPUT) {
+            fprintf(stderr, "cannot read %s\n", d.jobs[i].input);
+            failed++;
+        }
+        else if(d.jobs[i].status == NO_OUTPUT) {
+            fprintf(stderr, "cannot write %s\n", d.jobs[i].output);
+            failed++;
+        }
+        hits += (d.jobs[i].cache == CACHE_HIT);
+        misses += (d.jobs[i].cache == CACHE_MISS);
+    }
+
+    if(d.cacheDir != NULL) {
+        unsigned long long kept;
+        long evicted = cacheTrim(d.cacheDir, d.cacheBytes, &kept);
+
+        if(d.stats) {
+            fprintf(stderr, "cache: %d hits, %d misses, %ld evicted, %.1f MB in %s\n",
+                hits, misses, evicted, kept / 1048576.0, d.cacheDir);
+        }
+    }
+
+    for(i = 0; i < threads; ++i) {
+        freeContext(&d.workers[i].ctx);
+        freeBackEnd(&d.workers[i].be);
+        if(d.workers[i].diag != NULL) {
+            fclose(d.workers[i].diag);
+        }
+        free(d.workers[i].diagBuf);
+    }
+    free(d.workers);
+    free(d.jobs);
+    return failed ? EXIT_FAILURE : 0;
 }
\ No newline at end of file
@@ -0,0 +1,1583 @@
+#include <limits.h>
+
+#include "globals.h"
+#include "ir.h"
+#include "opt.h"
+
+#define INITOPT 64
+
+/* ops only the optimizer uses, after the last real one. A phi's arguments
+   are args[a, a + predecessors), in the order of its block's preds; b is
+   the register it was placed for. */
+#define OP_PHI ((IrOp)(IR_BRZ + 1))
+#define OP_DEAD ((IrOp)(IR_BRZ + 2))
+
+// where a register is read or defined: code index, phi k, or the branch
+#define SITE_PHI(k) (-1 - (k))
+#define SITE_BRANCH INT_MIN
+
+// lattice of the constant propagation
+enum { UNKNOWN, CONSTANT, VARYING };
+
+typedef struct _OptBlock {
+    IrInst *code;           // the jump at the end is in succ, not here
+    int numCode;
+    int maxCode;
+    IrInst *phis;
+    int numPhis;
+    int maxPhis;
+    int *preds;             // phi arguments come in this order
+    char *predExec;         // the edge from preds[i] can run
+    int numPreds;
+    int maxPreds;
+    int succ[2];            // next block, and for a branch the one it goes to on 0
+    int numSuccs;           // 0 after a return
+    int cond;               // what a branch tests
+    int rpo;                // place in reverse postorder, -1 if unreachable
+    int idom;
+    int domChild;
+    int domNext;
+    int exec;
+    int phiStamp;
+    int workStamp;
+    int placed;
+    int endGen;             // memory generation at its end, see numberBlock
+    int id;                 // in the rebuilt module
+} OptBlock;
+
+typedef struct _OptReg {
+    int defs;               // definitions before SSA
+    int cur;                // while renaming: the variable's current name
+    int block;              // the one definition in SSA; block -1 for a parameter
+    int site;
+    int state;              // constant propagation
+    int val;
+    int repl;               // value numbering: what it was replaced by
+    int live;
+    int renum;
+} OptReg;
+
+typedef struct _OptUse {
+    int block;
+    int site;
+} OptUse;
+
+typedef struct _OptExpr {
+    int op;                 // -1 if the entry is empty
+    int a;
+    int b;
+    int val;                // for memory: the generation it is valid in
+    int result;
+} OptExpr;
+
+typedef struct _Optimizer {
+    IrModule *m;
+    IrFunc *f;
+    int zero;               // the constant 0, made once per function
+    OptBlock *blocks;
+    int numBlocks;
+    int maxBlocks;
+    int *order;             // reachable blocks in reverse postorder
+    int numOrder;
+    int maxOrder;
+    int *args;              // phi arguments
+    int numArgs;
+    int maxArgs;
+    OptReg *regs;
+    int numRegs;
+    int maxRegs;
+    int origRegs;           // registers before SSA
+    int *frontStart;        // dominance frontiers, CSR over blocks
+    int maxFrontStart;
+    int *front;
+    int maxFront;
+    int *start;             // CSR over registers: blocks defining it, then where it is used
+    int maxStart;
+    int *list;
+    int maxList;
+    OptUse *uses;
+    int maxUses;
+    int *work;
+    int numWork;
+    int maxWork;
+    int *edges;             // constant propagation: edges found to run, pairs
+    int numEdges;
+    int maxEdges;
+    int *stack;
+    int maxStack;
+    int *log;               // renaming: variable and old name, pairs
+    int numLog;
+    int maxLog;
+    OptExpr *exprs;         // value numbering: scoped table, and loads of a block
+    OptExpr *mem;
+    unsigned int exprMask;
+    unsigned int maxExprs;
+    int gen;
+    IrInst *copies;         // parallel copies on one edge
+    int numCopies;
+    int maxCopies;
+    // the module being rebuilt
+    IrInst *insts;
+    int numInsts;
+    int maxInsts;
+    IrBlock *outBlocks;
+    int numOutBlocks;
+    int maxOutBlocks;
+} Optimizer;
+
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        if(*max < INITOPT) {
+            *max = INITOPT;
+        }
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+static void push(Optimizer *o, int x) {
+    o->work = (int *)growArray(o->work, &o->maxWork, o->numWork + 1, sizeof(int));
+    o->work[o->numWork++] = x;
+}
+
+static int readsA(IrOp op) {
+    return (op != IR_ADDR) && (op != IR_CALL) && (op != IR_JMP) && (op != OP_DEAD);
+}
+
+static int readsB(IrOp op) {
+    return ((op >= IR_ADD) && (op <= IR_NE)) || (op == IR_INDEX) || (op == IR_STORE);
+}
+
+// computes a value from its operands and nothing else
+static int isPure(IrOp op) {
+    return (op <= IR_INDEX) || (op == OP_PHI);
+}
+
+static int isReg(int x) {
+    return x >= 0;
+}
+
+static int newBlock(Optimizer *o) {
+    OptBlock *b;
+    int n = o->maxBlocks;
+
+    o->blocks = (OptBlock *)growArray(o->blocks, &o->maxBlocks, o->numBlocks + 1, sizeof(OptBlock));
+    if(o->maxBlocks > n) {
+        memset(o->blocks + n, 0, sizeof(OptBlock) * (o->maxBlocks - n));
+    }
+    b = &o->blocks[o->numBlocks];
+    b->numCode = b->numPhis = b->numPreds = b->numSuccs = 0;
+    b->cond = IR_NONE;
+    b->rpo = -1;
+    b->phiStamp = b->workStamp = 0;
+    return o->numBlocks++;
+}
+
+static void addCode(OptBlock *b, IrInst in) {
+    b->code = (IrInst *)growArray(b->code, &b->maxCode, b->numCode + 1, sizeof(IrInst));
+    b->code[b->numCode++] = in;
+}
+
+static void addPred(OptBlock *b, int p) {
+    int n = b->maxPreds;
+
+    b->preds = (int *)growArray(b->preds, &b->maxPreds, b->numPreds + 1, sizeof(int));
+    if(b->maxPreds > n) {
+        b->predExec = (char *)realloc(b->predExec, b->maxPreds);
+        if(b->predExec == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    b->predExec[b->numPreds] = FALSE;
+    b->preds[b->numPreds++] = p;
+}
+
+static int predIndex(const OptBlock *b, int p) {
+    int i;
+
+    for(i = 0; b->preds[i] != p; ++i);
+    return i;
+}
+
+static int newReg(Optimizer *o) {
+    OptReg *r;
+
+    o->regs = (OptReg *)growArray(o->regs, &o->maxRegs, o->numRegs + 1, sizeof(OptReg));
+    r = &o->regs[o->numRegs];
+    memset(r, 0, sizeof(OptReg));
+    r->cur = IR_NONE;
+    r->block = -1;
+    r->repl = o->numRegs;
+    return o->numRegs++;
+}
+
+static int zero(Optimizer *o) {
+    if(o->zero == IR_NONE) {
+        o->zero = irConst(o->m, 0);
+    }
+    return o->zero;
+}
+
+// the function's blocks, with jumps turned into successors
+static void loadFunction(Optimizer *o) {
+    IrModule *m = o->m;
+    IrFunc *f = o->f;
+    OptBlock *b;
+    IrInst *in;
+    int i, j;
+
+    o->numBlocks = 0;
+    o->numArgs = 0;
+    o->zero = IR_NONE;
+    for(i = 0; i < f->numBlocks; ++i) {
+        newBlock(o);
+        b = &o->blocks[i];
+        for(j = m->blocks[f->firstBlock + i].start; j < m->blocks[f->firstBlock + i].end; ++j) {
+            in = &m->insts[j];
+            if(in->op == IR_JMP) {
+                b->succ[0] = in->a - f->firstBlock;
+                b->numSuccs = 1;
+            }
+            else if(in->op == IR_BRZ) {
+                b->cond = in->a;
+                b->succ[0] = i + 1;
+                b->succ[1] = in->b - f->firstBlock;
+                b->numSuccs = (b->succ[0] == b->succ[1]) ? 1 : 2;
+            }
+            else {
+                addCode(b, *in);
+            }
+        }
+        // the last block always returns
+        if((b->numSuccs == 0) && ((b->numCode == 0) || (b->code[b->numCode - 1].op != IR_RET))) {
+            b->succ[0] = i + 1;
+            b->numSuccs = 1;
+        }
+    }
+
+    o->numRegs = 0;
+    for(i = 0; i < f->numRegs; ++i) {
+        newReg(o);
+    }
+    o->origRegs = f->numRegs;
+}
+
+// reverse postorder of what the entry reaches
+static void computeOrder(Optimizer *o) {
+    OptBlock *b;
+    int top = 0;
+    int i, s;
+
+    for(i = 0; i < o->numBlocks; ++i) {
+        o->blocks[i].rpo = -1;
+        o->blocks[i].placed = 0;    // successors visited so far
+    }
+    o->order = (int *)growArray(o->order, &o->maxOrder, o->numBlocks, sizeof(int));
+    o->numOrder = o->numBlocks;
+    o->stack = (int *)growArray(o->stack, &o->maxStack, o->numBlocks + 1, sizeof(int));
+    o->stack[top++] = 0;
+    o->blocks[0].rpo = 0;
+    i = o->numBlocks;
+    while(top > 0) {
+        b = &o->blocks[o->stack[top - 1]];
+        if(b->placed < b->numSuccs) {
+            s = b->succ[b->placed++];
+            if(o->blocks[s].rpo < 0) {
+                o->blocks[s].rpo = 0;
+                o->stack[top++] = s;
+            }
+            continue;
+        }
+        o->order[--i] = o->stack[--top];
+    }
+    // the unreachable ones left a gap at the front
+    o->numOrder -= i;
+    memmove(o->order, o->order + i, sizeof(int) * o->numOrder);
+    for(i = 0; i < o->numOrder; ++i) {
+        o->blocks[o->order[i]].rpo = i;
+    }
+}
+
+static void computePreds(Optimizer *o) {
+    OptBlock *b;
+    int i, k;
+
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(k = 0; k < b->numSuccs; ++k) {
+            addPred(&o->blocks[b->succ[k]], o->order[i]);
+        }
+    }
+}
+
+static int intersect(Optimizer *o, int a, int b) {
+    while(a != b) {
+        while(o->blocks[a].rpo > o->blocks[b].rpo) {
+            a = o->blocks[a].idom;
+        }
+        while(o->blocks[b].rpo > o->blocks[a].rpo) {
+            b = o->blocks[b].idom;
+        }
+    }
+    return a;
+}
+
+/* iterative dominators over reverse postorder (Cooper, Harvey and
+   Kennedy), and the dominator tree as child and sibling links */
+static void computeDominators(Optimizer *o) {
+    OptBlock *b;
+    int changed = TRUE;
+    int i, k, d, p;
+
+    for(i = 0; i < o->numOrder; ++i) {
+        o->blocks[o->order[i]].idom = -1;
+        o->blocks[o->order[i]].domChild = -1;
+    }
+    o->blocks[0].idom = 0;
+    while(changed) {
+        changed = FALSE;
+        for(i = 1; i < o->numOrder; ++i) {
+            b = &o->blocks[o->order[i]];
+            d = -1;
+            for(k = 0; k < b->numPreds; ++k) {
+                p = b->preds[k];
+                if(o->blocks[p].idom >= 0) {
+                    d = (d < 0) ? p : intersect(o, p, d);
+                }
+            }
+            if(b->idom != d) {
+                b->idom = d;
+                changed = TRUE;
+            }
+        }
+    }
+    for(i = o->numOrder - 1; i > 0; --i) {
+        b = &o->blocks[o->order[i]];
+        b->domNext = o->blocks[b->idom].domChild;
+        o->blocks[b->idom].domChild = o->order[i];
+    }
+}
+
+/* dominance frontiers as CSR over blocks: frontStart[b] to
+   frontStart[b + 1] in front. Walked twice, to count and then to fill. */
+static void computeFrontiers(Optimizer *o) {
+    OptBlock *b;
+    int fill, i, k, r;
+
+    o->frontStart = (int *)growArray(o->frontStart, &o->maxFrontStart, o->numBlocks + 1, sizeof(int));
+    memset(o->frontStart, 0, sizeof(int) * (o->numBlocks + 1));
+    for(fill = 0; fill < 2; ++fill) {
+        for(i = 0; i < o->numBlocks; ++i) {
+            o->blocks[i].workStamp = -1;
+        }
+        for(i = 0; i < o->numOrder; ++i) {
+            b = &o->blocks[o->order[i]];
+            if(b->numPreds < 2) {
+                continue;
+            }
+            // a runner already in this frontier had its dominators added too
+            for(k = 0; k < b->numPreds; ++k) {
+                for(r = b->preds[k]; (r != b->idom) && (o->blocks[r].workStamp != o->order[i]); r = o->blocks[r].idom) {
+                    o->blocks[r].workStamp = o->order[i];
+                    if(fill) {
+                        o->front[o->frontStart[r + 1]++] = o->order[i];
+                    }
+                    else {
+                        o->frontStart[r + 1]++;
+                    }
+                }
+            }
+        }
+        if(!fill) {
+            for(i = 0; i < o->numBlocks; ++i) {
+                o->frontStart[i + 1] += o->frontStart[i];
+            }
+            o->front = (int *)growArray(o->front, &o->maxFront, o->frontStart[o->numBlocks] + 1, sizeof(int));
+            // filling moves each frontStart[b + 1] from the start of b's range to its end
+            memmove(o->frontStart + 1, o->frontStart, sizeof(int) * o->numBlocks);
+        }
+    }
+    for(i = 0; i < o->numBlocks; ++i) {
+        o->blocks[i].workStamp = o->blocks[i].phiStamp = 0;
+    }
+}
+
+static void addPhi(Optimizer *o, OptBlock *b, int var) {
+    IrInst phi;
+    int i;
+
+    phi.op = OP_PHI;
+    phi.dst = var;
+    phi.a = o->numArgs;
+    phi.b = var;
+    o->args = (int *)growArray(o->args, &o->maxArgs, o->numArgs + b->numPreds, sizeof(int));
+    for(i = 0; i < b->numPreds; ++i) {
+        o->args[o->numArgs++] = IR_NONE;
+    }
+    b->phis = (IrInst *)growArray(b->phis, &b->maxPhis, b->numPhis + 1, sizeof(IrInst));
+    b->phis[b->numPhis++] = phi;
+}
+
+/* a phi for every variable with more than one definition, at the iterated
+   frontier of its definitions. Parameters are defined in the entry. */
+static void placePhis(Optimizer *o) {
+    OptBlock *b;
+    IrInst *in;
+    int i, k, v, d, y;
+
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(k = 0; k < b->numCode; ++k) {
+            if(isReg(b->code[k].dst)) {
+                o->regs[b->code[k].dst].defs++;
+            }
+        }
+    }
+    for(v = 0; v < o->f->numParams; ++v) {
+        o->regs[v].defs++;
+        o->regs[v].cur = v;
+    }
+
+    // the blocks defining each variable
+    o->start = (int *)growArray(o->start, &o->maxStart, o->origRegs + 1, sizeof(int));
+    o->start[0] = 0;
+    for(v = 0; v < o->origRegs; ++v) {
+        o->start[v + 1] = o->start[v] + o->regs[v].defs;
+    }
+    o->list = (int *)growArray(o->list, &o->maxList, o->start[o->origRegs] + 1, sizeof(int));
+    for(v = 0; v < o->f->numParams; ++v) {
+        o->list[o->start[v]++] = 0;
+    }
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(k = 0; k < b->numCode; ++k) {
+            in = &b->code[k];
+            if(isReg(in->dst)) {
+                o->list[o->start[in->dst]++] = o->order[i];
+            }
+        }
+    }
+    for(v = o->origRegs; v > 0; --v) {
+        o->start[v] = o->start[v - 1];
+    }
+    o->start[0] = 0;
+
+    for(v = 0; v < o->origRegs; ++v) {
+        if(o->regs[v].defs < 2) {
+            continue;
+        }
+        o->numWork = 0;
+        for(i = o->start[v]; i < o->start[v + 1]; ++i) {
+            if(o->blocks[o->list[i]].workStamp != v + 1) {
+                o->blocks[o->list[i]].workStamp = v + 1;
+                push(o, o->list[i]);
+            }
+        }
+        while(o->numWork > 0) {
+            d = o->work[--o->numWork];
+            for(k = o->frontStart[d]; k < o->frontStart[d + 1]; ++k) {
+                y = o->front[k];
+                if(o->blocks[y].phiStamp != v + 1) {
+                    o->blocks[y].phiStamp = v + 1;
+                    addPhi(o, &o->blocks[y], v);
+                    if(o->blocks[y].workStamp != v + 1) {
+                        o->blocks[y].workStamp = v + 1;
+                        push(o, y);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// the name variable x has here; a use no definition reaches reads 0
+static int current(Optimizer *o, int x) {
+    if(!isReg(x) || (x >= o->origRegs) || (o->regs[x].defs < 2)) {
+        return x;
+    }
+    return isReg(o->regs[x].cur) ? o->regs[x].cur : zero(o);
+}
+
+static void define(Optimizer *o, int var, int name) {
+    o->log = (int *)growArray(o->log, &o->maxLog, o->numLog + 2, sizeof(int));
+    o->log[o->numLog++] = var;
+    o->log[o->numLog++] = o->regs[var].cur;
+    o->regs[var].cur = name;
+}
+
+static void renameBlock(Optimizer *o, int bi) {
+    OptBlock *b = &o->blocks[bi];
+    OptBlock *s;
+    IrInst *in;
+    int i, k, j, n;
+
+    for(i = 0; i < b->numPhis; ++i) {
+        n = newReg(o);
+        define(o, b->phis[i].b, n);
+        b->phis[i].dst = n;
+    }
+    for(i = 0; i < b->numCode; ++i) {
+        in = &b->code[i];
+        if(readsA(in->op)) {
+            in->a = current(o, in->a);
+        }
+        if(readsB(in->op)) {
+            in->b = current(o, in->b);
+        }
+        if(isReg(in->dst) && (o->regs[in->dst].defs > 1)) {
+            n = newReg(o);
+            define(o, in->dst, n);
+            in->dst = n;
+        }
+    }
+    if(b->numSuccs == 2) {
+        b->cond = current(o, b->cond);
+    }
+    for(k = 0; k < b->numSuccs; ++k) {
+        s = &o->blocks[b->succ[k]];
+        j = predIndex(s, bi);
+        for(i = 0; i < s->numPhis; ++i) {
+            o->args[s->phis[i].a + j] = current(o, s->phis[i].b);
+        }
+    }
+}
+
+/* renaming walks the dominator tree, with the names a block defined
+   undone once everything it dominates is done. The stack holds a block
+   to visit, or ~mark to undo the log back to mark. */
+static void renameAll(Optimizer *o) {
+    int top = 0;
+    int x, c;
+
+    o->numLog = 0;
+    o->stack = (int *)growArray(o->stack, &o->maxStack, 2 * o->numBlocks + 2, sizeof(int));
+    o->stack[top++] = 0;
+    while(top > 0) {
+        x = o->stack[--top];
+        if(x < 0) {
+            while(o->numLog > ~x) {
+                o->numLog -= 2;
+                o->regs[o->log[o->numLog]].cur = o->log[o->numLog + 1];
+            }
+            continue;
+        }
+        o->stack[top++] = ~o->numLog;
+        renameBlock(o, x);
+        for(c = o->blocks[x].domChild; c >= 0; c = o->blocks[c].domNext) {
+            o->stack[top++] = c;
+        }
+    }
+}
+
+static void buildSsa(Optimizer *o) {
+    computeFrontiers(o);
+    placePhis(o);
+    renameAll(o);
+}
+
+// where each register is defined and read
+static void findSites(Optimizer *o) {
+    OptBlock *b;
+    IrInst *in;
+    int fill, i, k, j, x;
+
+    o->start = (int *)growArray(o->start, &o->maxStart, o->numRegs + 1, sizeof(int));
+    for(fill = 0; fill < 2; ++fill) {
+        if(!fill) {
+            memset(o->start, 0, sizeof(int) * (o->numRegs + 1));
+        }
+        for(i = 0; i < o->numOrder; ++i) {
+            b = &o->blocks[o->order[i]];
+            for(k = 0; k < b->numPhis; ++k) {
+                for(j = 0; j < b->numPreds; ++j) {
+                    x = o->args[b->phis[k].a + j];
+                    if(isReg(x)) {
+                        if(fill) {
+                            o->uses[o->start[x + 1]].block = o->order[i];
+                            o->uses[o->start[x + 1]++].site = SITE_PHI(k);
+                        }
+                        else {
+                            o->start[x + 1]++;
+                        }
+                    }
+                }
+                o->regs[b->phis[k].dst].block = o->order[i];
+                o->regs[b->phis[k].dst].site = SITE_PHI(k);
+            }
+            for(k = 0; k < b->numCode + 1; ++k) {
+                in = (k < b->numCode) ? &b->code[k] : NULL;
+                for(j = 0; j < 2; ++j) {
+                    if(k == b->numCode) {
+                        x = ((b->numSuccs == 2) && !j) ? b->cond : IR_NONE;
+                    }
+                    else {
+                        x = j ? (readsB(in->op) ? in->b : IR_NONE) : (readsA(in->op) ? in->a : IR_NONE);
+                    }
+                    if(!isReg(x)) {
+                        continue;
+                    }
+                    if(fill) {
+                        o->uses[o->start[x + 1]].block = o->order[i];
+                        o->uses[o->start[x + 1]++].site = (k == b->numCode) ? SITE_BRANCH : k;
+                    }
+                    else {
+                        o->start[x + 1]++;
+                    }
+                }
+                if((in != NULL) && isReg(in->dst)) {
+                    o->regs[in->dst].block = o->order[i];
+                    o->regs[in->dst].site = k;
+                }
+            }
+        }
+        if(!fill) {
+            for(i = 0; i < o->numRegs; ++i) {
+                o->start[i + 1] += o->start[i];
+            }
+            o->uses = (OptUse *)growArray(o->uses, &o->maxUses, o->start[o->numRegs] + 1, sizeof(OptUse));
+            memmove(o->start + 1, o->start, sizeof(int) * o->numRegs);
+        }
+    }
+}
+
+// x op y as the program computes it, FALSE if that must wait for run time
+static int evaluate(IrOp op, int x, int y, int *val) {
+    switch(op) {
+        case IR_ADD:
+            *val = (int)((unsigned int)x + (unsigned int)y);
+            return TRUE;
+        case IR_SUB:
+            *val = (int)((unsigned int)x - (unsigned int)y);
+            return TRUE;
+        case IR_MUL:
+            *val = (int)((unsigned int)x * (unsigned int)y);
+            return TRUE;
+        case IR_DIV:
+            if((y == 0) || ((x == INT_MIN) && (y == -1))) {
+                return FALSE;
+            }
+            *val = x / y;
+            return TRUE;
+        case IR_LT: *val = x < y; return TRUE;
+        case IR_LE: *val = x <= y; return TRUE;
+        case IR_GT: *val = x > y; return TRUE;
+        case IR_GE: *val = x >= y; return TRUE;
+        case IR_EQ: *val = x == y; return TRUE;
+        case IR_NE: *val = x != y; return TRUE;
+        default: return FALSE;
+    }
+}
+
+static int latticeOf(Optimizer *o, int x, int *val) {
+    if(IR_ISCONST(x)) {
+        *val = o->m->consts[IR_CONSTINDEX(x)];
+        return CONSTANT;
+    }
+    *val = o->regs[x].val;
+    return o->regs[x].state;
+}
+
+// lowers r to the meet of what it was and state/val
+static void lower(Optimizer *o, int r, int state, int val) {
+    OptReg *g = &o->regs[r];
+
+    if((state == CONSTANT) && (g->state == CONSTANT) && (val != g->val)) {
+        state = VARYING;
+    }
+    if(state > g->state) {
+        g->state = state;
+        g->val = val;
+        push(o, r);
+    }
+}
+
+static void edgeTo(Optimizer *o, int from, int to) {
+    o->edges = (int *)growArray(o->edges, &o->maxEdges, o->numEdges + 2, sizeof(int));
+    o->edges[o->numEdges++] = from;
+    o->edges[o->numEdges++] = to;
+}
+
+static void visitPhi(Optimizer *o, int bi, int k) {
+    OptBlock *b = &o->blocks[bi];
+    int state = UNKNOWN;
+    int val = 0;
+    int s, v, j;
+
+    for(j = 0; (j < b->numPreds) && (state != VARYING); ++j) {
+        if(!b->predExec[j]) {
+            continue;
+        }
+        s = latticeOf(o, o->args[b->phis[k].a + j], &v);
+        if((s == VARYING) || ((s == CONSTANT) && (state == CONSTANT) && (v != val))) {
+            state = VARYING;
+        }
+        else if(s == CONSTANT) {
+            state = CONSTANT;
+            val = v;
+        }
+    }
+    lower(o, b->phis[k].dst, state, val);
+}
+
+static void visitCode(Optimizer *o, IrInst *in) {
+    int sa, sb, va, vb, v;
+
+    if(!isReg(in->dst)) {
+        return;
+    }
+    if(in->op == IR_MOV) {
+        sa = latticeOf(o, in->a, &va);
+        lower(o, in->dst, sa, va);
+    }
+    else if((in->op >= IR_ADD) && (in->op <= IR_NE)) {
+        sa = latticeOf(o, in->a, &va);
+        sb = latticeOf(o, in->b, &vb);
+        if((sa == VARYING) || (sb == VARYING)) {
+            lower(o, in->dst, VARYING, 0);
+        }
+        else if((sa == CONSTANT) && (sb == CONSTANT)) {
+            if(evaluate(in->op, va, vb, &v)) {
+                lower(o, in->dst, CONSTANT, v);
+            }
+            else {
+                lower(o, in->dst, VARYING, 0);
+            }
+        }
+    }
+    else {
+        lower(o, in->dst, VARYING, 0);
+    }
+}
+
+static void visitBranch(Optimizer *o, int bi) {
+    OptBlock *b = &o->blocks[bi];
+    int s, v;
+
+    if(b->numSuccs == 1) {
+        edgeTo(o, bi, b->succ[0]);
+    }
+    else if(b->numSuccs == 2) {
+        s = latticeOf(o, b->cond, &v);
+        if((s == VARYING) || ((s == CONSTANT) && v)) {
+            edgeTo(o, bi, b->succ[0]);
+        }
+        if((s == VARYING) || ((s == CONSTANT) && !v)) {
+            edgeTo(o, bi, b->succ[1]);
+        }
+    }
+}
+
+// an edge runs: phis see another argument, and a block runs for the first time
+static void visitEdge(Optimizer *o, int from, int to) {
+    OptBlock *b = &o->blocks[to];
+    int j = predIndex(b, from);
+    int k;
+
+    if(b->predExec[j]) {
+        return;
+    }
+    b->predExec[j] = TRUE;
+    for(k = 0; k < b->numPhis; ++k) {
+        visitPhi(o, to, k);
+    }
+    if(b->exec) {
+        return;
+    }
+    b->exec = TRUE;
+    for(k = 0; k < b->numCode; ++k) {
+        visitCode(o, &b->code[k]);
+    }
+    visitBranch(o, to);
+}
+
+/* sparse conditional constant propagation (Wegman and Zadeck). Edges
+   found to run and registers that changed each have a work list; a
+   block's code is visited when its first edge runs, and the uses of a
+   register each time it changes. */
+static void propagate(Optimizer *o) {
+    OptBlock *b;
+    OptUse *u;
+    int i, r;
+
+    for(i = 0; i < o->numBlocks; ++i) {
+        o->blocks[i].exec = FALSE;
+    }
+    for(i = 0; i < o->numRegs; ++i) {
+        o->regs[i].state = (i < o->f->numParams) ? VARYING : UNKNOWN;
+    }
+    o->numWork = 0;
+    o->numEdges = 0;
+    b = &o->blocks[0];
+    b->exec = TRUE;
+    for(i = 0; i < b->numCode; ++i) {
+        visitCode(o, &b->code[i]);
+    }
+    visitBranch(o, 0);
+
+    while((o->numWork > 0) || (o->numEdges > 0)) {
+        if(o->numEdges > 0) {
+            o->numEdges -= 2;
+            visitEdge(o, o->edges[o->numEdges], o->edges[o->numEdges + 1]);
+            continue;
+        }
+        r = o->work[--o->numWork];
+        for(u = &o->uses[o->start[r]]; u < &o->uses[o->start[r + 1]]; ++u) {
+            b = &o->blocks[u->block];
+            if(!b->exec) {
+                continue;
+            }
+            if(u->site == SITE_BRANCH) {
+                visitBranch(o, u->block);
+            }
+            else if(u->site < 0) {
+                visitPhi(o, u->block, SITE_PHI(u->site));
+            }
+            else {
+                visitCode(o, &b->code[u->site]);
+            }
+        }
+    }
+}
+
+// repl holds the constant's operand until value numbering starts
+static int constantOf(Optimizer *o, int x) {
+    if(isReg(x) && (o->regs[x].state == CONSTANT)) {
+        if(isReg(o->regs[x].repl)) {
+            o->regs[x].repl = irConst(o->m, o->regs[x].val);
+        }
+        return o->regs[x].repl;
+    }
+    return x;
+}
+
+/* what propagation found, applied: constants replace their registers,
+   branches that go one way become jumps, and edges and blocks that can't
+   run are dropped with their phi arguments */
+static void applyConstants(Optimizer *o) {
+    OptBlock *b, *s;
+    IrInst *in;
+    int i, k, j, n, a;
+
+    // branches first: the edge lists are compacted below
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        if(!b->exec || (b->numSuccs < 2)) {
+            continue;
+        }
+        s = &o->blocks[b->succ[0]];
+        if(!s->predExec[predIndex(s, o->order[i])]) {
+            b->succ[0] = b->succ[1];
+            b->numSuccs = 1;
+        }
+        else {
+            s = &o->blocks[b->succ[1]];
+            if(!s->predExec[predIndex(s, o->order[i])]) {
+                b->numSuccs = 1;
+            }
+        }
+    }
+
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        if(!b->exec) {
+            continue;
+        }
+        if(b->numSuccs == 2) {
+            b->cond = constantOf(o, b->cond);
+        }
+
+        for(k = 0; k < b->numPhis; ++k) {
+            a = b->phis[k].a;
+            for(j = n = 0; j < b->numPreds; ++j) {
+                if(b->predExec[j]) {
+                    o->args[a + n++] = constantOf(o, o->args[a + j]);
+                }
+            }
+            if(o->regs[b->phis[k].dst].state == CONSTANT) {
+                b->phis[k].op = OP_DEAD;
+            }
+        }
+        for(j = n = 0; j < b->numPreds; ++j) {
+            if(b->predExec[j]) {
+                b->predExec[n] = TRUE;
+                b->preds[n++] = b->preds[j];
+            }
+        }
+        b->numPreds = n;
+
+        for(k = 0; k < b->numCode; ++k) {
+            in = &b->code[k];
+            if(readsA(in->op)) {
+                in->a = constantOf(o, in->a);
+            }
+            if(readsB(in->op)) {
+                in->b = constantOf(o, in->b);
+            }
+            if(isReg(in->dst) && (o->regs[in->dst].state == CONSTANT) && isPure(in->op)) {
+                in->op = OP_DEAD;
+            }
+        }
+    }
+}
+
+// x, or what it was replaced by
+static int resolve(Optimizer *o, int x) {
+    int y = x;
+    int z;
+
+    while(isReg(y) && (o->regs[y].repl != y)) {
+        y = o->regs[y].repl;
+    }
+    // shorten the chain for next time
+    while(isReg(x) && (o->regs[x].repl != x)) {
+        z = o->regs[x].repl;
+        o->regs[x].repl = y;
+        x = z;
+    }
+    return y;
+}
+
+static unsigned int hashExpr(int op, int a, int b) {
+    unsigned int h = (unsigned int)op * 0x9e3779b1u;
+
+    h = (h ^ (unsigned int)a) * 0x85ebca6bu;
+    h = (h ^ (unsigned int)b) * 0xc2b2ae35u;
+    return h ^ (h >> 15);
+}
+
+// an entry valid in generation gen or shared, or the empty one to fill in
+static OptExpr *findExpr(OptExpr *table, unsigned int mask, int op, int a, int b, int gen, int shared) {
+    unsigned int i;
+
+    for(i = hashExpr(op, a, b) & mask; table[i].op >= 0; i = (i + 1) & mask) {
+        if((table[i].op == op) && (table[i].a == a) && (table[i].b == b) &&
+            ((table[i].val == gen) || (table[i].val == shared))) {
+            break;
+        }
+    }
+    return &table[i];
+}
+
+/* r = a op b without computing it, or IR_NONE: constants, identities and
+   an operand compared with itself */
+static int simplify(Optimizer *o, IrOp op, int a, int b) {
+    int va = 0, vb = 0, v;
+    int ca = IR_ISCONST(a);
+    int cb = IR_ISCONST(b);
+
+    if(ca) {
+        va = o->m->consts[IR_CONSTINDEX(a)];
+    }
+    if(cb) {
+        vb = o->m->consts[IR_CONSTINDEX(b)];
+    }
+    if(ca && cb) {
+        return evaluate(op, va, vb, &v) ? irConst(o->m, v) : IR_NONE;
+    }
+    switch(op) {
+        case IR_ADD:
+            if(cb && !vb) {
+                return a;
+            }
+            if(ca && !va) {
+                return b;
+            }
+            break;
+        case IR_SUB:
+            if(cb && !vb) {
+                return a;
+            }
+            break;
+        case IR_MUL:
+            if(cb && (vb == 1)) {
+                return a;
+            }
+            if(ca && (va == 1)) {
+                return b;
+            }
+            break;
+        case IR_DIV:
+            if(cb && (vb == 1)) {
+                return a;
+            }
+            break;
+        default:
+            break;
+    }
+    if((a == b) && isReg(a)) {
+        switch(op) {
+            case IR_SUB: case IR_LT: case IR_GT: case IR_NE:
+                return zero(o);
+            case IR_LE: case IR_GE: case IR_EQ:
+                return irConst(o->m, 1);
+            default:
+                break;
+        }
+    }
+    return IR_NONE;
+}
+
+static void replace(Optimizer *o, IrInst *in, int by) {
+    o->regs[in->dst].repl = by;
+    in->op = OP_DEAD;
+}
+
+/* one block of value numbering. Pure operations go in the scoped table;
+   loads and stores go in the memory table. Its entries belong to a
+   generation, and a store or call starts a new one, which forgets what
+   memory held. A block starts a new generation too, but one entered only
+   from its dominator still sees the dominator's last. */
+static void numberBlock(Optimizer *o, int bi) {
+    OptBlock *b = &o->blocks[bi];
+    IrInst *in;
+    OptExpr *e;
+    int shared = -1;
+    int i, j, x, same, t;
+
+    for(i = 0; i < b->numPhis; ++i) {
+        in = &b->phis[i];
+        if(in->op == OP_DEAD) {
+            continue;
+        }
+        // all arguments the same, or the phi itself around a loop
+        same = IR_NONE;
+        for(j = 0; j < b->numPreds; ++j) {
+            x = resolve(o, o->args[in->a + j]);
+            if((x == in->dst) || (x == same)) {
+                continue;
+            }
+            if(same != IR_NONE) {
+                break;
+            }
+            same = x;
+        }
+        if((j == b->numPreds) && (same != IR_NONE)) {
+            replace(o, in, same);
+        }
+    }
+
+    o->gen++;
+    if((bi != 0) && (b->numPreds == 1) && (b->preds[0] == b->idom)) {
+        shared = o->blocks[b->idom].endGen;
+    }
+    for(i = 0; i < b->numCode; ++i) {
+        in = &b->code[i];
+        if(readsA(in->op)) {
+            in->a = resolve(o, in->a);
+        }
+        if(readsB(in->op)) {
+            in->b = resolve(o, in->b);
+        }
+        if((in->op == IR_CALL) || (in->op == IR_STORE)) {
+            o->gen++;
+            shared = -1;
+        }
+        if(in->op == IR_STORE) {
+            e = findExpr(o->mem, o->exprMask, IR_LOAD, in->a, 0, o->gen, shared);
+            e->op = IR_LOAD;
+            e->a = in->a;
+            e->b = 0;
+            e->val = o->gen;
+            e->result = in->b;
+            continue;
+        }
+        if(in->op == IR_LOAD) {
+            e = findExpr(o->mem, o->exprMask, IR_LOAD, in->a, 0, o->gen, shared);
+            if(e->op >= 0) {
+                replace(o, in, e->result);
+                continue;
+            }
+            e->op = IR_LOAD;
+            e->a = in->a;
+            e->b = 0;
+            e->val = o->gen;
+            e->result = in->dst;
+            continue;
+        }
+        if(in->op == IR_MOV) {
+            replace(o, in, in->a);
+            continue;
+        }
+        if(!isPure(in->op) || !isReg(in->dst)) {
+            continue;
+        }
+        if((in->op >= IR_ADD) && (in->op <= IR_NE)) {
+            x = simplify(o, in->op, in->a, in->b);
+            if(x != IR_NONE) {
+                replace(o, in, x);
+                continue;
+            }
+        }
+        // one order for operands that commute, a constant second
+        if(((in->op == IR_ADD) || (in->op == IR_MUL) || (in->op == IR_EQ) || (in->op == IR_NE)) &&
+            (IR_ISCONST(in->a) || (isReg(in->b) && (in->a > in->b)))) {
+            t = in->a;
+            in->a = in->b;
+            in->b = t;
+        }
+        e = findExpr(o->exprs, o->exprMask, in->op, in->a, in->b, 0, 0);
+        if(e->op >= 0) {
+            replace(o, in, e->result);
+            continue;
+        }
+        e->op = in->op;
+        e->a = in->a;
+        e->b = in->b;
+        e->val = 0;
+        e->result = in->dst;
+        o->log = (int *)growArray(o->log, &o->maxLog, o->numLog + 1, sizeof(int));
+        o->log[o->numLog++] = (int)(e - o->exprs);
+    }
+    b->endGen = o->gen;
+}
+
+/* dominator-based value numbering: what a block computes is reused by
+   the blocks it dominates, and forgotten when the walk leaves it. Entries
+   are removed in the reverse of the order they went in, so clearing one
+   never cuts a probe sequence that a later entry still needs. */
+static void numberValues(Optimizer *o) {
+    OptBlock *b;
+    unsigned int size = INITOPT;
+    int total = 0;
+    int top = 0;
+    int i, x, c;
+
+    for(i = 0; i < o->numOrder; ++i) {
+        total += o->blocks[o->order[i]].numCode;
+    }
+    while(size < 2 * (unsigned int)total + 2) {
+        size *= 2;
+    }
+    if(size > o->maxExprs) {
+        free(o->exprs);
+        free(o->mem);
+        o->exprs = (OptExpr *)malloc(sizeof(OptExpr) * size);
+        o->mem = (OptExpr *)malloc(sizeof(OptExpr) * size);
+        if((o->exprs == NULL) || (o->mem == NULL)) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        o->maxExprs = size;
+    }
+    // only as much as this function needs, so a small one doesn't clear a large table
+    for(i = 0; i < (int)size; ++i) {
+        o->exprs[i].op = o->mem[i].op = -1;
+    }
+    o->exprMask = size - 1;
+    o->gen = 0;
+
+    o->numLog = 0;
+    o->stack = (int *)growArray(o->stack, &o->maxStack, 2 * o->numBlocks + 2, sizeof(int));
+    o->stack[top++] = 0;
+    while(top > 0) {
+        x = o->stack[--top];
+        if(x < 0) {
+            while(o->numLog > ~x) {
+                o->exprs[o->log[--o->numLog]].op = -1;
+            }
+            continue;
+        }
+        o->stack[top++] = ~o->numLog;
+        numberBlock(o, x);
+        for(c = o->blocks[x].domChild; c >= 0; c = o->blocks[c].domNext) {
+            o->stack[top++] = c;
+        }
+    }
+
+    // phi arguments along back edges were read before their definitions were numbered
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(c = 0; c < b->numPhis; ++c) {
+            for(x = 0; x < b->numPreds; ++x) {
+                o->args[b->phis[c].a + x] = resolve(o, o->args[b->phis[c].a + x]);
+            }
+        }
+        for(c = 0; c < b->numCode; ++c) {
+            if(readsA(b->code[c].op)) {
+                b->code[c].a = resolve(o, b->code[c].a);
+            }
+            if(readsB(b->code[c].op)) {
+                b->code[c].b = resolve(o, b->code[c].b);
+            }
+        }
+        if(b->numSuccs == 2) {
+            b->cond = resolve(o, b->cond);
+        }
+    }
+}
+
+static void markLive(Optimizer *o, int x) {
+    if(isReg(x) && !o->regs[x].live) {
+        o->regs[x].live = TRUE;
+        push(o, x);
+    }
+}
+
+/* dead code elimination: everything is dead until a store, argument,
+   call, return or branch needs it. A register that only feeds itself
+   through phis is never reached. */
+static void removeDead(Optimizer *o) {
+    OptBlock *b;
+    IrInst *in;
+    OptReg *g;
+    int i, k, j, n;
+
+    for(i = 0; i < o->numRegs; ++i) {
+        o->regs[i].live = FALSE;
+        o->regs[i].block = -1;
+    }
+    findSites(o);
+    o->numWork = 0;
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(k = 0; k < b->numCode; ++k) {
+            in = &b->code[k];
+            if(!isPure(in->op) && (in->op != IR_LOAD) && (in->op != OP_DEAD)) {
+                if(readsA(in->op)) {
+                    markLive(o, in->a);
+                }
+                if(readsB(in->op)) {
+                    markLive(o, in->b);
+                }
+            }
+        }
+        if(b->numSuccs == 2) {
+            markLive(o, b->cond);
+        }
+    }
+    while(o->numWork > 0) {
+        g = &o->regs[o->work[--o->numWork]];
+        if(g->block < 0) {
+            continue;
+        }
+        b = &o->blocks[g->block];
+        if(g->site < 0) {
+            in = &b->phis[SITE_PHI(g->site)];
+            for(j = 0; j < b->numPreds; ++j) {
+                markLive(o, o->args[in->a + j]);
+            }
+        }
+        else {
+            in = &b->code[g->site];
+            if(readsA(in->op)) {
+                markLive(o, in->a);
+            }
+            if(readsB(in->op)) {
+                markLive(o, in->b);
+            }
+        }
+    }
+
+    for(i = 0; i < o->numOrder; ++i) {
+        b = &o->blocks[o->order[i]];
+        for(k = n = 0; k < b->numPhis; ++k) {
+            if((b->phis[k].op != OP_DEAD) && o->regs[b->phis[k].dst].live) {
+                b->phis[n++] = b->phis[k];
+            }
+        }
+        b->numPhis = n;
+        for(k = n = 0; k < b->numCode; ++k) {
+            in = &b->code[k];
+            if(in->op == OP_DEAD) {
+                continue;
+            }
+            if(isReg(in->dst) && !o->regs[in->dst].live) {
+                if(in->op != IR_CALL) {
+                    continue;
+                }
+                in->dst = IR_NONE;
+            }
+            b->code[n++] = *in;
+        }
+        b->numCode = n;
+    }
+}
+
+/* the copies dst <- a of one edge, all as if at once: a copy goes when
+   nothing still pending reads its destination, and a cycle is broken
+   through a new register */
+static void emitCopies(Optimizer *o, OptBlock *b) {
+    IrInst *c;
+    IrInst in;
+    int i, j, ready, t;
+
+    while(o->numCopies > 0) {
+        ready = -1;
+        for(i = 0; (i < o->numCopies) && (ready < 0); ++i) {
+            for(j = 0; j < o->numCopies; ++j) {
+                if((j != i) && (o->copies[j].a == o->copies[i].dst)) {
+                    break;
+                }
+            }
+            if(j == o->numCopies) {
+                ready = i;
+            }
+        }
+        if(ready < 0) {
+            c = &o->copies[0];
+            t = newReg(o);
+            in.op = IR_MOV;
+            in.dst = t;
+            in.a = c->dst;
+            in.b = IR_NONE;
+            addCode(b, in);
+            for(j = 0; j < o->numCopies; ++j) {
+                if(o->copies[j].a == c->dst) {
+                    o->copies[j].a = t;
+                }
+            }
+            continue;
+        }
+        addCode(b, o->copies[ready]);
+        o->copies[ready] = o->copies[--o->numCopies];
+    }
+}
+
+/* phis become copies at the end of each predecessor. An edge from a
+   branch to a block with phis gets a block of its own for them, so the
+   copies only run when that edge is taken. */
+static void leaveSsa(Optimizer *o) {
+    OptBlock *b, *p;
+    IrInst in;
+    int n = o->numOrder;
+    int i, j, k, pi, s;
+
+    for(i = 0; i < n; ++i) {
+        b = &o->blocks[o->order[i]];
+        if(b->numPhis == 0) {
+            continue;
+        }
+        for(j = 0; j < b->numPreds; ++j) {
+            o->numCopies = 0;
+            for(k = 0; k < b->numPhis; ++k) {
+                in.op = IR_MOV;
+                in.dst = b->phis[k].dst;
+                in.a = o->args[b->phis[k].a + j];
+                in.b = IR_NONE;
+                if(in.a != in.dst) {
+                    o->copies = (IrInst *)growArray(o->copies, &o->maxCopies, o->numCopies + 1, sizeof(IrInst));
+                    o->copies[o->numCopies++] = in;
+                }
+            }
+            pi = b->preds[j];
+            if(o->blocks[pi].numSuccs == 2) {
+                s = newBlock(o);
+                b = &o->blocks[o->order[i]];
+                p = &o->blocks[pi];
+                k = (p->succ[0] == o->order[i]) ? 0 : 1;
+                p->succ[k] = s;
+                o->blocks[s].succ[0] = o->order[i];
+                o->blocks[s].numSuccs = 1;
+                pi = s;
+            }
+            emitCopies(o, &o->blocks[pi]);
+        }
+        b->numPhis = 0;
+    }
+}
+
+// where a jump to b really ends up: past blocks that only jump on
+static int forward(Optimizer *o, int b) {
+    int steps = o->numBlocks;
+
+    while((b != 0) && (o->blocks[b].numCode == 0) && (o->blocks[b].numSuccs == 1) && (steps-- > 0)) {
+        b = o->blocks[b].succ[0];
+    }
+    return b;
+}
+
+static void output(Optimizer *o, IrInst in) {
+    o->insts = (IrInst *)growArray(o->insts, &o->maxInsts, o->numInsts + 1, sizeof(IrInst));
+    o->insts[o->numInsts++] = in;
+}
+
+static void outputBlock(Optimizer *o) {
+    IrBlock *ob;
+
+    if(o->numOutBlocks > 0) {
+        o->outBlocks[o->numOutBlocks - 1].end = o->numInsts;
+    }
+    o->outBlocks = (IrBlock *)growArray(o->outBlocks, &o->maxOutBlocks, o->numOutBlocks + 1, sizeof(IrBlock));
+    ob = &o->outBlocks[o->numOutBlocks++];
+    ob->start = ob->end = o->numInsts;
+}
+
+static int renumber(Optimizer *o, int x, int *next) {
+    if(!isReg(x)) {
+        return x;
+    }
+    if(o->regs[x].renum < 0) {
+        o->regs[x].renum = (*next)++;
+    }
+    return o->regs[x].renum;
+}
+
+/* the function back into flat code: blocks in their old order, each split
+   edge right after the branch it leaves if it is the fall through, jumps
+   only where the next block isn't the one control goes to */
+static void storeFunction(Optimizer *o) {
+    IrFunc *f = o->f;
+    OptBlock *b;
+    IrInst in;
+    int *layout;
+    int numLayout = 0;
+    int first = o->numOutBlocks;
+    int next = f->numParams;
+    int i, k, x, id;
+
+    for(i = 0; i < o->numBlocks; ++i) {
+        b = &o->blocks[i];
+        for(k = 0; k < b->numSuccs; ++k) {
+            b->succ[k] = forward(o, b->succ[k]);
+        }
+        if((b->numSuccs == 2) && (b->succ[0] == b->succ[1])) {
+            b->numSuccs = 1;
+        }
+    }
+    computeOrder(o);
+
+    layout = o->stack;
+    for(i = 0; i < o->numBlocks; ++i) {
+        o->blocks[i].placed = FALSE;
+    }
+    for(i = 0; i < o->numBlocks; ++i) {
+        for(x = i; (x >= 0) && (o->blocks[x].rpo >= 0) && !o->blocks[x].placed; ) {
+            o->blocks[x].placed = TRUE;
+            layout[numLayout++] = x;
+            // split edges were appended after the original blocks
+            b = &o->blocks[x];
+            x = ((b->numSuccs > 0) && (b->succ[0] >= o->f->numBlocks)) ? b->succ[0] : -1;
+        }
+    }
+
+    // ids first, since jumps go forward too
+    id = first;
+    for(i = 0; i < numLayout; ++i) {
+        b = &o->blocks[layout[i]];
+        b->id = id++;
+        if((b->numSuccs == 2) && ((i + 1 == numLayout) || (layout[i + 1] != b->succ[0]))) {
+            id++;
+        }
+    }
+
+    for(i = 0; i < o->numRegs; ++i) {
+        o->regs[i].renum = (i < f->numParams) ? i : -1;
+    }
+    for(i = 0; i < numLayout; ++i) {
+        b = &o->blocks[layout[i]];
+        outputBlock(o);
+        for(k = 0; k < b->numCode; ++k) {
+            in = b->code[k];
+            if(readsA(in.op)) {
+                in.a = renumber(o, in.a, &next);
+            }
+            if(readsB(in.op)) {
+                in.b = renumber(o, in.b, &next);
+            }
+            in.dst = renumber(o, in.dst, &next);
+            output(o, in);
+        }
+        in.dst = in.b = IR_NONE;
+        if(b->numSuccs == 2) {
+            in.op = IR_BRZ;
+            in.a = renumber(o, b->cond, &next);
+            in.b = o->blocks[b->succ[1]].id;
+            in.dst = IR_NONE;
+            output(o, in);
+            if((i + 1 == numLayout) || (layout[i + 1] != b->succ[0])) {
+                outputBlock(o);
+                in.op = IR_JMP;
+                in.a = o->blocks[b->succ[0]].id;
+                in.b = IR_NONE;
+                output(o, in);
+            }
+        }
+        else if((b->numSuccs == 1) && ((i + 1 == numLayout) || (layout[i + 1] != b->succ[0]))) {
+            in.op = IR_JMP;
+            in.a = o->blocks[b->succ[0]].id;
+            output(o, in);
+        }
+    }
+    o->outBlocks[o->numOutBlocks - 1].end = o->numInsts;
+
+    f->firstBlock = first;
+    f->numBlocks = o->numOutBlocks - first;
+    f->numRegs = next;
+}
+
+static void optimizeFunction(Optimizer *o) {
+    int i;
+
+    loadFunction(o);
+    computeOrder(o);
+    computePreds(o);
+    computeDominators(o);
+    buildSsa(o);
+
+    findSites(o);
+    propagate(o);
+    applyConstants(o);
+
+    computeOrder(o);
+    computeDominators(o);
+    for(i = 0; i < o->numRegs; ++i) {
+        o->regs[i].repl = i;
+    }
+    numberValues(o);
+    removeDead(o);
+
+    leaveSsa(o);
+    storeFunction(o);
+}
+
+void optimizeIr(IrModule *m) {
+    Optimizer o;
+    OptBlock *b;
+    int i;
+
+    memset(&o, 0, sizeof(Optimizer));
+    o.m = m;
+    for(i = 0; i < m->numFuncs; ++i) {
+        o.f = &m->funcs[i];
+        optimizeFunction(&o);
+    }
+
+    free(m->insts);
+    free(m->blocks);
+    m->insts = o.insts;
+    m->numInsts = o.numInsts;
+    m->maxInsts = o.maxInsts;
+    m->blocks = o.outBlocks;
+    m->numBlocks = o.numOutBlocks;
+    m->maxBlocks = o.maxOutBlocks;
+
+    for(i = 0; i < o.maxBlocks; ++i) {
+        b = &o.blocks[i];
+        free(b->code);
+        free(b->phis);
+        free(b->preds);
+        free(b->predExec);
+    }
+    free(o.blocks);
+    free(o.order);
+    free(o.args);
+    free(o.regs);
+    free(o.start);
+    free(o.list);
+    free(o.uses);
+    free(o.work);
+    free(o.edges);
+    free(o.frontStart);
+    free(o.front);
+    free(o.stack);
+    free(o.log);
+    free(o.exprs);
+    free(o.mem);
+    free(o.copies);
+}
\ No newline at end of file
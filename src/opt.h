@@ -0,0 +1,22 @@
+#ifndef _OPT_H_
+#define _OPT_H_
+
+/* scalar optimization of lowered code, one function at a time. Registers
+   are put in SSA form (phis at the iterated dominance frontiers of their
+   definitions), then
+   - sparse conditional constant propagation finds registers that are
+     constant on every path that can run, and branches that always go one
+     way; blocks that can't run are dropped,
+   - global value numbering over the dominator tree replaces an operation
+     computed before, in a block that dominates it, by the earlier result,
+     and propagates copies. A load is reused until a store or call, within
+     a block and into blocks entered only from their dominator,
+   - dead code elimination removes what nothing stored, passed, returned
+     or branched on depends on, including cycles of phis.
+   Phis become copies on the edges into their blocks, empty blocks are
+   jumped over, and registers are numbered densely again. Parameters keep
+   r0, r1, ... Control flow is kept, so a loop that does nothing still
+   runs. */
+void optimizeIr(IrModule *m);
+
+#endif
\ No newline at end of file
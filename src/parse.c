@@ -1,105 +1,126 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
+#include "tokens.h"
 #include "parse.h"
+#include "intern.h"
+#include "arena.h"
+#include "pool.h"
 
-static TokenType token;
+static TreeNode *createNewNode(CompileContext *ctx);
 
-static TreeNode *createNewNode(void);
-
-static TreeNode *declarationList(void);
-static TreeNode *declaration(void);
-static TreeNode *varDeclaration(void);
+static TreeNode *declarationList(CompileContext *ctx);
+static TreeNode *declaration(CompileContext *ctx);
+static TreeNode *varDeclaration(CompileContext *ctx);
 static TreeNode *typeSpecifier(void);
 static TreeNode *funDeclaration(void);
 static TreeNode *params(void);
-static TreeNode *paramList(void);
-static TreeNode *param(void);
-static TreeNode *compoundStmt(void);
-static TreeNode *localDeclaration(void);
-static TreeNode *statementList(void);
-static TreeNode *statement(void);
-static TreeNode *expressionStmt(void);
-static TreeNode *selectionStmt(void);
-static TreeNode *iterationStmt(void);
-static TreeNode *returnStmt(void);
-static TreeNode *expression(void);
-
-static TreeNode *varCall(void);
+static TreeNode *paramList(CompileContext *ctx);
+static TreeNode *param(CompileContext *ctx);
+static TreeNode *compoundStmt(CompileContext *ctx);
+static TreeNode *localDeclaration(CompileContext *ctx);
+static TreeNode *statementList(CompileContext *ctx);
+static TreeNode *statement(CompileContext *ctx);
+static int startsStatement(TokenType token);
+static TreeNode *expressionStmt(CompileContext *ctx);
+static TreeNode *selectionStmt(CompileContext *ctx);
+static TreeNode *iterationStmt(CompileContext *ctx);
+static TreeNode *returnStmt(CompileContext *ctx);
+static TreeNode *expression(CompileContext *ctx);
+
+static TreeNode *varCall(CompileContext *ctx);
 
 static TreeNode *var(void);
-static TreeNode *simpleExpression(TreeNode *n);
+static TreeNode *simpleExpression(CompileContext *ctx);
 static TreeNode *relop(void);
-static TreeNode *additiveExpression(TreeNode *n);
+static TreeNode *additiveExpression(CompileContext *ctx);
 static TreeNode *addop(void);
-static TreeNode *term(TreeNode *n);
+static TreeNode *term(CompileContext *ctx);
 static TreeNode *mulop(void);
-static TreeNode *factor(TreeNode *n);
+static TreeNode *factor(CompileContext *ctx);
 static TreeNode *call(void);
-static TreeNode *args(void);
-static TreeNode *argList(void);
+static TreeNode *args(CompileContext *ctx);
+static TreeNode *argList(CompileContext *ctx);
+
+static TreeNode *functionBody(CompileContext *ctx);
+static void localName(struct _BodyWorker *w, TreeNode *t);
 
 
-static void syntaxError(char *message) {
-    fprintf(outputfile, "\n>>> ");
-    fprintf(outputfile, "Syntax error at line %d: %s", lineno, message);
-    Error = TRUE;
+static void syntaxError(CompileContext *ctx, char *message) {
+    fprintf(ctx->out, "\n>>> ");
+    fprintf(ctx->out, "Syntax error at line %d: %s", ctx->lineno, message);
+    ctx->Error = TRUE;
 }
 
-char *copyString(const char *s) {
-    int n;
-    char *t;
-    if(s == NULL) {
-        return NULL;
+// name t after the current ID token, sharing the interned copy
+static void setName(CompileContext *ctx, TreeNode *t) {
+    t->sym = internString(&ctx->names, ctx->tokenString, (int)strlen(ctx->tokenString));
+    t->name = symName(&ctx->names, t->sym);
+    if(ctx->worker != NULL) {
+        localName(ctx->worker, t);
     }
-    n = strlen(s) + 1;
-    t = (char*)malloc(sizeof(char)*n);
-    if(t == NULL) {
-        fprintf(stderr, "memory allocation error. exiting...\n");
-        exit(EXIT_FAILURE);
+}
+
+// semantic checks fused into the parse, see analyze.h
+static void fusedEnter(CompileContext *ctx, TreeNode *t) {
+    if(ctx->checks == CHECK_FUSED) {
+        checkEnter(ctx, t);
     }
-    strcpy(t, s);
-    return t;
 }
 
-static void match(TokenType expected) {
-    if(token == expected) {
-        token = getToken();
+static void fusedCheck(CompileContext *ctx, TreeNode *t) {
+    if(ctx->checks == CHECK_FUSED) {
+        checkNode(ctx, t);
+    }
+}
+
+static void match(CompileContext *ctx, TokenType expected) {
+    if(ctx->token == expected) {
+        nextToken(ctx);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        fprintf(outputfile, "      ");
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        fprintf(ctx->out, "      ");
     }
 }
 
-static TreeNode *createNewNode(void) {
+static TreeNode *createNewNode(CompileContext *ctx) {
     TreeNode *t = NULL;
     int i = 0;
 
-    t = (TreeNode *)malloc(sizeof(TreeNode));
-    if(t == NULL) {
-        fprintf(stderr, "memory allocation error. exiting...\n");
-        exit(EXIT_FAILURE);
+    if(ctx->freeNodes != NULL) {
+        t = ctx->freeNodes;
+        ctx->freeNodes = t->sibling;
     }
     else {
-        for(i = 0; i < MAXCHILDREN; ++i) {
-            t->child[i] = NULL;
-        }
-        t->sibling = NULL;
-        t->lineno = lineno;
-        t->arrayType = FALSE;
+        t = (TreeNode *)arenaAlloc(&ctx->tree, sizeof(TreeNode));
+    }
+    for(i = 0; i < MAXCHILDREN; ++i) {
+        t->child[i] = NULL;
     }
+    t->sibling = NULL;
+    t->lineno = ctx->lineno;
+    t->name = NULL;
+    t->sym = NOSYM;
+    t->val = 0;
+    t->type = Void;
+    t->arrayType = FALSE;
+    t->decl = NULL;
+    // a declaration with syntax errors never gets a kind; don't leave it to chance
+    t->nodeKind = DecK;
+    t->kind.exp = (ExpKind)0;
+    t->op = ERROR;
     return t;
 }
 
-TreeNode *declarationList(void) {
-    TreeNode *t = declaration();
+static TreeNode *declarationList(CompileContext *ctx) {
+    TreeNode *t = declaration(ctx);
     TreeNode *p = t;
     TreeNode *q = NULL;
 
-    while(token != ENDFILE) {
-        q = declaration();
+    while(ctx->token != ENDFILE) {
+        q = declaration(ctx);
         if(q != NULL) {
             if(t == NULL) {
                 p = q;
@@ -115,121 +136,119 @@ TreeNode *declarationList(void) {
     return t;
 }
 
-static TreeNode *declaration(void) {
-    TreeNode *t = createNewNode();
-    char *n = NULL;
+static TreeNode *declaration(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     // get type of declaration
-    if(token == INT) {
+    if(ctx->token == INT) {
         t->type = Int;
-        match(INT);
+        match(ctx, INT);
     }
-    else if (token == VOID) {
+    else if (ctx->token == VOID) {
         t->type = Void;
-        match(VOID);
+        match(ctx, VOID);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
     // get name of declared variable/function
-    n = copyString(tokenString);
-    match(ID);
-    t->name = n;
+    setName(ctx, t);
+    match(ctx, ID);
 
     // case ';': var-declaration without array
-    if(token == SEMI) {
+    if(ctx->token == SEMI) {
         t->nodeKind = DecK;
         t->kind.dec = VarDeclaration;
-        match(SEMI);
+        match(ctx, SEMI);
     }
     // case '[': var-declaration with array
-    else if(token == LSQRBRKT) {
+    else if(ctx->token == LSQRBRKT) {
         t->nodeKind = DecK;
         t->kind.dec = VarDeclaration;
         t->arrayType = TRUE;
 
-        match(LSQRBRKT);
+        match(ctx, LSQRBRKT);
 
-        t->val = atoi(tokenString);
-        match(NUM);
+        t->val = atoi(ctx->tokenString);
+        match(ctx, NUM);
 
-        match(RSQRBRKT);
-        match(SEMI);
+        match(ctx, RSQRBRKT);
+        match(ctx, SEMI);
     }
     // case '(': function-declaration
-    else if(token == LRNDBRKT) {
+    else if(ctx->token == LRNDBRKT) {
         t->nodeKind = DecK;
         t->kind.dec = FunctionDeclaration;
+        fusedEnter(ctx, t);
 
-        match(LRNDBRKT);
-        t->child[0] = paramList();
-        match(RRNDBRKT);
-        t->child[1] = compoundStmt();
+        match(ctx, LRNDBRKT);
+        t->child[0] = paramList(ctx);
+        match(ctx, RRNDBRKT);
+        t->child[1] = functionBody(ctx);
     }
     // else: unexpected token
     else{ 
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *varDeclaration(void) {
-    TreeNode *t = createNewNode();
-    char *n = NULL;
+static TreeNode *varDeclaration(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     // get type of declaration
-    if(token == INT) {
+    if(ctx->token == INT) {
         t->type = Int;
-        match(INT);
+        match(ctx, INT);
     }
-    else if (token == VOID) {
+    else if (ctx->token == VOID) {
         t->type = Void;
-        match(VOID);
+        match(ctx, VOID);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
     // get name of declared variable
-    n = copyString(tokenString);
-    match(ID);
+    setName(ctx, t);
+    match(ctx, ID);
 
     // case ';': variable declaration without array;
-    if(token == SEMI) {
+    if(ctx->token == SEMI) {
         t->nodeKind = DecK;
         t->kind.dec = VarDeclaration;
         
-        t->name = n;
-        match(SEMI);
+        match(ctx, SEMI);
     }
-    else if(token == LSQRBRKT) {
+    else if(ctx->token == LSQRBRKT) {
         t->nodeKind = DecK;
         t->kind.dec = VarDeclaration;
         t->arrayType = TRUE;
 
-        match(LSQRBRKT);
+        match(ctx, LSQRBRKT);
 
-        t->name = n;
-        t->val = atoi(tokenString);
-        match(NUM);
+        t->val = atoi(ctx->tokenString);
+        match(ctx, NUM);
 
-        match(RSQRBRKT);
-        match(SEMI);
+        match(ctx, RSQRBRKT);
+        match(ctx, SEMI);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
+    fusedCheck(ctx, t);
     return t;
 }
 
@@ -238,31 +257,31 @@ static TreeNode *typeSpecifier(void) {
 }
 
 static TreeNode *funDeclaration(void) {
-    // No need. Implemented in declaration(void)
+    // No need. Implemented in declaration(ctx)
 }
 
 static TreeNode *params(void) {
-    // No need. Implemented in paramList(void)
+    // No need. Implemented in paramList(ctx)
 }
 
-static TreeNode *paramList(void) {
+static TreeNode *paramList(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
     TreeNode *q = NULL;
 
     // implementation of params->void. represent void in NULL
-    if(token == VOID) {
-        match(VOID);
+    if(ctx->token == VOID) {
+        match(ctx, VOID);
         return NULL;
     }
 
     // get parameters
-    t = param();
+    t = param(ctx);
     p = t;
 
-    while(token == COMMA) {
-        match(COMMA);
-        q = param();
+    while(ctx->token == COMMA) {
+        match(ctx, COMMA);
+        q = param(ctx);
 
         if(q != NULL) {
             p->sibling = q;
@@ -273,80 +292,80 @@ static TreeNode *paramList(void) {
     return t;
 }
 
-static TreeNode *param(void) {
-    TreeNode *t = createNewNode();
-    char *n = NULL;
+static TreeNode *param(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     // get type of declaration
-    if(token == INT) {
+    if(ctx->token == INT) {
         t->type = Int;
-        match(INT);
+        match(ctx, INT);
     }
-    else if(token == VOID) {
+    else if(ctx->token == VOID) {
         t->type = Void;
-        match(VOID);
+        match(ctx, VOID);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
     // get name of parameter
-    n = copyString(tokenString);
-    match(ID);
+    setName(ctx, t);
+    match(ctx, ID);
 
     // case '[': parameter declaration with array
-    if(token == LSQRBRKT) {
+    if(ctx->token == LSQRBRKT) {
         t->nodeKind = DecK;
         t->kind.dec = ParamDeclaration;
         t->arrayType = TRUE;
         
-        t->name = n;
-        match(LSQRBRKT);
-        match(RSQRBRKT);
+        match(ctx, LSQRBRKT);
+        match(ctx, RSQRBRKT);
     }
     else {
         t->nodeKind = DecK;
         t->kind.dec = ParamDeclaration;
-        t->name = n;
     }
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *compoundStmt(void) {
-    TreeNode *t = createNewNode();
+static TreeNode *compoundStmt(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     t->nodeKind = StmtK;
     t->kind.stmt = Compound;
 
-    match(LCURLBRKT);
+    match(ctx, LCURLBRKT);
+    fusedEnter(ctx, t);
     // case !'}': compound statement with some statments
-    if(token != RCURLBRKT) {
+    if(ctx->token != RCURLBRKT) {
         // compound statment with local declarations
-        if((token == INT) || (token == VOID)) {
-            t->child[0] = localDeclaration();
+        if((ctx->token == INT) || (ctx->token == VOID)) {
+            t->child[0] = localDeclaration(ctx);
         }
         // compound statement with statments
-        if(token != RCURLBRKT) {
-            t->child[1] = statementList();
+        if(ctx->token != RCURLBRKT) {
+            t->child[1] = statementList(ctx);
         }
     }
-    match(RCURLBRKT);
+    match(ctx, RCURLBRKT);
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *localDeclaration(void) {
+static TreeNode *localDeclaration(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
     TreeNode *q = NULL;
 
-    t = varDeclaration();
+    t = varDeclaration(ctx);
     p = t;
-    while((token == INT) || (token == VOID)) {
-        q = varDeclaration();
+    while((ctx->token == INT) || (ctx->token == VOID)) {
+        q = varDeclaration(ctx);
         if(q != NULL) {
             p->sibling = q;
             p = q;
@@ -356,19 +375,29 @@ static TreeNode *localDeclaration(void) {
     return t;
 }
 
-static TreeNode *statementList(void) {
+static TreeNode *statementList(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
     TreeNode *q = NULL;
 
-    t = statement();
-    p = t;
-
-    while(token != RCURLBRKT) {
-        q = statement();
+    while((ctx->token != RCURLBRKT) && (ctx->token != ENDFILE)) {
+        // no statement starts with this token: skip it rather than spin on it
+        if(!startsStatement(ctx->token)) {
+            syntaxError(ctx, "unexpected token -> ");
+            printToken(ctx, ctx->token, ctx->tokenString);
+            nextToken(ctx);
+            continue;
+        }
+        q = statement(ctx);
 
+        // an empty statement has no node
         if(q != NULL) {
-            p->sibling = q;
+            if(t == NULL) {
+                t = q;
+            }
+            else {
+                p->sibling = q;
+            }
             p = q;
         }
     }
@@ -376,187 +405,211 @@ static TreeNode *statementList(void) {
     return t;
 }
 
-static TreeNode *statement(void) {
+static int startsStatement(TokenType token) {
+    switch(token) {
+        case SEMI: case ID: case LRNDBRKT: case NUM:
+        case LCURLBRKT: case IF: case WHILE: case RETURN:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static TreeNode *statement(CompileContext *ctx) {
     TreeNode *t = NULL;
 
     // case #1: get expression statement
-    if((token == SEMI) || (token == ID) || (token == LRNDBRKT) || (token == NUM)) {
-        t = expressionStmt();
+    if((ctx->token == SEMI) || (ctx->token == ID) || (ctx->token == LRNDBRKT) || (ctx->token == NUM)) {
+        t = expressionStmt(ctx);
     }
     // case #2: get compound statement
-    else if(token == LCURLBRKT) {
-        t = compoundStmt();
+    else if(ctx->token == LCURLBRKT) {
+        t = compoundStmt(ctx);
     }
     // case #3: get selection statement
-    else if(token == IF) {
-        t = selectionStmt();
+    else if(ctx->token == IF) {
+        t = selectionStmt(ctx);
     }
     // case #4: get iteration statement
-    else if(token == WHILE) {
-        t = iterationStmt();
+    else if(ctx->token == WHILE) {
+        t = iterationStmt(ctx);
     }
     // case #5: get return statement
-    else if(token == RETURN) {
-        t = returnStmt();
+    else if(ctx->token == RETURN) {
+        t = returnStmt(ctx);
     }
 
     return t;
 }
 
-static TreeNode *expressionStmt(void) {
+static TreeNode *expressionStmt(CompileContext *ctx) {
     TreeNode *t = NULL;
 
     // case ';': expression with no information. no need to create new node
-    if(token == SEMI) {
-        match(SEMI);
+    if(ctx->token == SEMI) {
+        match(ctx, SEMI);
     }
     else {
-        t = expression();
-        match(SEMI);
+        t = expression(ctx);
+        match(ctx, SEMI);
     }
 
     return t;
 }
 
-static TreeNode *selectionStmt(void) {
-    TreeNode *t = createNewNode();
+static TreeNode *selectionStmt(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     t->nodeKind = StmtK;
     t->kind.stmt = Selection;
 
-    match(IF);
-    match(LRNDBRKT);
-    t->child[0] = expression();
-    match(RRNDBRKT);
-    t->child[1] = statement();
+    match(ctx, IF);
+    match(ctx, LRNDBRKT);
+    t->child[0] = expression(ctx);
+    match(ctx, RRNDBRKT);
+    t->child[1] = statement(ctx);
 
     // case ELSE: get if statement with else part
-    if(token == ELSE) {
-        match(ELSE);
-        t->child[2] = statement();
+    if(ctx->token == ELSE) {
+        match(ctx, ELSE);
+        t->child[2] = statement(ctx);
     }
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *iterationStmt(void) {
-    TreeNode *t = createNewNode();
+static TreeNode *iterationStmt(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     t->nodeKind = StmtK;
     t->kind.stmt = Iteration;
 
-    match(WHILE);
-    match(LRNDBRKT);
-    t->child[0] = expression();
-    match(RRNDBRKT);
-    t->child[1] = statement();
+    match(ctx, WHILE);
+    match(ctx, LRNDBRKT);
+    t->child[0] = expression(ctx);
+    match(ctx, RRNDBRKT);
+    t->child[1] = statement(ctx);
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *returnStmt(void) {
-    TreeNode *t = createNewNode();
+static TreeNode *returnStmt(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     t->nodeKind = StmtK;
     t->kind.stmt = Return;
 
-    match(RETURN);
+    match(ctx, RETURN);
     // get expression to return
-    if(token != SEMI) {
-        t->child[0] = expression();
+    if(ctx->token != SEMI) {
+        t->child[0] = expression(ctx);
     }
-    match(SEMI);
+    match(ctx, SEMI);
 
+    fusedCheck(ctx, t);
     return t;
 }
 
-static TreeNode *expression(void) {
-    TreeNode *t = NULL;
-    TreeNode *l = NULL;
+// the current token starts var '=': ID or ID [ ... ], then ASSIGN
+static int startsAssignment(CompileContext *ctx) {
+    int k = 1;
+    int depth = 0;
+    TokenType tok;
 
-    if(token == ID) {
-        l = varCall();
+    if(ctx->token != ID) {
+        return FALSE;
+    }
+    if(peekToken(ctx, k) == LSQRBRKT) {
+        do {
+            tok = peekToken(ctx, k++);
+            if(tok == LSQRBRKT) {
+                depth++;
+            }
+            else if(tok == RSQRBRKT) {
+                depth--;
+            }
+        // an index can't hold these, so an unclosed '[' ends there
+        } while((depth > 0) && (tok != ENDFILE) && (tok != SEMI) && (tok != LCURLBRKT) && (tok != RCURLBRKT));
     }
+    return peekToken(ctx, k) == ASSIGN;
+}
 
-    // case '=': get assignment expression
-    if((l != NULL) && (token == ASSIGN)) {
-        // if l is var
-        if((l->nodeKind == ExpK) && (l->kind.exp == Id)) {
-            t = createNewNode();
-            
-            t->nodeKind = ExpK;
-            t->kind.exp = Assign;
-            match(ASSIGN);
+static TreeNode *expression(CompileContext *ctx) {
+    TreeNode *t = NULL;
 
-            t->child[0] = l;
-            t->child[1] = expression();
-        }
-        // if l is not var
-        else {
-            syntaxError("unexpected token -> ");
-            printToken(token, tokenString);
-            token = getToken();
-        }
+    // case var '=': get assignment expression
+    if(startsAssignment(ctx)) {
+        t = createNewNode(ctx);
+
+        t->nodeKind = ExpK;
+        t->kind.exp = Assign;
+
+        t->child[0] = varCall(ctx);
+        match(ctx, ASSIGN);
+        t->child[1] = expression(ctx);
+        fusedCheck(ctx, t);
     }
     else {
-        t = simpleExpression(l);
+        t = simpleExpression(ctx);
     }
 
     return t;
 }
 
-static TreeNode *varCall(void) {
-    TreeNode *t = createNewNode();
-    char *n = NULL;
+static TreeNode *varCall(CompileContext *ctx) {
+    TreeNode *t = createNewNode(ctx);
 
     t->nodeKind = ExpK;
     t->kind.exp = Id;
 
-    n = copyString(tokenString);
-    match(ID);
-    t->name = n;
+    setName(ctx, t);
+    match(ctx, ID);
 
     // case '(': get call
-    if(token == LRNDBRKT) {
+    if(ctx->token == LRNDBRKT) {
         t->nodeKind = StmtK;
         t->kind.stmt = Call;
 
-        match(LRNDBRKT);
-        t->child[0] = args();
-        match(RRNDBRKT);
+        match(ctx, LRNDBRKT);
+        t->child[0] = args(ctx);
+        match(ctx, RRNDBRKT);
     }
     // case '[': get var with array
-    else if(token == LSQRBRKT) {
+    else if(ctx->token == LSQRBRKT) {
         t->arrayType = TRUE;
 
-        match(LSQRBRKT);
-        t->child[0] = expression();
-        match(RSQRBRKT);
+        match(ctx, LSQRBRKT);
+        t->child[0] = expression(ctx);
+        match(ctx, RSQRBRKT);
     }
 
+    fusedCheck(ctx, t);
     return t;
 }
 
 static TreeNode *var(void) {
-    // No need. Implemented in varCall()
+    // No need. Implemented in varCall(ctx)
 }
 
-static TreeNode *simpleExpression(TreeNode *n) {
+static TreeNode *simpleExpression(CompileContext *ctx) {
     TreeNode *t;
     TreeNode *l;
     
-    l = additiveExpression(n);
-    if((token == LESSTHAN) || (token == LESSEQTHAN) || (token == GREATERTHAN) || 
-        (token == GREATEREQTHAN) || (token == EQ) || (token == NEQ)) {
+    l = additiveExpression(ctx);
+    if((ctx->token == LESSTHAN) || (ctx->token == LESSEQTHAN) || (ctx->token == GREATERTHAN) || 
+        (ctx->token == GREATEREQTHAN) || (ctx->token == EQ) || (ctx->token == NEQ)) {
 
-        t = createNewNode();
+        t = createNewNode(ctx);
         t->nodeKind = ExpK;
         t->kind.exp = Op;
-        t->op = token;
-        match(token);
+        t->op = ctx->token;
+        match(ctx, ctx->token);
 
         t->child[0] = l;
-        t->child[1] = additiveExpression(NULL);
+        t->child[1] = additiveExpression(ctx);
+        fusedCheck(ctx, t);
     }
     else {
         t = l;
@@ -566,140 +619,480 @@ static TreeNode *simpleExpression(TreeNode *n) {
 }
 
 static TreeNode *relop(void) {
-    // No need. Implemented in simpleExpression(TreeNode *)
+    // No need. Implemented in simpleExpression(ctx)
 }
 
-static TreeNode *additiveExpression(TreeNode *n) {
+static TreeNode *additiveExpression(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
 
-    t = term(n);
-    while((token == PLUS) || (token == MINUS)) {
-        p = createNewNode();
+    t = term(ctx);
+    while((ctx->token == PLUS) || (ctx->token == MINUS)) {
+        p = createNewNode(ctx);
         p->nodeKind = ExpK;
         p->kind.exp = Op;
 
         p->child[0] = t;
-        p->op = token;
+        p->op = ctx->token;
 
         t = p;
-        match(token);
-        t->child[1] = term(NULL);
+        match(ctx, ctx->token);
+        t->child[1] = term(ctx);
+        fusedCheck(ctx, t);
     }
 
     return t;
 }
 
 static TreeNode *addop(void) {
-    // No need. Implemented in additiveExpression(TreeNode *)
+    // No need. Implemented in additiveExpression(ctx)
 }
 
-static TreeNode *term(TreeNode *n) {
+static TreeNode *term(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
 
-    t = factor(n);
-    while((token == TIMES) || (token == OVER)) {
-        p = createNewNode();
+    t = factor(ctx);
+    while((ctx->token == TIMES) || (ctx->token == OVER)) {
+        p = createNewNode(ctx);
         p->nodeKind = ExpK;
         p->kind.exp = Op;
 
         p->child[0] = t;
-        p->op = token;
+        p->op = ctx->token;
 
         t = p;
-        match(token);
-        t->child[1] = factor(NULL);
+        match(ctx, ctx->token);
+        t->child[1] = factor(ctx);
+        fusedCheck(ctx, t);
     }
 
     return t;
 }
 
 static TreeNode *mulop(void) {
-    // No need. Implemented in term(TreeNode *)
+    // No need. Implemented in term(ctx)
 }
 
-static TreeNode *factor(TreeNode *n) {
+static TreeNode *factor(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
 
-    // n is factor->call. Return n
-    if(n != NULL) {
-        return n;
-    }
-
     // case ID: get variable/call
-    if(token == ID) {
-        t = varCall();
+    if(ctx->token == ID) {
+        t = varCall(ctx);
     }
     // case '(': get ( expression )
-    else if(token == LRNDBRKT) {
-        match(LRNDBRKT);
-        t = expression();
-        match(RRNDBRKT);
+    else if(ctx->token == LRNDBRKT) {
+        match(ctx, LRNDBRKT);
+        t = expression(ctx);
+        match(ctx, RRNDBRKT);
     }
     // case NUM: get NUM
-    else if(token == NUM) {
-        t = createNewNode();
+    else if(ctx->token == NUM) {
+        t = createNewNode(ctx);
         
         t->nodeKind = ExpK;
         t->kind.exp = Constant;
-        t->val = atoi(tokenString);
+        t->val = atoi(ctx->tokenString);
         t->type = Int;
 
-        match(NUM);
+        match(ctx, NUM);
     }
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        token = getToken();
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(ctx, ctx->token, ctx->tokenString);
+        nextToken(ctx);
     }
 
     return t;
 }
 
 static TreeNode *call(void) {
-    // No need. Implemented in varCall()
+    // No need. Implemented in varCall(ctx)
 }
 
-static TreeNode *args(void) {
+static TreeNode *args(CompileContext *ctx) {
     TreeNode *t = NULL;
 
     // case !')': nonempty args
-    if(token != RRNDBRKT) {
-        t = argList();
+    if(ctx->token != RRNDBRKT) {
+        t = argList(ctx);
     }
 
     return t;
 }
 
-static TreeNode *argList(void) {
+static TreeNode *argList(CompileContext *ctx) {
     TreeNode *t = NULL;
     TreeNode *p = NULL;
     TreeNode *q = NULL;
 
-    t = expression();
+    t = expression(ctx);
     p = t;
-    while(token == COMMA) {
-        match(COMMA);
+    while(ctx->token == COMMA) {
+        match(ctx, COMMA);
 
-        q = expression();
-        p->sibling = q;
-        p = q;
+        q = expression(ctx);
+        // a malformed argument has no node
+        if(q != NULL) {
+            if(t == NULL) {
+                t = q;
+            }
+            else {
+                p->sibling = q;
+            }
+            p = q;
+        }
     }
 
     return t;
 }
 
-TreeNode *parse(void) {
+/* parallel parsing of function bodies. Every function body is a '{' at
+   the top level, and parsing one needs nothing but its tokens, so with the
+   whole source lexed, a brace-matching pass finds them and the bodies are
+   parsed on a pool first. The top-level pass then runs as usual, but takes
+   each body it comes to ready-made instead of parsing it. A body with
+   syntax errors, or one that doesn't end at its matching '}', is not taken
+   and gets parsed in place, so the tree and diagnostics are the serial
+   ones. */
+
+// sources with fewer tokens than this are parsed serially
+#define PARALLELMIN 16384
+
+typedef struct _Body {
+    int open;               // token index of its '{', and of the matching '}'
+    int close;
+    TreeNode *tree;
+    int ok;                 // parsed cleanly and ended at close
+    int used;               // taken by the top-level pass
+    int worker;             // parsed by
+    int names;              // its ranges in the worker's names and nodes
+    int numNames;
+    int nodes;
+    int numNodes;
+} Body;
+
+typedef struct _LocalSym {
+    int stamp;              // of the last body the symbol was used in
+    int id;                 // its number there
+    int global;             // in the parse's own table, once interned there
+} LocalSym;
+
+/* a parsing thread, kept with its memory from one parse to the next. Its
+   nodes live in ctx.tree until releaseTree(). Names go into its own
+   table, and each body numbers the ones it uses from 0 in order of first
+   use. The top-level pass interns them for real in that order, which is
+   the order the serial parser would have met them in, so symbol ids come
+   out the same. */
+typedef struct _BodyWorker {
+    CompileContext ctx;
+    int stamp;              // of the body being parsed; never repeats
+    int firstName;          // its first entry in names
+    LocalSym *syms;         // by symbol in ctx.names
+    int maxSyms;
+    int *names;             // symbols in order of first use per body: the
+    int numNames;           // worker's, then global ones once it is taken
+    int maxNames;
+    TreeNode **nodes;       // named nodes per body
+    int numNodes;
+    int maxNodes;
+} BodyWorker;
+
+typedef struct _Bodies {
+    Body *list;
+    int count;
+    int max;
+    int next;               // first body the top-level pass hasn't gone past
+    int active;             // parsed ahead for the parse under way
+    BodyWorker *workers;
+    int numWorkers;         // set up so far
+    int threads;            // used this time
+    const InternTable *names;
+} Bodies;
+
+// room for need elements of size bytes at p, which has room for *max
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+// number t's name within the body being parsed, and remember t
+static void localName(BodyWorker *w, TreeNode *t) {
+    int sym = t->sym;
+    int n = w->maxSyms;
+
+    if(sym >= w->maxSyms) {
+        w->syms = (LocalSym *)growArray(w->syms, &w->maxSyms, sym + 1, sizeof(LocalSym));
+        for(; n < w->maxSyms; ++n) {
+            w->syms[n].stamp = 0;
+            w->syms[n].global = NOSYM;
+        }
+    }
+    if(w->syms[sym].stamp != w->stamp) {
+        w->syms[sym].stamp = w->stamp;
+        w->syms[sym].id = w->numNames - w->firstName;
+        w->names = (int *)growArray(w->names, &w->maxNames, w->numNames + 1, sizeof(int));
+        w->names[w->numNames++] = sym;
+    }
+    w->nodes = (TreeNode **)growArray(w->nodes, &w->maxNodes, w->numNodes + 1, sizeof(TreeNode *));
+    w->nodes[w->numNodes++] = t;
+    t->sym = w->syms[sym].id;
+}
+
+// every '{' at depth 0 with its matching '}'
+static void findBodies(Bodies *bs, const TokenArray *ta) {
+    int depth = 0;
+    int open = 0;
+    int i;
+
+    bs->count = 0;
+    for(i = 0; i < ta->count; ++i) {
+        if(TOKEN_KIND(ta->toks[i]) == LCURLBRKT) {
+            if(depth++ == 0) {
+                open = i;
+            }
+        }
+        else if((TOKEN_KIND(ta->toks[i]) == RCURLBRKT) && (depth > 0) && (--depth == 0)) {
+            bs->list = (Body *)growArray(bs->list, &bs->max, bs->count + 1, sizeof(Body));
+            memset(&bs->list[bs->count], 0, sizeof(Body));
+            bs->list[bs->count].open = open;
+            bs->list[bs->count++].close = i;
+        }
+    }
+}
+
+static void parseBody(void *arg, int job, int worker) {
+    Bodies *bs = (Bodies *)arg;
+    BodyWorker *w = &bs->workers[worker];
+    Body *b = &bs->list[job];
+    CompileContext *ctx = &w->ctx;
+
+    w->stamp++;
+    w->firstName = w->numNames;
+    b->worker = worker;
+    b->names = w->numNames;
+    b->nodes = w->numNodes;
+
+    ctx->Error = FALSE;
+    seekToken(ctx, b->open);
+    b->tree = compoundStmt(ctx);
+    b->ok = !ctx->Error && (ctx->tokens.next - 1 == b->close + 1);
+
+    b->numNames = w->numNames - b->names;
+    b->numNodes = w->numNodes - b->nodes;
+}
+
+// give a taken body's nodes their global names
+static void nameBody(void *arg, int job, int worker) {
+    Bodies *bs = (Bodies *)arg;
+    Body *b = &bs->list[job];
+    BodyWorker *w = &bs->workers[b->worker];
+    const int *names = w->names + b->names;
+    TreeNode *t;
+    int i;
+
+    (void)worker;
+    if(!b->used) {
+        return;
+    }
+    for(i = b->nodes; i < b->nodes + b->numNodes; ++i) {
+        t = w->nodes[i];
+        t->sym = names[t->sym];
+        t->name = symName(bs->names, t->sym);
+    }
+}
+
+// make sure there are n workers, FALSE if that fails
+static int setupWorkers(Bodies *bs, int n) {
+    BodyWorker *w;
+
+    if(n <= bs->numWorkers) {
+        return TRUE;
+    }
+    bs->workers = (BodyWorker *)realloc(bs->workers, sizeof(BodyWorker) * n);
+    if(bs->workers == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    // workers[i].ctx.worker must follow the array as it moves
+    for(; bs->numWorkers < n; bs->numWorkers++) {
+        w = &bs->workers[bs->numWorkers];
+        memset(w, 0, sizeof(BodyWorker));
+        // diagnostics of a body that isn't taken come again from the top-level pass
+        w->ctx.out = tmpfile();
+        if(w->ctx.out == NULL) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// parse the bodies of a wholly lexed source ahead, if it is worth it
+static void parseBodies(CompileContext *ctx) {
+    Bodies *bs = ctx->bodies;
+    BodyWorker *w;
+    int i, k;
+
+    if(!ctx->lexAhead || (ctx->threads < 2) || (ctx->tokens.count < PARALLELMIN)) {
+        return;
+    }
+    if(bs == NULL) {
+        bs = (Bodies *)calloc(1, sizeof(Bodies));
+        if(bs == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        ctx->bodies = bs;
+    }
+    findBodies(bs, &ctx->tokens);
+    if(bs->count < 2) {
+        return;
+    }
+    bs->threads = (ctx->threads < bs->count) ? ctx->threads : bs->count;
+    if(!setupWorkers(bs, bs->threads)) {
+        return;
+    }
+
+    for(i = 0; i < bs->threads; ++i) {
+        w = &bs->workers[i];
+        // the token array is shared and only read
+        w->ctx.srcBase = ctx->srcBase;
+        w->ctx.tokens = ctx->tokens;
+        w->ctx.lexAhead = TRUE;
+        w->ctx.worker = w;
+        internReset(&w->ctx.names);
+        for(k = 0; k < w->maxSyms; ++k) {
+            w->syms[k].global = NOSYM;
+        }
+        rewind(w->ctx.out);
+        w->numNames = 0;
+        w->numNodes = 0;
+    }
+    runPool(bs->threads, bs->count, parseBody, bs);
+    bs->next = 0;
+    bs->active = TRUE;
+}
+
+// a function body: the one parsed ahead if there is a good one, else parse it now
+static TreeNode *functionBody(CompileContext *ctx) {
+    Bodies *bs = ctx->bodies;
+    int at = ctx->tokens.next - 1;
+    BodyWorker *w;
+    LocalSym *sym;
+    Body *b;
+    int i;
+
+    if((bs == NULL) || !bs->active) {
+        return compoundStmt(ctx);
+    }
+    // the top-level pass only moves forward
+    while((bs->next < bs->count) && (bs->list[bs->next].open < at)) {
+        bs->next++;
+    }
+    if((bs->next == bs->count) || (bs->list[bs->next].open != at) || !bs->list[bs->next].ok) {
+        return compoundStmt(ctx);
+    }
+
+    /* intern its names here, where the serial parser would have. One the
+       worker met in an earlier body is in the table already. */
+    b = &bs->list[bs->next];
+    w = &bs->workers[b->worker];
+    for(i = b->names; i < b->names + b->numNames; ++i) {
+        sym = &w->syms[w->names[i]];
+        if(sym->global == NOSYM) {
+            sym->global = internString(&ctx->names, symName(&w->ctx.names, w->names[i]),
+                symLength(&w->ctx.names, w->names[i]));
+        }
+        w->names[i] = sym->global;
+    }
+    b->used = TRUE;
+    seekToken(ctx, b->close + 1);
+    return b->tree;
+}
+
+// rename the nodes of the bodies the top-level pass took
+static void finishBodies(CompileContext *ctx) {
+    Bodies *bs = ctx->bodies;
+
+    if((bs == NULL) || !bs->active) {
+        return;
+    }
+    bs->active = FALSE;
+    bs->names = &ctx->names;
+    runPool(bs->threads, bs->count, nameBody, bs);
+}
+
+TreeNode *parse(CompileContext *ctx) {
     TreeNode *t = NULL;
 
-    token = getToken();
-    t = declarationList();
+    resetTokens(ctx);
+    // fused checks need each body parsed in the scope it sits in
+    if(ctx->checks == CHECK_FUSED) {
+        checkStart(ctx);
+    }
+    else {
+        parseBodies(ctx);
+    }
+    nextToken(ctx);
+    t = declarationList(ctx);
 
-    if(token != ENDFILE) {
-        syntaxError("Code ends before file\n");
+    if(ctx->token != ENDFILE) {
+        syntaxError(ctx, "Code ends before file\n");
+    }
+    finishBodies(ctx);
+    if(ctx->checks == CHECK_FUSED) {
+        checkFinish(ctx);
     }
 
     return t;
+}
+
+TreeNode *parseDeclaration(CompileContext *ctx) {
+    return declaration(ctx);
+}
+
+void releaseTree(CompileContext *ctx) {
+    Bodies *bs = ctx->bodies;
+    int i;
+
+    arenaReset(&ctx->tree);
+    ctx->freeNodes = NULL;
+    internReset(&ctx->names);
+    for(i = 0; (bs != NULL) && (i < bs->numWorkers); ++i) {
+        arenaReset(&bs->workers[i].ctx.tree);
+    }
+}
+
+void freeParser(CompileContext *ctx) {
+    Bodies *bs = ctx->bodies;
+    BodyWorker *w;
+    int i;
+
+    if(bs == NULL) {
+        return;
+    }
+    for(i = 0; i < bs->numWorkers; ++i) {
+        w = &bs->workers[i];
+        arenaFree(&w->ctx.tree);
+        internFree(&w->ctx.names);
+        if(w->ctx.out != NULL) {
+            fclose(w->ctx.out);
+        }
+        free(w->syms);
+        free(w->names);
+        free(w->nodes);
+    }
+    free(bs->workers);
+    free(bs->list);
+    free(bs);
+    ctx->bodies = NULL;
 }
\ No newline at end of file
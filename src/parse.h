@@ -1,6 +1,13 @@
 #ifndef _PARSE_H_
 #define _PARSE_H_
 
-TreeNode *parse(void);
+TreeNode *parse(CompileContext *ctx);
+/* one top-level declaration, starting at the current token; parse() is
+   one of these followed by more until ENDFILE */
+TreeNode *parseDeclaration(CompileContext *ctx);
+// drop the last tree and its names in O(1), keeping memory for the next parse
+void releaseTree(CompileContext *ctx);
+// give back what the parser keeps between parses, for freeContext
+void freeParser(CompileContext *ctx);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "globals.h"
+#include "pool.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct _Pool {
+    PoolJob fn;
+    void *arg;
+    int jobs;
+    int next;
+    pthread_mutex_t lock;
+} Pool;
+
+typedef struct _Worker {
+    Pool *pool;
+    int id;
+    pthread_t thread;
+} Worker;
+
+// jobs are handed out one at a time, so uneven files balance themselves
+static int takeJob(Pool *pool) {
+    int job;
+
+    pthread_mutex_lock(&pool->lock);
+    job = (pool->next < pool->jobs) ? pool->next++ : -1;
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+static void *work(void *p) {
+    Worker *w = (Worker *)p;
+    int job;
+
+    while((job = takeJob(w->pool)) >= 0) {
+        w->pool->fn(w->pool->arg, job, w->id);
+    }
+    return NULL;
+}
+#endif
+
+int poolThreads(void) {
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(n > 0) {
+        return (int)n;
+    }
+#endif
+    return 1;
+}
+
+void runPool(int threads, int jobs, PoolJob fn, void *arg) {
+#ifndef _WIN32
+    Pool pool;
+    Worker *workers;
+    int started, i;
+
+    if(threads > jobs) {
+        threads = jobs;
+    }
+    if(threads > 1) {
+        workers = (Worker *)malloc(sizeof(Worker) * threads);
+        if(workers == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        pool.fn = fn;
+        pool.arg = arg;
+        pool.jobs = jobs;
+        pool.next = 0;
+        pthread_mutex_init(&pool.lock, NULL);
+
+        // a thread that fails to start just leaves its share to the others
+        started = 1;
+        for(i = 1; i < threads; ++i) {
+            workers[started].pool = &pool;
+            workers[started].id = started;
+            if(pthread_create(&workers[started].thread, NULL, work, &workers[started]) == 0) {
+                started++;
+            }
+        }
+        workers[0].pool = &pool;
+        workers[0].id = 0;
+        work(&workers[0]);
+
+        for(i = 1; i < started; ++i) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        pthread_mutex_destroy(&pool.lock);
+        free(workers);
+        return;
+    }
+#endif
+    // serial: one worker, jobs in order
+    {
+        int job;
+
+        for(job = 0; job < jobs; ++job) {
+            fn(arg, job, 0);
+        }
+    }
+}
\ No newline at end of file
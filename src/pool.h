@@ -0,0 +1,14 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/* one job of a batch. worker is in [0, threads) and no two jobs run on
+   the same worker at once, so it can index per-worker state. */
+typedef void (*PoolJob)(void *arg, int job, int worker);
+
+// online cpus, at least 1
+int poolThreads(void);
+/* run fn for every job in [0, jobs) on a fixed set of threads; the caller
+   is worker 0. Returns once all jobs are done. */
+void runPool(int threads, int jobs, PoolJob fn, void *arg);
+
+#endif
\ No newline at end of file
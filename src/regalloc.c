@@ -0,0 +1,1432 @@
+#include <limits.h>
+
+#include "globals.h"
+#include "ir.h"
+#include "regalloc.h"
+
+#define INITRA 64
+#define NOWHERE INT_MAX         // a position after all others
+
+// where the SysV ABI passes the first parameters
+static const int argRegs[6] = {RA_RDI, RA_RSI, RA_RDX, RA_RCX, RA_R8, RA_R9};
+static const char *regNames[RA_NUMREGS] = {
+    "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "rbx", "r12", "r13", "r14", "r15"
+};
+
+typedef struct _RaRange {
+    int from;               // [from, to) in positions
+    int to;
+    int next;               // while building: the next later range
+} RaRange;
+
+/* the part of one register's lifetime inside [from, to). A register
+   starts as one interval, and splitting cuts it into consecutive ones. */
+typedef struct _RaInterval {
+    int reg;
+    int from;
+    int to;
+    int start;              // first position it is live at, and one past the last
+    int end;
+    int loc;                // IR_NONE until it gets one
+    int next;               // the interval after it, -1 for the last
+    int cursor;             // first range not over before the current position
+} RaInterval;
+
+typedef struct _RaVirtual {
+    int head;               // while building: earliest range and use so far
+    int useHead;
+    int live;               // while building: the block it is live in
+    int defStamp;           // while scanning: the last block defining it
+    int useStamp;
+    int hint;               // register it would like, or -2 - r for where r is
+    int partner;            // copied to it and from it, a phi web out of SSA; -1 if none
+    int slot;               // -1 until it needs one
+    int first;              // its first interval, -1 if it is never live
+    int last;               // the latest one that got a place
+} RaVirtual;
+
+typedef struct _Allocator {
+    const IrModule *m;
+    const IrFunc *f;
+    RegAlloc *ra;
+    int fi;
+    RaVirtual *regs;
+    int maxRegs;
+    // blocks of the function, numbered from 0
+    int *succ;              // 2 per block
+    int *numSuccs;
+    int maxSuccs;
+    int maxNumSuccs;
+    int *predStart;         // CSR over blocks
+    int maxPredStart;
+    int *preds;
+    int maxPreds;
+    int *marks;             // 3 per block: live in, live out and defines, for one register
+    int maxMarks;
+    int *pairs;
+    int numPairs;
+    int maxPairs;
+    int *ueStart;           // CSR over registers: blocks using it before any definition
+    int maxUeStart;
+    int *ue;
+    int maxUe;
+    int *defStart;          // CSR over registers: blocks defining it
+    int maxDefStart;
+    int *defs;
+    int maxDefs;
+    int *copyStart;         // CSR over registers: what is copied into them
+    int maxCopyStart;
+    int *copies;
+    int maxCopies;
+    int *liveStart;         // CSR over blocks: registers live at the end
+    int maxLiveStart;
+    int *liveOut;
+    int maxLiveOut;
+    int *work;
+    int maxWork;
+    // lifetimes
+    RaRange *built;
+    int numBuilt;
+    int maxBuilt;
+    int *useNodes;          // while building: position and next, pairs
+    int numUseNodes;
+    int maxUseNodes;
+    RaRange *ranges;        // by register, then position
+    int maxRanges;
+    int *rangeStart;
+    int maxRangeStart;
+    int *uses;              // use positions, by register, then position
+    int maxUses;
+    int *useStart;
+    int maxUseStart;
+    int *calls;             // clobbers of all caller-saved registers, by position
+    int numCalls;
+    int maxCalls;
+    int *divs;              // clobbers of rax and rdx
+    int numDivs;
+    int maxDivs;
+    // the scan
+    RaInterval *intervals;
+    int numIntervals;
+    int maxIntervals;
+    int *heap;              // intervals waiting, by start
+    int numHeap;
+    int maxHeap;
+    int *active;            // have a register and are live at the current position
+    int numActive;
+    int maxActive;
+    int *inactive;          // have a register and are in a hole
+    int numInactive;
+    int maxInactive;
+    int *victims;
+    int maxVictims;
+    int numSlots;
+    unsigned int saved;
+    // resolution
+    int *childStart;        // CSR over registers: their intervals in order
+    int maxChildStart;
+    int *children;
+    int maxChildren;
+    char *blockStart;       // per instruction of the module: a block starts there
+    int maxBlockStart;
+    int *pending;           // moves as place, from, to triples
+    int numPending;
+    int maxPending;
+    int *sorted;
+    int maxSorted;
+    int *readers;
+    int maxReaders;
+    int maxSlots;           // most slots of any function
+} Allocator;
+
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        if(*max < INITRA) {
+            *max = INITRA;
+        }
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+static int readsA(IrOp op) {
+    return (op != IR_ADDR) && (op != IR_CALL) && (op != IR_JMP);
+}
+
+static int readsB(IrOp op) {
+    return ((op >= IR_ADD) && (op <= IR_NE)) || (op == IR_INDEX) || (op == IR_STORE);
+}
+
+static int isReg(int x) {
+    return x >= 0;
+}
+
+static void addPair(Allocator *a, int key, int val) {
+    a->pairs = (int *)growArray(a->pairs, &a->maxPairs, 2 * a->numPairs + 2, sizeof(int));
+    a->pairs[2 * a->numPairs] = key;
+    a->pairs[2 * a->numPairs + 1] = val;
+    a->numPairs++;
+}
+
+// the pairs by key below n: list[start[k], start[k + 1]) are k's values
+static void bucket(Allocator *a, int n, int **start, int *maxStart, int **list, int *maxList) {
+    int i, k;
+
+    *start = (int *)growArray(*start, maxStart, n + 2, sizeof(int));
+    *list = (int *)growArray(*list, maxList, a->numPairs + 1, sizeof(int));
+    memset(*start, 0, sizeof(int) * (n + 2));
+    for(i = 0; i < a->numPairs; ++i) {
+        (*start)[a->pairs[2 * i] + 2]++;
+    }
+    for(k = 0; k < n; ++k) {
+        (*start)[k + 2] += (*start)[k + 1];
+    }
+    for(i = 0; i < a->numPairs; ++i) {
+        (*list)[(*start)[a->pairs[2 * i] + 1]++] = a->pairs[2 * i + 1];
+    }
+    a->numPairs = 0;
+}
+
+// blocks control goes to from block b of the function: the next one or a jump's target, then a branch's
+static void findSuccessors(Allocator *a) {
+    const IrModule *m = a->m;
+    const IrFunc *f = a->f;
+    const IrBlock *blk;
+    const IrInst *last;
+    int *s;
+    int b, n;
+
+    a->succ = (int *)growArray(a->succ, &a->maxSuccs, 2 * f->numBlocks, sizeof(int));
+    a->numSuccs = (int *)growArray(a->numSuccs, &a->maxNumSuccs, f->numBlocks, sizeof(int));
+    for(b = 0; b < f->numBlocks; ++b) {
+        blk = &m->blocks[f->firstBlock + b];
+        last = (blk->end > blk->start) ? &m->insts[blk->end - 1] : NULL;
+        s = &a->succ[2 * b];
+        n = 1;
+        s[0] = b + 1;
+        if(last != NULL) {
+            if(last->op == IR_RET) {
+                n = 0;
+            }
+            else if(last->op == IR_JMP) {
+                s[0] = last->a - f->firstBlock;
+            }
+            else if(last->op == IR_BRZ) {
+                s[1] = last->b - f->firstBlock;
+                n = 2;
+            }
+        }
+        // the last block returns
+        a->numSuccs[b] = (s[0] < f->numBlocks) ? n : 0;
+        for(n = 0; n < a->numSuccs[b]; ++n) {
+            addPair(a, s[n], b);
+        }
+    }
+    bucket(a, f->numBlocks, &a->predStart, &a->maxPredStart, &a->preds, &a->maxPreds);
+}
+
+/* which blocks use a register before defining it and which define it,
+   hints, and where calls and divisions are */
+static void scanBlocks(Allocator *a) {
+    const IrModule *m = a->m;
+    const IrFunc *f = a->f;
+    const IrInst *in;
+    RaVirtual *r;
+    int b, i, j, x;
+
+    a->numCalls = a->numDivs = 0;
+    for(b = 0; b < f->numBlocks; ++b) {
+        for(i = m->blocks[f->firstBlock + b].start; i < m->blocks[f->firstBlock + b].end; ++i) {
+            in = &m->insts[i];
+            for(j = 0; j < 2; ++j) {
+                x = j ? (readsB(in->op) ? in->b : IR_NONE) : (readsA(in->op) ? in->a : IR_NONE);
+                if(isReg(x) && (a->regs[x].defStamp != b) && (a->regs[x].useStamp != b)) {
+                    a->regs[x].useStamp = b;
+                    addPair(a, x, b);
+                }
+            }
+            if(in->op == IR_CALL) {
+                a->calls = (int *)growArray(a->calls, &a->maxCalls, a->numCalls + 1, sizeof(int));
+                a->calls[a->numCalls++] = 4 * i + 1;
+            }
+            else if(in->op == IR_DIV) {
+                a->divs = (int *)growArray(a->divs, &a->maxDivs, a->numDivs + 1, sizeof(int));
+                a->divs[a->numDivs++] = 4 * i + 1;
+            }
+            if(isReg(in->dst)) {
+                r = &a->regs[in->dst];
+                if(r->hint == IR_NONE) {
+                    if(in->op == IR_CALL) {
+                        r->hint = RA_RAX;
+                    }
+                    else if((in->op == IR_MOV) && isReg(in->a)) {
+                        r->hint = -2 - in->a;
+                    }
+                }
+                r->defStamp = b;
+            }
+        }
+    }
+    bucket(a, f->numRegs, &a->ueStart, &a->maxUeStart, &a->ue, &a->maxUe);
+
+    for(i = 0; i < f->numRegs; ++i) {
+        a->regs[i].defStamp = -1;
+    }
+    for(b = 0; b < f->numBlocks; ++b) {
+        for(i = m->blocks[f->firstBlock + b].start; i < m->blocks[f->firstBlock + b].end; ++i) {
+            x = m->insts[i].dst;
+            if(isReg(x) && (a->regs[x].defStamp != b)) {
+                a->regs[x].defStamp = b;
+                addPair(a, x, b);
+            }
+        }
+    }
+    bucket(a, f->numRegs, &a->defStart, &a->maxDefStart, &a->defs, &a->maxDefs);
+
+    /* a copy's source would like its destination's register too, and
+       registers copied into each other would like the same one */
+    for(i = m->blocks[f->firstBlock].start; i < m->blocks[f->firstBlock + f->numBlocks - 1].end; ++i) {
+        in = &m->insts[i];
+        if((in->op == IR_MOV) && isReg(in->a) && (in->a != in->dst)) {
+            addPair(a, in->dst, in->a);
+            if(a->regs[in->a].hint == IR_NONE) {
+                a->regs[in->a].hint = -2 - in->dst;
+            }
+        }
+    }
+    bucket(a, f->numRegs, &a->copyStart, &a->maxCopyStart, &a->copies, &a->maxCopies);
+    for(x = 0; x < f->numRegs; ++x) {
+        for(i = a->copyStart[x]; i < a->copyStart[x + 1]; ++i) {
+            for(j = a->copyStart[a->copies[i]]; j < a->copyStart[a->copies[i] + 1]; ++j) {
+                if(a->copies[j] == x) {
+                    a->regs[x].partner = a->copies[i];
+                }
+            }
+        }
+    }
+}
+
+/* registers live at the end of each block. From every block that uses
+   a register before defining it, walk back through predecessors until
+   blocks that define it. */
+static void computeLiveness(Allocator *a) {
+    const IrFunc *f = a->f;
+    int *in, *out, *def;
+    int top, v, k, b, p, e;
+
+    a->marks = (int *)growArray(a->marks, &a->maxMarks, 3 * f->numBlocks, sizeof(int));
+    a->work = (int *)growArray(a->work, &a->maxWork, f->numBlocks, sizeof(int));
+    in = a->marks;
+    out = in + f->numBlocks;
+    def = out + f->numBlocks;
+    for(b = 0; b < 3 * f->numBlocks; ++b) {
+        a->marks[b] = -1;
+    }
+
+    for(v = 0; v < f->numRegs; ++v) {
+        for(k = a->defStart[v]; k < a->defStart[v + 1]; ++k) {
+            def[a->defs[k]] = v;
+        }
+        top = 0;
+        for(k = a->ueStart[v]; k < a->ueStart[v + 1]; ++k) {
+            in[a->ue[k]] = v;
+            a->work[top++] = a->ue[k];
+        }
+        while(top > 0) {
+            b = a->work[--top];
+            for(e = a->predStart[b]; e < a->predStart[b + 1]; ++e) {
+                p = a->preds[e];
+                if(out[p] != v) {
+                    out[p] = v;
+                    addPair(a, p, v);
+                    if((def[p] != v) && (in[p] != v)) {
+                        in[p] = v;
+                        a->work[top++] = p;
+                    }
+                }
+            }
+        }
+    }
+    bucket(a, f->numBlocks, &a->liveStart, &a->maxLiveStart, &a->liveOut, &a->maxLiveOut);
+}
+
+// ranges come in going back, so a new one is at or before the earliest
+static void addRange(Allocator *a, int v, int from, int to) {
+    RaVirtual *r = &a->regs[v];
+    RaRange *head;
+
+    if(from >= to) {
+        return;
+    }
+    if(r->head >= 0) {
+        head = &a->built[r->head];
+        if(head->from <= to) {
+            if(from < head->from) {
+                head->from = from;
+            }
+            if(to > head->to) {
+                head->to = to;
+            }
+            return;
+        }
+    }
+    a->built = (RaRange *)growArray(a->built, &a->maxBuilt, a->numBuilt + 1, sizeof(RaRange));
+    head = &a->built[a->numBuilt];
+    head->from = from;
+    head->to = to;
+    head->next = r->head;
+    r->head = a->numBuilt++;
+}
+
+static void addUse(Allocator *a, int v, int pos) {
+    a->useNodes = (int *)growArray(a->useNodes, &a->maxUseNodes, 2 * a->numUseNodes + 2, sizeof(int));
+    a->useNodes[2 * a->numUseNodes] = pos;
+    a->useNodes[2 * a->numUseNodes + 1] = a->regs[v].useHead;
+    a->regs[v].useHead = a->numUseNodes++;
+}
+
+/* lifetimes, going back over the blocks and their code: a register is
+   live from where it is read back to the block's start, or to where it
+   is defined */
+static void buildLifetimes(Allocator *a) {
+    const IrModule *m = a->m;
+    const IrFunc *f = a->f;
+    const IrInst *in;
+    RaRange *rg;
+    int b, i, k, x, j, from, to, call, pos, n;
+
+    a->numBuilt = a->numUseNodes = 0;
+    for(b = f->numBlocks - 1; b >= 0; --b) {
+        from = 4 * m->blocks[f->firstBlock + b].start;
+        to = 4 * m->blocks[f->firstBlock + b].end;
+        for(k = a->liveStart[b]; k < a->liveStart[b + 1]; ++k) {
+            addRange(a, a->liveOut[k], from, to);
+            a->regs[a->liveOut[k]].live = b;
+        }
+        call = -1;
+        for(i = m->blocks[f->firstBlock + b].end - 1; i >= m->blocks[f->firstBlock + b].start; --i) {
+            in = &m->insts[i];
+            if(in->op == IR_CALL) {
+                call = i;
+            }
+            x = in->dst;
+            if(isReg(x)) {
+                if(a->regs[x].live == b) {
+                    a->built[a->regs[x].head].from = 4 * i + 2;
+                    a->regs[x].live = -1;
+                }
+                else {
+                    addRange(a, x, 4 * i + 2, 4 * i + 3);
+                }
+            }
+            pos = ((in->op == IR_ARG) && (call >= 0)) ? 4 * call : 4 * i;
+            for(j = 0; j < 2; ++j) {
+                x = j ? (readsB(in->op) ? in->b : IR_NONE) : (readsA(in->op) ? in->a : IR_NONE);
+                if(isReg(x)) {
+                    addRange(a, x, from, pos + 1);
+                    addUse(a, x, pos);
+                    a->regs[x].live = b;
+                }
+            }
+        }
+    }
+
+    // into arrays by register; the lists already run forward
+    a->rangeStart = (int *)growArray(a->rangeStart, &a->maxRangeStart, f->numRegs + 1, sizeof(int));
+    a->ranges = (RaRange *)growArray(a->ranges, &a->maxRanges, a->numBuilt + 1, sizeof(RaRange));
+    a->useStart = (int *)growArray(a->useStart, &a->maxUseStart, f->numRegs + 1, sizeof(int));
+    a->uses = (int *)growArray(a->uses, &a->maxUses, a->numUseNodes + 1, sizeof(int));
+    n = 0;
+    j = 0;
+    for(x = 0; x < f->numRegs; ++x) {
+        a->rangeStart[x] = n;
+        for(k = a->regs[x].head; k >= 0; k = rg->next) {
+            rg = &a->built[k];
+            a->ranges[n++] = *rg;
+        }
+        a->useStart[x] = j;
+        for(k = a->regs[x].useHead; k >= 0; k = a->useNodes[2 * k + 1]) {
+            a->uses[j++] = a->useNodes[2 * k];
+        }
+    }
+    a->rangeStart[f->numRegs] = n;
+    a->useStart[f->numRegs] = j;
+}
+
+// first range of v that ends after p
+static int rangeAfter(const Allocator *a, int v, int p) {
+    int lo = a->rangeStart[v];
+    int hi = a->rangeStart[v + 1];
+    int mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(a->ranges[mid].to <= p) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// first position in [p, to) v is live at
+static int liveFrom(const Allocator *a, int v, int p, int to) {
+    int r = rangeAfter(a, v, p);
+
+    if((r == a->rangeStart[v + 1]) || (a->ranges[r].from >= to)) {
+        return NOWHERE;
+    }
+    return (a->ranges[r].from > p) ? a->ranges[r].from : p;
+}
+
+// one past the last position v is live at before to, which is after from
+static int liveUntil(const Allocator *a, int v, int to) {
+    int lo = a->rangeStart[v];
+    int hi = a->rangeStart[v + 1];
+    int mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(a->ranges[mid].from < to) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return (a->ranges[lo - 1].to < to) ? a->ranges[lo - 1].to : to;
+}
+
+static int covers(const Allocator *a, const RaInterval *it, int p) {
+    int r;
+
+    if((p < it->from) || (p >= it->to)) {
+        return FALSE;
+    }
+    r = rangeAfter(a, it->reg, p);
+    return (r < a->rangeStart[it->reg + 1]) && (a->ranges[r].from <= p);
+}
+
+// the same for positions that only go up
+static int coversNext(const Allocator *a, RaInterval *it, int p) {
+    int end = a->rangeStart[it->reg + 1];
+
+    while((it->cursor < end) && (a->ranges[it->cursor].to <= p)) {
+        it->cursor++;
+    }
+    return (p >= it->from) && (p < it->to) && (it->cursor < end) && (a->ranges[it->cursor].from <= p);
+}
+
+// first use of it at or after p
+static int nextUse(const Allocator *a, const RaInterval *it, int p) {
+    int lo = a->useStart[it->reg];
+    int hi = a->useStart[it->reg + 1];
+    int mid;
+
+    if(p < it->from) {
+        p = it->from;
+    }
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(a->uses[mid] < p) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return ((lo < a->useStart[it->reg + 1]) && (a->uses[lo] < it->to)) ? a->uses[lo] : NOWHERE;
+}
+
+// first position from cur's start on where both are live
+static int intersection(const Allocator *a, const RaInterval *it, const RaInterval *cur) {
+    int lo = (cur->start > it->from) ? cur->start : it->from;
+    int hi = (cur->end < it->to) ? cur->end : it->to;
+    int i = rangeAfter(a, it->reg, lo);
+    int j = rangeAfter(a, cur->reg, lo);
+    const RaRange *ri, *rj;
+    int from, to;
+
+    while((i < a->rangeStart[it->reg + 1]) && (j < a->rangeStart[cur->reg + 1])) {
+        ri = &a->ranges[i];
+        rj = &a->ranges[j];
+        from = (ri->from > rj->from) ? ri->from : rj->from;
+        if(from < lo) {
+            from = lo;
+        }
+        to = (ri->to < rj->to) ? ri->to : rj->to;
+        if(from >= hi) {
+            break;
+        }
+        if(from < to) {
+            return from;
+        }
+        if(ri->to < rj->to) {
+            i++;
+        }
+        else {
+            j++;
+        }
+    }
+    return NOWHERE;
+}
+
+/* first of the sorted positions in list that cur is live at. Each
+   round finds the next position from where cur is live and the range of
+   cur around it, so both sides are skipped over by binary search. */
+static int firstHit(const Allocator *a, const RaInterval *cur, const int *list, int n) {
+    int p = cur->start;
+    int lo, hi, mid, r;
+
+    for(;;) {
+        lo = 0;
+        hi = n;
+        while(lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if(list[mid] < p) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if((lo == n) || (list[lo] >= cur->end)) {
+            return NOWHERE;
+        }
+        p = list[lo];
+        r = rangeAfter(a, cur->reg, p);
+        if(r == a->rangeStart[cur->reg + 1]) {
+            return NOWHERE;
+        }
+        if(a->ranges[r].from <= p) {
+            return p;
+        }
+        p = a->ranges[r].from;
+    }
+}
+
+static int newInterval(Allocator *a, int v, int from, int to, int start) {
+    RaInterval *it;
+
+    a->intervals = (RaInterval *)growArray(a->intervals, &a->maxIntervals, a->numIntervals + 1, sizeof(RaInterval));
+    it = &a->intervals[a->numIntervals];
+    it->reg = v;
+    it->from = from;
+    it->to = to;
+    it->start = start;
+    it->end = liveUntil(a, v, to);
+    it->loc = IR_NONE;
+    it->next = -1;
+    it->cursor = rangeAfter(a, v, start);
+    return a->numIntervals++;
+}
+
+static int before(const Allocator *a, int x, int y) {
+    const RaInterval *ix = &a->intervals[x];
+    const RaInterval *iy = &a->intervals[y];
+
+    return (ix->start < iy->start) || ((ix->start == iy->start) && (x < y));
+}
+
+static void heapPush(Allocator *a, int id) {
+    int i, p;
+
+    a->heap = (int *)growArray(a->heap, &a->maxHeap, a->numHeap + 1, sizeof(int));
+    for(i = a->numHeap++; i > 0; i = p) {
+        p = (i - 1) / 2;
+        if(!before(a, id, a->heap[p])) {
+            break;
+        }
+        a->heap[i] = a->heap[p];
+    }
+    a->heap[i] = id;
+}
+
+static int heapPop(Allocator *a) {
+    int top = a->heap[0];
+    int last = a->heap[--a->numHeap];
+    int i = 0;
+    int c;
+
+    while((c = 2 * i + 1) < a->numHeap) {
+        if((c + 1 < a->numHeap) && before(a, a->heap[c + 1], a->heap[c])) {
+            c++;
+        }
+        if(!before(a, a->heap[c], last)) {
+            break;
+        }
+        a->heap[i] = a->heap[c];
+        i = c;
+    }
+    if(a->numHeap > 0) {
+        a->heap[i] = last;
+    }
+    return top;
+}
+
+/* cut id at s, after its start: it keeps what comes before, and the
+   interval it returns gets the rest, -1 if none of the rest is live */
+static int split(Allocator *a, int id, int s) {
+    RaInterval *it = &a->intervals[id];
+    int v = it->reg;
+    int to = it->to;
+    int start = liveFrom(a, v, s, to);
+    int c;
+
+    if(start == NOWHERE) {
+        it->to = s;
+        it->end = liveUntil(a, v, s);
+        return -1;
+    }
+    c = newInterval(a, v, s, to, start);
+    it = &a->intervals[id];
+    a->intervals[c].next = it->next;
+    it->next = c;
+    it->to = s;
+    it->end = liveUntil(a, v, s);
+    return c;
+}
+
+static int slotOf(Allocator *a, int v) {
+    if(a->regs[v].slot < 0) {
+        a->regs[v].slot = a->numSlots++;
+    }
+    return RA_SLOT(a->regs[v].slot);
+}
+
+static void removeFrom(int *list, int *n, int id) {
+    int i;
+
+    for(i = 0; i < *n; ++i) {
+        if(list[i] == id) {
+            list[i] = list[--*n];
+            return;
+        }
+    }
+}
+
+/* id gives its register up at p: it goes to the stack from the last
+   instruction boundary, and waits for a register again at its next use */
+static void spillAt(Allocator *a, int id, int p) {
+    int s = p & ~3;
+    int c, u;
+
+    if(s <= a->intervals[id].start) {
+        removeFrom(a->active, &a->numActive, id);
+        removeFrom(a->inactive, &a->numInactive, id);
+        c = id;
+    }
+    else if((c = split(a, id, s)) < 0) {
+        return;
+    }
+    u = nextUse(a, &a->intervals[c], p + 1);
+    if(u == NOWHERE) {
+        a->intervals[c].loc = slotOf(a, a->intervals[c].reg);
+    }
+    else if(u <= a->intervals[c].start) {
+        a->intervals[c].loc = IR_NONE;
+        heapPush(a, c);
+    }
+    else {
+        a->intervals[c].loc = slotOf(a, a->intervals[c].reg);
+        u = split(a, c, u);
+        if(u >= 0) {
+            heapPush(a, u);
+        }
+    }
+}
+
+// registers the fixed clobbers leave cur before: calls take the caller-saved ones, divisions rax and rdx
+static void clobbers(const Allocator *a, const RaInterval *cur, int *until) {
+    int call = firstHit(a, cur, a->calls, a->numCalls);
+    int div = firstHit(a, cur, a->divs, a->numDivs);
+    int r;
+
+    for(r = 0; r < RA_NUMREGS; ++r) {
+        until[r] = (r < RA_CALLERSAVED) ? call : NOWHERE;
+    }
+    if(div < until[RA_RAX]) {
+        until[RA_RAX] = div;
+    }
+    if(div < until[RA_RDX]) {
+        until[RA_RDX] = div;
+    }
+}
+
+static void assign(Allocator *a, int id, int r) {
+    a->intervals[id].loc = r;
+    if(r >= RA_CALLERSAVED) {
+        a->saved |= 1u << r;
+    }
+}
+
+// the register r is in lately, IR_NONE if none
+static int placed(const Allocator *a, int r) {
+    int loc = (a->regs[r].last >= 0) ? a->intervals[a->regs[r].last].loc : IR_NONE;
+
+    return ((loc >= 0) && (loc < RA_NUMREGS)) ? loc : IR_NONE;
+}
+
+/* a register free for all of cur, preferring its partner's and its hint, then ones a call
+   may clobber, then saved ones already in use; failing that the one free
+   longest, and cur is split where it stops being free */
+static int tryFree(Allocator *a, int id) {
+    RaInterval *cur = &a->intervals[id];
+    const RaVirtual *v = &a->regs[cur->reg];
+    int until[RA_NUMREGS];
+    int hint = IR_NONE;
+    int i, r, p, best, pass, s, c;
+
+    clobbers(a, cur, until);
+    for(i = 0; i < a->numActive; ++i) {
+        until[a->intervals[a->active[i]].loc] = 0;
+    }
+    for(i = 0; i < a->numInactive; ++i) {
+        r = a->intervals[a->inactive[i]].loc;
+        if(until[r] > cur->start) {
+            p = intersection(a, &a->intervals[a->inactive[i]], cur);
+            if(p < until[r]) {
+                until[r] = p;
+            }
+        }
+    }
+
+    best = -1;
+    if(v->first == id) {
+        hint = (v->partner >= 0) ? placed(a, v->partner) : IR_NONE;
+        if((hint >= 0) && (until[hint] >= cur->end)) {
+            best = hint;
+        }
+        hint = (v->hint <= -2) ? placed(a, -2 - v->hint) : v->hint;
+        if((best < 0) && (hint >= 0) && (until[hint] >= cur->end)) {
+            best = hint;
+        }
+    }
+    for(r = 0; (r < RA_CALLERSAVED) && (best < 0); ++r) {
+        if(until[r] >= cur->end) {
+            best = r;
+        }
+    }
+    for(pass = 0; (pass < 2) && (best < 0); ++pass) {
+        for(r = RA_CALLERSAVED; (r < RA_NUMREGS) && (best < 0); ++r) {
+            if((((a->saved >> r) & 1) == (unsigned int)!pass) && (until[r] >= cur->end)) {
+                best = r;
+            }
+        }
+    }
+    if(best >= 0) {
+        assign(a, id, best);
+        return TRUE;
+    }
+
+    best = 0;
+    for(r = 1; r < RA_NUMREGS; ++r) {
+        if(until[r] > until[best]) {
+            best = r;
+        }
+    }
+    s = until[best] & ~3;
+    if(s <= cur->start) {
+        return FALSE;
+    }
+    assign(a, id, best);
+    c = split(a, id, s);
+    if(c >= 0) {
+        heapPush(a, c);
+    }
+    return TRUE;
+}
+
+/* no register is free for long enough. The one whose holders are used
+   again latest goes to cur, and they are spilled, unless cur's own first
+   use is later still; then cur waits on the stack until that use. */
+static void allocateBlocked(Allocator *a, int id) {
+    RaInterval *cur = &a->intervals[id];
+    int block[RA_NUMREGS];
+    int use[RA_NUMREGS];
+    int i, r, u, first, best, c, n, start;
+
+    clobbers(a, cur, block);
+    for(r = 0; r < RA_NUMREGS; ++r) {
+        use[r] = block[r];
+    }
+    for(i = 0; i < a->numActive; ++i) {
+        r = a->intervals[a->active[i]].loc;
+        u = nextUse(a, &a->intervals[a->active[i]], cur->start);
+        if(u < use[r]) {
+            use[r] = u;
+        }
+    }
+    for(i = 0; i < a->numInactive; ++i) {
+        r = a->intervals[a->inactive[i]].loc;
+        if(intersection(a, &a->intervals[a->inactive[i]], cur) != NOWHERE) {
+            u = nextUse(a, &a->intervals[a->inactive[i]], cur->start);
+            if(u < use[r]) {
+                use[r] = u;
+            }
+        }
+    }
+    best = -1;
+    for(r = 0; r < RA_NUMREGS; ++r) {
+        if(((block[r] & ~3) > cur->start) && ((best < 0) || (use[r] > use[best]))) {
+            best = r;
+        }
+    }
+
+    first = nextUse(a, cur, cur->start);
+    if((best < 0) || (first > use[best]) || (first == NOWHERE)) {
+        cur->loc = slotOf(a, cur->reg);
+        u = (first > cur->start) ? first : nextUse(a, cur, cur->start + 1);
+        if(u != NOWHERE) {
+            c = split(a, id, u);
+            if(c >= 0) {
+                heapPush(a, c);
+            }
+        }
+        return;
+    }
+
+    assign(a, id, best);
+    if(block[best] < cur->end) {
+        c = split(a, id, block[best] & ~3);
+        if(c >= 0) {
+            heapPush(a, c);
+        }
+    }
+    cur = &a->intervals[id];
+    start = cur->start;
+    n = 0;
+    a->victims = (int *)growArray(a->victims, &a->maxVictims, a->numActive + a->numInactive, sizeof(int));
+    for(i = 0; i < a->numActive; ++i) {
+        if(a->intervals[a->active[i]].loc == best) {
+            a->victims[n++] = a->active[i];
+        }
+    }
+    for(i = 0; i < a->numInactive; ++i) {
+        if((a->intervals[a->inactive[i]].loc == best) &&
+            (intersection(a, &a->intervals[a->inactive[i]], &a->intervals[id]) != NOWHERE)) {
+            a->victims[n++] = a->inactive[i];
+        }
+    }
+    for(i = 0; i < n; ++i) {
+        spillAt(a, a->victims[i], start);
+    }
+}
+
+static void pushList(int **list, int *n, int *max, int id) {
+    *list = (int *)growArray(*list, max, *n + 1, sizeof(int));
+    (*list)[(*n)++] = id;
+}
+
+// intervals in order of their starts, each to a register or the stack
+static void linearScan(Allocator *a) {
+    const IrFunc *f = a->f;
+    RaInterval *it;
+    int v, id, pos, i, n, moved;
+
+    a->numIntervals = a->numHeap = a->numActive = a->numInactive = 0;
+    for(v = 0; v < f->numRegs; ++v) {
+        if(a->rangeStart[v] < a->rangeStart[v + 1]) {
+            a->regs[v].first = newInterval(a, v, a->ranges[a->rangeStart[v]].from,
+                a->ranges[a->rangeStart[v + 1] - 1].to, a->ranges[a->rangeStart[v]].from);
+            heapPush(a, a->regs[v].first);
+        }
+    }
+
+    while(a->numHeap > 0) {
+        id = heapPop(a);
+        pos = a->intervals[id].start;
+
+        // holes end and start: inactive ones first, so the ones moved there aren't looked at again
+        moved = a->numActive;
+        n = 0;
+        for(i = 0; i < a->numInactive; ++i) {
+            it = &a->intervals[a->inactive[i]];
+            if(it->end <= pos) {
+                continue;
+            }
+            if(coversNext(a, it, pos)) {
+                pushList(&a->active, &a->numActive, &a->maxActive, a->inactive[i]);
+            }
+            else {
+                a->inactive[n++] = a->inactive[i];
+            }
+        }
+        a->numInactive = n;
+        n = 0;
+        for(i = 0; i < a->numActive; ++i) {
+            it = &a->intervals[a->active[i]];
+            if(it->end <= pos) {
+                continue;
+            }
+            if((i >= moved) || coversNext(a, it, pos)) {
+                a->active[n++] = a->active[i];
+            }
+            else {
+                pushList(&a->inactive, &a->numInactive, &a->maxInactive, a->active[i]);
+            }
+        }
+        a->numActive = n;
+
+        if(!tryFree(a, id)) {
+            allocateBlocked(a, id);
+        }
+        it = &a->intervals[id];
+        if(isReg(it->loc) && (it->loc < RA_NUMREGS)) {
+            pushList(&a->active, &a->numActive, &a->maxActive, id);
+        }
+        a->regs[it->reg].last = id;
+    }
+}
+
+// where v is at p, IR_NONE if it isn't live there
+static int locAt(const Allocator *a, int v, int p) {
+    int lo = a->childStart[v];
+    int hi = a->childStart[v + 1];
+    int mid;
+    const RaInterval *it;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(a->intervals[a->children[mid]].from <= p) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if(lo == a->childStart[v]) {
+        return IR_NONE;
+    }
+    it = &a->intervals[a->children[lo - 1]];
+    return covers(a, it, p) ? it->loc : IR_NONE;
+}
+
+static void addMove(Allocator *a, int place, int from, int to) {
+    if((from == to) || (to == IR_NONE) || (from == IR_NONE)) {
+        return;
+    }
+    a->pending = (int *)growArray(a->pending, &a->maxPending, 3 * a->numPending + 3, sizeof(int));
+    a->pending[3 * a->numPending] = place;
+    a->pending[3 * a->numPending + 1] = from;
+    a->pending[3 * a->numPending + 2] = to;
+    a->numPending++;
+    if(RA_ISSLOT(from) || RA_ISSLOT(to)) {
+        a->ra->funcs[a->fi].spillMoves++;
+    }
+}
+
+/* where every operand is, and the moves that join split intervals: in
+   a block where the split is, else on each edge the register is live
+   along, and from the ABI's places for parameters */
+static void resolve(Allocator *a) {
+    const IrModule *m = a->m;
+    const IrFunc *f = a->f;
+    const IrInst *in;
+    const RaInterval *it, *prev;
+    int *locs = a->ra->locs;
+    int v, k, n, b, i, call, s, e, from, to, end;
+
+    a->childStart = (int *)growArray(a->childStart, &a->maxChildStart, f->numRegs + 1, sizeof(int));
+    a->children = (int *)growArray(a->children, &a->maxChildren, a->numIntervals + 1, sizeof(int));
+    n = 0;
+    for(v = 0; v < f->numRegs; ++v) {
+        a->childStart[v] = n;
+        for(k = a->regs[v].first; k >= 0; k = a->intervals[k].next) {
+            a->children[n++] = k;
+        }
+        if(a->regs[v].slot >= 0) {
+            a->ra->funcs[a->fi].spilled++;
+        }
+    }
+    a->childStart[f->numRegs] = n;
+
+    for(v = 0; v < f->numRegs; ++v) {
+        for(k = a->childStart[v] + 1; k < a->childStart[v + 1]; ++k) {
+            prev = &a->intervals[a->children[k - 1]];
+            it = &a->intervals[a->children[k]];
+            s = it->from;
+            if((it->start == s) && !a->blockStart[s / 4]) {
+                addMove(a, RA_BEFORE(s / 4), prev->loc, it->loc);
+            }
+        }
+    }
+
+    for(b = 0; b < f->numBlocks; ++b) {
+        from = 4 * m->blocks[f->firstBlock + b].start;
+        end = 4 * m->blocks[f->firstBlock + b].end;
+        end = (end > from) ? end - 1 : from;
+        for(k = 0; k < a->numSuccs[b]; ++k) {
+            s = 4 * m->blocks[f->firstBlock + a->succ[2 * b + k]].start;
+            for(e = a->liveStart[b]; e < a->liveStart[b + 1]; ++e) {
+                v = a->liveOut[e];
+                to = locAt(a, v, s);
+                if(to != IR_NONE) {
+                    addMove(a, RA_EDGE(m, f->firstBlock + b, k), locAt(a, v, end), to);
+                }
+            }
+        }
+
+        call = -1;
+        for(i = m->blocks[f->firstBlock + b].end - 1; i >= m->blocks[f->firstBlock + b].start; --i) {
+            in = &m->insts[i];
+            if(in->op == IR_CALL) {
+                call = i;
+            }
+            locs[3 * i] = isReg(in->dst) ? locAt(a, in->dst, 4 * i + 2) : IR_NONE;
+            s = ((in->op == IR_ARG) && (call >= 0)) ? 4 * call : 4 * i;
+            locs[3 * i + 1] = (readsA(in->op) && isReg(in->a)) ? locAt(a, in->a, s) : IR_NONE;
+            locs[3 * i + 2] = (readsB(in->op) && isReg(in->b)) ? locAt(a, in->b, s) : IR_NONE;
+        }
+    }
+
+    s = 4 * m->blocks[f->firstBlock].start;
+    for(v = 0; v < f->numParams; ++v) {
+        addMove(a, RA_ENTRY(m, a->fi), (v < 6) ? argRegs[v] : RA_INCOMING(v - 6), locAt(a, v, s));
+    }
+}
+
+static void allocateFunction(Allocator *a) {
+    const IrFunc *f = a->f;
+    RaFunc *rf = &a->ra->funcs[a->fi];
+    RaVirtual *r;
+    int i;
+
+    a->regs = (RaVirtual *)growArray(a->regs, &a->maxRegs, f->numRegs, sizeof(RaVirtual));
+    for(i = 0; i < f->numRegs; ++i) {
+        r = &a->regs[i];
+        r->head = r->useHead = r->live = -1;
+        r->defStamp = r->useStamp = -1;
+        r->hint = (i < f->numParams) ? ((i < 6) ? argRegs[i] : IR_NONE) : IR_NONE;
+        r->slot = r->first = r->last = r->partner = -1;
+    }
+    a->numSlots = 0;
+    a->saved = 0;
+
+    findSuccessors(a);
+    scanBlocks(a);
+    computeLiveness(a);
+    buildLifetimes(a);
+    linearScan(a);
+    memset(rf, 0, sizeof(RaFunc));
+    resolve(a);
+    rf->numSlots = a->numSlots;
+    rf->saved = a->saved;
+    if(a->numSlots > a->maxSlots) {
+        a->maxSlots = a->numSlots;
+    }
+}
+
+/* the moves of one place as if all at once: a move goes when nothing
+   pending still reads where it writes. What is left are cycles of
+   registers, since a slot holds one register's value; a swap takes one
+   move of a cycle off, and what read its destination reads its source. */
+static void sequence(Allocator *a, const int *list, int n) {
+    RegAlloc *ra = a->ra;
+    int *mv = a->sorted;
+    int i, j, done, from, to;
+
+    for(i = 0; i < n; ++i) {
+        mv[2 * i] = a->pending[3 * list[i] + 1];
+        mv[2 * i + 1] = a->pending[3 * list[i] + 2];
+        if(mv[2 * i] >= 0) {
+            a->readers[mv[2 * i]]++;
+        }
+    }
+    ra->moves = (RaMove *)growArray(ra->moves, &ra->maxMoves, ra->numMoves + n, sizeof(RaMove));
+    while(n > 0) {
+        done = FALSE;
+        for(i = 0; i < n; ++i) {
+            if(a->readers[mv[2 * i + 1]] == 0) {
+                from = mv[2 * i];
+                ra->moves[ra->numMoves].from = from;
+                ra->moves[ra->numMoves].to = mv[2 * i + 1];
+                ra->moves[ra->numMoves++].swap = FALSE;
+                if(from >= 0) {
+                    a->readers[from]--;
+                }
+                n--;
+                mv[2 * i] = mv[2 * n];
+                mv[2 * i + 1] = mv[2 * n + 1];
+                i--;
+                done = TRUE;
+            }
+        }
+        if(!done) {
+            from = mv[0];
+            to = mv[1];
+            ra->moves[ra->numMoves].from = from;
+            ra->moves[ra->numMoves].to = to;
+            ra->moves[ra->numMoves++].swap = TRUE;
+            a->readers[from]--;
+            n--;
+            mv[0] = mv[2 * n];
+            mv[1] = mv[2 * n + 1];
+            for(j = 0; j < n; ++j) {
+                if(mv[2 * j] == to) {
+                    a->readers[to]--;
+                    if(mv[2 * j + 1] == from) {
+                        // it would copy from to itself
+                        n--;
+                        mv[2 * j] = mv[2 * n];
+                        mv[2 * j + 1] = mv[2 * n + 1];
+                        j--;
+                    }
+                    else {
+                        mv[2 * j] = from;
+                        a->readers[from]++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// pending moves by place, in order to run
+static void placeMoves(Allocator *a) {
+    const IrModule *m = a->m;
+    RegAlloc *ra = a->ra;
+    int places = RA_ENTRY(m, m->numFuncs);
+    int *start;
+    int i, p;
+
+    ra->moveStart = (int *)growArray(ra->moveStart, &ra->maxMoveStart, places + 2, sizeof(int));
+    start = ra->moveStart;
+    memset(start, 0, sizeof(int) * (places + 2));
+    for(i = 0; i < a->numPending; ++i) {
+        start[a->pending[3 * i] + 2]++;
+    }
+    for(p = 0; p < places; ++p) {
+        start[p + 2] += start[p + 1];
+    }
+    a->sorted = (int *)growArray(a->sorted, &a->maxSorted, 2 * a->numPending + 2, sizeof(int));
+    a->work = (int *)growArray(a->work, &a->maxWork, a->numPending + 1, sizeof(int));
+    for(i = 0; i < a->numPending; ++i) {
+        a->work[start[a->pending[3 * i] + 1]++] = i;
+    }
+
+    a->readers = (int *)growArray(a->readers, &a->maxReaders, RA_SLOT(a->maxSlots) + 1, sizeof(int));
+    memset(a->readers, 0, sizeof(int) * (RA_SLOT(a->maxSlots) + 1));
+    ra->numMoves = 0;
+    for(p = 0; p < places; ++p) {
+        i = start[p];
+        start[p] = ra->numMoves;
+        sequence(a, a->work + i, start[p + 1] - i);
+    }
+    start[places] = ra->numMoves;
+}
+
+void allocateRegisters(const IrModule *m, RegAlloc *ra) {
+    Allocator a;
+    int i, b;
+
+    memset(&a, 0, sizeof(Allocator));
+    a.m = m;
+    a.ra = ra;
+    ra->locs = (int *)growArray(ra->locs, &ra->maxLocs, 3 * m->numInsts + 1, sizeof(int));
+    ra->funcs = (RaFunc *)growArray(ra->funcs, &ra->maxFuncs, m->numFuncs + 1, sizeof(RaFunc));
+    a.blockStart = (char *)growArray(a.blockStart, &a.maxBlockStart, m->numInsts + 1, 1);
+    memset(a.blockStart, 0, m->numInsts + 1);
+    for(b = 0; b < m->numBlocks; ++b) {
+        a.blockStart[m->blocks[b].start] = TRUE;
+    }
+
+    for(i = 0; i < m->numFuncs; ++i) {
+        a.fi = i;
+        a.f = &m->funcs[i];
+        allocateFunction(&a);
+    }
+    placeMoves(&a);
+
+    free(a.regs);
+    free(a.succ);
+    free(a.numSuccs);
+    free(a.predStart);
+    free(a.preds);
+    free(a.marks);
+    free(a.pairs);
+    free(a.ueStart);
+    free(a.ue);
+    free(a.defStart);
+    free(a.defs);
+    free(a.copyStart);
+    free(a.copies);
+    free(a.liveStart);
+    free(a.liveOut);
+    free(a.work);
+    free(a.built);
+    free(a.useNodes);
+    free(a.ranges);
+    free(a.rangeStart);
+    free(a.uses);
+    free(a.useStart);
+    free(a.calls);
+    free(a.divs);
+    free(a.intervals);
+    free(a.heap);
+    free(a.active);
+    free(a.inactive);
+    free(a.victims);
+    free(a.childStart);
+    free(a.children);
+    free(a.blockStart);
+    free(a.pending);
+    free(a.sorted);
+    free(a.readers);
+}
+
+static void printLoc(const IrModule *m, int loc, int operand, FILE *out) {
+    if(IR_ISCONST(operand)) {
+        fprintf(out, "%d", m->consts[IR_CONSTINDEX(operand)]);
+    }
+    else if(RA_ISINCOMING(loc)) {
+        fprintf(out, "in%d", RA_INCOMINGINDEX(loc));
+    }
+    else if(RA_ISSLOT(loc)) {
+        fprintf(out, "s%d", RA_SLOTINDEX(loc));
+    }
+    else if(loc >= 0) {
+        fprintf(out, "%s", regNames[loc]);
+    }
+    else {
+        fprintf(out, "-");
+    }
+}
+
+static void printMoves(const IrModule *m, const RegAlloc *ra, int place, const char *prefix, FILE *out) {
+    const RaMove *mv;
+    int i;
+
+    for(i = ra->moveStart[place]; i < ra->moveStart[place + 1]; ++i) {
+        mv = &ra->moves[i];
+        fprintf(out, "    %s", prefix);
+        if(mv->swap) {
+            fprintf(out, "swap %s, %s\n", regNames[mv->from], regNames[mv->to]);
+        }
+        else {
+            printLoc(m, mv->to, IR_NONE, out);
+            fprintf(out, " = ");
+            printLoc(m, mv->from, IR_NONE, out);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+static const char *opNames[] = {
+    "", "+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!="
+};
+
+static void printPlaced(const IrModule *m, const RegAlloc *ra, const InternTable *names, int i, FILE *out) {
+    const IrInst *in = &m->insts[i];
+    const int *l = &ra->locs[3 * i];
+
+    fprintf(out, "    ");
+    if(in->dst != IR_NONE) {
+        printLoc(m, l[0], in->dst, out);
+        fprintf(out, " = ");
+    }
+    switch(in->op) {
+        case IR_ADDR:
+            fprintf(out, "addr %s", symName(names, m->slots[in->a].sym));
+            break;
+        case IR_INDEX: case IR_STORE:
+            fprintf(out, (in->op == IR_INDEX) ? "index " : "store ");
+            printLoc(m, l[1], in->a, out);
+            fprintf(out, ", ");
+            printLoc(m, l[2], in->b, out);
+            break;
+        case IR_LOAD: case IR_ARG:
+            fprintf(out, (in->op == IR_LOAD) ? "load " : "arg ");
+            printLoc(m, l[1], in->a, out);
+            break;
+        case IR_CALL:
+            fprintf(out, "call %s, %d", symName(names, in->a), in->b);
+            break;
+        case IR_RET:
+            fprintf(out, "ret");
+            if(in->a != IR_NONE) {
+                fprintf(out, " ");
+                printLoc(m, l[1], in->a, out);
+            }
+            break;
+        case IR_JMP:
+            fprintf(out, "jmp B%d", in->a);
+            break;
+        case IR_BRZ:
+            fprintf(out, "brz ");
+            printLoc(m, l[1], in->a, out);
+            fprintf(out, ", B%d", in->b);
+            break;
+        default:
+            printLoc(m, l[1], in->a, out);
+            if(in->op != IR_MOV) {
+                fprintf(out, " %s ", opNames[in->op]);
+                printLoc(m, l[2], in->b, out);
+            }
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+void printAlloc(const IrModule *m, const RegAlloc *ra, const InternTable *names, FILE *out) {
+    const IrFunc *f;
+    const RaFunc *rf;
+    const IrInst *last;
+    char prefix[32];
+    int i, b, j, r, k;
+
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func < 0) {
+            fprintf(out, "global %s[%d]\n", symName(names, m->slots[i].sym), m->slots[i].size);
+        }
+    }
+    for(i = 0; i < m->numFuncs; ++i) {
+        f = &m->funcs[i];
+        rf = &ra->funcs[i];
+        fprintf(out, "function %s: %d params, %d registers, %d spilled, %d spill moves, %d slots",
+            symName(names, f->sym), f->numParams, f->numRegs, rf->spilled, rf->spillMoves, rf->numSlots);
+        k = 0;
+        for(r = RA_CALLERSAVED; r < RA_NUMREGS; ++r) {
+            if((rf->saved >> r) & 1) {
+                fprintf(out, k++ ? " %s" : ", saves %s", regNames[r]);
+            }
+        }
+        fprintf(out, "\n");
+        for(j = 0; j < m->numSlots; ++j) {
+            if(m->slots[j].func == i) {
+                fprintf(out, "  local %s[%d]\n", symName(names, m->slots[j].sym), m->slots[j].size);
+            }
+        }
+        printMoves(m, ra, RA_ENTRY(m, i), "", out);
+        for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+            fprintf(out, "  B%d:\n", b);
+            for(j = m->blocks[b].start; j < m->blocks[b].end; ++j) {
+                printMoves(m, ra, RA_BEFORE(j), "", out);
+                printPlaced(m, ra, names, j, out);
+            }
+            last = (m->blocks[b].end > m->blocks[b].start) ? &m->insts[m->blocks[b].end - 1] : NULL;
+            for(k = 0; k < 2; ++k) {
+                if(ra->moveStart[RA_EDGE(m, b, k)] < ra->moveStart[RA_EDGE(m, b, k) + 1]) {
+                    r = (last == NULL) ? b + 1 : (k == 1) ? last->b : (last->op == IR_JMP) ? last->a : b + 1;
+                    sprintf(prefix, "to B%d: ", r);
+                    printMoves(m, ra, RA_EDGE(m, b, k), prefix, out);
+                }
+            }
+        }
+    }
+}
+
+void freeAlloc(RegAlloc *ra) {
+    free(ra->locs);
+    free(ra->moves);
+    free(ra->moveStart);
+    free(ra->funcs);
+    memset(ra, 0, sizeof(RegAlloc));
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef _REGALLOC_H_
+#define _REGALLOC_H_
+
+/* linear scan register allocation of lowered code for x86-64, one
+   function at a time. Instructions are numbered in block order with four
+   positions each: operands are read at 4i, a call or division clobbers
+   registers at 4i + 1 and the result is written at 4i + 2. An ARG's
+   operand is read at its CALL.
+
+   A register's lifetime is a list of ranges of positions, with holes
+   where it is dead. Liveness is found per register by walking back from
+   its uses, so the work grows with where registers are live, not with
+   blocks times registers. Lifetimes get registers in order of their
+   starts. One that can't keep a register to its end is split, and the
+   rest waits for another. When none is free, whichever of the lifetimes
+   involved is used furthest away goes to the stack until its next use.
+   Registers a SysV callee may clobber are taken first, but not by
+   lifetimes that span a call; the others have to be saved by whoever
+   uses them. r11 is left to the code generator as scratch, rsp and rbp
+   to the frame.
+
+   Split lifetimes are joined with moves before an instruction, on the
+   edges out of a block, and at function entry from where the SysV ABI
+   passes parameters. The moves of one place run in the order given. */
+typedef enum {
+    RA_RAX, RA_RCX, RA_RDX, RA_RSI, RA_RDI, RA_R8, RA_R9, RA_R10,
+    RA_RBX, RA_R12, RA_R13, RA_R14, RA_R15
+} RaReg;
+
+#define RA_NUMREGS 13
+#define RA_CALLERSAVED 8        // RA_RAX to RA_R10 don't survive a call
+
+/* where a value is: a register, stack slot k of the frame, or the k-th
+   parameter passed on the stack. IR_NONE for constants and nothing. */
+#define RA_SLOT(k) (RA_NUMREGS + (k))
+#define RA_ISSLOT(l) ((l) >= RA_NUMREGS)
+#define RA_SLOTINDEX(l) ((l) - RA_NUMREGS)
+#define RA_INCOMING(k) (-2 - (k))
+#define RA_ISINCOMING(l) ((l) <= -2)
+#define RA_INCOMINGINDEX(l) (-2 - (l))
+
+/* places moves go: before instruction i, on the way from block b to the
+   next block or where its jump goes (k 0) or where its branch goes (k 1),
+   and at the entry of function f */
+#define RA_BEFORE(i) (i)
+#define RA_EDGE(m, b, k) ((m)->numInsts + 2 * (b) + (k))
+#define RA_ENTRY(m, f) ((m)->numInsts + 2 * (m)->numBlocks + (f))
+
+typedef struct _RaMove {
+    int from;
+    int to;
+    int swap;               // exchange the two registers instead
+} RaMove;
+
+typedef struct _RaFunc {
+    int numSlots;
+    unsigned int saved;     // callee-saved registers it uses, a bit per RaReg
+    int spilled;            // registers that spend part of their lifetime in a slot
+    int spillMoves;         // moves to and from slots
+} RaFunc;
+
+// a zeroed one is ready to use, and keeps its memory for the next module
+typedef struct _RegAlloc {
+    int *locs;              // per instruction: where its dst, a and b are
+    int maxLocs;
+    RaMove *moves;
+    int numMoves;
+    int maxMoves;
+    int *moveStart;         // moves of place p are [moveStart[p], moveStart[p + 1])
+    int maxMoveStart;
+    RaFunc *funcs;
+    int maxFuncs;
+} RegAlloc;
+
+void allocateRegisters(const IrModule *m, RegAlloc *ra);
+// the code with registers replaced by where they are
+void printAlloc(const IrModule *m, const RegAlloc *ra, const InternTable *names, FILE *out);
+void freeAlloc(RegAlloc *ra);
+
+#endif
\ No newline at end of file
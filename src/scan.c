@@ -1,363 +1,393 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
+#include "skip.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-#define BUFLEN 256
+// initial buffer size for sources that can't be mapped
+#define READCHUNK 65536
 
 typedef enum {
     START, CHECKCOMMENT, INCOMMENT,BREAKCOMMENT,
-    INID, INNUM, ERRORSTATE, INSYMBOL, DONE
+    INID, INNUM, ERRORSTATE, INBANG, INLESS, INGREATER, INASSIGN,
+    DONE, NUMSTATES = DONE
 }StateType;
 
-typedef struct _Keyword{
-    char* str;
-    TokenType tok;
-}Keyword;
+// character classes: one column of the transition table each
+typedef enum {
+    C_OTHER, C_WS, C_DIGIT, C_LETTER, C_SLASH, C_STAR, C_BANG,
+    C_LT, C_GT, C_EQ, C_PLUS, C_MINUS, C_LRND, C_RRND,
+    C_LCURL, C_RCURL, C_LSQR, C_RSQR, C_SEMI, C_COMMA, C_EOF,
+    NUMCLASSES
+}CharClass;
+
+/* reserved words as X(token, spelling, first char, last char).
+   keywordLookup() expands this into one case label per word at compile
+   time, so adding a word needs no hand-tuned table: if its hash collides
+   with another word the switch fails to build with a duplicate case value,
+   and KWHASH's multiplier or mask has to change. */
+#define KEYWORDS(X) \
+    X(IF, "if", 'i', 'f') \
+    X(ELSE, "else", 'e', 'e') \
+    X(RETURN, "return", 'r', 'n') \
+    X(INT, "int", 'i', 't') \
+    X(VOID, "void", 'v', 'd') \
+    X(WHILE, "while", 'w', 'e')
 
-static Keyword keyWords[MAXRESERVED] = {
-    {"if", IF}, {"else", ELSE}, {"return", RETURN},
-    {"int", INT}, {"void", VOID}, {"while", WHILE}
+// perfect hash over length and first/last characters
+#define KWHASH(len, first, last) (((len) + (first) + (last) * 7) & 15)
+
+static const unsigned char charClass[256] = {
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_WS, C_WS, C_OTHER, C_OTHER, C_WS, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_WS, C_BANG, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_LRND, C_RRND, C_STAR, C_PLUS, C_COMMA, C_MINUS, C_OTHER, C_SLASH,
+    C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT,
+    C_DIGIT, C_DIGIT, C_OTHER, C_SEMI, C_LT, C_EQ, C_GT, C_OTHER,
+    C_OTHER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LSQR, C_OTHER, C_RSQR, C_OTHER, C_OTHER,
+    C_OTHER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER, C_LETTER,
+    C_LETTER, C_LETTER, C_LETTER, C_LCURL, C_OTHER, C_RCURL, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
+    C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER, C_OTHER,
 };
 
-char tokenString[MAXTOKENLEN+1];
+/* a transition packs the next state with what to do about the current char:
+   SAVE appends it to tokenString, KEEP leaves it unconsumed as lookahead,
+   DROP discards what was saved so far, and RUN hands the rest of a run in
+   the new state to a skip kernel. The token of an accepting transition
+   sits in the high byte. */
+#define STATEMASK 0x0f
+#define SAVE 0x10
+#define KEEP 0x20
+#define DROP 0x40
+#define RUN 0x80
+#define TOKENSHIFT 8
 
-static char lineBuf[BUFLEN];
-static int linepos = 0;
-static int bufsize = 0;
-static int EOF_flag = FALSE;
+#define GO(s) ((s) | SAVE)
+#define GORUN(s) ((s) | SAVE | RUN)
+#define SKIP(s) (s)
+#define SKIPRUN(s) ((s) | RUN)
+#define OPEN(s) ((s) | DROP | RUN)
+#define ACC(t) (DONE | SAVE | ((t) << TOKENSHIFT))
+#define RET(t) (DONE | KEEP | ((t) << TOKENSHIFT))
 
-static int isDigit(int c) {
-    c = c - '0';
-    if((0 <= c ) && (c <= 9)) {
-        return TRUE;
-    }
-    return FALSE;
+/* columns follow CharClass:
+   OTHER WS DIGIT LETTER / * ! < > = + - ( ) { } [ ] ; , EOF */
+static const unsigned short transition[NUMSTATES][NUMCLASSES] = {
+    // START
+    { ACC(ERROR), SKIPRUN(START), GORUN(INNUM), GORUN(INID), GO(CHECKCOMMENT), ACC(TIMES), GO(INBANG),
+      GO(INLESS), GO(INGREATER), GO(INASSIGN), ACC(PLUS), ACC(MINUS), ACC(LRNDBRKT), ACC(RRNDBRKT),
+      ACC(LCURLBRKT), ACC(RCURLBRKT), ACC(LSQRBRKT), ACC(RSQRBRKT), ACC(SEMI), ACC(COMMA), RET(ENDFILE) },
+    // CHECKCOMMENT
+    { RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER), OPEN(INCOMMENT), RET(OVER),
+      RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER),
+      RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER), RET(OVER) },
+    // INCOMMENT
+    { SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIP(BREAKCOMMENT), SKIPRUN(INCOMMENT),
+      SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT),
+      SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), RET(ENDFILE) },
+    // BREAKCOMMENT
+    { SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(START), SKIP(BREAKCOMMENT), SKIPRUN(INCOMMENT),
+      SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT),
+      SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), SKIPRUN(INCOMMENT), RET(ENDFILE) },
+    // INID
+    { RET(ID), RET(ID), GO(ERRORSTATE), GO(INID), RET(ID), RET(ID), RET(ID),
+      RET(ID), RET(ID), RET(ID), RET(ID), RET(ID), RET(ID), RET(ID),
+      RET(ID), RET(ID), RET(ID), RET(ID), RET(ID), RET(ID), RET(ID) },
+    // INNUM
+    { RET(NUM), RET(NUM), GO(INNUM), GO(ERRORSTATE), RET(NUM), RET(NUM), RET(NUM),
+      RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM),
+      RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM), RET(NUM) },
+    // ERRORSTATE
+    { RET(ERROR), RET(ERROR), GO(ERRORSTATE), GO(ERRORSTATE), RET(ERROR), RET(ERROR), RET(ERROR),
+      RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR),
+      RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR) },
+    // INBANG
+    { RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR),
+      RET(ERROR), RET(ERROR), ACC(NEQ), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR),
+      RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR), RET(ERROR) },
+    // INLESS
+    { RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN),
+      RET(LESSTHAN), RET(LESSTHAN), ACC(LESSEQTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN),
+      RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN), RET(LESSTHAN) },
+    // INGREATER
+    { RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN),
+      RET(GREATERTHAN), RET(GREATERTHAN), ACC(GREATEREQTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN),
+      RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN), RET(GREATERTHAN) },
+    // INASSIGN
+    { RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN),
+      RET(ASSIGN), RET(ASSIGN), ACC(EQ), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN),
+      RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN), RET(ASSIGN) },
+};
+
+// echo the source line starting at srcPos when tracing the scan
+static void printLine(CompileContext *ctx) {
+    const char *e = memchr(ctx->srcPos, '\n', ctx->srcEnd - ctx->srcPos);
+    e = (e == NULL) ? ctx->srcEnd : e + 1;
+    fprintf(ctx->out, "%4d: %.*s", ctx->lineno, (int)(e - ctx->srcPos), ctx->srcPos);
 }
 
-static int isLetter(int c) {
-    if((('a' <= c) && (c <= 'z')) || (('A' <= c) && (c <= 'Z'))) {
-        return TRUE;
+// read the rest of a stream that can't be mapped (pipes, empty files, no mmap)
+static int readSource(CompileContext *ctx, FILE *fp) {
+    size_t cap = READCHUNK;
+    size_t len = 0;
+    size_t n;
+    char *buf = (char *)malloc(cap);
+
+    if(buf == NULL) {
+        return FALSE;
     }
-    return FALSE;
+    while((n = fread(buf + len, 1, cap - len, fp)) > 0) {
+        len += n;
+        if(len == cap) {
+            char *p = (char *)realloc(buf, cap * 2);
+            if(p == NULL) {
+                free(buf);
+                return FALSE;
+            }
+            buf = p;
+            cap *= 2;
+        }
+    }
+    ctx->srcBase = buf;
+    ctx->srcEnd = buf + len;
+    return TRUE;
 }
 
-static int getNextChar(void) {
-    if(!(linepos < bufsize)) {
-        lineno++;
-        if(fgets(lineBuf, BUFLEN-1, inputfile)) {
-            if(PrintScan) {
-                fprintf(outputfile, "%4d: %s", lineno, lineBuf);
+int openSource(CompileContext *ctx, FILE *fp) {
+    closeSource(ctx);
+
+#ifndef _WIN32
+    {
+        struct stat st;
+        void *p;
+
+        // map regular files as a whole, read-only
+        if((fstat(fileno(fp), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+            p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+            if(p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+                madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+                ctx->srcMapped = (size_t)st.st_size;
+                ctx->srcBase = (const char *)p;
+                ctx->srcEnd = ctx->srcBase + ctx->srcMapped;
             }
-            bufsize = strlen(lineBuf);
-            // for some OS that takes newline other than \n
-            lineBuf[bufsize-2] = '\n';
-            linepos = 0;
-            
-            return lineBuf[linepos++];
-        }
-        else{
-            EOF_flag = TRUE;
-            return EOF;
         }
     }
-    else {
-        return lineBuf[linepos++];
+#endif
+
+    if((ctx->srcBase == NULL) && !readSource(ctx, fp)) {
+        return FALSE;
     }
+    ctx->srcOwned = TRUE;
+    rewindSource(ctx);
+    return TRUE;
+}
+
+void setSource(CompileContext *ctx, const char *src, size_t len) {
+    closeSource(ctx);
+    ctx->srcBase = src;
+    ctx->srcEnd = src + len;
+    rewindSource(ctx);
 }
 
-static void ungetNextChar(void) {
-    if(!EOF_flag) linepos--;
+void rewindSource(CompileContext *ctx) {
+    seekSource(ctx, 0, 1);
+}
+
+void seekSource(CompileContext *ctx, size_t offset, int lineno) {
+    ctx->srcPos = ctx->srcBase + offset;
+    ctx->lineno = lineno;
+    ctx->inComment = FALSE;
+    if(ctx->skipper == NULL) {
+        ctx->skipper = bestSkipper();
+    }
 }
 
-static TokenType keywordLookup(char *s) {
-    int i;
-    for (i = 0; i < MAXRESERVED; ++i) {
-        if(!strcmp(s, keyWords[i].str)) {
-            return keyWords[i].tok;
+void closeSource(CompileContext *ctx) {
+    if(ctx->srcOwned) {
+#ifndef _WIN32
+        if(ctx->srcMapped) {
+            munmap((void *)ctx->srcBase, ctx->srcMapped);
         }
+        else
+#endif
+        free((void *)ctx->srcBase);
     }
 
-    return ID;
+    ctx->srcBase = ctx->srcPos = ctx->srcEnd = NULL;
+    ctx->srcMapped = 0;
+    ctx->srcOwned = FALSE;
 }
 
-TokenType getToken(void) {
+const char *splitPoint(const char *p, const char *end) {
+    for(; p < end; ++p) {
+        if(charClass[(unsigned char)*p] == C_WS) {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static TokenType keywordLookup(const char *s, int len) {
+    if(len == 0) {
+        return ID;
+    }
+
+    // one hash, one memcmp to confirm
+    switch(KWHASH(len, (unsigned char)s[0], (unsigned char)s[len-1])) {
+#define KWCASE(tok, str, first, last) \
+        case KWHASH(sizeof(str) - 1, first, last): \
+            return ((len == sizeof(str) - 1) && !memcmp(s, str, len)) ? tok : ID;
+        KEYWORDS(KWCASE)
+#undef KWCASE
+        default:
+            return ID;
+    }
+}
+
+int useSkipper(CompileContext *ctx, const char *isa) {
+    const Skipper *s = findSkipper(isa);
+
+    if(s == NULL) {
+        return FALSE;
+    }
+    ctx->skipper = s;
+    return TRUE;
+}
+
+// consume the rest of a run entered in state, saving identifier/number bytes
+static const char *skipRun(CompileContext *ctx, int state, const char *pos, int *line, int *tokenStringIndex) {
+    const char *end = ctx->srcEnd;
+    const char *e;
+    long n;
+
+    // most runs in C- are a byte or two long: leave those to the table
+    if(!(pos + 1 < end) || (charClass[(unsigned char)pos[0]] != charClass[(unsigned char)pos[1]])) {
+        return pos;
+    }
+
+    switch(state) {
+        case START:
+            return ctx->skipper->space(pos, end, line);
+        case INCOMMENT:
+            return ctx->skipper->comment(pos, end, line);
+        case INID:
+            e = ctx->skipper->letters(pos, end);
+        break;
+        case INNUM:
+            e = ctx->skipper->digits(pos, end);
+        break;
+        default:
+            return pos;
+    }
+
+    n = e - pos;
+    if(n > MAXTOKENLEN - *tokenStringIndex) {
+        n = MAXTOKENLEN - *tokenStringIndex;
+    }
+    memcpy(ctx->tokenString + *tokenStringIndex, pos, n);
+    *tokenStringIndex += (int)n;
+    return e;
+}
+
+TokenType getToken(CompileContext *ctx) {
+    char *tokenString = ctx->tokenString;
     int tokenStringIndex = 0;
     TokenType currentToken;
-    StateType state = START;
-    int save;
-
-    while(state != DONE) {
-        int c = getNextChar();
-
-        switch(state) {
-            // initial state
-            case START:
-                save = TRUE;
-                // start scanning NUM token
-                if(isDigit(c)) {
-                    state = INNUM;
-                }
-                
-                // start scanning ID or KEYWORD token
-                else if(isLetter(c)) {
-                    state = INID;
-                }
-                
-                // start scanning comment or OVER token
-                else if(c == '/') {
-                    state = CHECKCOMMENT;
-                }
-
-                // start scanning bi-SYMBOL token
-                else if((c == '!') || (c == '<') || (c == '>') || (c == '=')) {
-                    state = INSYMBOL;
-                }
-
-                // passing whitespaces
-                else if((c == ' ') || (c == '\n') || (c == '\t')) {
-                    save = FALSE;
-                }
-
-                // returning uni-SYMBOL tokens
-                else {
-                    state = DONE;
-                    switch (c) {
-                        case EOF:
-                            save = FALSE;
-                            currentToken = ENDFILE;
-                        break;
-                        case '+':
-                            currentToken = PLUS;
-                        break;
-                        case '-':
-                            currentToken = MINUS;
-                        break;
-                        case '*':
-                            currentToken = TIMES;
-                        break;
-                        case '(':
-                            currentToken = LRNDBRKT;
-                        break;
-                        case ')':
-                            currentToken = RRNDBRKT;
-                        break;
-                        case '{':
-                            currentToken = LCURLBRKT;
-                        break;
-                        case '}':
-                            currentToken = RCURLBRKT;
-                        break;
-                        case '[':
-                            currentToken = LSQRBRKT;
-                        break;
-                        case ']':
-                            currentToken = RSQRBRKT;
-                        break;
-                        case ';':
-                            currentToken = SEMI;
-                        break;
-                        case ',':
-                            currentToken = COMMA;
-                        break;
-                        default:
-                            currentToken = ERROR;
-                        break;
-                    } 
-                }
-            break;
-
-            // start of scanning comment session
-            // state for checking if '*' comes after '/'
-            case CHECKCOMMENT:
-                // '*' after '/', move to INCOMMENT state and remove '/' from tokenString
-                if(c == '*') {
-                    save = FALSE;
-                    tokenStringIndex--;
-                    state = INCOMMENT;
-                }
-                // other character after '/', return OVER token
-                else {
-                    ungetNextChar();
-                    save = FALSE;
-                    currentToken = OVER;
-                    state = DONE;
-                }
-            break;
-            // does nothing until '*' comes
-            case INCOMMENT:
-                if(c == '*') {
-                    state = BREAKCOMMENT;
-                }
-                else if(c == EOF) {
-                    state = DONE;
-                    currentToken = ENDFILE;
-                }
-            break;
-            // state for checking if '/' comes after '*'
-            case BREAKCOMMENT:
-                // '/' after '*', comment session over. move to START state
-                if(c == '/') {
-                    state = START;
-                }
-                else if(c == '*') {
-                    // just consume a character;
-                }
-                else if(c == EOF) {
-                    state = DONE;
-                    currentToken = ENDFILE;
-                }
-                // other character after '*', go back to INCOMMENT state
-                else {
-                    state = INCOMMENT;
-                }
-            break;
-            // end of scanning comment session
-
-            // start of scanning bi-SYMBOL session
-            case INSYMBOL:
-                // '=' after '!', '<', '>', '=', return NEQ, LESSEQTHAN, GREATEREQTHAN, EQ
-                if(c == '=') {
-                    switch(tokenString[0]) {
-                        case '!':
-                            currentToken = NEQ;
-                            state = DONE;
-                        break;
-                        case '<':
-                            currentToken = LESSEQTHAN;
-                            state = DONE;
-                        break;
-                        case '>':
-                            currentToken = GREATEREQTHAN;
-                            state = DONE;
-                        break;
-                        case '=':
-                            currentToken = EQ;
-                            state = DONE;
-                        break;
-                        // should never happen
-                        default:
-                            // DEBUGGING: report error state
-                            fprintf(outputfile, "Scanner Bug: state = %d\n", state);
-                            state = DONE;
-                            currentToken = ERROR;
-                        break;
-                    }
-                }
-                // any other character after '!', '<', '>', '=', return ERROR, LESSTHAN, GREATERTHAN, 
-                else {
-                    ungetNextChar();
-                    save = FALSE;
-                    switch(tokenString[0]) {
-                        case '!':
-                            currentToken = ERROR;
-                            state = DONE;
-                        break;
-                        case '<':
-                            currentToken = LESSTHAN;
-                            state = DONE;
-                        break;
-                        case '>':
-                            currentToken = GREATERTHAN;
-                            state = DONE;
-                        break;
-                        case '=':
-                            currentToken = ASSIGN;
-                            state = DONE;
-                        break;
-                        // should never happen
-                        default:
-                            // DEBUGGING: report error state
-                            fprintf(outputfile, "Scanner Bug: state = %d\n", state);
-                            state = DONE;
-                            currentToken = ERROR;
-                        break;
-                    }
-                }
-            break;
-            // end of scanning bi-SYMBOL session
-
-            // start of scanning ID session
-            // state for scanning letter for ID
-            case INID:
-                // keep scanning if another letter comes in
-                if(isLetter(c)) {
-                    state = INID;
-                }
-                // move to ERRORID state if digit comes in
-                else if (isDigit(c)) {
-                    state = ERRORSTATE;
-                }
-                // return ID if any other character comes in
-                else {
-                    ungetNextChar();
-                    save = FALSE;
-                    currentToken = ID;
-                    state = DONE;
-                }
-            break;
-            // state for scanning letters and digits for error token
-            case ERRORSTATE:
-                // keep scanning letters and digits
-                if(isLetter(c) || isDigit(c)) {
-                    state = ERRORSTATE;
-                }
-                // return error token if another character comes in
-                else {
-                    ungetNextChar();
-                    save = FALSE;
-                    currentToken = ERROR;
-                    state = DONE;
-                }
-            break;
-            // end of scanning ID session
-
-            // start of scanning NUM session
-            case INNUM:
-                if(isDigit(c)) {
-                    state = INNUM;
-                }
-                else if (isLetter(c)) {
-                    state = ERRORSTATE;
-                }
-                else {
-                    ungetNextChar();
-                    save = FALSE;
-                    currentToken = NUM;
-                    state = DONE;
-                }
-            break;
-            // end of scanning NUM session
-
-            // should never happen
-            case DONE:
-            break;
-            default: 
-                // DEBUGGING: report error state
-                fprintf(outputfile, "Scanner Bug: state = %d\n", state);
-                state = DONE;
-                currentToken = ERROR;
-            break;
+    unsigned int action = ctx->inComment ? INCOMMENT : START;
+    int trace = ctx->PrintScan;
+    int line = ctx->lineno;
+    const char *pos = ctx->srcPos;
+    const char *end = ctx->srcEnd;
+    const char *start = NULL;
+    int c;
+
+    ctx->inComment = FALSE;
+    do {
+        // one class lookup and one transition load per character
+        if(pos < end) {
+            c = (unsigned char)*pos;
+            action = transition[action & STATEMASK][charClass[c]];
+        }
+        else {
+            c = EOF;
+            ctx->inComment = ((action & STATEMASK) == INCOMMENT) || ((action & STATEMASK) == BREAKCOMMENT);
+            action = transition[action & STATEMASK][C_EOF];
         }
 
-        // save token character if save flag is on
-        if((save) && (tokenStringIndex <= MAXTOKENLEN)) {
-            tokenString[tokenStringIndex++] = (char) c;
+        if(!(action & KEEP)) {
+            if(trace && ((pos == ctx->srcBase) || (pos[-1] == '\n'))) {
+                ctx->srcPos = pos;
+                ctx->lineno = line;
+                printLine(ctx);
+            }
+            // line numbers come from counting consumed newlines
+            line += (c == '\n');
+            pos++;
         }
 
-        // close token string and check if it is one of keywords
-        if(state == DONE) {
-            tokenString[tokenStringIndex] = '\0';
-            if(currentToken == ID) {
-                currentToken = keywordLookup(tokenString);
+        // save token character if save flag is on
+        if(action & SAVE) {
+            if(start == NULL) {
+                start = pos - 1;
+            }
+            if(tokenStringIndex < MAXTOKENLEN) {
+                tokenString[tokenStringIndex++] = (char) c;
             }
         }
+        // '/' turned out to open a comment
+        if(action & DROP) {
+            tokenStringIndex = 0;
+            start = NULL;
+        }
+        // tracing echoes each line as it is entered, so it walks byte by byte
+        if((action & RUN) && !trace) {
+            pos = skipRun(ctx, action & STATEMASK, pos, &line, &tokenStringIndex);
+        }
+    } while((action & STATEMASK) != DONE);
+    ctx->srcPos = pos;
+    ctx->lineno = line;
+    ctx->tokenStart = (start != NULL) ? start : pos;
+
+    // close token string and check if it is one of keywords
+    tokenString[tokenStringIndex] = '\0';
+    currentToken = (TokenType)(action >> TOKENSHIFT);
+    if(currentToken == ID) {
+        currentToken = keywordLookup(tokenString, tokenStringIndex);
     }
 
     // report scanned token
-    if(PrintScan) {
-        fprintf(outputfile, "\t%d: ", lineno);
-        printToken(currentToken, tokenString);
+    if(trace) {
+        fprintf(ctx->out, "\t%d: ", ctx->lineno);
+        printToken(ctx, currentToken, tokenString);
     }
 
     return currentToken;
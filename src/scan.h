@@ -1,8 +1,20 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 
-extern char tokenString[MAXTOKENLEN+1];
-
-TokenType getToken(void);
+// scan a whole file, mapped or read in one go
+int openSource(CompileContext *ctx, FILE *fp);
+// scan a caller-owned buffer, which must outlive the scan
+void setSource(CompileContext *ctx, const char *src, size_t len);
+void rewindSource(CompileContext *ctx);
+/* continue at a byte offset known to be outside any token or comment,
+   lineno being the line there */
+void seekSource(CompileContext *ctx, size_t offset, int lineno);
+void closeSource(CompileContext *ctx);
+/* just past the first whitespace byte in [p, end), or NULL. Every token
+   ends before such a point, so a scan can restart there, either between
+   tokens or (with ctx->inComment set) inside a comment. */
+const char *splitPoint(const char *p, const char *end);
+int useSkipper(CompileContext *ctx, const char *isa);
+TokenType getToken(CompileContext *ctx);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "globals.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "select.h"
+
+static const int argRegs[6] = {RA_RDI, RA_RSI, RA_RDX, RA_RCX, RA_R8, RA_R9};
+
+void initSelect(Select *s, const IrModule *m, const RegAlloc *ra) {
+    int i, n;
+
+    memset(s, 0, sizeof(Select));
+    s->m = m;
+    s->ra = ra;
+    n = 1;
+    for(i = 0; i < m->numFuncs; ++i) {
+        if(m->funcs[i].numRegs > n) {
+            n = m->funcs[i].numRegs;
+        }
+    }
+    s->offsets = (int *)malloc(sizeof(int) * (m->numSlots + 1));
+    s->uses = (int *)malloc(sizeof(int) * n);
+    if((s->offsets == NULL) || (s->uses == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void countUses(Select *s, const IrInst *in) {
+    switch(in->op) {
+        case IR_ADDR: case IR_CALL: case IR_JMP:
+            return;
+        case IR_MOV: case IR_LOAD: case IR_ARG: case IR_RET: case IR_BRZ:
+            break;
+        default:
+            if(in->b >= 0) {
+                s->uses[in->b]++;
+            }
+            break;
+    }
+    if(in->a >= 0) {
+        s->uses[in->a]++;
+    }
+}
+
+void selectFunction(Select *s, int fi) {
+    const IrModule *m = s->m;
+    const IrFunc *f = &m->funcs[fi];
+    unsigned int saved = s->ra->funcs[fi].saved;
+    int size = 8 * s->ra->funcs[fi].numSlots;
+    int i, r;
+
+    s->fi = fi;
+    memset(s->uses, 0, sizeof(int) * f->numRegs);
+    for(i = m->blocks[f->firstBlock].start; i < m->blocks[f->firstBlock + f->numBlocks - 1].end; ++i) {
+        countUses(s, &m->insts[i]);
+    }
+
+    s->numSaved = 0;
+    for(r = RA_CALLERSAVED; r < RA_NUMREGS; ++r) {
+        if((saved >> r) & 1) {
+            s->saved[s->numSaved++] = r;
+        }
+    }
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func == fi) {
+            size += slotBytes(&m->slots[i]);
+            s->offsets[i] = -(8 * s->numSaved + size);
+        }
+    }
+    // rbp and the return address are 16 bytes
+    s->frameBytes = size + ((8 * s->numSaved + size) & 8);
+}
+
+void freeSelect(Select *s) {
+    free(s->offsets);
+    free(s->uses);
+    memset(s, 0, sizeof(Select));
+}
+
+int isMem(int operand, int loc) {
+    return !IR_ISCONST(operand) && (RA_ISSLOT(loc) || RA_ISINCOMING(loc));
+}
+
+int regOf(int operand, int loc) {
+    return (!IR_ISCONST(operand) && (loc >= 0) && (loc < RA_NUMREGS)) ? loc : -1;
+}
+
+int workReg(int loc) {
+    return regOf(IR_NONE, loc) >= 0 ? loc : SCRATCH;
+}
+
+int baseReg(int operand, int loc) {
+    return regOf(operand, loc) >= 0 ? loc : SCRATCH;
+}
+
+int frameOffset(const Select *s, int loc) {
+    if(RA_ISINCOMING(loc)) {
+        return 16 + 8 * RA_INCOMINGINDEX(loc);
+    }
+    return -8 * (s->numSaved + 1 + RA_SLOTINDEX(loc));
+}
+
+int slotBytes(const IrSlot *slot) {
+    return (4 * slot->size + 7) & ~7;
+}
+
+int argReg(int j) {
+    return argRegs[j];
+}
+
+int hasMoves(const Select *s, int place) {
+    return s->ra->moveStart[place] < s->ra->moveStart[place + 1];
+}
+
+int emitsCode(const Select *s, int b, int i) {
+    const IrInst *in = &s->m->insts[i];
+    const int *loc = &s->ra->locs[3 * i];
+    int dead = (in->dst != IR_NONE) && (loc[0] == IR_NONE);
+
+    switch(in->op) {
+        case IR_MOV:
+            return !dead && (IR_ISCONST(in->a) || (loc[1] != loc[0]));
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_ADDR: case IR_LOAD:
+            return !dead;
+        case IR_INDEX:
+            return !dead && !fusedIndex(s, b, i);
+        case IR_ARG:
+            return FALSE;
+        default:
+            return TRUE;
+    }
+}
+
+int feedsNext(const Select *s, int b, int i) {
+    const IrInst *in = &s->m->insts[i];
+
+    return (i + 1 < s->m->blocks[b].end) && (s->uses[in->dst] == 1) &&
+        (s->m->insts[i + 1].a == in->dst) && !hasMoves(s, RA_BEFORE(i + 1));
+}
+
+/* only when the INDEX is all the LOAD or STORE reads, its base is in a
+   register and r11 is free for the index */
+int fusedIndex(const Select *s, int b, int i) {
+    const IrInst *in = &s->m->insts[i];
+    const IrInst *next = &s->m->insts[i + 1];
+
+    if((in->op != IR_INDEX) || !feedsNext(s, b, i) || ((next->op != IR_LOAD) && (next->op != IR_STORE)) ||
+        (regOf(in->a, s->ra->locs[3 * i + 1]) < 0)) {
+        return FALSE;
+    }
+    return (next->op == IR_LOAD) || IR_ISCONST(in->b) || !isMem(next->b, s->ra->locs[3 * (i + 1) + 2]);
+}
+
+int swapsOperands(const IrInst *in, const int *loc) {
+    return (in->op != IR_SUB) && (regOf(in->b, loc[2]) >= 0) && (regOf(in->b, loc[2]) == loc[0]);
+}
+
+int keepsFlags(const Select *s, int b, int i) {
+    return feedsNext(s, b, i) && (s->m->insts[i + 1].op == IR_BRZ);
+}
+
+int branchesOnFlags(const Select *s, int b, int i) {
+    const IrInst *prev = (i > s->m->blocks[b].start) ? &s->m->insts[i - 1] : NULL;
+
+    return (prev != NULL) && (prev->op >= IR_LT) && (prev->op <= IR_NE) && (prev->dst == s->m->insts[i].a) &&
+        !hasMoves(s, RA_BEFORE(i));
+}
+
+/* arguments are the ARGs right before the call. Registers get them
+   directly unless one would be overwritten before it is read; then
+   everything goes through the stack. */
+int directArgs(const Select *s, int i) {
+    int n = s->m->insts[i].b;
+    int j, k;
+
+    for(j = 0; (j < n) && (j < 6); ++j) {
+        for(k = j + 1; (k < n) && (k < 6); ++k) {
+            if(regOf(s->m->insts[i - n + k].a, s->ra->locs[3 * (i - n + k) + 1]) == argRegs[j]) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+// a move the allocator turned into nothing, with no moves of its own before it
+static int emitsNothing(const Select *s, int i) {
+    const IrInst *in = &s->m->insts[i];
+    const int *loc = &s->ra->locs[3 * i];
+
+    return (in->op == IR_MOV) && !IR_ISCONST(in->a) && ((loc[0] == IR_NONE) || (loc[0] == loc[1])) &&
+        !hasMoves(s, RA_BEFORE(i));
+}
+
+int branchEdge(const Select *s, int b) {
+    const IrBlock *block = &s->m->blocks[b];
+
+    return (block->end > block->start) && (s->m->insts[block->end - 1].op == IR_BRZ) &&
+        hasMoves(s, RA_EDGE(s->m, b, 1));
+}
+
+// up to a few blocks, so a loop of them stays put
+int jumpTarget(const Select *s, int b) {
+    const IrModule *m = s->m;
+    int n, i;
+
+    for(n = 0; n < 4; ++n) {
+        const IrBlock *block = &m->blocks[b];
+
+        i = block->start;
+        while((i < block->end - 1) && emitsNothing(s, i)) {
+            ++i;
+        }
+        if((i != block->end - 1) || (m->insts[i].op != IR_JMP) || hasMoves(s, RA_BEFORE(i)) ||
+            hasMoves(s, RA_EDGE(m, b, 0))) {
+            break;
+        }
+        b = m->insts[i].a;
+    }
+    return b;
+}
+
+int fallsThrough(const Select *s, int b) {
+    const IrBlock *block = &s->m->blocks[b];
+    int op;
+
+    if(block->end == block->start) {
+        return TRUE;
+    }
+    op = s->m->insts[block->end - 1].op;
+    return (op != IR_JMP) && (op != IR_BRZ) && (op != IR_RET);
+}
+
+// lowering ends every function with a return, but nothing may run off it
+int runsOff(const Select *s) {
+    const IrFunc *f = &s->m->funcs[s->fi];
+    const IrBlock *block = &s->m->blocks[f->firstBlock + f->numBlocks - 1];
+    int op;
+
+    if(block->end == block->start) {
+        return TRUE;
+    }
+    op = s->m->insts[block->end - 1].op;
+    return (op != IR_JMP) && (op != IR_RET);
+}
\ No newline at end of file
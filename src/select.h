@@ -0,0 +1,72 @@
+#ifndef _SELECT_H_
+#define _SELECT_H_
+
+/* the choices codegen.h and jit.h make alike about code with registers
+   allocated, so the assembly and the machine code stay the same
+   instructions: where an operand is read from and a result computed,
+   which instructions write nothing or fold into the next one, where a
+   jump ends up, and how a function's frame is laid out. The back ends
+   only turn them into text or bytes.
+
+   The frame is rbp, the saved registers, the allocator's slots and then
+   the local arrays; rsp stays a multiple of 16 at calls. r11 is scratch.
+   Dividing the smallest int by -1 gives the smallest int, as the
+   bytecode does, where idiv would trap. */
+#define SCRATCH RA_NUMREGS      // r11, after the registers the allocator hands out
+
+// of one module, and of the function selectFunction was last given
+typedef struct _Select {
+    const IrModule *m;
+    const RegAlloc *ra;
+    int fi;
+    int saved[RA_NUMREGS];  // callee-saved registers the prologue pushes, in order
+    int numSaved;
+    int frameBytes;         // what it takes off rsp after the pushes
+    int *offsets;           // rbp offset of each local array; a back end may note its globals
+    int *uses;              // how often each register of the function is read
+} Select;
+
+void initSelect(Select *s, const IrModule *m, const RegAlloc *ra);
+// counts what reads function fi's registers and lays out its frame
+void selectFunction(Select *s, int fi);
+void freeSelect(Select *s);
+
+int isMem(int operand, int loc);
+// the machine register operand is in, -1 for a constant or memory
+int regOf(int operand, int loc);
+// where a result is computed: in place if dst has a register, else in r11
+int workReg(int loc);
+// an address operand as a base register, r11 if it has to be loaded from memory
+int baseReg(int operand, int loc);
+// rbp offset of a slot or a parameter passed on the stack
+int frameOffset(const Select *s, int loc);
+// bytes an array takes, a multiple of 8
+int slotBytes(const IrSlot *slot);
+// the register the SysV ABI passes argument j in, j < 6
+int argReg(int j);
+int hasMoves(const Select *s, int place);
+
+// FALSE for an instruction that writes nothing, such as a dead one or an ARG
+int emitsCode(const Select *s, int b, int i);
+// the instruction after i is all that reads the result of i
+int feedsNext(const Select *s, int b, int i);
+// an INDEX that goes into the address of the LOAD or STORE after it
+int fusedIndex(const Select *s, int b, int i);
+// dst = b op a instead, when dst is b's register and op allows it
+int swapsOperands(const IrInst *in, const int *loc);
+// a compare whose only reader is the branch right after it, which takes the flags
+int keepsFlags(const Select *s, int b, int i);
+// a branch right after the compare that made its operand
+int branchesOnFlags(const Select *s, int b, int i);
+// the arguments of call i go straight to their registers, not through the stack
+int directArgs(const Select *s, int i);
+// block b ends in a branch whose edge needs moves, which go after the function
+int branchEdge(const Select *s, int b);
+// where a jump to block b ends up, passing blocks that come down to a jump
+int jumpTarget(const Select *s, int b);
+// block b goes on to the next one, and takes its edge's moves along
+int fallsThrough(const Select *s, int b);
+// the function ends without a jump or return to leave it
+int runsOff(const Select *s);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include "globals.h"
+#include "skip.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// avx2 kernels are compiled per function and picked at runtime
+#if defined(HAVE_SSE2) && defined(__GNUC__)
+#define HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+static int countBits(unsigned int x) {
+#ifdef __GNUC__
+    return __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0f0f0f0fu;
+    return (int)((x * 0x01010101u) >> 24);
+#endif
+}
+
+// index of the lowest set bit, x != 0
+static int lowBit(unsigned int x) {
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    int i = 0;
+    while(!(x & 1)) {
+        x >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+// newlines among the bytes before the stop position k
+#define LINESBEFORE(nls, k) countBits((nls) & ((1u << (k)) - 1))
+
+/* scalar fallback, also used for the tails shorter than a vector */
+static const char *spaceScalar(const char *p, const char *end, int *lines) {
+    int n = 0;
+
+    for(; p < end; ++p) {
+        if(*p == '\n') {
+            n++;
+        }
+        else if((*p != ' ') && (*p != '\t') && (*p != '\r')) {
+            break;
+        }
+    }
+    *lines += n;
+    return p;
+}
+
+static const char *commentScalar(const char *p, const char *end, int *lines) {
+    int n = 0;
+
+    for(; (p < end) && (*p != '*'); ++p) {
+        n += (*p == '\n');
+    }
+    *lines += n;
+    return p;
+}
+
+static const char *lettersScalar(const char *p, const char *end) {
+    while((p < end) && ((unsigned)((*p | 0x20) - 'a') < 26)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *digitsScalar(const char *p, const char *end) {
+    while((p < end) && ((unsigned)(*p - '0') < 10)) {
+        p++;
+    }
+    return p;
+}
+
+static const Skipper scalarSkipper = {
+    "scalar", spaceScalar, commentScalar, lettersScalar, digitsScalar
+};
+
+#ifdef HAVE_SSE2
+/* 16 bytes per step. Loads never go past end, so a mapped file can end
+   right at a page boundary. */
+static const char *spaceSSE2(const char *p, const char *end, int *lines) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+
+    while(end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i n = _mm_cmpeq_epi8(v, nl);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(n, _mm_cmpeq_epi8(v, cr)));
+        unsigned int nls = (unsigned int)_mm_movemask_epi8(n);
+        unsigned int stop = ~(unsigned int)_mm_movemask_epi8(ws) & 0xffffu;
+
+        if(stop) {
+            *lines += LINESBEFORE(nls, lowBit(stop));
+            return p + lowBit(stop);
+        }
+        *lines += countBits(nls);
+        p += 16;
+    }
+    return spaceScalar(p, end, lines);
+}
+
+static const char *commentSSE2(const char *p, const char *end, int *lines) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i star = _mm_set1_epi8('*');
+
+    while(end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned int nls = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        unsigned int stop = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, star));
+
+        if(stop) {
+            *lines += LINESBEFORE(nls, lowBit(stop));
+            return p + lowBit(stop);
+        }
+        *lines += countBits(nls);
+        p += 16;
+    }
+    return commentScalar(p, end, lines);
+}
+
+static const char *lettersSSE2(const char *p, const char *end) {
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i lo = _mm_set1_epi8('a' - 1);
+    const __m128i hi = _mm_set1_epi8('z' + 1);
+
+    while(end - p >= 16) {
+        // bytes >= 0x80 compare as negative and fall outside the range
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)p), fold);
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        unsigned int stop = ~(unsigned int)_mm_movemask_epi8(in) & 0xffffu;
+
+        if(stop) {
+            return p + lowBit(stop);
+        }
+        p += 16;
+    }
+    return lettersScalar(p, end);
+}
+
+static const char *digitsSSE2(const char *p, const char *end) {
+    const __m128i lo = _mm_set1_epi8('0' - 1);
+    const __m128i hi = _mm_set1_epi8('9' + 1);
+
+    while(end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        unsigned int stop = ~(unsigned int)_mm_movemask_epi8(in) & 0xffffu;
+
+        if(stop) {
+            return p + lowBit(stop);
+        }
+        p += 16;
+    }
+    return digitsScalar(p, end);
+}
+
+static const Skipper sse2Skipper = {
+    "sse2", spaceSSE2, commentSSE2, lettersSSE2, digitsSSE2
+};
+#endif
+
+#ifdef HAVE_AVX2
+#define AVX2 __attribute__((target("avx2")))
+
+/* same kernels, 32 bytes per step */
+AVX2 static const char *spaceAVX2(const char *p, const char *end, int *lines) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+
+    while(end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i n = _mm256_cmpeq_epi8(v, nl);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(n, _mm256_cmpeq_epi8(v, cr)));
+        unsigned int nls = (unsigned int)_mm256_movemask_epi8(n);
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(ws);
+
+        if(stop) {
+            *lines += LINESBEFORE(nls, lowBit(stop));
+            return p + lowBit(stop);
+        }
+        *lines += countBits(nls);
+        p += 32;
+    }
+    return spaceSSE2(p, end, lines);
+}
+
+AVX2 static const char *commentAVX2(const char *p, const char *end, int *lines) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i star = _mm256_set1_epi8('*');
+
+    while(end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned int nls = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        unsigned int stop = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, star));
+
+        if(stop) {
+            *lines += LINESBEFORE(nls, lowBit(stop));
+            return p + lowBit(stop);
+        }
+        *lines += countBits(nls);
+        p += 32;
+    }
+    return commentSSE2(p, end, lines);
+}
+
+AVX2 static const char *lettersAVX2(const char *p, const char *end) {
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    const __m256i lo = _mm256_set1_epi8('a' - 1);
+    const __m256i hi = _mm256_set1_epi8('z' + 1);
+
+    while(end - p >= 32) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)p), fold);
+        __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(in);
+
+        if(stop) {
+            return p + lowBit(stop);
+        }
+        p += 32;
+    }
+    return lettersSSE2(p, end);
+}
+
+AVX2 static const char *digitsAVX2(const char *p, const char *end) {
+    const __m256i lo = _mm256_set1_epi8('0' - 1);
+    const __m256i hi = _mm256_set1_epi8('9' + 1);
+
+    while(end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(in);
+
+        if(stop) {
+            return p + lowBit(stop);
+        }
+        p += 32;
+    }
+    return digitsSSE2(p, end);
+}
+
+static const Skipper avx2Skipper = {
+    "avx2", spaceAVX2, commentAVX2, lettersAVX2, digitsAVX2
+};
+
+// libgcc fills in the cpu model before main, so this is safe from any thread
+static int haveAVX2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+const Skipper *findSkipper(const char *isa) {
+    if(!strcmp(isa, "scalar")) {
+        return &scalarSkipper;
+    }
+#ifdef HAVE_SSE2
+    if(!strcmp(isa, "sse2")) {
+        return &sse2Skipper;
+    }
+#endif
+#ifdef HAVE_AVX2
+    if(!strcmp(isa, "avx2") && haveAVX2()) {
+        return &avx2Skipper;
+    }
+#endif
+    return NULL;
+}
+
+const Skipper *bestSkipper(void) {
+#ifdef HAVE_AVX2
+    if(haveAVX2()) {
+        return &avx2Skipper;
+    }
+#endif
+#ifdef HAVE_SSE2
+    return &sse2Skipper;
+#else
+    return &scalarSkipper;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef _SKIP_H_
+#define _SKIP_H_
+
+/* run-skipping kernels for the scanner. Each returns the first byte in
+   [p, end) that does not belong to the run; the space and comment kernels
+   also add the newlines they pass over to *lines. */
+typedef struct _Skipper {
+    const char *name;
+    const char *(*space)(const char *p, const char *end, int *lines);
+    const char *(*comment)(const char *p, const char *end, int *lines);
+    const char *(*letters)(const char *p, const char *end);
+    const char *(*digits)(const char *p, const char *end);
+} Skipper;
+
+// widest kernel set the running cpu supports
+const Skipper *bestSkipper(void);
+// "scalar", "sse2" or "avx2"; NULL if unknown or unsupported here
+const Skipper *findSkipper(const char *isa);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "globals.h"
+#include "symtab.h"
+
+#define INITSCOPES 64
+
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        if(*max < INITSCOPES) {
+            *max = INITSCOPES;
+        }
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+void enterScope(SymTable *st) {
+    st->marks = (int *)growArray(st->marks, &st->maxDepth, st->depth + 1, sizeof(int));
+    st->marks[st->depth++] = st->numLog;
+}
+
+void leaveScope(SymTable *st) {
+    int mark = st->marks[--st->depth];
+    Binding *b;
+
+    while(st->numLog > mark) {
+        b = st->log[--st->numLog];
+        st->current[b->sym] = b->shadowed;
+    }
+}
+
+Binding *declareName(SymTable *st, TreeNode *decl) {
+    Binding *b;
+    int n = st->maxSyms;
+
+    if(decl->sym >= st->maxSyms) {
+        st->current = (Binding **)growArray(st->current, &st->maxSyms, decl->sym + 1, sizeof(Binding *));
+        for(; n < st->maxSyms; ++n) {
+            st->current[n] = NULL;
+        }
+    }
+
+    b = (Binding *)arenaAlloc(&st->bindings, sizeof(Binding));
+    b->decl = decl;
+    b->sym = decl->sym;
+    b->depth = st->depth - 1;
+    b->shadowed = st->current[decl->sym];
+    st->current[decl->sym] = b;
+
+    st->log = (Binding **)growArray(st->log, &st->maxLog, st->numLog + 1, sizeof(Binding *));
+    st->log[st->numLog++] = b;
+    return b;
+}
+
+Binding *lookupName(const SymTable *st, int sym) {
+    if((sym == NOSYM) || (sym >= st->maxSyms)) {
+        return NULL;
+    }
+    return st->current[sym];
+}
+
+void freeSymTable(SymTable *st) {
+    free(st->current);
+    free(st->log);
+    free(st->marks);
+    arenaFree(&st->bindings);
+    memset(st, 0, sizeof(SymTable));
+}
+
+TreeNode *builtinDecl(CompileContext *ctx, const char *name) {
+    int sym = findString(&ctx->names, name, (int)strlen(name));
+    int takesInt = !strcmp(name, "output");
+    TreeNode *t;
+
+    if((sym == NOSYM) || (!takesInt && strcmp(name, "input"))) {
+        return NULL;
+    }
+    t = (TreeNode *)arenaAlloc(&ctx->tree, sizeof(TreeNode));
+    memset(t, 0, sizeof(TreeNode));
+    t->nodeKind = DecK;
+    t->kind.dec = FunctionDeclaration;
+    t->type = takesInt ? Void : Int;
+    t->sym = sym;
+    t->name = symName(&ctx->names, sym);
+    if(takesInt) {
+        TreeNode *p = (TreeNode *)arenaAlloc(&ctx->tree, sizeof(TreeNode));
+        memset(p, 0, sizeof(TreeNode));
+        p->nodeKind = DecK;
+        p->kind.dec = ParamDeclaration;
+        p->type = Int;
+        p->sym = NOSYM;
+        t->child[0] = p;
+    }
+    return t;
+}
\ No newline at end of file
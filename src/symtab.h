@@ -0,0 +1,44 @@
+#ifndef _SYMTAB_H_
+#define _SYMTAB_H_
+
+/* one declaration in scope. shadowed is the binding of the same name it
+   hides, so leaving a scope restores the outer one without a search. */
+typedef struct _Binding {
+    TreeNode *decl;
+    struct _Binding *shadowed;
+    int sym;
+    int depth;              // scope the binding belongs to, 0 is global
+} Binding;
+
+/* scoped names. Names are already interned (the intern table is the
+   open-addressing hash), so the table itself is indexed by sym and
+   current[sym] is the innermost binding of that name. Every declaration
+   goes on an undo log; leaving a scope pops the log back to the mark taken
+   on entry. Bindings live in an arena. A zeroed table is ready to use. */
+typedef struct _SymTable {
+    Binding **current;
+    int maxSyms;
+    Binding **log;
+    int numLog;
+    int maxLog;
+    int *marks;             // log length at the entry of each open scope
+    int depth;
+    int maxDepth;
+    Arena bindings;
+} SymTable;
+
+void enterScope(SymTable *st);
+void leaveScope(SymTable *st);
+// bind decl->sym in the innermost scope, hiding any outer binding
+Binding *declareName(SymTable *st, TreeNode *decl);
+// innermost visible binding of sym, NULL if none
+Binding *lookupName(const SymTable *st, int sym);
+void freeSymTable(SymTable *st);
+
+struct compileContext;
+
+/* a declaration node, line 0, for the runtime function input or output;
+   NULL for other names or if the tree doesn't use it */
+TreeNode *builtinDecl(struct compileContext *ctx, const char *name);
+
+#endif
\ No newline at end of file
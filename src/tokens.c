@@ -0,0 +1,338 @@
+#include "globals.h"
+#include "scan.h"
+#include "tokens.h"
+#include "pool.h"
+
+#define MAXTOKENBYTES 0xffffffu
+
+// sources with less than this per thread are lexed on one
+#define LEXCHUNKMIN 65536
+
+/* a piece of the source lexed on its own. Whether it starts inside a
+   comment is only known once the pieces before it are done, so it is
+   lexed both ways; the comment reading stops as soon as it reaches a
+   token the other one also found, as from there on they agree. */
+typedef struct _LexChunk {
+    const char *begin;
+    const char *end;
+    TokenArray spec[2];     // lexed from begin between tokens, and in a comment
+    int inComment[2];       // whether each reading ends in a comment
+    int joined;             // index in spec[0] where spec[1] caught up, or -1
+    int fromComment;        // which reading is the real one
+    int first;              // where its tokens go in the merged array
+    int count;
+    int line;               // line at begin
+} LexChunk;
+
+typedef struct _LexJob {
+    CompileContext *ctx;
+    LexChunk *chunks;
+    int numChunks;
+} LexJob;
+
+static int atEnd(const TokenArray *ta) {
+    return (ta->count > 0) && (TOKEN_KIND(ta->toks[ta->count - 1]) == ENDFILE);
+}
+
+static void growTokens(TokenArray *ta, int n) {
+    if(n > ta->max) {
+        ta->max = ta->max ? ta->max * 2 : TOKENBATCH * 2;
+        if(ta->max < n) {
+            ta->max = n;
+        }
+        ta->toks = (Token *)realloc(ta->toks, sizeof(Token) * ta->max);
+        if(ta->toks == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// record the token getToken just returned
+static void addToken(TokenArray *ta, const CompileContext *ctx, TokenType kind) {
+    size_t len = (size_t)(ctx->srcPos - ctx->tokenStart);
+    Token *t;
+
+    if(len > MAXTOKENBYTES) {
+        len = MAXTOKENBYTES;
+    }
+    growTokens(ta, ta->count + 1);
+    t = &ta->toks[ta->count++];
+    t->offset = (unsigned int)(ctx->tokenStart - ctx->srcBase);
+    t->info = (unsigned int)kind | ((unsigned int)len << 8);
+    t->line = ctx->lineno;
+}
+
+/* lex up to n more tokens, or all of them if n < 0. getToken leaves its
+   text and line in ctx, where the parser keeps its current token; once
+   there is one, it stays as it was while the parser peeks ahead. */
+static void fillTokens(CompileContext *ctx, int n) {
+    TokenArray *ta = &ctx->tokens;
+    char text[MAXTOKENLEN + 1];
+    int line = ctx->lineno;
+    int current = (ta->count > 0);
+
+    // a streaming parser only ever looks back at the current token
+    if(!ctx->lexAhead && (ta->next > 1)) {
+        memmove(ta->toks, ta->toks + ta->next - 1, sizeof(Token) * (ta->count - ta->next + 1));
+        ta->count -= ta->next - 1;
+        ta->next = 1;
+    }
+
+    if(current) {
+        memcpy(text, ctx->tokenString, sizeof(text));
+        // a token has no newline in it, so the scanner is on the last one's line
+        ctx->lineno = ta->toks[ta->count - 1].line;
+    }
+    for(; (n != 0) && !atEnd(ta); --n) {
+        addToken(ta, ctx, getToken(ctx));
+    }
+    if(current) {
+        memcpy(ctx->tokenString, text, sizeof(text));
+        ctx->lineno = line;
+    }
+}
+
+// lex one chunk both ways, counting lines from 0 at its start
+static void lexChunk(void *arg, int job, int worker) {
+    LexJob *lj = (LexJob *)arg;
+    LexChunk *c = &lj->chunks[job];
+    const TokenArray *spec = &c->spec[0];
+    CompileContext sc;
+    TokenType kind;
+    unsigned int offset;
+    int k = 0;
+
+    (void)worker;
+    // a bare scanner over [begin, end), with end standing in for EOF
+    memset(&sc, 0, sizeof(CompileContext));
+    sc.skipper = lj->ctx->skipper;
+    setSource(&sc, lj->ctx->srcBase, (size_t)(c->end - lj->ctx->srcBase));
+    seekSource(&sc, (size_t)(c->begin - sc.srcBase), 0);
+    do {
+        kind = getToken(&sc);
+        addToken(&c->spec[0], &sc, kind);
+    } while(kind != ENDFILE);
+    c->inComment[0] = sc.inComment;
+
+    c->joined = -1;
+    if(job == 0) {
+        return;
+    }
+    seekSource(&sc, (size_t)(c->begin - sc.srcBase), 0);
+    sc.inComment = TRUE;
+    do {
+        kind = getToken(&sc);
+        // a token starting at the same byte means both readings are between tokens there
+        if(kind != ENDFILE) {
+            offset = (unsigned int)(sc.tokenStart - sc.srcBase);
+            while((k < spec->count) && (spec->toks[k].offset < offset)) {
+                k++;
+            }
+            if((k < spec->count - 1) && (spec->toks[k].offset == offset)) {
+                c->joined = k;
+                return;
+            }
+        }
+        addToken(&c->spec[1], &sc, kind);
+    } while(kind != ENDFILE);
+    c->inComment[1] = sc.inComment;
+}
+
+// move a chunk's tokens into place with absolute line numbers
+static void copyChunk(void *arg, int job, int worker) {
+    LexJob *lj = (LexJob *)arg;
+    LexChunk *c = &lj->chunks[job];
+    Token *out = lj->ctx->tokens.toks + c->first;
+    const Token *t;
+    int n = c->count;
+    int i;
+
+    (void)worker;
+    if(c->fromComment) {
+        t = c->spec[1].toks;
+        for(i = 0; (i < c->spec[1].count) && (n > 0); ++i, --n) {
+            *out = t[i];
+            out++->line += c->line;
+        }
+        i = c->joined;
+    }
+    else {
+        i = 0;
+    }
+    for(t = c->spec[0].toks; n > 0; ++i, --n) {
+        *out = t[i];
+        out++->line += c->line;
+    }
+
+    free(c->spec[0].toks);
+    free(c->spec[1].toks);
+}
+
+/* lex the rest of the source into ctx->tokens on ctx->threads threads.
+   FALSE, having done nothing, if it is too small to be worth it */
+static int lexParallel(CompileContext *ctx) {
+    size_t bytes = (size_t)(ctx->srcEnd - ctx->srcPos);
+    LexJob lj;
+    LexChunk *c;
+    const Token *last;
+    int inComment = ctx->inComment;
+    int line = ctx->lineno;
+    int n, i;
+
+    // tracing prints as it scans, which only makes sense in order
+    if((ctx->threads < 2) || ctx->PrintScan || (bytes / LEXCHUNKMIN < 2)) {
+        return FALSE;
+    }
+    n = ctx->threads;
+    if((size_t)n > bytes / LEXCHUNKMIN) {
+        n = (int)(bytes / LEXCHUNKMIN);
+    }
+    lj.ctx = ctx;
+    lj.chunks = (LexChunk *)calloc(n, sizeof(LexChunk));
+    if(lj.chunks == NULL) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // split at whitespace near equal shares
+    lj.chunks[0].begin = ctx->srcPos;
+    for(i = 1, lj.numChunks = 1; i < n; ++i) {
+        const char *p = ctx->srcPos + bytes / n * i;
+
+        if(p <= lj.chunks[lj.numChunks - 1].begin) {
+            continue;
+        }
+        p = splitPoint(p, ctx->srcEnd);
+        if((p == NULL) || (p >= ctx->srcEnd)) {
+            break;
+        }
+        lj.chunks[lj.numChunks - 1].end = p;
+        lj.chunks[lj.numChunks++].begin = p;
+    }
+    lj.chunks[lj.numChunks - 1].end = ctx->srcEnd;
+
+    runPool(ctx->threads, lj.numChunks, lexChunk, &lj);
+
+    // each chunk's end state says how the next one really starts
+    ctx->tokens.count = 0;
+    for(i = 0; i < lj.numChunks; ++i) {
+        c = &lj.chunks[i];
+        c->fromComment = inComment && (i > 0);
+        c->line = line;
+        c->first = ctx->tokens.count;
+        if(!c->fromComment) {
+            c->count = c->spec[0].count;
+            inComment = c->inComment[0];
+            last = &c->spec[0].toks[c->spec[0].count - 1];
+        }
+        else if(c->joined >= 0) {
+            c->count = c->spec[1].count + c->spec[0].count - c->joined;
+            inComment = c->inComment[0];
+            last = &c->spec[0].toks[c->spec[0].count - 1];
+        }
+        else {
+            c->count = c->spec[1].count;
+            inComment = c->inComment[1];
+            last = &c->spec[1].toks[c->spec[1].count - 1];
+        }
+        // the ENDFILE at the end of a chunk only carries its line count
+        line += last->line;
+        if(i < lj.numChunks - 1) {
+            c->count--;
+        }
+        ctx->tokens.count += c->count;
+    }
+
+    growTokens(&ctx->tokens, ctx->tokens.count);
+    runPool(ctx->threads, lj.numChunks, copyChunk, &lj);
+    free(lj.chunks);
+
+    // leave the scanner where a serial lex would have
+    ctx->srcPos = ctx->srcEnd;
+    ctx->lineno = line;
+    ctx->inComment = inComment;
+    return TRUE;
+}
+
+void resetTokens(CompileContext *ctx) {
+    TokenArray *ta = &ctx->tokens;
+
+    ta->count = 0;
+    ta->next = 0;
+    ta->start = ctx->srcPos;
+    ta->startLine = ctx->lineno;
+    if(ctx->lexAhead && !lexParallel(ctx)) {
+        fillTokens(ctx, -1);
+    }
+}
+
+void nextToken(CompileContext *ctx) {
+    TokenArray *ta = &ctx->tokens;
+    const Token *t;
+    size_t len;
+
+    // ENDFILE repeats, like getToken at the end of the source
+    if(ta->next > 0) {
+        t = &ta->toks[ta->next - 1];
+        if(TOKEN_KIND(*t) == ENDFILE) {
+            return;
+        }
+        ctx->prevEnd = ctx->srcBase + t->offset + TOKEN_LEN(*t);
+        ctx->prevLine = t->line;
+    }
+    else {
+        ctx->prevEnd = ta->start;
+        ctx->prevLine = ta->startLine;
+    }
+
+    if(ta->next == ta->count) {
+        fillTokens(ctx, TOKENBATCH);
+    }
+    t = &ta->toks[ta->next++];
+
+    // the text is the source bytes, cut to what getToken would have kept
+    len = TOKEN_LEN(*t);
+    if(len > MAXTOKENLEN) {
+        len = MAXTOKENLEN;
+    }
+    memcpy(ctx->tokenString, ctx->srcBase + t->offset, len);
+    ctx->tokenString[len] = '\0';
+    ctx->token = TOKEN_KIND(*t);
+    ctx->lineno = t->line;
+}
+
+void seekToken(CompileContext *ctx, int index) {
+    ctx->tokens.next = index;
+    nextToken(ctx);
+}
+
+TokenType peekToken(CompileContext *ctx, int k) {
+    TokenArray *ta = &ctx->tokens;
+
+    if(k <= 0) {
+        return ctx->token;
+    }
+    while(ta->next - 1 + k >= ta->count) {
+        if(atEnd(ta)) {
+            return ENDFILE;
+        }
+        fillTokens(ctx, k + TOKENBATCH);
+    }
+    return TOKEN_KIND(ta->toks[ta->next - 1 + k]);
+}
+
+int lexTokens(CompileContext *ctx) {
+    int lexAhead = ctx->lexAhead;
+
+    rewindSource(ctx);
+    ctx->lexAhead = TRUE;
+    resetTokens(ctx);
+    ctx->lexAhead = lexAhead;
+    return ctx->tokens.count;
+}
+
+void freeTokens(CompileContext *ctx) {
+    free(ctx->tokens.toks);
+    memset(&ctx->tokens, 0, sizeof(TokenArray));
+}
\ No newline at end of file
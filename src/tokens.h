@@ -0,0 +1,25 @@
+#ifndef _TOKENS_H_
+#define _TOKENS_H_
+
+/* the parser reads tokens from ctx->tokens rather than straight from
+   getToken(). Normally the lexer refills it TOKENBATCH tokens at a time;
+   with ctx->lexAhead set, the whole source is lexed before parsing starts
+   and the array keeps every token. Either way, lexing and parsing each
+   run in their own loop, and peekToken() can look any distance ahead.
+   Scanner tracing (PrintScan) comes out a batch at a time. */
+#define TOKENBATCH 256
+
+// forget buffered tokens and lex from the scanner's current position
+void resetTokens(CompileContext *ctx);
+// advance: token, tokenString, lineno, prevEnd and prevLine describe the next one
+void nextToken(CompileContext *ctx);
+/* make token index current, as if the parser had just advanced to it.
+   Only for a source lexed whole (lexAhead). */
+void seekToken(CompileContext *ctx, int index);
+// kind of the k-th token after the current one, ENDFILE past the end
+TokenType peekToken(CompileContext *ctx, int k);
+// lex the whole source from its start into ctx->tokens; returns the count
+int lexTokens(CompileContext *ctx);
+void freeTokens(CompileContext *ctx);
+
+#endif
\ No newline at end of file
@@ -1,220 +1,310 @@
 #include "globals.h"
 #include "util.h"
 
-void printToken(TokenType currentToken, const char* tokenString) {
+// the whole line printToken writes for tokens that carry no text
+static const char *tokenText(TokenType tok) {
+    switch(tok) {
+        case IF: return "keyword: if\n";
+        case ELSE: return "keyword: else\n";
+        case INT: return "keyword: int\n";
+        case VOID: return "keyword: void\n";
+        case RETURN: return "keyword: return\n";
+        case WHILE: return "keyword: while\n";
+        case ASSIGN: return "=\n";
+        case PLUS: return "+\n";
+        case MINUS: return "-\n";
+        case TIMES: return "*\n";
+        case OVER: return "/\n";
+        case LESSTHAN: return "<\n";
+        case LESSEQTHAN: return "<=\n";
+        case GREATERTHAN: return ">\n";
+        case GREATEREQTHAN: return ">=\n";
+        case EQ: return "==\n";
+        case NEQ: return "!=\n";
+        case SEMI: return ";\n";
+        case COMMA: return ",\n";
+        case LRNDBRKT: return "(\n";
+        case RRNDBRKT: return ")\n";
+        case LCURLBRKT: return "{\n";
+        case RCURLBRKT: return "}\n";
+        case LSQRBRKT: return "[\n";
+        case RSQRBRKT: return "]\n";
+        case ENDFILE: return "EOF\n";
+        default: return NULL;
+    }
+}
+
+void printToken(CompileContext *ctx, TokenType currentToken, const char* tokenString) {
+    const char *text = tokenText(currentToken);
+
+    if(text != NULL) {
+        fputs(text, ctx->out);
+        return;
+    }
     switch(currentToken) {
-        case IF:
-            fprintf(outputfile, "keyword: %s\n", "if");
-        break;
-        case ELSE:
-            fprintf(outputfile, "keyword: %s\n", "else");
-        break;
-        case INT:
-            fprintf(outputfile, "keyword: %s\n", "int");
-        break;
-        case VOID:
-            fprintf(outputfile, "keyword: %s\n", "void");
-        break;
-        case RETURN:
-            fprintf(outputfile, "keyword: %s\n", "return");
-        break;
-        case WHILE:
-            fprintf(outputfile, "keyword: %s\n", "while");
-        break;
         case ID:
-            fprintf(outputfile, "ID, name= %s\n", tokenString);
+            fprintf(ctx->out, "ID, name= %s\n", tokenString);
         break;
         case NUM: 
-            fprintf(outputfile, "NUM, var= %s\n", tokenString);
-        break;
-        case ASSIGN:
-            fprintf(outputfile, "%s\n", "=");
-        break;
-        case PLUS: 
-            fprintf(outputfile, "%s\n", "+");
-        break;
-        case MINUS: 
-            fprintf(outputfile, "%s\n", "-");
-        break;
-        case TIMES: 
-            fprintf(outputfile, "%s\n", "*");
-        break;
-        case OVER:
-            fprintf(outputfile, "%s\n", "/");
-        break;
-        case LESSTHAN: 
-            fprintf(outputfile, "%s\n", "<");
-        break;
-        case LESSEQTHAN: 
-            fprintf(outputfile, "%s\n", "<=");
-        break;
-        case GREATERTHAN: 
-            fprintf(outputfile, "%s\n", ">");
-        break;
-        case GREATEREQTHAN:
-            fprintf(outputfile, "%s\n", ">=");
-        break;
-        case EQ:
-            fprintf(outputfile, "%s\n", "==");
-        break;
-        case NEQ:
-            fprintf(outputfile, "%s\n", "!=");
-        break;
-        case SEMI: 
-            fprintf(outputfile, "%s\n", ";");
-        break;
-        case COMMA:
-            fprintf(outputfile, "%s\n", ",");
-        break;
-        case LRNDBRKT: 
-            fprintf(outputfile, "%s\n", "(");
-        break;
-        case RRNDBRKT:
-            fprintf(outputfile, "%s\n", ")");
-        break;
-        case LCURLBRKT:
-            fprintf(outputfile, "%s\n", "{");
-        break;
-        case RCURLBRKT:
-            fprintf(outputfile, "%s\n", "}");
-        break;
-        case LSQRBRKT:
-            fprintf(outputfile, "%s\n", "[");
-        break;
-        case RSQRBRKT:
-            fprintf(outputfile, "%s\n", "]");
-        break;
-        case ENDFILE:
-            fprintf(outputfile, "EOF\n");
+            fprintf(ctx->out, "NUM, var= %s\n", tokenString);
         break;
         case ERROR:
-            fprintf(outputfile, "ERROR, No such token \"%s\"\n", tokenString);
+            fprintf(ctx->out, "ERROR, No such token \"%s\"\n", tokenString);
+        break;
+        default:
         break;
     }
+}
 
+void outInit(OutBuf *b, FILE *out) {
+    b->out = out;
+    b->len = 0;
+}
+
+void outFlush(OutBuf *b) {
+    if(b->len) {
+        fwrite(b->buf, 1, b->len, b->out);
+        b->len = 0;
+    }
 }
 
-static int indentno = 0;
+static void outBytes(OutBuf *b, const char *s, size_t len) {
+    if(b->len + len > OUTBUFSIZE) {
+        outFlush(b);
+        if(len > OUTBUFSIZE) {
+            fwrite(s, 1, len, b->out);
+            return;
+        }
+    }
+    memcpy(b->buf + b->len, s, len);
+    b->len += len;
+}
 
-#define INDENT indentno+=2
-#define UNINDENT indentno-=2
+// literal strings only
+#define OUTLIT(b, s) outBytes(b, s, sizeof(s) - 1)
 
-static void printSpaces(void) {
-    int i = 0;
-    for(i = 0; i < indentno; ++i) {
-        fprintf(outputfile, " ");
+// what %s makes of a null pointer, so the dump doesn't change
+static void outStr(OutBuf *b, const char *s) {
+    if(s == NULL) {
+        s = "(null)";
     }
+    outBytes(b, s, strlen(s));
 }
-void printTree(TreeNode *t) {
-    int i;
-    char type[20];
-    INDENT;
-
-    while(t != NULL) {
-        printSpaces();
-        if(t->nodeKind == DecK) {
-            if(t->type == Int) {
-                strcpy(type, "int");
-            }
-            else if(t->type == Void) {
-                strcpy(type, "void");
-            }
-            else {
-                strcpy(type, "error, unknown type");
-            }
 
-            switch(t->kind.dec) {
-                // var-declaration
-                case VarDeclaration:
-                    // var-declaration with array
-                    if(t->arrayType) {
-                        fprintf(outputfile, "Variable Declaration: %s %s in size [%d]\n", type, t->name, t->val);
-                    }
-                    // var-declaration without array
-                    else {
-
-                        fprintf(outputfile, "Varible Declaration: %s %s\n", type, t->name);
-                    }
-                break;
-                // function-declaration
-                case FunctionDeclaration:
-                    fprintf(outputfile, "Function Declaration: %s %s\n", type, t->name);
-                break;
-                // param
-                case ParamDeclaration:
-                    // param with array
-                    if(t->arrayType) {
-                        fprintf(outputfile, "Param Declaration: %s %s[]\n", type, t->name);
-                    }
-                    // param without array
-                    else {
-
-                        fprintf(outputfile, "Param Declaration: %s %s\n", type, t->name);
-                    }
-                break;
-                default:
-                    fprintf(outputfile, "Unknown DecK\n");
-                break;
-            }
-        }
-        else if(t->nodeKind == StmtK) {
-            switch(t->kind.stmt) {
-                // compound-stmt
-                case Compound:
-                    fprintf(outputfile, "Compound: \n");
-                break;
-                // selection-stmt
-                case Selection:
-                    fprintf(outputfile, "If: \n");
-                break;
-                // iteration-stmt
-                case Iteration:
-                    fprintf(outputfile, "While: \n");
-                break;
-                // return-stmt
-                case Return:
-                    fprintf(outputfile, "Return: \n");
-                break;
-                // call
-                case Call:
-                    fprintf(outputfile, "Call: %s\n", t->name);
-                break;
-                default:
-                    fprintf(outputfile, "Unknown StmtK\n");
-                break;
-            }
+static void outInt(OutBuf *b, int v) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned int u = (v < 0) ? 0u - (unsigned int)v : (unsigned int)v;
+
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while(u);
+    if(v < 0) {
+        *--p = '-';
+    }
+    outBytes(b, p, digits + sizeof(digits) - p);
+}
+
+void outIndent(OutBuf *b, int n) {
+    static const char spaces[] = "                                                                ";
+
+    while(n > 0) {
+        int k = (n < (int)sizeof(spaces) - 1) ? n : (int)sizeof(spaces) - 1;
+        outBytes(b, spaces, k);
+        n -= k;
+    }
+}
+
+// same text as printToken with an empty token string
+static void outToken(OutBuf *b, TokenType tok) {
+    const char *text = tokenText(tok);
+
+    if(text != NULL) {
+        outStr(b, text);
+    }
+    else if(tok == ID) {
+        OUTLIT(b, "ID, name= \n");
+    }
+    else if(tok == NUM) {
+        OUTLIT(b, "NUM, var= \n");
+    }
+    else if(tok == ERROR) {
+        OUTLIT(b, "ERROR, No such token \"\"\n");
+    }
+}
+
+// "<type> <name>" of a declaration
+static void outDecl(OutBuf *b, const TreeNode *t) {
+    if(t->type == Int) {
+        OUTLIT(b, "int ");
+    }
+    else if(t->type == Void) {
+        OUTLIT(b, "void ");
+    }
+    else {
+        OUTLIT(b, "error, unknown type ");
+    }
+    outStr(b, t->name);
+}
+
+void outNode(OutBuf *b, const TreeNode *t) {
+    if(t->nodeKind == DecK) {
+        switch(t->kind.dec) {
+            // var-declaration
+            case VarDeclaration:
+                // var-declaration with array
+                if(t->arrayType) {
+                    OUTLIT(b, "Variable Declaration: ");
+                    outDecl(b, t);
+                    OUTLIT(b, " in size [");
+                    outInt(b, t->val);
+                    OUTLIT(b, "]\n");
+                }
+                // var-declaration without array
+                else {
+                    OUTLIT(b, "Varible Declaration: ");
+                    outDecl(b, t);
+                    OUTLIT(b, "\n");
+                }
+            break;
+            // function-declaration
+            case FunctionDeclaration:
+                OUTLIT(b, "Function Declaration: ");
+                outDecl(b, t);
+                OUTLIT(b, "\n");
+            break;
+            // param
+            case ParamDeclaration:
+                OUTLIT(b, "Param Declaration: ");
+                outDecl(b, t);
+                // param with array
+                if(t->arrayType) {
+                    OUTLIT(b, "[]\n");
+                }
+                // param without array
+                else {
+                    OUTLIT(b, "\n");
+                }
+            break;
+            default:
+                OUTLIT(b, "Unknown DecK\n");
+            break;
         }
-        else if(t->nodeKind == ExpK) {
-            switch (t->kind.exp) {
-                case Op:
-                    fprintf(outputfile, "Op: ");
-                    printToken(t->op, "\0");
-                break;
-                case Id:
-                    fprintf(outputfile, "Id: %s\n", t->name);
-                break;
-                case Assign:
-                    fprintf(outputfile, "Assign: \n");
-                break;
-                case Constant:
-                    fprintf(outputfile, "Const: %d\n", t->val);
-                break;
-                default:
-                    fprintf(outputfile, "Unknown ExpK\n");
-                break;
-            }
+    }
+    else if(t->nodeKind == StmtK) {
+        switch(t->kind.stmt) {
+            // compound-stmt
+            case Compound:
+                OUTLIT(b, "Compound: \n");
+            break;
+            // selection-stmt
+            case Selection:
+                OUTLIT(b, "If: \n");
+            break;
+            // iteration-stmt
+            case Iteration:
+                OUTLIT(b, "While: \n");
+            break;
+            // return-stmt
+            case Return:
+                OUTLIT(b, "Return: \n");
+            break;
+            // call
+            case Call:
+                OUTLIT(b, "Call: ");
+                outStr(b, t->name);
+                OUTLIT(b, "\n");
+            break;
+            default:
+                OUTLIT(b, "Unknown StmtK\n");
+            break;
         }
-        else {
-            // error unknown node kind
-            fprintf(outputfile, "Unkwon node kind\n");
+    }
+    else if(t->nodeKind == ExpK) {
+        switch (t->kind.exp) {
+            case Op:
+                OUTLIT(b, "Op: ");
+                outToken(b, t->op);
+            break;
+            case Id:
+                OUTLIT(b, "Id: ");
+                outStr(b, t->name);
+                OUTLIT(b, "\n");
+            break;
+            case Assign:
+                OUTLIT(b, "Assign: \n");
+            break;
+            case Constant:
+                OUTLIT(b, "Const: ");
+                outInt(b, t->val);
+                OUTLIT(b, "\n");
+            break;
+            default:
+                OUTLIT(b, "Unknown ExpK\n");
+            break;
         }
+    }
+    else {
+        // error unknown node kind
+        OUTLIT(b, "Unkwon node kind\n");
+    }
+}
+
+// a sibling list still to print, and how deep it sits
+typedef struct _Pending {
+    TreeNode *t;
+    int depth;
+} Pending;
+
+/* preorder with an explicit stack, so nesting depth is bounded by memory
+   rather than the C stack. Each list is indented two more than its parent. */
+void printTree(CompileContext *ctx, TreeNode *t) {
+    OutBuf *b;
+    Pending *stack;
+    int top = 0;
+    int size = 64;
+    int depth;
+    int i;
+
+    b = (OutBuf *)malloc(sizeof(OutBuf));
+    stack = (Pending *)malloc(sizeof(Pending) * size);
+    if((b == NULL) || (stack == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    outInit(b, ctx->out);
 
-        for(i = 0; i < MAXCHILDREN; ++i) {
-            printTree(t->child[i]);
+    stack[top].t = t;
+    stack[top++].depth = 1;
+    while(top > 0) {
+        t = stack[--top].t;
+        depth = stack[top].depth;
+        if(t == NULL) {
+            continue;
         }
 
-        t = t->sibling;
+        outIndent(b, 2 * depth);
+        outNode(b, t);
+
+        // sibling goes under the children so it's printed after them
+        if(top + MAXCHILDREN + 1 > size) {
+            size *= 2;
+            stack = (Pending *)realloc(stack, sizeof(Pending) * size);
+            if(stack == NULL) {
+                fprintf(stderr, "memory allocation error. exiting...\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        stack[top].t = t->sibling;
+        stack[top++].depth = depth;
+        for(i = MAXCHILDREN - 1; i >= 0; --i) {
+            stack[top].t = t->child[i];
+            stack[top++].depth = depth + 1;
+        }
     }
 
-    UNINDENT;
+    outFlush(b);
+    free(stack);
+    free(b);
 }
\ No newline at end of file
@@ -1,6 +1,22 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
-void printToken(TokenType currentToken, const char* tokenString);
-void printTree(TreeNode *t);
+#define OUTBUFSIZE 65536
+
+/* tree dumps are built up here and handed to the FILE in large writes
+   instead of one fprintf per field */
+typedef struct _OutBuf {
+    FILE *out;
+    size_t len;
+    char buf[OUTBUFSIZE];
+} OutBuf;
+
+void outInit(OutBuf *b, FILE *out);
+void outFlush(OutBuf *b);
+void outIndent(OutBuf *b, int n);
+// one line describing t, without the indentation
+void outNode(OutBuf *b, const TreeNode *t);
+
+void printToken(CompileContext *ctx, TokenType currentToken, const char* tokenString);
+void printTree(CompileContext *ctx, TreeNode *t);
 #endif
\ No newline at end of file
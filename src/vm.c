@@ -0,0 +1,1023 @@
+#include "globals.h"
+#include "ir.h"
+#include "vm.h"
+
+#define INITVM 256
+#define HEADER 3                // return address, caller's frame and result register
+#define MINWORDS (1 << 16)
+#define MAXWORDS (1 << 26)      // deeper than this is taken for runaway recursion
+#define MAXSETS (1 << 22)       // words of bit sets coalescing may take per function
+
+#ifdef __GNUC__
+#define THREADED
+#endif
+
+/* every opcode, in order. One ending in K takes a constant for its last
+   value and comes right after the one that takes a register there. */
+#define VM_OPS(X) \
+    X(HALT) X(MOV) X(MOVK) \
+    X(ADD) X(ADDK) X(SUB) X(SUBK) X(MUL) X(MULK) X(DIV) X(DIVK) \
+    X(LT) X(LTK) X(LE) X(LEK) X(GT) X(GTK) X(GE) X(GEK) X(EQ) X(EQK) X(NE) X(NEK) \
+    X(INC) X(ADDR) X(LOAD) X(STORE) X(STOREK) X(LOADX) X(STOREX) X(STOREXK) \
+    X(JMP) X(BRZ) \
+    X(JLT) X(JLTK) X(JLE) X(JLEK) X(JGT) X(JGTK) X(JGE) X(JGEK) X(JEQ) X(JEQK) X(JNE) X(JNEK) \
+    X(CALL) X(RET) X(RETK) X(INPUT) X(OUTPUT) X(OUTPUTK)
+
+#define VM_ENUM(name) VM_##name,
+typedef enum { VM_OPS(VM_ENUM) VM_NUMOPS } VmOp;
+
+/* op         operands
+   MOV        d v
+   ADD..NE    d a v             d = a op v
+   INC        d k               d = d + k
+   ADDR       d off             address of word off of the frame
+   LOAD       d a               d = mem[a]
+   STORE      a v               mem[a] = v
+   LOADX      d a i             d = mem[a + i]
+   STOREX     a i v             mem[a + i] = v
+   JMP        pc
+   BRZ        c pc              to pc if c is 0
+   JLT..JNE   a v pc            to pc if a op v
+   CALL       f d base          the callee's frame starts at base, -1 for d drops the result
+   RET        v
+   INPUT      d
+   OUTPUT     v */
+
+// IR_LT..IR_NE with their operands the other way round, and negated
+static const IrOp mirrored[] = {IR_GT, IR_GE, IR_LT, IR_LE, IR_EQ, IR_NE};
+static const IrOp negated[] = {IR_GE, IR_GT, IR_LE, IR_LT, IR_NE, IR_EQ};
+
+typedef struct _Compiler {
+    Vm *vm;
+    const IrModule *m;
+    int fi;
+    int scratch;            // register a constant goes through where an op can't take one
+    int frameSize;
+    int maxArgs;
+    int *uses;              // how often each register of the function is read
+    int *reg;               // where each register lives in the frame, see coalesce
+    int *defs;              // how often each register is written, parameters once on entry
+    unsigned int *sets;     // liveness and interference, while coalescing
+    int maxSets;
+    int *labels;            // per block where its code starts, -1 before
+    int *fixups;            // operands holding a block, to replace with its label
+    int numFixups;
+    int maxFixups;
+    int *slotAt;            // per slot its address, or its offset in the frame
+    int *funcOf;            // per symbol its function, -1 for none
+    int input;
+    int output;
+} Compiler;
+
+static void *growArray(void *p, int *max, int need, size_t size) {
+    if(need > *max) {
+        *max = (need > *max * 2) ? need : *max * 2;
+        if(*max < INITVM) {
+            *max = INITVM;
+        }
+        p = realloc(p, size * *max);
+        if(p == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return p;
+}
+
+static void put(Compiler *c, int word) {
+    Vm *vm = c->vm;
+
+    vm->code = (int *)growArray(vm->code, &vm->maxCode, vm->numCode + 1, sizeof(int));
+    vm->code[vm->numCode++] = word;
+}
+
+static int constant(const Compiler *c, int o) {
+    return c->m->consts[IR_CONSTINDEX(o)];
+}
+
+/* op, or the K op after it for a constant, with n register operands and
+   then the value v */
+static void putValue(Compiler *c, int op, int n, int a, int b, int v) {
+    put(c, IR_ISCONST(v) ? op + 1 : op);
+    if(n > 0) {
+        put(c, a);
+    }
+    if(n > 1) {
+        put(c, b);
+    }
+    put(c, IR_ISCONST(v) ? constant(c, v) : c->reg[v]);
+}
+
+// where block b starts, or a note to fill it in once it is known
+static void putLabel(Compiler *c, int b) {
+    if(c->labels[b] >= 0) {
+        put(c, c->labels[b]);
+        return;
+    }
+    c->fixups = (int *)growArray(c->fixups, &c->maxFixups, c->numFixups + 1, sizeof(int));
+    c->fixups[c->numFixups++] = c->vm->numCode;
+    put(c, b);
+}
+
+// a register holding o; a constant goes through the scratch register
+static int inRegister(Compiler *c, int o) {
+    if(IR_ISCONST(o)) {
+        putValue(c, VM_MOV, 1, c->scratch, 0, o);
+        return c->scratch;
+    }
+    return c->reg[o];
+}
+
+// the only read of the result of i is a MOV right after it
+static int movedOn(const Compiler *c, int b, int i) {
+    const IrInst *in = &c->m->insts[i];
+
+    return (i + 1 < c->m->blocks[b].end) && (in->dst != IR_NONE) && (c->uses[in->dst] == 1) &&
+        (in[1].op == IR_MOV) && (in[1].a == in->dst);
+}
+
+// where the result of *i goes: past such a MOV, which *i moves on to
+static int dest(const Compiler *c, int b, int *i) {
+    if(movedOn(c, b, *i)) {
+        ++*i;
+    }
+    return c->reg[c->m->insts[*i].dst];
+}
+
+static void binary(Compiler *c, IrOp op, int d, int a, int b) {
+    int t;
+
+    if(IR_ISCONST(a) && !IR_ISCONST(b) && (op != IR_SUB) && (op != IR_DIV)) {
+        t = a, a = b, b = t;
+        if(op >= IR_LT) {
+            op = mirrored[op - IR_LT];
+        }
+    }
+    a = inRegister(c, a);
+    // i = i + k
+    if(((op == IR_ADD) || (op == IR_SUB)) && IR_ISCONST(b) && (a == d)) {
+        put(c, VM_INC);
+        put(c, d);
+        put(c, (op == IR_ADD) ? constant(c, b) : (int)(0u - (unsigned int)constant(c, b)));
+        return;
+    }
+    putValue(c, VM_ADD + 2 * (op - IR_ADD), 2, d, a, b);
+}
+
+// to block target if a op b
+static void compareJump(Compiler *c, IrOp op, int a, int b, int target) {
+    int t;
+
+    if(IR_ISCONST(a) && !IR_ISCONST(b)) {
+        t = a, a = b, b = t;
+        op = mirrored[op - IR_LT];
+    }
+    a = inRegister(c, a);
+    putValue(c, VM_JLT + 2 * (op - IR_LT), 1, a, 0, b);
+    putLabel(c, target);
+}
+
+// a compare only the BRZ right after it reads
+static int fusedCompare(const Compiler *c, int b, int i) {
+    const IrInst *in = &c->m->insts[i];
+
+    return (in->op >= IR_LT) && (in->op <= IR_NE) && (i + 1 < c->m->blocks[b].end) &&
+        (c->uses[in->dst] == 1) && (in[1].op == IR_BRZ) && (in[1].a == in->dst);
+}
+
+// a copy into the register it is from, or one nothing reads
+static int emitsNothing(const Compiler *c, const IrInst *in) {
+    return (in->op == IR_MOV) && !IR_ISCONST(in->a) &&
+        ((c->uses[in->dst] == 0) || (c->reg[in->dst] == c->reg[in->a]));
+}
+
+/* where a jump to block t ends up: blocks that come down to a jump are
+   passed through, up to a few so a loop of them stays put */
+static int jumpTarget(const Compiler *c, int t) {
+    const IrModule *m = c->m;
+    int n, i;
+
+    for(n = 0; n < 4; ++n) {
+        i = m->blocks[t].start;
+        while((i < m->blocks[t].end - 1) && emitsNothing(c, &m->insts[i])) {
+            ++i;
+        }
+        if((i != m->blocks[t].end - 1) || (m->insts[i].op != IR_JMP)) {
+            break;
+        }
+        t = m->insts[i].a;
+    }
+    return t;
+}
+
+// a jump to block t; a loop's jump back to its test does the test here
+static void jump(Compiler *c, int b, int t) {
+    const IrModule *m = c->m;
+    const IrInst *in;
+
+    t = jumpTarget(c, t);
+    in = &m->insts[m->blocks[t].start];
+    if(t == b + 1) {
+        return;
+    }
+    if((m->blocks[t].end - m->blocks[t].start == 2) && fusedCompare(c, t, m->blocks[t].start)) {
+        compareJump(c, in->op, in->a, in->b, jumpTarget(c, t + 1));
+        if(jumpTarget(c, in[1].b) != b + 1) {
+            put(c, VM_JMP);
+            putLabel(c, jumpTarget(c, in[1].b));
+        }
+        return;
+    }
+    put(c, VM_JMP);
+    putLabel(c, t);
+}
+
+// the ARGs right before it go where the callee's frame starts
+static void call(Compiler *c, int b, int *i) {
+    const IrInst *in = &c->m->insts[*i];
+    int f = c->funcOf[in->a];
+    int first = *i - in->b;
+    int base = c->frameSize + HEADER;
+    int k, d;
+
+    if(f < 0) {
+        if(in->a == c->output) {
+            putValue(c, VM_OUTPUT, 0, 0, 0, c->m->insts[first].a);
+        }
+        else {
+            d = ((in->dst != IR_NONE) && (c->uses[in->dst] > 0)) ? dest(c, b, i) : c->scratch;
+            put(c, VM_INPUT);
+            put(c, d);
+        }
+        return;
+    }
+    for(k = 0; k < in->b; ++k) {
+        putValue(c, VM_MOV, 1, base + k, 0, c->m->insts[first + k].a);
+    }
+    if(in->b > c->maxArgs) {
+        c->maxArgs = in->b;
+    }
+    d = ((in->dst != IR_NONE) && (c->uses[in->dst] > 0)) ? dest(c, b, i) : -1;
+    put(c, VM_CALL);
+    put(c, f);
+    put(c, d);
+    put(c, base);
+}
+
+// an INDEX only the LOAD or STORE right after it reads goes into that one
+static void indexed(Compiler *c, int b, int *i) {
+    const IrInst *in = &c->m->insts[*i];
+    int single = (*i + 1 < c->m->blocks[b].end) && (c->uses[in->dst] == 1) && (in[1].a == in->dst);
+    int d;
+
+    if(single && (in[1].op == IR_LOAD)) {
+        ++*i;
+        if(c->uses[in[1].dst] > 0) {
+            int index = inRegister(c, in->b);
+
+            d = dest(c, b, i);
+            put(c, VM_LOADX);
+            put(c, d);
+            put(c, c->reg[in->a]);
+            put(c, index);
+        }
+    }
+    else if(single && (in[1].op == IR_STORE)) {
+        ++*i;
+        putValue(c, VM_STOREX, 2, c->reg[in->a], inRegister(c, in->b), in[1].b);
+    }
+    else {
+        binary(c, IR_ADD, dest(c, b, i), in->a, in->b);
+    }
+}
+
+static void compileInst(Compiler *c, int b, int *i) {
+    const IrModule *m = c->m;
+    const IrInst *in = &m->insts[*i];
+    int dead = (in->dst != IR_NONE) && (c->uses[in->dst] == 0);
+    int d;
+
+    switch(in->op) {
+        case IR_MOV:
+            if(!dead) {
+                d = dest(c, b, i);
+                if(IR_ISCONST(in->a) || (c->reg[in->a] != d)) {
+                    putValue(c, VM_MOV, 1, d, 0, in->a);
+                }
+            }
+            break;
+        case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+            if(fusedCompare(c, b, *i)) {
+                ++*i;
+                compareJump(c, negated[in->op - IR_LT], in->a, in->b, jumpTarget(c, in[1].b));
+                break;
+            }
+            // fall through
+        case IR_ADD: case IR_SUB: case IR_MUL:
+            if(!dead) {
+                binary(c, in->op, dest(c, b, i), in->a, in->b);
+            }
+            break;
+        case IR_DIV:
+            // even unused, it may divide by zero
+            binary(c, in->op, dead ? c->scratch : dest(c, b, i), in->a, in->b);
+            break;
+        case IR_ADDR:
+            if(!dead) {
+                d = dest(c, b, i);
+                put(c, (m->slots[in->a].func < 0) ? VM_MOVK : VM_ADDR);
+                put(c, d);
+                put(c, c->slotAt[in->a]);
+            }
+            break;
+        case IR_INDEX:
+            if(!dead) {
+                indexed(c, b, i);
+            }
+            break;
+        case IR_LOAD:
+            if(!dead) {
+                d = dest(c, b, i);
+                put(c, VM_LOAD);
+                put(c, d);
+                put(c, c->reg[in->a]);
+            }
+            break;
+        case IR_STORE:
+            putValue(c, VM_STORE, 1, c->reg[in->a], 0, in->b);
+            break;
+        case IR_ARG:
+            break;
+        case IR_CALL:
+            call(c, b, i);
+            break;
+        case IR_RET:
+            if(in->a == IR_NONE) {
+                put(c, VM_RETK);
+                put(c, 0);
+            }
+            else {
+                putValue(c, VM_RET, 0, 0, 0, in->a);
+            }
+            break;
+        case IR_JMP:
+            jump(c, b, in->a);
+            break;
+        case IR_BRZ:
+            if(!IR_ISCONST(in->a)) {
+                put(c, VM_BRZ);
+                put(c, c->reg[in->a]);
+                putLabel(c, jumpTarget(c, in->b));
+            }
+            else if(constant(c, in->a) == 0) {
+                put(c, VM_JMP);
+                putLabel(c, jumpTarget(c, in->b));
+            }
+            break;
+    }
+}
+
+// the registers *in reads, into r; how many
+static int readsOf(const IrInst *in, int *r) {
+    int n = 0;
+
+    switch(in->op) {
+        case IR_ADDR: case IR_CALL: case IR_JMP:
+            return 0;
+        case IR_MOV: case IR_LOAD: case IR_ARG: case IR_RET: case IR_BRZ:
+            break;
+        default:
+            if(in->b >= 0) {
+                r[n++] = in->b;
+            }
+            break;
+    }
+    if(in->a >= 0) {
+        r[n++] = in->a;
+    }
+    return n;
+}
+
+static int findReg(int *join, int r) {
+    while(join[r] != r) {
+        join[r] = join[join[r]];
+        r = join[r];
+    }
+    return r;
+}
+
+// live registers before block b runs, from those after it; TRUE if they changed
+static int liveBefore(Compiler *c, int b, unsigned int *live, unsigned int *in, int w) {
+    const IrModule *m = c->m;
+    int r[2];
+    int i, k, n, changed = FALSE;
+
+    for(i = m->blocks[b].end - 1; i >= m->blocks[b].start; --i) {
+        if(m->insts[i].dst >= 0) {
+            live[m->insts[i].dst / 32] &= ~(1u << (m->insts[i].dst % 32));
+        }
+        n = readsOf(&m->insts[i], r);
+        for(k = 0; k < n; ++k) {
+            live[r[k] / 32] |= 1u << (r[k] % 32);
+        }
+    }
+    for(k = 0; k < w; ++k) {
+        changed |= (in[k] != live[k]);
+        in[k] = live[k];
+    }
+    return changed;
+}
+
+// live registers after block b, from what its successors need
+static void liveAfter(const Compiler *c, int b, const unsigned int *liveIn, unsigned int *live, int w) {
+    const IrModule *m = c->m;
+    const IrFunc *f = &m->funcs[c->fi];
+    const IrInst *last = (m->blocks[b].end > m->blocks[b].start) ? &m->insts[m->blocks[b].end - 1] : NULL;
+    int succ[2];
+    int n = 0;
+    int j, k;
+
+    if((last != NULL) && (last->op == IR_JMP)) {
+        succ[n++] = last->a;
+    }
+    else if((last == NULL) || (last->op != IR_RET)) {
+        if((last != NULL) && (last->op == IR_BRZ)) {
+            succ[n++] = last->b;
+        }
+        if(b + 1 < f->firstBlock + f->numBlocks) {
+            succ[n++] = b + 1;
+        }
+    }
+    memset(live, 0, sizeof(unsigned int) * w);
+    for(j = 0; j < n; ++j) {
+        for(k = 0; k < w; ++k) {
+            live[k] |= liveIn[(size_t)(succ[j] - f->firstBlock) * w + k];
+        }
+    }
+}
+
+static void interfere(unsigned int *edges, int w, int x, int y) {
+    edges[(size_t)x * w + y / 32] |= 1u << (y % 32);
+    edges[(size_t)y * w + x / 32] |= 1u << (x % 32);
+}
+
+// x interferes with every register in live but itself and skip
+static void interfereAll(unsigned int *edges, int w, int x, const unsigned int *live, int skip) {
+    unsigned int bits;
+    int k, j;
+
+    for(k = 0; k < w; ++k) {
+        for(bits = live[k], j = 0; bits != 0; bits >>= 1, ++j) {
+            if((bits & 1) && (32 * k + j != x) && (32 * k + j != skip)) {
+                interfere(edges, w, x, 32 * k + j);
+            }
+        }
+    }
+}
+
+// d and s in one register, unless they clash
+static void join(Compiler *c, unsigned int *edges, int w, int d, int s) {
+    int params = c->m->funcs[c->fi].numParams;
+    int x = findReg(c->reg, d);
+    int y = findReg(c->reg, s);
+    unsigned int bits;
+    int k, j;
+
+    if((x == y) || ((x < params) && (y < params)) || (edges[(size_t)x * w + y / 32] & (1u << (y % 32)))) {
+        return;
+    }
+    // y joins x, and x takes on y's clashes
+    if(y < params) {
+        k = x, x = y, y = k;
+    }
+    c->reg[y] = x;
+    for(k = 0; k < w; ++k) {
+        for(bits = edges[(size_t)y * w + k], j = 0; bits != 0; bits >>= 1, ++j) {
+            if(bits & 1) {
+                interfere(edges, w, x, 32 * k + j);
+            }
+        }
+    }
+}
+
+/* one frame register for registers joined by copies, where their values
+   are never live apart: leaving SSA form puts a copy on every edge into a
+   join, and the VM would run each one. Copies between registers written
+   more than once go first: those are the ones on edges, where a copy
+   from a temporary runs only where its value is made. Parameters keep
+   their place, and two of them are never joined. A function too big for bit sets of its
+   blocks and registers keeps them all apart. */
+static void coalesce(Compiler *c) {
+    const IrModule *m = c->m;
+    const IrFunc *f = &m->funcs[c->fi];
+    int n = f->numRegs;
+    int w = (n + 31) / 32;
+    unsigned int *liveIn, *live, *edges;
+    int b, i, k, x, y, pass, changed;
+
+    for(x = 0; x < n; ++x) {
+        c->reg[x] = x;
+    }
+    if((n == 0) || ((size_t)w * (f->numBlocks + n + 1) > MAXSETS)) {
+        return;
+    }
+    c->sets = (unsigned int *)growArray(c->sets, &c->maxSets, w * (f->numBlocks + n + 1), sizeof(unsigned int));
+    memset(c->sets, 0, sizeof(unsigned int) * w * (f->numBlocks + n + 1));
+    liveIn = c->sets;
+    live = liveIn + (size_t)w * f->numBlocks;
+    edges = live + w;
+
+    do {
+        changed = FALSE;
+        for(b = f->firstBlock + f->numBlocks - 1; b >= f->firstBlock; --b) {
+            liveAfter(c, b, liveIn, live, w);
+            changed |= liveBefore(c, b, live, liveIn + (size_t)(b - f->firstBlock) * w, w);
+        }
+    } while(changed);
+
+    // what each result is written over; a copy doesn't clash with its source
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        liveAfter(c, b, liveIn, live, w);
+        for(i = m->blocks[b].end - 1; i >= m->blocks[b].start; --i) {
+            const IrInst *in = &m->insts[i];
+            int r[2];
+
+            if(in->dst >= 0) {
+                interfereAll(edges, w, in->dst, live, (in->op == IR_MOV) ? in->a : -1);
+                live[in->dst / 32] &= ~(1u << (in->dst % 32));
+            }
+            for(k = readsOf(in, r) - 1; k >= 0; --k) {
+                live[r[k] / 32] |= 1u << (r[k] % 32);
+            }
+        }
+    }
+    // parameters all arrive at the entry
+    for(x = 0; x < f->numParams; ++x) {
+        interfereAll(edges, w, x, liveIn, -1);
+        for(y = 0; y < x; ++y) {
+            interfere(edges, w, x, y);
+        }
+    }
+
+    for(pass = 0; pass < 2; ++pass) {
+        for(i = m->blocks[f->firstBlock].start; i < m->blocks[f->firstBlock + f->numBlocks - 1].end; ++i) {
+            const IrInst *in = &m->insts[i];
+
+            if((in->op == IR_MOV) && (in->a >= 0) && (in->dst >= 0) &&
+                ((pass > 0) || ((c->defs[in->dst] > 1) && (c->defs[in->a] > 1)))) {
+                join(c, edges, w, in->dst, in->a);
+            }
+        }
+    }
+    for(x = 0; x < n; ++x) {
+        c->reg[x] = findReg(c->reg, x);
+    }
+}
+
+static void countUses(Compiler *c, const IrInst *in) {
+    int r[2];
+    int k;
+
+    for(k = readsOf(in, r) - 1; k >= 0; --k) {
+        c->uses[r[k]]++;
+    }
+    if(in->dst >= 0) {
+        c->defs[in->dst]++;
+    }
+}
+
+static void compileFunction(Compiler *c) {
+    const IrModule *m = c->m;
+    const IrFunc *f = &m->funcs[c->fi];
+    VmFunc *vf = &c->vm->funcs[c->fi];
+    const IrInst *last = NULL;
+    int b, i, k;
+
+    memset(c->uses, 0, sizeof(int) * (f->numRegs + 1));
+    memset(c->defs, 0, sizeof(int) * (f->numRegs + 1));
+    for(i = 0; i < f->numParams; ++i) {
+        c->defs[i] = 1;
+    }
+    for(i = m->blocks[f->firstBlock].start; i < m->blocks[f->firstBlock + f->numBlocks - 1].end; ++i) {
+        countUses(c, &m->insts[i]);
+    }
+    coalesce(c);
+    // registers, the scratch one, then local arrays
+    c->scratch = f->numRegs;
+    c->frameSize = f->numRegs + 1;
+    for(k = 0; k < m->numSlots; ++k) {
+        if(m->slots[k].func == c->fi) {
+            c->slotAt[k] = c->frameSize;
+            c->frameSize += m->slots[k].size;
+        }
+    }
+    c->maxArgs = 0;
+    c->numFixups = 0;
+    vf->entry = c->vm->numCode;
+    vf->numParams = f->numParams;
+    vf->frameSize = c->frameSize;
+
+    for(b = f->firstBlock; b < f->firstBlock + f->numBlocks; ++b) {
+        c->labels[b] = c->vm->numCode;
+        for(i = m->blocks[b].start; i < m->blocks[b].end; ++i) {
+            compileInst(c, b, &i);
+        }
+        last = (m->blocks[b].end > m->blocks[b].start) ? &m->insts[m->blocks[b].end - 1] : NULL;
+    }
+    // lowering ends every function with a return, but nothing may run off it
+    if((last == NULL) || ((last->op != IR_JMP) && (last->op != IR_RET))) {
+        put(c, VM_RETK);
+        put(c, 0);
+    }
+
+    for(k = 0; k < c->numFixups; ++k) {
+        c->vm->code[c->fixups[k]] = c->labels[c->vm->code[c->fixups[k]]];
+    }
+    vf->extent = c->frameSize + HEADER + c->maxArgs;
+}
+
+int vmCompile(Vm *vm, const IrModule *m, const InternTable *names) {
+    Compiler c;
+    int mainSym = findString(names, "main", 4);
+    int i, n;
+
+    memset(&c, 0, sizeof(Compiler));
+    c.vm = vm;
+    c.m = m;
+    c.input = findString(names, "input", 5);
+    c.output = findString(names, "output", 6);
+    n = 1;
+    for(i = 0; i < m->numFuncs; ++i) {
+        if(m->funcs[i].numRegs >= n) {
+            n = m->funcs[i].numRegs + 1;
+        }
+    }
+    c.uses = (int *)malloc(sizeof(int) * n);
+    c.reg = (int *)malloc(sizeof(int) * n);
+    c.defs = (int *)malloc(sizeof(int) * n);
+    c.labels = (int *)malloc(sizeof(int) * (m->numBlocks + 1));
+    c.slotAt = (int *)malloc(sizeof(int) * (m->numSlots + 1));
+    c.funcOf = (int *)malloc(sizeof(int) * (symCount(names) + 1));
+    if((c.uses == NULL) || (c.reg == NULL) || (c.defs == NULL) || (c.labels == NULL) || (c.slotAt == NULL) || (c.funcOf == NULL)) {
+        fprintf(stderr, "memory allocation error. exiting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < m->numBlocks; ++i) {
+        c.labels[i] = -1;
+    }
+    for(i = 0; i < symCount(names); ++i) {
+        c.funcOf[i] = -1;
+    }
+
+    vm->main = -1;
+    vm->funcs = (VmFunc *)growArray(vm->funcs, &vm->maxFuncs, m->numFuncs, sizeof(VmFunc));
+    vm->numFuncs = m->numFuncs;
+    for(i = 0; i < m->numFuncs; ++i) {
+        c.funcOf[m->funcs[i].sym] = i;
+        if(m->funcs[i].sym == mainSym) {
+            vm->main = i;
+        }
+    }
+    vm->globalWords = 0;
+    for(i = 0; i < m->numSlots; ++i) {
+        if(m->slots[i].func < 0) {
+            c.slotAt[i] = vm->globalWords;
+            vm->globalWords += m->slots[i].size;
+        }
+    }
+
+    // main returns to the HALT at 0
+    vm->numCode = 0;
+    put(&c, VM_HALT);
+    for(i = 0; i < m->numFuncs; ++i) {
+        c.fi = i;
+        compileFunction(&c);
+    }
+
+    free(c.uses);
+    free(c.reg);
+    free(c.defs);
+    free(c.sets);
+    free(c.labels);
+    free(c.fixups);
+    free(c.slotAt);
+    free(c.funcOf);
+    return vm->main >= 0;
+}
+
+// room for need words of globals and stack; FALSE past MAXWORDS
+static int reserveStack(Vm *vm, long need) {
+    int words = (vm->memWords > 0) ? vm->memWords : MINWORDS;
+
+    if(need > MAXWORDS) {
+        return FALSE;
+    }
+    while(words < need) {
+        words *= 2;
+    }
+    if(words != vm->memWords) {
+        vm->mem = (int *)realloc(vm->mem, sizeof(int) * words);
+        if(vm->mem == NULL) {
+            fprintf(stderr, "memory allocation error. exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        vm->memWords = words;
+    }
+    return TRUE;
+}
+
+#ifdef THREADED
+#define OP(name) op_##name:
+#define NEXT(n) pc += (n); goto *labels[*pc]
+#else
+#define OP(name) case VM_##name:
+#define NEXT(n) pc += (n); continue
+#endif
+
+#define R(k) fp[pc[k]]
+// ints wrap around as the machine's do
+#define WRAP(a, op, b) ((int)((unsigned int)(a) op (unsigned int)(b)))
+#define CHECK(addr) if((unsigned int)(addr) >= (unsigned int)words) { status = VM_BOUNDS; goto done; }
+
+VmStatus vmRun(Vm *vm, VmInput input, VmOutput output, void *arg) {
+#ifdef THREADED
+#define VM_LABEL(name) &&op_##name,
+    static const void *labels[VM_NUMOPS] = { VM_OPS(VM_LABEL) };
+#endif
+    const int *code = vm->code;
+    const int *pc;
+    const VmFunc *f;
+    int *mem, *fp, *callee;
+    int words, v, d;
+    long at;
+    VmStatus status = VM_DONE;
+
+    if(vm->main < 0) {
+        return VM_DONE;
+    }
+    f = &vm->funcs[vm->main];
+    reserveStack(vm, (long)vm->globalWords + HEADER + f->extent);
+    mem = vm->mem;
+    words = vm->memWords;
+    memset(mem, 0, sizeof(int) * (vm->globalWords + HEADER + f->frameSize));
+    fp = mem + vm->globalWords + HEADER;
+    fp[-3] = 0;
+    fp[-2] = (int)(fp - mem);
+    fp[-1] = -1;
+    pc = code + f->entry;
+
+#ifdef THREADED
+    NEXT(0);
+#else
+    for(;;) {
+        switch(*pc) {
+#endif
+    OP(HALT)
+        goto done;
+    OP(MOV)
+        R(1) = R(2);
+        NEXT(3);
+    OP(MOVK)
+        R(1) = pc[2];
+        NEXT(3);
+    OP(ADD)
+        R(1) = WRAP(R(2), +, R(3));
+        NEXT(4);
+    OP(ADDK)
+        R(1) = WRAP(R(2), +, pc[3]);
+        NEXT(4);
+    OP(SUB)
+        R(1) = WRAP(R(2), -, R(3));
+        NEXT(4);
+    OP(SUBK)
+        R(1) = WRAP(R(2), -, pc[3]);
+        NEXT(4);
+    OP(MUL)
+        R(1) = WRAP(R(2), *, R(3));
+        NEXT(4);
+    OP(MULK)
+        R(1) = WRAP(R(2), *, pc[3]);
+        NEXT(4);
+    OP(DIV)
+        v = R(3);
+        goto divide;
+    OP(DIVK)
+        v = pc[3];
+    divide:
+        if(v == 0) {
+            status = VM_DIVZERO;
+            goto done;
+        }
+        R(1) = (v == -1) ? WRAP(0, -, R(2)) : R(2) / v;
+        NEXT(4);
+    OP(LT)
+        R(1) = R(2) < R(3);
+        NEXT(4);
+    OP(LTK)
+        R(1) = R(2) < pc[3];
+        NEXT(4);
+    OP(LE)
+        R(1) = R(2) <= R(3);
+        NEXT(4);
+    OP(LEK)
+        R(1) = R(2) <= pc[3];
+        NEXT(4);
+    OP(GT)
+        R(1) = R(2) > R(3);
+        NEXT(4);
+    OP(GTK)
+        R(1) = R(2) > pc[3];
+        NEXT(4);
+    OP(GE)
+        R(1) = R(2) >= R(3);
+        NEXT(4);
+    OP(GEK)
+        R(1) = R(2) >= pc[3];
+        NEXT(4);
+    OP(EQ)
+        R(1) = R(2) == R(3);
+        NEXT(4);
+    OP(EQK)
+        R(1) = R(2) == pc[3];
+        NEXT(4);
+    OP(NE)
+        R(1) = R(2) != R(3);
+        NEXT(4);
+    OP(NEK)
+        R(1) = R(2) != pc[3];
+        NEXT(4);
+    OP(INC)
+        R(1) = WRAP(R(1), +, pc[2]);
+        NEXT(3);
+    OP(ADDR)
+        R(1) = (int)(fp - mem) + pc[2];
+        NEXT(3);
+    OP(LOAD)
+        v = R(2);
+        CHECK(v);
+        R(1) = mem[v];
+        NEXT(3);
+    OP(STORE)
+        v = R(1);
+        CHECK(v);
+        mem[v] = R(2);
+        NEXT(3);
+    OP(STOREK)
+        v = R(1);
+        CHECK(v);
+        mem[v] = pc[2];
+        NEXT(3);
+    OP(LOADX)
+        v = WRAP(R(2), +, R(3));
+        CHECK(v);
+        R(1) = mem[v];
+        NEXT(4);
+    OP(STOREX)
+        v = WRAP(R(1), +, R(2));
+        CHECK(v);
+        mem[v] = R(3);
+        NEXT(4);
+    OP(STOREXK)
+        v = WRAP(R(1), +, R(2));
+        CHECK(v);
+        mem[v] = pc[3];
+        NEXT(4);
+    OP(JMP)
+        pc = code + pc[1];
+        NEXT(0);
+    OP(BRZ)
+        if(R(1) == 0) {
+            pc = code + pc[2];
+            NEXT(0);
+        }
+        NEXT(3);
+    OP(JLT)
+        if(R(1) < R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JLTK)
+        if(R(1) < pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JLE)
+        if(R(1) <= R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JLEK)
+        if(R(1) <= pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JGT)
+        if(R(1) > R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JGTK)
+        if(R(1) > pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JGE)
+        if(R(1) >= R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JGEK)
+        if(R(1) >= pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JEQ)
+        if(R(1) == R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JEQK)
+        if(R(1) == pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JNE)
+        if(R(1) != R(2)) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(JNEK)
+        if(R(1) != pc[2]) {
+            pc = code + pc[3];
+            NEXT(0);
+        }
+        NEXT(4);
+    OP(CALL)
+        f = &vm->funcs[pc[1]];
+        callee = fp + pc[3];
+        if((callee - mem) + f->extent > words) {
+            at = fp - mem;
+            if(!reserveStack(vm, (callee - mem) + f->extent)) {
+                status = VM_DEPTH;
+                goto done;
+            }
+            mem = vm->mem;
+            words = vm->memWords;
+            fp = mem + at;
+            callee = fp + pc[3];
+        }
+        callee[-3] = (int)(pc + 4 - code);
+        callee[-2] = (int)(fp - mem);
+        callee[-1] = pc[2];
+        memset(callee + f->numParams, 0, sizeof(int) * (f->frameSize - f->numParams));
+        fp = callee;
+        pc = code + f->entry;
+        NEXT(0);
+    OP(RET)
+        v = R(1);
+        goto ret;
+    OP(RETK)
+        v = pc[1];
+    ret:
+        d = fp[-1];
+        pc = code + fp[-3];
+        fp = mem + fp[-2];
+        if(d >= 0) {
+            fp[d] = v;
+        }
+        NEXT(0);
+    OP(INPUT)
+        R(1) = input(arg);
+        NEXT(2);
+    OP(OUTPUT)
+        output(arg, R(1));
+        NEXT(2);
+    OP(OUTPUTK)
+        output(arg, pc[1]);
+        NEXT(2);
+#ifndef THREADED
+        }
+    }
+#endif
+
+done:
+    return status;
+}
+
+void freeVm(Vm *vm) {
+    free(vm->code);
+    free(vm->funcs);
+    free(vm->mem);
+    memset(vm, 0, sizeof(Vm));
+}
\ No newline at end of file
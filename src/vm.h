@@ -0,0 +1,58 @@
+#ifndef _VM_H_
+#define _VM_H_
+
+/* a bytecode interpreter, for where machine code can't run. Lowered code
+   is compiled to a register bytecode of ints: an opcode and its
+   operands. Registers are offsets into the running function's frame,
+   with constants inline in the instruction.
+
+   Common runs of three-address code are single instructions:
+   - a compare and the branch on it;
+   - an index and the load or store through it;
+   - i = i + k;
+   - any result moved straight on, written where it goes.
+   Registers joined by copies share a frame register where their values
+   never need to be apart, so the copies SSA form leaves behind go away.
+   With GCC and clang the interpreter jumps from handler to handler
+   through a table of label addresses; elsewhere it is a switch.
+
+   Memory is one array of ints: the globals, then a stack of frames. An
+   address is an index into it, so an int register holds one and the
+   stack can move as it grows. A frame has its registers, a scratch
+   register and its local arrays. The caller's return address, frame and
+   result register sit right below it, and the arguments of its own
+   calls go right above it, where the callee's frame starts. Registers
+   and arrays start out zero. */
+typedef enum { VM_DONE, VM_DIVZERO, VM_BOUNDS, VM_DEPTH } VmStatus;
+
+typedef int (*VmInput)(void *arg);
+typedef void (*VmOutput)(void *arg, int value);
+
+typedef struct _VmFunc {
+    int entry;              // first instruction
+    int numParams;
+    int frameSize;          // registers, scratch and local arrays
+    int extent;             // with its calls' headers and arguments
+} VmFunc;
+
+// a zeroed one is ready to use, and keeps its memory for the next module
+typedef struct _Vm {
+    int *code;
+    int numCode;
+    int maxCode;
+    VmFunc *funcs;
+    int numFuncs;
+    int maxFuncs;
+    int *mem;               // globals, then the stack
+    int memWords;
+    int globalWords;
+    int main;               // function main is, -1 if none
+} Vm;
+
+// FALSE if the module has no main
+int vmCompile(Vm *vm, const IrModule *m, const InternTable *names);
+// main with fresh globals, input() and output() calling back with arg
+VmStatus vmRun(Vm *vm, VmInput input, VmOutput output, void *arg);
+void freeVm(Vm *vm);
+
+#endif
\ No newline at end of file
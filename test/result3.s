@@ -0,0 +1,166 @@
+	.bss
+	.p2align 3
+cm_x:
+	.zero	40
+	.p2align 3
+cm_y:
+	.zero	40
+	.p2align 3
+cm_z:
+	.zero	4
+	.text
+	.p2align 4
+	.type	cm_minloc, @function
+cm_minloc:
+	pushq	%rbp
+	movq	%rsp, %rbp
+.LB0:
+	movq	$0, %rax
+	movq	$0, %rcx
+	movq	$0, %r8
+	movq	%rsi, %r8
+	movslq	%esi, %r11
+	movl	(%rdi,%r11,4), %ecx
+	movl	%esi, %eax
+	addl	$1, %eax
+.LB1:
+	cmpl	%edx, %eax
+	jge	.LB5
+.LB2:
+	movslq	%eax, %r11
+	movl	(%rdi,%r11,4), %esi
+	cmpl	%ecx, %esi
+	jge	.LB4
+.LB3:
+	movslq	%eax, %r11
+	movl	(%rdi,%r11,4), %ecx
+	movq	%rax, %r8
+.LB4:
+	addl	$1, %eax
+	jmp	.LB1
+.LB5:
+	movl	%r8d, %eax
+	leave
+	ret
+	.p2align 4
+	.type	cm_sort, @function
+cm_sort:
+	pushq	%rbp
+	movq	%rsp, %rbp
+	pushq	%rbx
+	pushq	%r12
+	pushq	%r13
+	subq	$8, %rsp
+	movq	%rdi, %rbx
+	movq	%rdx, %r12
+.LB6:
+	movq	$0, %r13
+	movq	$0, %rax
+	movq	%rsi, %r13
+.LB7:
+	movl	%r12d, %eax
+	subl	$1, %eax
+	cmpl	%eax, %r13d
+	jge	.LB9
+.LB8:
+	movq	$0, %rcx
+	movq	%rbx, %rdi
+	movq	%r13, %rsi
+	movq	%r12, %rdx
+	call	cm_minloc
+	movslq	%eax, %r11
+	movl	(%rbx,%r11,4), %ecx
+	movslq	%eax, %r11
+	leaq	(%rbx,%r11,4), %rax
+	movslq	%r13d, %r11
+	movl	(%rbx,%r11,4), %edx
+	movl	%edx, (%rax)
+	movslq	%r13d, %r11
+	movl	%ecx, (%rbx,%r11,4)
+	addl	$1, %r13d
+	jmp	.LB7
+.LB9:
+	leaq	-24(%rbp), %rsp
+	popq	%r13
+	popq	%r12
+	popq	%rbx
+	popq	%rbp
+	ret
+	.p2align 4
+	.type	cm_main, @function
+cm_main:
+	pushq	%rbp
+	movq	%rsp, %rbp
+	pushq	%rbx
+	pushq	%r12
+.LB10:
+	movq	$0, %rbx
+	movq	$0, %rbx
+.LB11:
+	cmpl	$10, %ebx
+	jge	.LB13
+.LB12:
+	leaq	cm_x(%rip), %rax
+	movslq	%ebx, %r11
+	leaq	(%rax,%r11,4), %r12
+	call	cm_input
+	movl	%eax, (%r12)
+	addl	$1, %ebx
+	jmp	.LB11
+.LB13:
+	leaq	cm_x(%rip), %rax
+	movq	%rax, %rdi
+	movq	$0, %rsi
+	movq	$10, %rdx
+	call	cm_sort
+	movq	$0, %rbx
+.LB14:
+	cmpl	$10, %ebx
+	jge	.LB16
+.LB15:
+	leaq	cm_x(%rip), %rax
+	movslq	%ebx, %r11
+	movl	(%rax,%r11,4), %eax
+	movq	%rax, %rdi
+	call	cm_output
+	addl	$1, %ebx
+	jmp	.LB14
+.LB16:
+	leaq	-16(%rbp), %rsp
+	popq	%r12
+	popq	%rbx
+	popq	%rbp
+	ret
+	.text
+	.globl	main
+	.type	main, @function
+main:
+	subq	$8, %rsp
+	call	cm_main
+	xorl	%eax, %eax
+	addq	$8, %rsp
+	ret
+cm_input:
+	subq	$24, %rsp
+	movl	$0, 12(%rsp)
+	leaq	.Lin(%rip), %rdi
+	leaq	12(%rsp), %rsi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	movl	12(%rsp), %eax
+	addq	$24, %rsp
+	ret
+cm_output:
+	subq	$8, %rsp
+	movl	%edi, %esi
+	leaq	.Lout(%rip), %rdi
+	xorl	%eax, %eax
+	call	printf@PLT
+	addq	$8, %rsp
+	ret
+	.section	.rodata
+.Lin:
+	.string	"%d"
+.Lout:
+	.string	"%d\n"
+	.section	.note.GNU-stack,"",@progbits